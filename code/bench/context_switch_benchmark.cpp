@@ -0,0 +1,182 @@
+/* Source: context_switch_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Kernel context switch in CYCCNT cycles at 168MHz / 5 wait states with the ART accelerator
+ * on, stacks in SRAM. Each sample runs from a CYCCNT read in one context to the first read
+ * in the task switched to, so it includes the PendSV entry, save, kernel_switch(), restore
+ * and exception return, plus the kernel call or ISR that asked for the switch:
+ * 	interrupt -> task  TIM7 pended (STIR), its handler calls kernel_resume() on a suspended
+ * 	                   higher priority task, PendSV tail-chains
+ * 	kernel_yield       two tasks of one priority hand the CPU back and forth
+ * 	kernel_yield, FPU  the same with an FP instruction in both tasks, so PendSV saves
+ * 	                   s16-s31 and the lazily reserved s0-s15/FPSCR are stacked too
+ * A SysTick in between shows in the maximum, the minimum is the switch.
+ * Build with make CPU="-mcpu=cortex-m4 -mfpu=fpv4-sp-d16 -mfloat-abi=hard" for the FPU line,
+ * without it that line stays 0. Results land in context_switch_benchmark_result, read them
+ * with the debugger once done is 1. QEMU (-M netduinoplus2) runs the image but does not
+ * model CYCCNT, the numbers only mean something on hardware.
+ */
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <nvic.h>
+#include <vector_table.h>
+#include <kernel.h>
+#include <dwt.h>
+
+using namespace bare_metal;
+
+constexpr std::uint32_t CONTEXT_SWITCH_SAMPLES = (256);
+constexpr Irq_Number    CONTEXT_SWITCH_IRQ     = Irq_Number::IRQ_TIM7;    /* Never enabled in TIM7 itself, only pended */
+
+struct Context_Switch_Type
+{
+	std::uint32_t cycles_min;
+	std::uint32_t cycles_max;
+};
+
+struct Context_Switch_Benchmark_Result_Type
+{
+	Context_Switch_Type interrupt_wake;    /* ISR kernel_resume() -> task */
+	Context_Switch_Type yield;             /* kernel_yield() -> task, integer context */
+	Context_Switch_Type yield_fpu;         /* kernel_yield() -> task, FPU context on both sides */
+	std::uint32_t switches;
+	std::uint32_t done;
+};
+
+volatile Context_Switch_Benchmark_Result_Type context_switch_benchmark_result;
+
+static Kernel_Task wake_task;
+static Kernel_Task trigger_task;
+static Kernel_Task yield_task[2];
+static Kernel_Task report_task;
+static Kernel_Stack_Type<128> wake_stack;
+static Kernel_Stack_Type<128> trigger_stack;
+static Kernel_Stack_Type<128> yield_stack[2];
+static Kernel_Stack_Type<128> report_stack;
+#if defined(__ARM_FP)
+static Kernel_Task yield_fpu_task[2];
+static Kernel_Stack_Type<128> yield_fpu_stack[2];
+static volatile float context_switch_fpu_value = 1.0F;
+#endif
+
+static volatile std::uint32_t context_switch_start;
+static volatile std::uint32_t context_switch_start_count;
+static Kernel_Task* volatile context_switch_start_task;
+
+static void context_switch_add(volatile Context_Switch_Type& result, const std::uint32_t cycles)
+{
+	result.cycles_min = (cycles < result.cycles_min) ? cycles : result.cycles_min;
+	result.cycles_max = (cycles > result.cycles_max) ? cycles : result.cycles_max;
+}
+
+static void context_switch_handler()
+{
+	context_switch_start = dwt_cycle_count();
+	kernel_resume(wake_task);
+}
+
+/* Priority 0, suspended until the handler resumes it */
+static void wake_loop(void*)
+{
+	for (std::uint32_t i = 0U; i < CONTEXT_SWITCH_SAMPLES; ++i)
+	{
+		kernel_suspend();
+		context_switch_add(context_switch_benchmark_result.interrupt_wake, dwt_cycle_count() - context_switch_start);
+	}
+}
+
+/* Priority 1, runs whenever the wake task is suspended */
+static void trigger_loop(void*)
+{
+	nvic_enable_irq(CONTEXT_SWITCH_IRQ);
+	for (std::uint32_t i = 0U; i < CONTEXT_SWITCH_SAMPLES; ++i)
+	{
+		nvic_trigger_irq(CONTEXT_SWITCH_IRQ);
+		__asm volatile ("dsb" ::: "memory");
+		__asm volatile ("isb" ::: "memory");
+	}
+	nvic_disable_irq(CONTEXT_SWITCH_IRQ);
+}
+
+/* A sample when exactly one switch from the other task of the pair led here */
+static void yield_sample(volatile Context_Switch_Type& result)
+{
+	const std::uint32_t end = dwt_cycle_count();
+	if (context_switch_start_task != nullptr && context_switch_start_task != kernel_current() &&
+	    kernel_switch_count() == context_switch_start_count + 1U)
+	{
+		context_switch_add(result, end - context_switch_start);
+	}
+	context_switch_start_task = kernel_current();
+	context_switch_start_count = kernel_switch_count();
+	context_switch_start = dwt_cycle_count();
+	kernel_yield();
+}
+
+/* Priority 2, after the interrupt samples */
+static void yield_loop(void*)
+{
+	for (std::uint32_t i = 0U; i < CONTEXT_SWITCH_SAMPLES; ++i)
+	{
+		yield_sample(context_switch_benchmark_result.yield);
+	}
+	context_switch_start_task = nullptr;
+}
+
+#if defined(__ARM_FP)
+/* Priority 3, the FP multiply sets CONTROL.FPCA, from then on the task has FPU context */
+static void yield_fpu_loop(void*)
+{
+	for (std::uint32_t i = 0U; i < CONTEXT_SWITCH_SAMPLES; ++i)
+	{
+		context_switch_fpu_value = context_switch_fpu_value * 1.0001F;
+		yield_sample(context_switch_benchmark_result.yield_fpu);
+	}
+	context_switch_start_task = nullptr;
+}
+#endif
+
+/* Priority 4, runs once every test task has returned */
+static void report_loop(void*)
+{
+	context_switch_benchmark_result.switches = kernel_switch_count();
+	context_switch_benchmark_result.done = 1U;
+}
+
+int main()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	Sys_Clock sys_clock = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	if (sys_clock.configure_clock(Clock_168MHz::config) != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+	{
+		while(true);
+	}
+	sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_PERFORMANCE);
+	dwt_enable_cycle_counter();
+
+	context_switch_benchmark_result.interrupt_wake.cycles_min = 0xFFFFFFFF;
+	context_switch_benchmark_result.yield.cycles_min = 0xFFFFFFFF;
+	context_switch_benchmark_result.yield_fpu.cycles_min = 0xFFFFFFFF;
+
+	vector_table_set_handler(CONTEXT_SWITCH_IRQ, context_switch_handler);
+	nvic_set_priority(CONTEXT_SWITCH_IRQ, nvic_encode_priority(Priority_Group::PRIORITY_GROUP_4_0, 0U, 0U));
+
+	Nvic nvic(sys_clock, 1000U);
+
+	kernel_task_create(wake_task, wake_stack, wake_loop, nullptr, 0U);
+	kernel_task_create(trigger_task, trigger_stack, trigger_loop, nullptr, 1U);
+	kernel_task_create(yield_task[0], yield_stack[0], yield_loop, nullptr, 2U);
+	kernel_task_create(yield_task[1], yield_stack[1], yield_loop, nullptr, 2U);
+#if defined(__ARM_FP)
+	kernel_task_create(yield_fpu_task[0], yield_fpu_stack[0], yield_fpu_loop, nullptr, 3U);
+	kernel_task_create(yield_fpu_task[1], yield_fpu_stack[1], yield_fpu_loop, nullptr, 3U);
+#else
+	context_switch_benchmark_result.yield_fpu.cycles_min = 0U;
+#endif
+	kernel_task_create(report_task, report_stack, report_loop, nullptr, 4U);
+	kernel_start();
+}
@@ -0,0 +1,198 @@
+/* Source: flash_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * CoreMark style loop (list walk, matrix multiply, state machine, CRC) run from flash
+ * at 168MHz / 5 wait states, once with the ART accelerator off and once with it on.
+ * Results land in flash_benchmark_result, read them with the debugger.
+ * iterations per second = iterations * SYSCLK / cycles
+ */
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <dwt.h>
+
+using namespace bare_metal;
+
+constexpr std::uint32_t FLASH_BENCHMARK_ITERATIONS = (2000);
+constexpr std::uint32_t FLASH_BENCHMARK_LIST_SIZE  = (32);
+constexpr std::uint32_t FLASH_BENCHMARK_MATRIX     = (8);
+
+struct Flash_Benchmark_Result_Type
+{
+	std::uint32_t cycles_latency;                /* ART off */
+	std::uint32_t cycles_performance;            /* ART on */
+	std::uint32_t iterations_per_second_latency;
+	std::uint32_t iterations_per_second_performance;
+	std::uint16_t crc;                           /* Same on both runs or the workload is broken */
+};
+
+volatile Flash_Benchmark_Result_Type flash_benchmark_result;
+
+struct List_Node_Type
+{
+	List_Node_Type* next;
+	std::int32_t value;
+};
+
+static List_Node_Type list_nodes[FLASH_BENCHMARK_LIST_SIZE];
+static std::int16_t matrix_a[FLASH_BENCHMARK_MATRIX][FLASH_BENCHMARK_MATRIX];
+static std::int16_t matrix_b[FLASH_BENCHMARK_MATRIX][FLASH_BENCHMARK_MATRIX];
+static std::int32_t matrix_c[FLASH_BENCHMARK_MATRIX][FLASH_BENCHMARK_MATRIX];
+static const char state_input[] = "5012,-3.14e+2,0x1F,--,7.5,abc,+42,1e9,,0.001";
+
+static std::uint16_t crc16(std::uint16_t crc, const std::uint32_t data)
+{
+	for (std::uint32_t bit = 0U; bit < 32U; ++bit)
+	{
+		const bool carry = ((crc ^ (data >> bit)) & 0x1U) != 0U;
+		crc >>= 1U;
+		if (carry)
+		{
+			crc ^= 0xA001U;
+		}
+	}
+	return crc;
+}
+
+static void workload_init()
+{
+	for (std::uint32_t i = 0U; i < FLASH_BENCHMARK_LIST_SIZE; ++i)
+	{
+		list_nodes[i].next = (i + 1U < FLASH_BENCHMARK_LIST_SIZE) ? &list_nodes[i + 1U] : nullptr;
+		list_nodes[i].value = static_cast<std::int32_t>((i * 7919U) & 0xFFU);
+	}
+	for (std::uint32_t i = 0U; i < FLASH_BENCHMARK_MATRIX; ++i)
+	{
+		for (std::uint32_t j = 0U; j < FLASH_BENCHMARK_MATRIX; ++j)
+		{
+			matrix_a[i][j] = static_cast<std::int16_t>(i * 3U + j);
+			matrix_b[i][j] = static_cast<std::int16_t>(j * 5U - i);
+		}
+	}
+}
+
+static List_Node_Type* list_reverse(List_Node_Type* head)
+{
+	List_Node_Type* previous = nullptr;
+	while (head != nullptr)
+	{
+		List_Node_Type* next = head->next;
+		head->next = previous;
+		previous = head;
+		head = next;
+	}
+	return previous;
+}
+
+/* Counts numbers in state_input the way CoreMark's core_state does */
+static std::uint32_t state_machine()
+{
+	std::uint32_t valid = 0U;
+	std::uint32_t state = 0U;    /* 0 start, 1 integer, 2 float, 3 exponent, 4 invalid */
+
+	for (const char* c = state_input; ; ++c)
+	{
+		if (*c == ',' || *c == '\0')
+		{
+			valid += (state >= 1U && state <= 3U) ? 1U : 0U;
+			state = 0U;
+			if (*c == '\0')
+			{
+				break;
+			}
+			continue;
+		}
+		const bool digit = (*c >= '0' && *c <= '9');
+		switch(state)
+		{
+			case 0U:
+				state = (digit || *c == '+' || *c == '-') ? 1U : 4U;
+				break;
+			case 1U:
+				state = digit ? 1U : (*c == '.') ? 2U : (*c == 'e') ? 3U : 4U;
+				break;
+			case 2U:
+				state = digit ? 2U : (*c == 'e') ? 3U : 4U;
+				break;
+			case 3U:
+				state = (digit || *c == '+' || *c == '-') ? 3U : 4U;
+				break;
+			default:
+				break;
+		}
+	}
+	return valid;
+}
+
+static std::uint16_t workload_iteration(std::uint16_t crc)
+{
+	List_Node_Type* head = list_reverse(&list_nodes[0]);
+	std::int32_t sum = 0;
+	for (List_Node_Type* node = head; node != nullptr; node = node->next)
+	{
+		sum += node->value;
+	}
+	list_reverse(head);
+	crc = crc16(crc, static_cast<std::uint32_t>(sum));
+
+	for (std::uint32_t i = 0U; i < FLASH_BENCHMARK_MATRIX; ++i)
+	{
+		for (std::uint32_t j = 0U; j < FLASH_BENCHMARK_MATRIX; ++j)
+		{
+			std::int32_t accumulator = 0;
+			for (std::uint32_t k = 0U; k < FLASH_BENCHMARK_MATRIX; ++k)
+			{
+				accumulator += matrix_a[i][k] * matrix_b[k][j];
+			}
+			matrix_c[i][j] = accumulator;
+		}
+	}
+	crc = crc16(crc, static_cast<std::uint32_t>(matrix_c[3][5]));
+
+	return crc16(crc, state_machine());
+}
+
+static std::uint32_t workload_run(std::uint16_t& crc)
+{
+	crc = 0U;
+	const std::uint32_t start = dwt_cycle_count();
+	for (std::uint32_t i = 0U; i < FLASH_BENCHMARK_ITERATIONS; ++i)
+	{
+		crc = workload_iteration(crc);
+	}
+	return dwt_cycle_count() - start;
+}
+
+int main()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	Sys_Clock sys_clock = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	if (sys_clock.configure_clock(Clock_168MHz::config) != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+	{
+		while(true);
+	}
+
+	dwt_enable_cycle_counter();
+	workload_init();
+
+	std::uint16_t crc_latency = 0U;
+	std::uint16_t crc_performance = 0U;
+
+	sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_LATENCY);
+	const std::uint32_t cycles_latency = workload_run(crc_latency);
+
+	sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_PERFORMANCE);
+	const std::uint32_t cycles_performance = workload_run(crc_performance);
+
+	const std::uint64_t work = static_cast<std::uint64_t>(FLASH_BENCHMARK_ITERATIONS) * sys_clock.get_sysclk_frequency();
+	flash_benchmark_result.cycles_latency = cycles_latency;
+	flash_benchmark_result.cycles_performance = cycles_performance;
+	flash_benchmark_result.iterations_per_second_latency = static_cast<std::uint32_t>(work / cycles_latency);
+	flash_benchmark_result.iterations_per_second_performance = static_cast<std::uint32_t>(work / cycles_performance);
+	flash_benchmark_result.crc = (crc_latency == crc_performance) ? crc_performance : 0U;
+
+	while(true);
+}
@@ -0,0 +1,106 @@
+/* Source: isr_latency_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Cycles from pending an IRQ (STIR write) to the first load in its handler, at 168MHz /
+ * 5 wait states, vector table in SRAM. Same handler body linked to flash and to SRAM
+ * (BARE_METAL_RAMFUNC), swapped through the RAM vector table, with the ART accelerator
+ * off and on. Includes the fixed cost of the STIR write and the CYCCNT reads.
+ * Results land in isr_latency_benchmark_result, read them with the debugger.
+ * QEMU (-M netduinoplus2) runs the image but models neither flash wait states nor
+ * CYCCNT, the numbers only mean something on hardware.
+ */
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <nvic.h>
+#include <vector_table.h>
+#include <dwt.h>
+
+using namespace bare_metal;
+
+constexpr std::uint32_t ISR_LATENCY_SAMPLES = (256);
+constexpr Irq_Number    ISR_LATENCY_IRQ     = Irq_Number::IRQ_TIM7;    /* Never enabled in TIM7 itself, only pended */
+
+struct Isr_Latency_Type
+{
+	std::uint32_t cycles_min;
+	std::uint32_t cycles_max;
+};
+
+struct Isr_Latency_Benchmark_Result_Type
+{
+	Isr_Latency_Type flash_latency;        /* Handler in flash, ART off */
+	Isr_Latency_Type ram_latency;          /* Handler in SRAM, ART off */
+	Isr_Latency_Type flash_performance;    /* Handler in flash, ART on */
+	Isr_Latency_Type ram_performance;      /* Handler in SRAM, ART on */
+};
+
+volatile Isr_Latency_Benchmark_Result_Type isr_latency_benchmark_result;
+
+static volatile std::uint32_t isr_latency_end;
+
+static void isr_latency_flash_handler()
+{
+	isr_latency_end = dwt_cycle_count();
+}
+
+BARE_METAL_RAMFUNC static void isr_latency_ram_handler()
+{
+	isr_latency_end = dwt_cycle_count();
+}
+
+static Isr_Latency_Type isr_latency_run(const Isr_Handler handler)
+{
+	Isr_Latency_Type latency = { 0xFFFFFFFF, 0U };
+
+	nvic_disable_irq(ISR_LATENCY_IRQ);
+	vector_table_set_handler(ISR_LATENCY_IRQ, handler);
+	nvic_enable_irq(ISR_LATENCY_IRQ);
+
+	for (std::uint32_t i = 0U; i < ISR_LATENCY_SAMPLES; ++i)
+	{
+		const std::uint32_t start = dwt_cycle_count();
+		nvic_trigger_irq(ISR_LATENCY_IRQ);
+		__asm volatile ("dsb" ::: "memory");
+		__asm volatile ("isb" ::: "memory");
+		const std::uint32_t cycles = isr_latency_end - start;
+
+		latency.cycles_min = (cycles < latency.cycles_min) ? cycles : latency.cycles_min;
+		latency.cycles_max = (cycles > latency.cycles_max) ? cycles : latency.cycles_max;
+	}
+
+	nvic_disable_irq(ISR_LATENCY_IRQ);
+	return latency;
+}
+
+static void isr_latency_store(volatile Isr_Latency_Type& result, const Isr_Latency_Type& latency)
+{
+	result.cycles_min = latency.cycles_min;
+	result.cycles_max = latency.cycles_max;
+}
+
+int main()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	Sys_Clock sys_clock = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	if (sys_clock.configure_clock(Clock_168MHz::config) != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+	{
+		while(true);
+	}
+
+	dwt_enable_cycle_counter();
+	nvic_set_priority(ISR_LATENCY_IRQ, nvic_encode_priority(Priority_Group::PRIORITY_GROUP_4_0, 0U, 0U));
+
+	sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_LATENCY);
+	isr_latency_store(isr_latency_benchmark_result.flash_latency, isr_latency_run(isr_latency_flash_handler));
+	isr_latency_store(isr_latency_benchmark_result.ram_latency, isr_latency_run(isr_latency_ram_handler));
+
+	sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_PERFORMANCE);
+	isr_latency_store(isr_latency_benchmark_result.flash_performance, isr_latency_run(isr_latency_flash_handler));
+	isr_latency_store(isr_latency_benchmark_result.ram_performance, isr_latency_run(isr_latency_ram_handler));
+
+	while(true);
+}
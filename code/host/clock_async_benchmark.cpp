@@ -0,0 +1,80 @@
+/* Source: clock_async_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Boot-to-ready time for HSE -> PLL 168MHz with blocking configure_clock() versus
+ * configure_clock_async(), for a range of application init lengths (simulated work).
+ * Blocking: clock bring-up, then init. Async: init runs while HSE starts and the PLL
+ * locks, the RCC interrupt finishes the switch. Ready = clock switched and init done.
+ * Exits non-zero if a run does not end on the PLL or writes the RCC out of order.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+struct Boot_Result_Type
+{
+	std::uint64_t cycles;
+	bool ok;
+};
+
+static bool boot_finished()
+{
+	const Mmio_Simulator_Statistics statistics = mmio_simulator_statistics();
+	return (((static_cast<std::uint32_t>(RCC->rcc_cfgr) >> 2U) & 0x3U) == 0x2U) && (statistics.invalid_writes == 0U);
+}
+
+static Boot_Result_Type boot_blocking(const std::uint64_t init_cycles)
+{
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock();
+	const bool ok = (sys_clock.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	mmio_simulator_advance(init_cycles);
+
+	return { mmio_simulator_statistics().cycles, ok && boot_finished() };
+}
+
+static Boot_Result_Type boot_async(const std::uint64_t init_cycles)
+{
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock();
+	bool ok = (sys_clock.configure_clock_async(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	mmio_simulator_advance(init_cycles);
+
+	/* Init is done, idle until the RCC interrupt completed the switch */
+	while (ok && sys_clock.get_async_state() != Sys_Clock_Async_State::ASYNC_STATE_READY)
+	{
+		ok = (sys_clock.get_async_state() != Sys_Clock_Async_State::ASYNC_STATE_FAILED);
+		mmio_simulator_advance(MMIO_SIMULATOR_DEFAULT.cycles_per_access);
+	}
+
+	return { mmio_simulator_statistics().cycles, ok && boot_finished() && sys_clock.get_sysclk_frequency() == 168000000U };
+}
+
+int main()
+{
+	const std::uint64_t init_cycles[] = { 0U, 8000U, 16000U, 32000U, 48000U, 96000U };
+
+	bool ok = true;
+	std::printf("%-12s %14s %14s %10s %s\n", "init", "blocking", "async", "saved", "status");
+	for (const std::uint64_t init : init_cycles)
+	{
+		const Boot_Result_Type blocking = boot_blocking(init);
+		const Boot_Result_Type async = boot_async(init);
+		const double saved = 100.0 * (static_cast<double>(blocking.cycles) - static_cast<double>(async.cycles)) / static_cast<double>(blocking.cycles);
+		std::printf("%-12llu %14llu %14llu %9.1f%% %s\n",
+		            static_cast<unsigned long long>(init),
+		            static_cast<unsigned long long>(blocking.cycles),
+		            static_cast<unsigned long long>(async.cycles),
+		            saved,
+		            (blocking.ok && async.ok) ? "ok" : "FAIL");
+		ok = ok && blocking.ok && async.ok;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/* Source: clock_gate_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Bus accesses to clock a typical driver set (GPIO, DMA, UART, SPI, timer) one peripheral
+ * at a time against one Clock_Gate_Batch, then checks the reference counts of a
+ * peripheral shared by two drivers, the reference limit and the Sleep mode mask.
+ * Exits non-zero if a register ends up in the wrong state.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_gate.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+static const Peripheral_Id CLOCK_GATE_BENCHMARK_SET[] =
+{
+	Peripheral_Id::PERIPHERAL_GPIOA,
+	Peripheral_Id::PERIPHERAL_GPIOB,
+	Peripheral_Id::PERIPHERAL_DMA1,
+	Peripheral_Id::PERIPHERAL_DMA2,
+	Peripheral_Id::PERIPHERAL_USART2,
+	Peripheral_Id::PERIPHERAL_TIM2,
+	Peripheral_Id::PERIPHERAL_SPI1,
+	Peripheral_Id::PERIPHERAL_SYSCFG
+};
+
+static void benchmark_print(const char* name, const Bus_Access_Counter_Type& bus, const bool ok)
+{
+	std::printf("%-22s %8u %8u %s\n", name, bus.reads, bus.writes, ok ? "ok" : "FAIL");
+}
+
+static bool benchmark_enabled(const std::uint32_t ahb1, const std::uint32_t apb1, const std::uint32_t apb2)
+{
+	return (static_cast<std::uint32_t>(RCC->rcc_ahb1enr) == ahb1) &&
+	       (static_cast<std::uint32_t>(RCC->rcc_apb1enr) == apb1) &&
+	       (static_cast<std::uint32_t>(RCC->rcc_apb2enr) == apb2);
+}
+
+constexpr std::uint32_t SET_AHB1 = (0x1U << 0U) | (0x1U << 1U) | (0x1U << 21U) | (0x1U << 22U);
+constexpr std::uint32_t SET_APB1 = (0x1U << 17U) | (0x1U << 0U);
+constexpr std::uint32_t SET_APB2 = (0x1U << 12U) | (0x1U << 14U);
+
+int main()
+{
+	bool ok = true;
+	mmio_simulator_reset();
+
+	std::printf("%-22s %8s %8s %s\n", "sequence", "reads", "writes", "status");
+
+	bus_access_counter_reset();
+	for (const Peripheral_Id id : CLOCK_GATE_BENCHMARK_SET)
+	{
+		clock_gate_enable(id);
+	}
+	Bus_Access_Counter_Type bus = bus_access_counter_get();
+	bool step = benchmark_enabled(SET_AHB1, SET_APB1, SET_APB2);
+	benchmark_print("enable one by one", bus, step);
+	ok = ok && step;
+
+	bus_access_counter_reset();
+	for (const Peripheral_Id id : CLOCK_GATE_BENCHMARK_SET)
+	{
+		clock_gate_disable(id);
+	}
+	bus = bus_access_counter_get();
+	step = benchmark_enabled(0U, 0U, 0U);
+	benchmark_print("disable one by one", bus, step);
+	ok = ok && step;
+
+	Clock_Gate_Batch batch;
+	bus_access_counter_reset();
+	for (const Peripheral_Id id : CLOCK_GATE_BENCHMARK_SET)
+	{
+		batch.enable(id);
+	}
+	batch.commit();
+	bus = bus_access_counter_get();
+	step = benchmark_enabled(SET_AHB1, SET_APB1, SET_APB2);
+	benchmark_print("enable batch", bus, step);
+	ok = ok && step;
+
+	bus_access_counter_reset();
+	for (const Peripheral_Id id : CLOCK_GATE_BENCHMARK_SET)
+	{
+		batch.disable(id);
+	}
+	batch.commit();
+	bus = bus_access_counter_get();
+	step = benchmark_enabled(0U, 0U, 0U);
+	benchmark_print("disable batch", bus, step);
+	ok = ok && step;
+
+	/* Two drivers on GPIOA, the first one out must not gate it */
+	bus_access_counter_reset();
+	clock_gate_enable(Peripheral_Id::PERIPHERAL_GPIOA);
+	clock_gate_enable(Peripheral_Id::PERIPHERAL_GPIOA);
+	clock_gate_disable(Peripheral_Id::PERIPHERAL_GPIOA);
+	bus = bus_access_counter_get();
+	step = (clock_gate_get_count(Peripheral_Id::PERIPHERAL_GPIOA) == 1U) && benchmark_enabled(0x1U, 0U, 0U);
+	bus_access_counter_reset();
+	clock_gate_disable(Peripheral_Id::PERIPHERAL_GPIOA);
+	clock_gate_disable(Peripheral_Id::PERIPHERAL_GPIOA);
+	bus.reads += bus_access_counter_get().reads;
+	bus.writes += bus_access_counter_get().writes;
+	step = step && !clock_gate_is_enabled(Peripheral_Id::PERIPHERAL_GPIOA) && benchmark_enabled(0U, 0U, 0U);
+	benchmark_print("shared reference", bus, step);
+	ok = ok && step;
+
+	/* Past CLOCK_GATE_COUNT_MAX an enable is refused, every reference taken still balances */
+	bus_access_counter_reset();
+	for (std::uint32_t index = 0U; index < CLOCK_GATE_COUNT_MAX; ++index)
+	{
+		step = clock_gate_enable(Peripheral_Id::PERIPHERAL_TIM2);
+	}
+	step = step && !clock_gate_enable(Peripheral_Id::PERIPHERAL_TIM2);
+	step = step && !batch.enable(Peripheral_Id::PERIPHERAL_TIM2).enable(Peripheral_Id::PERIPHERAL_GPIOA).commit();
+	batch = Clock_Gate_Batch();
+	step = step && (clock_gate_get_count(Peripheral_Id::PERIPHERAL_TIM2) == CLOCK_GATE_COUNT_MAX) && benchmark_enabled(0U, 0x1U, 0U);
+	for (std::uint32_t index = 0U; index < CLOCK_GATE_COUNT_MAX; ++index)
+	{
+		step = step && clock_gate_disable(Peripheral_Id::PERIPHERAL_TIM2);
+	}
+	step = step && !clock_gate_disable(Peripheral_Id::PERIPHERAL_TIM2) && benchmark_enabled(0U, 0U, 0U);
+	bus = bus_access_counter_get();
+	benchmark_print("reference limit", bus, step);
+	ok = ok && step;
+
+	/* Sleep mode keeps only what runs, SRAM and flash interface bits untouched */
+	mmio_simulator_reset();
+	RCC->rcc_ahb1lpenr = 0xFFFFFFFFU;
+	RCC->rcc_apb1lpenr = 0xFFFFFFFFU;
+	clock_gate_enable(Peripheral_Id::PERIPHERAL_USART2);
+	bus_access_counter_reset();
+	clock_gate_sleep_unused();
+	bus = bus_access_counter_get();
+	step = (static_cast<std::uint32_t>(RCC->rcc_ahb1lpenr) == (0x7U << 15U)) &&
+	       (static_cast<std::uint32_t>(RCC->rcc_apb1lpenr) == (0x1U << 17U));
+	clock_gate_disable(Peripheral_Id::PERIPHERAL_USART2);
+	benchmark_print("sleep unused", bus, step);
+	ok = ok && step;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/* Source: clock_i2s_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Solves every standard audio sample rate with MCLK and with 16/32 bit frames against the
+ * 168 MHz HSE clock tree (VCO input 2 MHz) and checks each against an exhaustive search over
+ * PLLI2SN, PLLI2SR and every 2 * I2SDIV + ODD. Then applies one solution to the host
+ * simulator with configure_plli2s().
+ * Exits non-zero if the solver misses the best setting, a rate is off by more than 500 ppm or
+ * the simulated RCC ends in the wrong state. MCLK above 96 kHz leaves 2 * I2SDIV + ODD at 4 with
+ * I2SCLK near its 192 MHz limit, those rows are only reported.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <clock_solver_i2s.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+static const std::uint32_t CLOCK_I2S_BENCHMARK_RATE[] =
+{
+	8000U, 11025U, 16000U, 22050U, 32000U, 44100U, 48000U, 88200U, 96000U, 176400U, 192000U
+};
+
+constexpr std::int64_t CLOCK_I2S_BENCHMARK_PPB_MAX = (500000);
+
+/* Lowest |error| over the full search space, divider range included */
+static std::int64_t benchmark_exhaustive(const std::uint32_t pllcfgr, const std::uint32_t frequency_sample, const std::uint32_t bit_clocks)
+{
+	std::int64_t best = INT64_MAX;
+	for (std::uint32_t plli2sn = 50U; plli2sn <= 432U; ++plli2sn)
+	{
+		for (std::uint32_t plli2sr = 2U; plli2sr <= 7U; ++plli2sr)
+		{
+			const std::uint32_t plli2scfgr = (plli2sn << 6U) | (plli2sr << 28U);
+			const std::uint32_t frequency_vco = sys_clock_decode_plli2s(pllcfgr, (plli2sn << 6U) | (2U << 28U)) * 2U;
+			if (frequency_vco < FREQUENCY_VCO_OUTPUT_MIN || frequency_vco > FREQUENCY_VCO_OUTPUT_MAX ||
+			    sys_clock_decode_plli2s(pllcfgr, plli2scfgr) > FREQUENCY_I2SCLK_MAX)
+			{
+				continue;
+			}
+			const std::uint64_t numerator = static_cast<std::uint64_t>(FREQUENCY_HSE) * plli2sn;
+			for (std::uint32_t div = CLOCK_SOLVER_I2S_DIV_MIN; div <= CLOCK_SOLVER_I2S_DIV_MAX; ++div)
+			{
+				const std::uint64_t denominator = static_cast<std::uint64_t>(pllcfgr & 0x3FU) * plli2sr * bit_clocks * div * frequency_sample;
+				const std::int64_t error = clock_solver_i2s_abs(clock_solver_i2s_error(numerator, denominator));
+				best = (error < best) ? error : best;
+			}
+		}
+	}
+	return best;
+}
+
+static bool benchmark_rate(const std::uint32_t frequency_sample, const bool mclk, const std::uint32_t channel_bits)
+{
+	const std::uint32_t pllcfgr = Clock_168MHz::config.register_pllcfgr;
+	const Clock_I2s_Config_Type config = clock_solve_i2s(pllcfgr, frequency_sample, mclk, channel_bits);
+	const std::uint32_t bit_clocks = mclk ? 256U : (2U * channel_bits);
+
+	const bool bounded = !mclk || (frequency_sample <= 96000U);
+	const bool optimal = (clock_solver_i2s_abs(config.error_ppb) == benchmark_exhaustive(pllcfgr, frequency_sample, bit_clocks));
+	const bool ok = (config.status == Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK) && optimal &&
+	                (!bounded || clock_solver_i2s_abs(config.error_ppb) <= CLOCK_I2S_BENCHMARK_PPB_MAX);
+
+	std::printf("%6u %-5s %3u %3u %3u %u %12u.%03u %10.3f %s\n",
+	            frequency_sample, mclk ? "mclk" : (channel_bits == 16U ? "16bit" : "32bit"),
+	            config.plli2sn, config.plli2sr, config.i2sdiv, config.odd,
+	            config.frequency_sample / 1000U, config.frequency_sample % 1000U,
+	            static_cast<double>(config.error_ppb) / 1000.0,
+	            !ok ? "FAIL" : (bounded ? "ok" : "ok (reported only)"));
+	return ok;
+}
+
+static bool benchmark_apply()
+{
+	using Clock_48kHz = Clock_Solver_I2s<Clock_168MHz, 48000, true>;
+
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock();
+	bool ok = (hse.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+
+	bus_access_counter_reset();
+	ok = ok && (hse.configure_plli2s(Clock_48kHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	const Bus_Access_Counter_Type bus_first = bus_access_counter_get();
+	bus_access_counter_reset();
+	ok = ok && (hse.configure_plli2s(Clock_48kHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	const Bus_Access_Counter_Type bus_again = bus_access_counter_get();
+
+	ok = ok && (hse.get_plli2s_frequency() == Clock_48kHz::config.frequency_i2sclk) &&
+	     (bus_again.writes == 0U) && (mmio_simulator_statistics().invalid_writes == 0U);
+	std::printf("\n%-22s %8s %8s %s\n", "sequence", "reads", "writes", "status");
+	std::printf("%-22s %8u %8u %s\n", "plli2s 48kHz mclk", bus_first.reads, bus_first.writes, ok ? "ok" : "FAIL");
+	std::printf("%-22s %8u %8u %s\n", "plli2s again", bus_again.reads, bus_again.writes, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+
+	std::printf("%6s %-5s %3s %3s %3s %s %16s %10s %s\n", "Fs", "frame", "N", "R", "div", "o", "achieved Hz", "error ppm", "status");
+	for (const std::uint32_t frequency_sample : CLOCK_I2S_BENCHMARK_RATE)
+	{
+		ok = benchmark_rate(frequency_sample, true, 16U) && ok;
+		ok = benchmark_rate(frequency_sample, false, 16U) && ok;
+		ok = benchmark_rate(frequency_sample, false, 32U) && ok;
+	}
+	ok = benchmark_apply() && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/* Source: clock_observer_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Cost of notifying N Clock_Observer subscribers on a clock change.
+ * Each subscriber recomputes a baud rate divider, like a UART driver would.
+ * The 0 subscriber run is the baseline (register writes through the simulator),
+ * everything above it is notification cost.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <sys_clock.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+constexpr std::uint32_t OBSERVER_BENCHMARK_MAX     = (256);
+constexpr std::uint32_t OBSERVER_BENCHMARK_CHANGES = (20000);
+
+class Baud_Observer : public Clock_Observer
+{
+	public:
+		void clock_post_change(const Frequency_Clock_Type& frequency_new) override
+		{
+			this->divider = frequency_new.frequency_p2clk / 115200U;
+		}
+
+		std::uint32_t divider = 0U;
+};
+
+static Baud_Observer observers[OBSERVER_BENCHMARK_MAX];
+
+static double benchmark_changes(const std::uint32_t subscribers)
+{
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock();
+	for (std::uint32_t i = 0U; i < subscribers; ++i)
+	{
+		sys_clock.attach_observer(observers[i]);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint32_t i = 0U; i < OBSERVER_BENCHMARK_CHANGES; ++i)
+	{
+		sys_clock.configure_prescaler_ahb((i & 0x1U) ? Prescaler_AHB::PRESCALER_AHB_DIV2 : Prescaler_AHB::PRESCALER_AHB_DIV1);
+	}
+	const auto stop = std::chrono::steady_clock::now();
+
+	for (std::uint32_t i = 0U; i < subscribers; ++i)
+	{
+		sys_clock.detach_observer(observers[i]);
+	}
+	return std::chrono::duration<double, std::nano>(stop - start).count() / OBSERVER_BENCHMARK_CHANGES;
+}
+
+int main()
+{
+	const std::uint32_t subscribers[] = { 0U, 1U, 4U, 16U, 64U, 256U };
+
+	const double baseline = benchmark_changes(0U);
+	std::printf("%-12s %16s %20s\n", "subscribers", "ns/change", "ns/subscriber");
+	for (const std::uint32_t count : subscribers)
+	{
+		const double ns = (count == 0U) ? baseline : benchmark_changes(count);
+		const double per_subscriber = (count == 0U) ? 0.0 : (ns - baseline) / count;
+		std::printf("%-12u %16.1f %20.2f\n", count, ns, per_subscriber);
+	}
+
+	/* Every subscriber saw the last change: HCLK = 16MHz / 2 */
+	for (std::uint32_t i = 0U; i < OBSERVER_BENCHMARK_MAX; ++i)
+	{
+		if (observers[i].divider != (8000000U / 115200U))
+		{
+			std::printf("subscriber %u missed a change\n", i);
+			return 1;
+		}
+	}
+	return 0;
+}
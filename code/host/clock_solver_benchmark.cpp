@@ -0,0 +1,85 @@
+/* Source: clock_solver_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Lists the SYSCLK / PLL48CLK Pareto front of clock_solve_pll48() for common crystals,
+ * then applies Clock_Solver_Pll48 for HSE and HSI to the host simulator and checks that
+ * SYSCLK and PLL48CLK read back from RCC are what the solver promised.
+ * The solver self-tests are compile-time checks here rather than in clock_solver.h, each
+ * search costs seconds of constexpr evaluation and would run again in every translation unit.
+ * Exits non-zero if a configuration ends in the wrong state.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+/* 8 MHz HSE and 16 MHz HSI both reach 168 MHz with VCO = 336 MHz, PLLQ = 7 */
+constexpr Clock_Pll48_Solution_Type CLOCK_SOLVER_BENCHMARK_HSE = clock_solve_pll48(FREQUENCY_HSE, FREQUENCY_SYSCLK_MAX);
+constexpr Clock_Pll48_Solution_Type CLOCK_SOLVER_BENCHMARK_HSI = clock_solve_pll48(FREQUENCY_HSI, FREQUENCY_SYSCLK_MAX);
+static_assert(CLOCK_SOLVER_BENCHMARK_HSE.exact, "HSE reaches 48 MHz");
+static_assert(CLOCK_SOLVER_BENCHMARK_HSE.pareto[0].frequency_sysclk == 168000000U, "HSE keeps 168 MHz");
+static_assert(CLOCK_SOLVER_BENCHMARK_HSE.pareto[0].pllq == 7U, "HSE PLLQ");
+static_assert(CLOCK_SOLVER_BENCHMARK_HSI.pareto[0].frequency_sysclk == 168000000U, "HSI keeps 168 MHz");
+
+/* 12.288 MHz audio crystal: exact 48 MHz costs SYSCLK, the front offers faster settings with an error */
+constexpr Clock_Pll48_Solution_Type CLOCK_SOLVER_BENCHMARK_AUDIO = clock_solve_pll48(12288000U, FREQUENCY_SYSCLK_MAX);
+static_assert(CLOCK_SOLVER_BENCHMARK_AUDIO.exact, "12.288 MHz reaches 48 MHz");
+static_assert(CLOCK_SOLVER_BENCHMARK_AUDIO.pareto[0].frequency_sysclk == 96000000U, "12.288 MHz exact SYSCLK");
+static_assert(CLOCK_SOLVER_BENCHMARK_AUDIO.pareto[1].frequency_sysclk > 96000000U, "12.288 MHz alternatives");
+
+static const std::uint32_t CLOCK_SOLVER_BENCHMARK_INPUT[] =
+{
+	8000000U, 12000000U, 12288000U, 14745600U, 16000000U, 24576000U, 25000000U, 26000000U
+};
+
+static void benchmark_print_front(const std::uint32_t frequency_input)
+{
+	const Clock_Pll48_Solution_Type solution = clock_solve_pll48(frequency_input, FREQUENCY_SYSCLK_MAX);
+
+	std::printf("%9u Hz %s\n", frequency_input, solution.exact ? "exact" : "no exact 48 MHz");
+	for (std::uint32_t i = 0U; i < solution.count; ++i)
+	{
+		const Clock_Pll48_Candidate_Type& candidate = solution.pareto[i];
+		std::printf("    M %2u N %3u P %u Q %2u  SYSCLK %9u  PLL48CLK %8u  error %6d ppm\n",
+		            candidate.pllm, candidate.plln, candidate.pllp, candidate.pllq,
+		            candidate.frequency_sysclk, candidate.frequency_pll48,
+		            static_cast<int>((static_cast<std::int64_t>(candidate.frequency_pll48) - FREQUENCY_PLL48_MAX) * 1000000 / FREQUENCY_PLL48_MAX));
+	}
+}
+
+template <typename Solver>
+static bool benchmark_apply(const char* name)
+{
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock();
+	bus_access_counter_reset();
+	bool ok = (sys_clock.configure_clock(Solver::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	const Bus_Access_Counter_Type bus = bus_access_counter_get();
+
+	ok = ok && (sys_clock.get_sysclk_frequency() == Solver::solution.pareto[0].frequency_sysclk) &&
+	     (sys_clock.get_pll48clk_frequency() == FREQUENCY_PLL48_MAX) &&
+	     (sys_clock.get_p1clk_frequency() <= FREQUENCY_P1CLK_MAX) &&
+	     (sys_clock.get_p2clk_frequency() <= FREQUENCY_P2CLK_MAX);
+	std::printf("%-22s %8u %8u %9u %8u %s\n", name, bus.reads, bus.writes,
+	            sys_clock.get_sysclk_frequency(), sys_clock.get_pll48clk_frequency(), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main()
+{
+	for (const std::uint32_t frequency_input : CLOCK_SOLVER_BENCHMARK_INPUT)
+	{
+		benchmark_print_front(frequency_input);
+	}
+
+	std::printf("\n%-22s %8s %8s %9s %8s %s\n", "configuration", "reads", "writes", "sysclk", "pll48", "status");
+	bool ok = benchmark_apply<Clock_Solver_Pll48<Sys_Oscillator_Type::OSC_TYPE_HSE>>("hse pll48");
+	ok = benchmark_apply<Clock_Solver_Pll48<Sys_Oscillator_Type::OSC_TYPE_HSI>>("hsi pll48") && ok;
+	ok = benchmark_apply<Clock_Solver_Pll48<Sys_Oscillator_Type::OSC_TYPE_HSE, 100000000>>("hse pll48 <= 100MHz") && ok;
+
+	return ok ? 0 : 1;
+}
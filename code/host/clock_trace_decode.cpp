@@ -0,0 +1,195 @@
+/* Source: clock_trace_decode.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Decodes the clock trace history (clock_trace.h) into one row per step with how often
+ * it ran and min/avg/max cycles across every kept boot.
+ * clock_trace_decode <file>   a dump of clock_trace_data taken from the target:
+ *                               (gdb) dump binary value clock_trace.bin clock_trace_data
+ * clock_trace_decode          simulates CLOCK_TRACE_BOOTS + 2 resets into a 168 MHz HSE
+ *                               bring-up on the host simulator with a different crystal
+ *                               startup and PLL lock time per boot, then decodes that history.
+ *                               Exits non-zero if a step is missing, timed out or does not
+ *                               match the simulated latency.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <clock_trace.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+static const char* const CLOCK_TRACE_DECODE_NAME[] =
+{
+	"hsi ready", "hse ready", "hse stop", "pll lock", "pll stop",
+	"plli2s lock", "plli2s stop", "sws switch", "flash latency", "configure_clock"
+};
+
+static_assert(sizeof(CLOCK_TRACE_DECODE_NAME) / sizeof(CLOCK_TRACE_DECODE_NAME[0]) ==
+              static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_EVENT_COUNT), "One name per Clock_Trace_Event");
+
+struct Clock_Trace_Summary_Type
+{
+	std::uint32_t count;
+	std::uint32_t timeouts;
+	std::uint32_t min;
+	std::uint32_t max;
+	std::uint64_t sum;
+};
+
+constexpr std::uint32_t CLOCK_TRACE_EVENT_COUNT = static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_EVENT_COUNT);
+
+/* Records that hold a boot, oldest first does not matter for min/avg/max */
+static std::uint32_t decode_records(const Clock_Trace_History_Type& history)
+{
+	return (history.boots < CLOCK_TRACE_BOOTS) ? history.boots : CLOCK_TRACE_BOOTS;
+}
+
+static bool decode_summarize(const Clock_Trace_History_Type& history, Clock_Trace_Summary_Type (&summary)[CLOCK_TRACE_EVENT_COUNT], std::uint32_t& dropped)
+{
+	if (history.magic != CLOCK_TRACE_MAGIC)
+	{
+		return false;
+	}
+	for (Clock_Trace_Summary_Type& step : summary)
+	{
+		step = Clock_Trace_Summary_Type{ 0U, 0U, UINT32_MAX, 0U, 0U };
+	}
+	dropped = 0U;
+
+	for (std::uint32_t i = 0U; i < decode_records(history); ++i)
+	{
+		const Clock_Trace_Record_Type& record = history.record[i];
+		if (record.count > CLOCK_TRACE_ENTRIES)
+		{
+			return false;
+		}
+		dropped += record.dropped;
+		for (std::uint32_t j = 0U; j < record.count; ++j)
+		{
+			const Clock_Trace_Entry_Type& entry = record.entry[j];
+			const std::uint32_t event = static_cast<std::uint32_t>(entry.event);
+			if (event >= CLOCK_TRACE_EVENT_COUNT)
+			{
+				return false;
+			}
+			Clock_Trace_Summary_Type& step = summary[event];
+			++step.count;
+			step.timeouts += entry.timeout;
+			step.min = (entry.cycles < step.min) ? entry.cycles : step.min;
+			step.max = (entry.cycles > step.max) ? entry.cycles : step.max;
+			step.sum += entry.cycles;
+		}
+	}
+	return true;
+}
+
+static bool decode_print(const Clock_Trace_History_Type& history)
+{
+	Clock_Trace_Summary_Type summary[CLOCK_TRACE_EVENT_COUNT];
+	std::uint32_t dropped = 0U;
+	if (!decode_summarize(history, summary, dropped))
+	{
+		std::printf("not a clock trace (magic 0x%08X, expected 0x%08X)\n", history.magic, CLOCK_TRACE_MAGIC);
+		return false;
+	}
+
+	std::printf("boots %u, records %u, dropped steps %u\n", history.boots, decode_records(history), dropped);
+	std::printf("%-16s %6s %8s %10s %10s %10s\n", "step", "count", "timeout", "min", "avg", "max");
+	for (std::uint32_t event = 0U; event < CLOCK_TRACE_EVENT_COUNT; ++event)
+	{
+		const Clock_Trace_Summary_Type& step = summary[event];
+		if (step.count == 0U)
+		{
+			continue;
+		}
+		std::printf("%-16s %6u %8u %10u %10u %10u\n", CLOCK_TRACE_DECODE_NAME[event], step.count, step.timeouts,
+		            step.min, static_cast<std::uint32_t>(step.sum / step.count), step.max);
+	}
+	return true;
+}
+
+static bool decode_file(const char* path)
+{
+	Clock_Trace_History_Type history = {};
+	std::FILE* file = std::fopen(path, "rb");
+	if (file == nullptr)
+	{
+		std::printf("cannot open %s\n", path);
+		return false;
+	}
+	const std::size_t size = std::fread(&history, 1U, sizeof(history), file);
+	std::fclose(file);
+	if (size != sizeof(history))
+	{
+		std::printf("%s: %zu bytes, a clock trace is %zu\n", path, size, sizeof(history));
+		return false;
+	}
+	return decode_print(history);
+}
+
+/* Boot n: crystal startup and PLL lock grow with n, like a board warming up */
+static Mmio_Simulator_Config decode_boot_config(const std::uint32_t boot)
+{
+	Mmio_Simulator_Config config = MMIO_SIMULATOR_DEFAULT;
+	config.hse_startup_cycles += boot * 1500U;
+	config.pll_lock_cycles += boot * 100U;
+	return config;
+}
+
+static bool decode_simulate()
+{
+	constexpr std::uint32_t boots = CLOCK_TRACE_BOOTS + 2U;
+	clock_trace_clear();
+
+	for (std::uint32_t boot = 0U; boot < boots; ++boot)
+	{
+		mmio_simulator_reset(decode_boot_config(boot));
+		clock_trace_boot();
+		Sys_Clock sys_clock = Sys_Clock::adopt();
+		if (sys_clock.configure_clock(Clock_168MHz::config) != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			std::printf("boot %u: configure_clock failed\n", boot);
+			return false;
+		}
+	}
+
+	const Clock_Trace_History_Type& history = clock_trace_history();
+	Clock_Trace_Summary_Type summary[CLOCK_TRACE_EVENT_COUNT];
+	std::uint32_t dropped = 0U;
+	bool ok = decode_print(history) && decode_summarize(history, summary, dropped);
+
+	/* Boots 2 - 9 are kept, every one waits for the crystal, the lock, one switch and one latency write */
+	const Clock_Trace_Summary_Type& hse = summary[static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_HSE_READY)];
+	const Clock_Trace_Summary_Type& pll = summary[static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_PLL_LOCK)];
+	const std::uint32_t slack = 4U * MMIO_SIMULATOR_DEFAULT.cycles_per_access;
+	ok = ok && (history.boots == boots) && (dropped == 0U) &&
+	     (hse.count == CLOCK_TRACE_BOOTS) && (hse.timeouts == 0U) &&
+	     (hse.min >= decode_boot_config(2U).hse_startup_cycles) && (hse.min <= decode_boot_config(2U).hse_startup_cycles + slack) &&
+	     (hse.max >= decode_boot_config(boots - 1U).hse_startup_cycles) && (hse.max <= decode_boot_config(boots - 1U).hse_startup_cycles + slack) &&
+	     (pll.count == CLOCK_TRACE_BOOTS) &&
+	     (pll.min >= decode_boot_config(2U).pll_lock_cycles) && (pll.max <= decode_boot_config(boots - 1U).pll_lock_cycles + slack) &&
+	     (summary[static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_SWS_SWITCH)].count == CLOCK_TRACE_BOOTS) &&
+	     (summary[static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_FLASH_LATENCY)].count == CLOCK_TRACE_BOOTS) &&
+	     (summary[static_cast<std::uint32_t>(Clock_Trace_Event::CLOCK_TRACE_CONFIGURE_CLOCK)].count == CLOCK_TRACE_BOOTS);
+
+	/* Power-on noise that happens to hold the magic, the count it claims cannot fit */
+	clock_trace_data.record[3].count = CLOCK_TRACE_ENTRIES + 1U;
+	clock_trace_boot();
+	ok = ok && (history.boots == 1U) && (history.record[3].count == 0U);
+	std::printf("%s\n", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 2)
+	{
+		return decode_file(argv[1]) ? 0 : 1;
+	}
+	return decode_simulate() ? 0 : 1;
+}
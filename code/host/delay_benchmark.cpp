@@ -0,0 +1,81 @@
+/* Source: delay_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Runs delay_cycles(), delay_ns()/delay_us() and the compile-time delay_ns<>() on the host
+ * simulator, where CYCCNT moves by cycles_per_access per read. Every delay is timed from the
+ * caller and has to last at least what was asked and at most one poll longer. The attached
+ * delays are checked at HSI 16MHz and again after configure_clock() to 168MHz, where the
+ * observer has to have picked up the new HCLK. Exits non-zero on any miss.
+ * A clock change in the middle of a delay needs an ISR between two CYCCNT reads, the
+ * simulator only runs RCC_IRQHandler from mmio_simulator_advance(), that case is not covered.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <delay.h>
+#include <dwt.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+static const std::uint32_t DELAY_BENCHMARK_CYCLES[] =
+{
+	0U, 1U, 7U, 16U, 33U, 100U, 1000U, 100000U
+};
+
+/* Cycles a call took from the caller's side, the two stamps taken out */
+template <typename Function>
+static std::uint32_t benchmark_time(Function function)
+{
+	const std::uint32_t empty_start = dwt_cycle_count();
+	const std::uint32_t empty = dwt_cycle_count() - empty_start;
+	const std::uint32_t start = dwt_cycle_count();
+	function();
+	return dwt_cycle_count() - start - empty;
+}
+
+static bool benchmark_row(const char* name, const std::uint32_t asked, const std::uint32_t elapsed)
+{
+	/* A zero length delay still costs the fixed overhead */
+	const std::uint32_t floor = (asked > delay_overhead()) ? asked : 0U;
+	const bool ok = (elapsed >= floor) && (elapsed <= ((asked > delay_overhead()) ? asked : delay_overhead()) + MMIO_SIMULATOR_DEFAULT.cycles_per_access);
+	std::printf("%-28s %10u %10u %s\n", name, asked, elapsed, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+	char name[32];
+
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock();
+	delay_attach(sys_clock);
+	std::printf("overhead %u cycles\n", delay_overhead());
+	std::printf("%-28s %10s %10s %s\n", "delay", "cycles", "elapsed", "status");
+
+	for (const std::uint32_t cycles : DELAY_BENCHMARK_CYCLES)
+	{
+		std::snprintf(name, sizeof(name), "delay_cycles(%u)", cycles);
+		ok = benchmark_row(name, cycles, benchmark_time([cycles]() { delay_cycles(cycles); })) && ok;
+	}
+
+	ok = benchmark_row("delay_ns(500) hsi", delay_cycles_ns(500U, FREQUENCY_HSI), benchmark_time([]() { delay_ns(500U); })) && ok;
+	ok = benchmark_row("delay_us(10) hsi", delay_cycles_us(10U, FREQUENCY_HSI), benchmark_time([]() { delay_us(10U); })) && ok;
+
+	ok = (sys_clock.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) && ok;
+	std::printf("overhead %u cycles after configure_clock()\n", delay_overhead());
+
+	ok = benchmark_row("delay_ns(500) 168MHz", delay_cycles_ns(500U, 168000000U), benchmark_time([]() { delay_ns(500U); })) && ok;
+	ok = benchmark_row("delay_us(10) 168MHz", delay_cycles_us(10U, 168000000U), benchmark_time([]() { delay_us(10U); })) && ok;
+	ok = benchmark_row("delay_us(10, frequency)", delay_cycles_us(10U, 168000000U),
+	                   benchmark_time([&sys_clock]() { delay_us(10U, sys_clock.get_frequency()); })) && ok;
+	ok = benchmark_row("delay_ns<Clock_168MHz, 400>", delay_cycles_ns(400U, 168000000U), benchmark_time([]() { delay_ns<Clock_168MHz, 400>(); })) && ok;
+
+	delay_detach(sys_clock);
+	return ok ? 0 : 1;
+}
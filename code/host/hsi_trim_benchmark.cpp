@@ -0,0 +1,132 @@
+/* Source: hsi_trim_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Gives the simulated HSI a factory error (hsi_offset) and calibrates it against LSE and
+ * against HSE with hsi_trim_calibrate(). For every run it checks:
+ * 1. the measured frequency is within 100 ppm of the simulated one
+ * 2. the chosen HSITRIM leaves HSI within half a trim step (40kHz) of 16MHz
+ * 3. Sys_Clock reports the measured frequency
+ * Then stores the last calibration, trims back to 16, restores it into a fresh Sys_Clock and
+ * checks that a run with SYSCLK on HSE, and an HSE measurement during an asynchronous
+ * bring-up, are refused. Exits non-zero on any failure.
+ */
+
+#include <cstdio>
+#include <sys_clock.h>
+#include <hsi_trim.h>
+#include <clock_solver.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+static const std::int32_t HSI_TRIM_BENCHMARK_OFFSET[] =
+{
+	-160000, -95000, -41000, 0, 23000, 77000, 160000
+};
+
+constexpr std::int64_t HSI_TRIM_BENCHMARK_PPM_MAX = (100);
+
+/* Frequency the simulator runs HSI at for the HSITRIM currently in RCC_CR */
+static std::int64_t benchmark_actual_hsi(const std::int32_t hsi_offset)
+{
+	const std::int64_t trim = static_cast<std::int64_t>((RCC->rcc_cr >> 3U) & 0x1FU);
+	return static_cast<std::int64_t>(FREQUENCY_HSI) + hsi_offset + (trim - static_cast<std::int64_t>(HSI_TRIM_DEFAULT)) * FREQUENCY_HSI_TRIM_STEP;
+}
+
+static bool benchmark_calibrate(const std::int32_t hsi_offset, const Hsi_Trim_Reference reference, Hsi_Trim_Result_Type& result)
+{
+	Mmio_Simulator_Config config = MMIO_SIMULATOR_DEFAULT;
+	config.hsi_offset = hsi_offset;
+	mmio_simulator_reset(config);
+	if (reference == Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE)
+	{
+		/* LSEON, the backup domain keeps LSE running across resets */
+		RCC->rcc_bdcr |= 0x1U;
+	}
+
+	Sys_Clock hsi = Sys_Clock();
+	bus_access_counter_reset();
+	const std::uint64_t start = mmio_simulator_statistics().cycles;
+	result = hsi_trim_calibrate(hsi, reference);
+	const std::uint64_t cycles = mmio_simulator_statistics().cycles - start;
+	const Bus_Access_Counter_Type bus = bus_access_counter_get();
+
+	const std::int64_t actual = benchmark_actual_hsi(hsi_offset);
+	const std::int64_t measured_ppm = ((static_cast<std::int64_t>(result.frequency_hsi) - actual) * 1000000) / actual;
+	const std::int64_t residual = actual - static_cast<std::int64_t>(FREQUENCY_HSI);
+	const bool ok = (result.status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) &&
+	                (measured_ppm <= HSI_TRIM_BENCHMARK_PPM_MAX && measured_ppm >= -HSI_TRIM_BENCHMARK_PPM_MAX) &&
+	                (residual <= static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP / 2U) && residual >= -static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP / 2U)) &&
+	                (hsi.get_hsi_frequency() == result.frequency_hsi);
+
+	std::printf("%8d %-4s %5u %10u %8d %8d %8.2f %8u %8u %s\n", hsi_offset,
+	            (reference == Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE) ? "lse" : "hse",
+	            result.trim, result.frequency_hsi, result.error_ppm, static_cast<int>(measured_ppm),
+	            static_cast<double>(cycles) * 1000.0 / static_cast<double>(actual), bus.reads, bus.writes, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static bool benchmark_store_restore(const Hsi_Trim_Result_Type& result)
+{
+	hsi_trim_store(result);
+
+	/* Reset clears RCC_CR, RTC backup registers survive */
+	Mmio_Simulator_Config config = MMIO_SIMULATOR_DEFAULT;
+	config.hsi_offset = HSI_TRIM_BENCHMARK_OFFSET[6];
+	mmio_simulator_reset(config);
+	Sys_Clock hsi = Sys_Clock();
+	const bool restored = hsi_trim_restore(hsi);
+
+	const bool ok = restored && (((RCC->rcc_cr >> 3U) & 0x1FU) == result.trim) && (hsi.get_hsi_frequency() == result.frequency_hsi) &&
+	                (hsi.get_sysclk_frequency() == result.frequency_hsi) && ((PWR->pwr_cr & (0x1U << 8U)) == 0U);
+	std::printf("\n%-22s trim %2u hsi %u %s\n", "store / restore", static_cast<unsigned>((RCC->rcc_cr >> 3U) & 0x1FU), hsi.get_hsi_frequency(), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static bool benchmark_refuse_hse()
+{
+	mmio_simulator_reset();
+	RCC->rcc_bdcr |= 0x1U;
+	Sys_Clock hse = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	bool ok = (hse.sysclk_select_hse() == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	const Hsi_Trim_Result_Type result = hsi_trim_calibrate(hse, Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE);
+	ok = ok && (result.status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK) && (hse.get_hsi_frequency() == FREQUENCY_HSI);
+	std::printf("%-22s %s\n", "sysclk on hse refused", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* HSE measurement during configure_clock_async(): NOK, HSEON stays with the bring-up, which still finishes */
+static bool benchmark_refuse_async()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSI);
+	bool ok = (hse.configure_clock_async(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	Frequency_Sys_Clock_Status status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+	const std::uint32_t frequency = hsi_trim_measure(Hsi_Trim_Reference::HSI_TRIM_REFERENCE_HSE, status);
+	ok = ok && (frequency == 0U) && (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK) && (RCC->rcc_cr & (0x1U << 16U));
+	mmio_simulator_advance(MMIO_SIMULATOR_DEFAULT.hse_startup_cycles + 4U * MMIO_SIMULATOR_DEFAULT.pll_lock_cycles);
+	ok = ok && (hse.get_async_state() == Sys_Clock_Async_State::ASYNC_STATE_READY) && !sys_clock_async_pending();
+	std::printf("%-22s %s\n", "hse in async refused", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+	Hsi_Trim_Result_Type result = {};
+
+	std::printf("%8s %-4s %5s %10s %8s %8s %8s %8s %8s %s\n", "offset", "ref", "trim", "hsi", "err ppm", "meas ppm", "ms", "reads", "writes", "status");
+	for (const std::int32_t hsi_offset : HSI_TRIM_BENCHMARK_OFFSET)
+	{
+		ok = benchmark_calibrate(hsi_offset, Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE, result) && ok;
+		ok = benchmark_calibrate(hsi_offset, Hsi_Trim_Reference::HSI_TRIM_REFERENCE_HSE, result) && ok;
+	}
+	ok = benchmark_store_restore(result) && ok;
+	ok = benchmark_refuse_hse() && ok;
+	ok = benchmark_refuse_async() && ok;
+
+	return ok ? 0 : 1;
+}
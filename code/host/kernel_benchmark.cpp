@@ -0,0 +1,216 @@
+/* Source: kernel_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * The kernel on the host simulator, 168MHz with a 1kHz SysTick, one workload for every path:
+ * 	control  priority 0  kernel_sleep_until() every tick, 20000 cycles of FPU work
+ * 	sensor   priority 1  suspended, resumed by an interrupt every 37000 cycles
+ * 	comms    priority 2  two CPU bound tasks sharing the CPU round robin, then sleeping
+ * 	logger   priority 3  a little work every tick, only runs when the comms tasks sleep
+ * 	ping     priority 4  two tasks handing the CPU to each other with kernel_yield()
+ * The control loop must never miss its tick, the comms tasks must get the same CPU time,
+ * the logger and the idle task must still run. Latencies are in simulated cycles from the
+ * event (tick, interrupt handler, kernel_yield() call) to the first instruction of the task,
+ * so they are the Cortex-M4 cycle model of the PendSV path (kernel_simulator.h) plus any
+ * higher priority work in between. bench/context_switch_benchmark.cpp measures the real path.
+ * Exits non-zero if a check fails.
+ */
+
+#include <cstdio>
+#include "kernel_simulator.h"
+
+using namespace bare_metal;
+
+constexpr std::uint32_t KERNEL_BENCHMARK_TICKS          = (2000);
+constexpr std::uint32_t KERNEL_BENCHMARK_CONTROL_WORK   = (20000);
+constexpr std::uint32_t KERNEL_BENCHMARK_SENSOR_PERIOD  = (37000);
+constexpr std::uint32_t KERNEL_BENCHMARK_SENSOR_WORK    = (3000);
+constexpr std::uint32_t KERNEL_BENCHMARK_COMMS_CHUNK    = (1000);
+constexpr std::uint32_t KERNEL_BENCHMARK_COMMS_CHUNKS   = (4000);     /* About 24 ticks of CPU per burst */
+constexpr std::uint32_t KERNEL_BENCHMARK_COMMS_SLEEP    = (20);
+constexpr std::uint32_t KERNEL_BENCHMARK_LOGGER_WORK    = (500);
+constexpr std::uint32_t KERNEL_BENCHMARK_PING_ROUNDS    = (50);
+
+struct Kernel_Latency_Type
+{
+	std::uint64_t cycles_min = 0xFFFFFFFFFFFFFFFFU;
+	std::uint64_t cycles_max = 0U;
+	std::uint64_t cycles_total = 0U;
+	std::uint32_t count = 0U;
+
+	void add(const std::uint64_t cycles)
+	{
+		cycles_min = (cycles < cycles_min) ? cycles : cycles_min;
+		cycles_max = (cycles > cycles_max) ? cycles : cycles_max;
+		cycles_total += cycles;
+		count += 1U;
+	}
+};
+
+static Kernel_Task control_task;
+static Kernel_Task sensor_task;
+static Kernel_Task comms_task[2];
+static Kernel_Task logger_task;
+static Kernel_Task ping_task[2];
+static Kernel_Stack_Type<256> control_stack;
+static Kernel_Stack_Type<128> sensor_stack;
+static Kernel_Stack_Type<128> comms_stack[2];
+static Kernel_Stack_Type<128> logger_stack;
+static Kernel_Stack_Type<64> ping_stack[2];
+
+static Kernel_Latency_Type control_latency;
+static Kernel_Latency_Type sensor_latency;
+static Kernel_Latency_Type ping_latency;
+static std::uint32_t control_runs;
+static std::uint32_t control_missed;
+static std::uint64_t sensor_interrupt;
+static std::uint32_t sensor_interrupts;
+static std::uint32_t sensor_runs;
+static std::uint32_t comms_chunks[2];
+static std::uint32_t comms_handovers;
+static std::uint32_t comms_last;
+static std::uint32_t logger_runs;
+static std::uint64_t ping_stamp;
+
+static void control_loop(void*)
+{
+	kernel_simulator_fpu_used();
+	std::uint32_t wake = kernel_tick_count();
+	for (std::uint32_t i = 0U; i < KERNEL_BENCHMARK_TICKS; ++i)
+	{
+		wake += 1U;
+		kernel_sleep_until(wake);
+		control_latency.add(kernel_simulator_cycle_count() - static_cast<std::uint64_t>(wake) * KERNEL_SIMULATOR_DEFAULT.cycles_per_tick);
+		kernel_simulator_run(KERNEL_BENCHMARK_CONTROL_WORK);
+		control_runs += 1U;
+		/* Work has to be done before the next tick */
+		control_missed += (kernel_tick_count() != wake) ? 1U : 0U;
+	}
+	kernel_simulator_stop();
+}
+
+static void sensor_interrupt_handler()
+{
+	sensor_interrupt = kernel_simulator_cycle_count();
+	sensor_interrupts += 1U;
+	kernel_resume(sensor_task);
+}
+
+static void sensor_loop(void*)
+{
+	for (;;)
+	{
+		kernel_suspend();
+		sensor_latency.add(kernel_simulator_cycle_count() - sensor_interrupt);
+		kernel_simulator_run(KERNEL_BENCHMARK_SENSOR_WORK);
+		sensor_runs += 1U;
+	}
+}
+
+static void comms_loop(void* argument)
+{
+	const std::uint32_t index = *static_cast<const std::uint32_t*>(argument);
+	for (;;)
+	{
+		for (std::uint32_t i = 0U; i < KERNEL_BENCHMARK_COMMS_CHUNKS; ++i)
+		{
+			comms_handovers += (comms_last != index) ? 1U : 0U;
+			comms_last = index;
+			kernel_simulator_run(KERNEL_BENCHMARK_COMMS_CHUNK);
+			comms_chunks[index] += 1U;
+		}
+		kernel_sleep(KERNEL_BENCHMARK_COMMS_SLEEP);
+	}
+}
+
+static void logger_loop(void*)
+{
+	for (;;)
+	{
+		kernel_simulator_run(KERNEL_BENCHMARK_LOGGER_WORK);
+		logger_runs += 1U;
+		kernel_sleep(1U);
+	}
+}
+
+static void ping_loop(void*)
+{
+	for (;;)
+	{
+		for (std::uint32_t i = 0U; i < KERNEL_BENCHMARK_PING_ROUNDS; ++i)
+		{
+			if (ping_stamp != 0U)
+			{
+				ping_latency.add(kernel_simulator_cycle_count() - ping_stamp);
+			}
+			ping_stamp = kernel_simulator_cycle_count();
+			kernel_yield();
+		}
+		ping_stamp = 0U;
+		kernel_sleep(3U);
+	}
+}
+
+static bool print_latency(const char* name, const Kernel_Latency_Type& latency, const std::uint64_t bound)
+{
+	const bool ok = (latency.count != 0U) && (latency.cycles_min <= bound);
+	const std::uint64_t average = (latency.count != 0U) ? latency.cycles_total / latency.count : 0U;
+	std::printf("%-28s %10u %10llu %10llu %10llu %s\n", name, latency.count, static_cast<unsigned long long>(latency.cycles_min),
+	            static_cast<unsigned long long>(average), static_cast<unsigned long long>(latency.cycles_max), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static bool print_check(const char* name, const std::uint64_t value, const bool ok)
+{
+	std::printf("%-28s %10llu %s\n", name, static_cast<unsigned long long>(value), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main()
+{
+	static const std::uint32_t comms_index[2] = { 0U, 1U };
+	const Kernel_Simulator_Config& config = KERNEL_SIMULATOR_DEFAULT;
+	bool ok = true;
+
+	kernel_simulator_config(config);
+	kernel_simulator_interrupt(5000U, KERNEL_BENCHMARK_SENSOR_PERIOD, sensor_interrupt_handler);
+	ok = kernel_task_create(control_task, control_stack, control_loop, nullptr, 0U) && ok;
+	ok = kernel_task_create(sensor_task, sensor_stack, sensor_loop, nullptr, 1U) && ok;
+	ok = kernel_task_create(comms_task[0], comms_stack[0], comms_loop, const_cast<std::uint32_t*>(&comms_index[0]), 2U) && ok;
+	ok = kernel_task_create(comms_task[1], comms_stack[1], comms_loop, const_cast<std::uint32_t*>(&comms_index[1]), 2U) && ok;
+	ok = kernel_task_create(logger_task, logger_stack, logger_loop, nullptr, 3U) && ok;
+	ok = kernel_task_create(ping_task[0], ping_stack[0], ping_loop, nullptr, 4U) && ok;
+	ok = kernel_task_create(ping_task[1], ping_stack[1], ping_loop, nullptr, 4U) && ok;
+	/* Alive already, out of range priority */
+	ok = !kernel_task_create(ping_task[1], ping_stack[1], ping_loop, nullptr, 4U) && ok;
+	ok = !kernel_task_create(logger_task, logger_stack, logger_loop, nullptr, KERNEL_PRIORITIES) && ok;
+
+	kernel_start();
+
+	const Kernel_Simulator_Statistics statistics = kernel_simulator_statistics();
+	const std::uint32_t comms_total = comms_chunks[0] + comms_chunks[1];
+	const std::uint32_t comms_difference = (comms_chunks[0] > comms_chunks[1]) ? comms_chunks[0] - comms_chunks[1] : comms_chunks[1] - comms_chunks[0];
+	/* Entry + switch, with the FPU context of the task switched to (control) or from */
+	const std::uint64_t switch_fpu = config.switch_cycles + config.fpu_restore_cycles;
+
+	std::printf("%-28s %10s %10s %10s %10s\n", "latency (cycles)", "count", "min", "avg", "max");
+	ok = print_latency("tick -> control (FPU)", control_latency, config.interrupt_cycles + switch_fpu) && ok;
+	ok = print_latency("interrupt -> sensor", sensor_latency, config.switch_cycles + config.fpu_save_cycles) && ok;
+	ok = print_latency("kernel_yield -> ping", ping_latency, config.switch_cycles) && ok;
+	std::printf("\n");
+	ok = print_check("control runs", control_runs, control_runs == KERNEL_BENCHMARK_TICKS) && ok;
+	ok = print_check("control missed ticks", control_missed, control_missed == 0U) && ok;
+	ok = print_check("control max latency", control_latency.cycles_max, control_latency.cycles_max < config.cycles_per_tick / 100U) && ok;
+	ok = print_check("sensor runs", sensor_runs, sensor_runs != 0U && sensor_runs <= sensor_interrupts) && ok;
+	ok = print_check("comms chunks", comms_total, comms_total != 0U) && ok;
+	ok = print_check("comms imbalance (chunks)", comms_difference, comms_difference * 10U <= comms_total) && ok;
+	ok = print_check("comms handovers", comms_handovers, comms_handovers > 2U) && ok;
+	ok = print_check("logger runs", logger_runs, logger_runs != 0U) && ok;
+	ok = print_check("idle cycles", statistics.idle_cycles, statistics.idle_cycles != 0U) && ok;
+	ok = print_check("switches", statistics.switches, statistics.switches == kernel_switch_count() - 1U) && ok;
+	std::printf("%-28s %10llu\n", "switch cycles", static_cast<unsigned long long>(statistics.switch_cycles));
+	std::printf("%-28s %10.3f %%\n", "switch overhead", 100.0 * static_cast<double>(statistics.switch_cycles) / static_cast<double>(statistics.cycles));
+	std::printf("%-28s %10llu\n", "simulated cycles", static_cast<unsigned long long>(statistics.cycles));
+
+	return ok ? 0 : 1;
+}
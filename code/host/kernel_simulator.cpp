@@ -0,0 +1,254 @@
+/* Source: kernel_simulator.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Stands in for the PendSV port of kernel.cpp. A slot pairs a Kernel_Task with its ucontext
+ * and host stack, kernel_simulator_task_init() (re)starts the slot on the task's entry.
+ * Switch: what PendSV_Handler does, kernel_switch() picks the next task and swapcontext()
+ * resumes it where it last switched out. The cycle cost is added to simulated time.
+ * Events: the next SysTick and the next periodic interrupt are cycle stamps, run() and idle()
+ * move time to each stamp that falls inside the span, run the handler with in_interrupt set
+ * (a switch it requests is only pended) and take the pended switch before moving on.
+ * Critical_Section is empty on the host, nothing here runs concurrently: a task only loses
+ * the CPU inside run(), idle() or a kernel call that pends a switch.
+ */
+
+#include "kernel_simulator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ucontext.h>
+
+extern "C"
+{
+	extern bare_metal::Kernel_Task* kernel_current_task;
+	std::uint32_t* kernel_switch();
+}
+
+namespace bare_metal
+{
+	constexpr std::uint32_t KERNEL_SIMULATOR_TASKS = (16);
+	constexpr std::uint32_t KERNEL_SIMULATOR_STACK = (256U * 1024U);     /* Host code needs far more than the target */
+
+	struct Kernel_Simulator_Slot
+	{
+		Kernel_Task* task;
+		Kernel_Entry entry;
+		void* argument;
+		bool fpu;
+		ucontext_t context;
+		alignas(16) std::uint8_t stack[KERNEL_SIMULATOR_STACK];
+	};
+
+	struct Kernel_Simulator_State
+	{
+		Kernel_Simulator_Config config = KERNEL_SIMULATOR_DEFAULT;
+		Kernel_Simulator_Statistics statistics;
+		std::uint64_t cycles;
+		std::uint64_t next_tick;
+		std::uint64_t next_interrupt = 0xFFFFFFFFFFFFFFFFU;     /* No periodic interrupt */
+		std::uint64_t interrupt_period;
+		void (*interrupt_handler)();
+		bool in_interrupt;
+		bool switch_pending;
+		bool stopped;
+		ucontext_t main_context;
+	};
+
+	static Kernel_Simulator_Slot simulator_slots[KERNEL_SIMULATOR_TASKS];
+	static Kernel_Simulator_State simulator;
+
+	static Kernel_Simulator_Slot& simulator_slot(const Kernel_Task* task)
+	{
+		for (Kernel_Simulator_Slot& slot : simulator_slots)
+		{
+			if (slot.task == task)
+			{
+				return slot;
+			}
+		}
+		std::fprintf(stderr, "kernel_simulator: task without a slot\n");
+		std::abort();
+	}
+
+	static void simulator_task_entry(int index)
+	{
+		Kernel_Simulator_Slot& slot = simulator_slots[index];
+		slot.entry(slot.argument);
+		kernel_exit();
+	}
+
+	static void simulator_stop()
+	{
+		simulator.stopped = true;
+		swapcontext(&simulator_slot(kernel_current_task).context, &simulator.main_context);
+		/* Never resumed */
+		std::abort();
+	}
+
+	/* PendSV_Handler */
+	static void simulator_switch()
+	{
+		simulator.switch_pending = false;
+		Kernel_Task* outgoing = kernel_current_task;
+		kernel_switch();
+		Kernel_Task* incoming = kernel_current_task;
+		if (incoming == outgoing)
+		{
+			return;
+		}
+		Kernel_Simulator_Slot& from = simulator_slot(outgoing);
+		Kernel_Simulator_Slot& to = simulator_slot(incoming);
+		const std::uint32_t cost = simulator.config.switch_cycles + (from.fpu ? simulator.config.fpu_save_cycles : 0U) +
+		                           (to.fpu ? simulator.config.fpu_restore_cycles : 0U);
+		simulator.cycles += cost;
+		simulator.statistics.switch_cycles += cost;
+		simulator.statistics.switches += 1U;
+		swapcontext(&from.context, &to.context);
+	}
+
+	/* An event that came due during a switch fires at once */
+	static std::uint64_t simulator_next_event()
+	{
+		const std::uint64_t next = (simulator.next_interrupt < simulator.next_tick) ? simulator.next_interrupt : simulator.next_tick;
+		return (next < simulator.cycles) ? simulator.cycles : next;
+	}
+
+	/* Time is at an event stamp: runs what is due, then PendSV if it was requested */
+	static void simulator_event()
+	{
+		simulator.in_interrupt = true;
+		if (simulator.cycles >= simulator.next_tick)
+		{
+			simulator.cycles += simulator.config.interrupt_cycles;
+			simulator.next_tick += simulator.config.cycles_per_tick;
+			simulator.statistics.interrupts += 1U;
+			kernel_tick(1U);
+		}
+		if (simulator.cycles >= simulator.next_interrupt)
+		{
+			simulator.cycles += simulator.config.interrupt_cycles;
+			simulator.next_interrupt += simulator.interrupt_period;
+			simulator.statistics.interrupts += 1U;
+			simulator.interrupt_handler();
+		}
+		simulator.in_interrupt = false;
+
+		if (simulator.cycles >= simulator.config.stop_cycles)
+		{
+			simulator_stop();
+		}
+		if (simulator.switch_pending)
+		{
+			simulator_switch();
+		}
+	}
+
+	void kernel_simulator_task_init(Kernel_Task& task, Kernel_Entry entry, void* argument)
+	{
+		Kernel_Simulator_Slot* free_slot = nullptr;
+		for (Kernel_Simulator_Slot& slot : simulator_slots)
+		{
+			/* A task created again after kernel_exit() gets its old slot */
+			if (slot.task == &task || (free_slot == nullptr && slot.task == nullptr))
+			{
+				free_slot = &slot;
+			}
+		}
+		if (free_slot == nullptr)
+		{
+			std::fprintf(stderr, "kernel_simulator: more than %u tasks\n", KERNEL_SIMULATOR_TASKS);
+			std::abort();
+		}
+		free_slot->task = &task;
+		free_slot->entry = entry;
+		free_slot->argument = argument;
+		free_slot->fpu = false;
+		getcontext(&free_slot->context);
+		free_slot->context.uc_stack.ss_sp = free_slot->stack;
+		free_slot->context.uc_stack.ss_size = sizeof(free_slot->stack);
+		free_slot->context.uc_link = nullptr;
+		makecontext(&free_slot->context, reinterpret_cast<void (*)()>(&simulator_task_entry), 1, static_cast<int>(free_slot - simulator_slots));
+	}
+
+	void kernel_simulator_pend_switch()
+	{
+		simulator.switch_pending = true;
+		/* Thread mode with PRIMASK clear takes PendSV at once */
+		if (!simulator.in_interrupt && kernel_current_task != nullptr)
+		{
+			simulator_switch();
+			/* Back in this task, tasks that only yield move time through their switches alone */
+			kernel_simulator_run(0U);
+		}
+	}
+
+	void kernel_simulator_start()
+	{
+		simulator.statistics = Kernel_Simulator_Statistics();
+		simulator.cycles = 0U;
+		simulator.next_tick = simulator.config.cycles_per_tick;
+		simulator.in_interrupt = false;
+		simulator.switch_pending = false;
+		simulator.stopped = false;
+
+		/* First PendSV, nothing to save */
+		kernel_switch();
+		swapcontext(&simulator.main_context, &simulator_slot(kernel_current_task).context);
+	}
+
+	/* Nothing is ready, sleeps until the next event */
+	void kernel_simulator_idle()
+	{
+		const std::uint64_t next = simulator_next_event();
+		simulator.statistics.idle_cycles += next - simulator.cycles;
+		simulator.cycles = next;
+		simulator_event();
+	}
+
+	void kernel_simulator_config(const Kernel_Simulator_Config& config)
+	{
+		simulator.config = config;
+	}
+
+	void kernel_simulator_interrupt(const std::uint64_t first, const std::uint64_t period, void (*handler)())
+	{
+		simulator.next_interrupt = first;
+		simulator.interrupt_period = period;
+		simulator.interrupt_handler = handler;
+	}
+
+	void kernel_simulator_run(const std::uint32_t cycles)
+	{
+		std::uint64_t remaining = cycles;
+		while (simulator.cycles + remaining >= simulator_next_event())
+		{
+			const std::uint64_t next = simulator_next_event();
+			remaining -= next - simulator.cycles;
+			simulator.cycles = next;
+			simulator_event();
+		}
+		simulator.cycles += remaining;
+	}
+
+	void kernel_simulator_fpu_used()
+	{
+		simulator_slot(kernel_current_task).fpu = true;
+	}
+
+	void kernel_simulator_stop()
+	{
+		simulator_stop();
+	}
+
+	std::uint64_t kernel_simulator_cycle_count()
+	{
+		return simulator.cycles;
+	}
+
+	Kernel_Simulator_Statistics kernel_simulator_statistics()
+	{
+		Kernel_Simulator_Statistics statistics = simulator.statistics;
+		statistics.cycles = simulator.cycles;
+		return statistics;
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef KERNEL_SIMULATOR_H
+#define KERNEL_SIMULATOR_H
+
+#include <cstdint>
+#include <kernel.h>
+
+/** Host side port of the kernel (build with -DBARE_METAL_HOST)
+  * Every task runs on its own ucontext and host stack, one at a time. Time is simulated:
+  * it only moves when a task calls kernel_simulator_run() (application work) or when the
+  * idle task waits for the next event, so a run is deterministic and CPU speed independent.
+  * Events fire at their cycle, in the middle of a task's work:
+  * 	SysTick every cycles_per_tick, runs kernel_tick(1) like time_base_tick() does
+  * 	one periodic interrupt, kernel_simulator_interrupt(), runs its handler
+  * A switch requested from an event is taken once the handler returns, one requested from a
+  * task at once, where the core would take PendSV. Each switch costs the cycles of the
+  * PendSV path on a Cortex-M4 (kernel.cpp), plus the FPU context of the tasks that called
+  * kernel_simulator_fpu_used(), the host cannot see FPU instructions.
+  * kernel_start() returns once a task calls kernel_simulator_stop() or stop_cycles pass.
+  * The static task stacks are painted but not used, kernel_stack_unused() reports them full.
+  */
+
+namespace bare_metal
+{
+	struct Kernel_Simulator_Config
+	{
+		std::uint32_t cycles_per_tick;        /* SysTick period */
+		std::uint32_t interrupt_cycles;       /* Exception entry before the first handler instruction */
+		std::uint32_t switch_cycles;          /* PendSV entry to task running, integer context */
+		std::uint32_t fpu_save_cycles;        /* Outgoing task with FPU context */
+		std::uint32_t fpu_restore_cycles;     /* Incoming task with FPU context */
+		std::uint64_t stop_cycles;
+	};
+
+	/* 1kHz SysTick at 168MHz, Cortex-M4 timings from kernel.cpp */
+	constexpr Kernel_Simulator_Config KERNEL_SIMULATOR_DEFAULT = { 168000U, 12U, 85U, 34U, 34U, 0xFFFFFFFFFFFFFFFFU };
+
+	struct Kernel_Simulator_Statistics
+	{
+		std::uint64_t cycles;                 /* Simulated time since kernel_start() */
+		std::uint64_t idle_cycles;            /* Spent in the idle task */
+		std::uint64_t switch_cycles;          /* Spent switching */
+		std::uint32_t switches;
+		std::uint32_t interrupts;             /* Handler runs, SysTick included */
+	};
+
+	/* Before kernel_start() */
+	void kernel_simulator_config(const Kernel_Simulator_Config& config);
+
+	/* Periodic interrupt every period cycles from first, handler runs in interrupt context */
+	void kernel_simulator_interrupt(const std::uint64_t first, const std::uint64_t period, void (*handler)());
+
+	/* Calling task works for cycles, events fire and may switch tasks meanwhile */
+	void kernel_simulator_run(const std::uint32_t cycles);
+
+	/* Calling task has FPU context from now on, its switches cost the FPU cycles */
+	void kernel_simulator_fpu_used();
+
+	/* kernel_start() returns, the tasks are abandoned */
+	void kernel_simulator_stop();
+
+	std::uint64_t kernel_simulator_cycle_count();
+
+	Kernel_Simulator_Statistics kernel_simulator_statistics();
+}
+
+#endif /* KERNEL_SIMULATOR_H */
@@ -0,0 +1,373 @@
+/* Source: log_decode.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Formats deferred log records (log.h) against the log_fmt section of the ELF that wrote them.
+ * log_decode <elf> <file>          words as log_drain() handed them to the sink
+ * log_decode <elf> --ring <file>   (gdb) dump binary value log.bin log_ring, the records
+ *                                  between tail and head that were not drained yet
+ * log_decode                       logs a 168 MHz bring-up, a prescaler change, a PLL relock,
+ *                                  a switch back to HSI and an overflowing burst on the host
+ *                                  simulator, drains it and decodes it against its own ELF
+ *                                  (/proc/self/exe), also through a ring dump. Exits non-zero if
+ *                                  a line is missing or formats differently.
+ * The ELF may be 32 bit (target) or 64 bit (host), little endian. A record whose ID is not a
+ * string or whose argument count does not match the format is printed raw and skipped one word
+ * at a time until the stream makes sense again.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <log.h>
+#include <spsc_ring.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+using Clock_84MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 84000000, 84000000, 42000000, 84000000>;
+
+namespace bare_metal
+{
+	extern Spsc_Ring<std::uint32_t, LOG_WORDS> log_ring;
+}
+
+static std::vector<std::uint8_t> decode_read_file(const char* path)
+{
+	std::vector<std::uint8_t> data;
+	std::FILE* file = std::fopen(path, "rb");
+	if (file == nullptr)
+	{
+		return data;
+	}
+	std::uint8_t chunk[4096];
+	std::size_t count;
+	while ((count = std::fread(chunk, 1U, sizeof(chunk), file)) != 0U)
+	{
+		data.insert(data.end(), chunk, chunk + count);
+	}
+	std::fclose(file);
+	return data;
+}
+
+static std::uint64_t decode_field(const std::vector<std::uint8_t>& elf, const std::size_t offset, const std::size_t size)
+{
+	std::uint64_t value = 0U;
+	for (std::size_t i = 0U; i < size && offset + i < elf.size(); ++i)
+	{
+		value |= static_cast<std::uint64_t>(elf[offset + i]) << (8U * i);
+	}
+	return value;
+}
+
+/* Contents of the log_fmt section, empty if the ELF has none */
+static std::vector<char> decode_format_section(const std::vector<std::uint8_t>& elf)
+{
+	std::vector<char> section;
+	if (elf.size() < 52U || std::memcmp(elf.data(), "\x7F" "ELF", 4U) != 0 || elf[5] != 1U)
+	{
+		return section;
+	}
+	const bool elf64 = (elf[4] == 2U);
+	const std::size_t address_size = elf64 ? 8U : 4U;
+	const std::uint64_t shoff = decode_field(elf, elf64 ? 0x28U : 0x20U, address_size);
+	const std::size_t shentsize = decode_field(elf, elf64 ? 0x3AU : 0x2EU, 2U);
+	const std::size_t shnum = decode_field(elf, elf64 ? 0x3CU : 0x30U, 2U);
+	const std::size_t shstrndx = decode_field(elf, elf64 ? 0x3EU : 0x32U, 2U);
+	/* sh_name at 0, sh_offset and sh_size after sh_type, sh_flags, sh_addr */
+	const std::size_t name_offset = 0U;
+	const std::size_t data_offset = elf64 ? 0x18U : 0x10U;
+	const std::size_t size_offset = elf64 ? 0x20U : 0x14U;
+
+	if (shstrndx >= shnum || shoff + shnum * shentsize > elf.size())
+	{
+		return section;
+	}
+	const std::uint64_t names = decode_field(elf, shoff + shstrndx * shentsize + data_offset, address_size);
+	for (std::size_t i = 0U; i < shnum; ++i)
+	{
+		const std::size_t header = shoff + i * shentsize;
+		const std::uint64_t name = names + decode_field(elf, header + name_offset, 4U);
+		if (name + sizeof("log_fmt") <= elf.size() && std::memcmp(&elf[name], "log_fmt", sizeof("log_fmt")) == 0)
+		{
+			const std::uint64_t offset = decode_field(elf, header + data_offset, address_size);
+			const std::uint64_t size = decode_field(elf, header + size_offset, address_size);
+			if (offset + size <= elf.size())
+			{
+				section.assign(elf.begin() + offset, elf.begin() + offset + size);
+			}
+			break;
+		}
+	}
+	return section;
+}
+
+/* Formats one record, false if format does not take exactly arguments */
+static bool decode_format(const char* format, const std::uint32_t* arguments, const std::uint32_t count, std::string& line)
+{
+	std::uint32_t used = 0U;
+	char text[64];
+	line.clear();
+	while (*format != '\0')
+	{
+		if (*format != '%')
+		{
+			line += *format++;
+			continue;
+		}
+		if (format[1] == '%')
+		{
+			line += '%';
+			format += 2;
+			continue;
+		}
+		/* %[flags][width][.precision][length]conversion, length is dropped: every argument is a word */
+		std::string spec = "%";
+		++format;
+		while (std::strchr("-+ #0", *format) != nullptr && *format != '\0')
+		{
+			spec += *format++;
+		}
+		while ((*format >= '0' && *format <= '9') || *format == '.')
+		{
+			spec += *format++;
+		}
+		while (std::strchr("hlzjt", *format) != nullptr && *format != '\0')
+		{
+			++format;
+		}
+		const char conversion = *format++;
+		if (conversion == '\0' || used == count)
+		{
+			return false;
+		}
+		const std::uint32_t word = arguments[used++];
+		spec += conversion;
+		if (std::strchr("di", conversion) != nullptr)
+		{
+			std::snprintf(text, sizeof(text), spec.c_str(), static_cast<std::int32_t>(word));
+		}
+		else if (std::strchr("uxXoc", conversion) != nullptr)
+		{
+			std::snprintf(text, sizeof(text), spec.c_str(), word);
+		}
+		else if (std::strchr("fFeEgGaA", conversion) != nullptr)
+		{
+			float value;
+			std::memcpy(&value, &word, sizeof(value));
+			std::snprintf(text, sizeof(text), spec.c_str(), static_cast<double>(value));
+		}
+		else if (conversion == 'p')
+		{
+			std::snprintf(text, sizeof(text), "0x%08x", word);
+		}
+		else
+		{
+			return false;
+		}
+		line += text;
+	}
+	return used == count;
+}
+
+/* Decodes a word stream into lines "CYCCNT +delta text" */
+static std::vector<std::string> decode_stream(const std::vector<char>& formats, const std::uint32_t* words, const std::size_t count)
+{
+	std::vector<std::string> lines;
+	std::string line;
+	char prefix[160];
+	std::uint32_t previous = 0U;
+	std::size_t i = 0U;
+	while (i < count)
+	{
+		const std::uint32_t header = words[i];
+		const std::uint32_t id = header & LOG_ID_MASK;
+		const std::uint32_t arguments = log_header_arguments(header);
+		const bool fits = (arguments <= LOG_ARGUMENTS_MAX) && (i + 2U + arguments <= count);
+		bool ok = false;
+		if (fits && id == LOG_ID_DROPPED)
+		{
+			ok = (arguments == 1U);
+			line = "log: " + std::to_string(words[i + 2U]) + " records dropped";
+		}
+		else if (fits && id < formats.size() && std::memchr(&formats[id], '\0', formats.size() - id) != nullptr)
+		{
+			ok = decode_format(&formats[id], &words[i + 2U], arguments, line);
+		}
+		if (!ok)
+		{
+			std::snprintf(prefix, sizeof(prefix), "?? 0x%08x", header);
+			lines.push_back(prefix);
+			i += 1U;
+			continue;
+		}
+		const std::uint32_t stamp = words[i + 1U];
+		std::snprintf(prefix, sizeof(prefix), "%10u %+10d  ", stamp, lines.empty() ? 0 : static_cast<std::int32_t>(stamp - previous));
+		previous = stamp;
+		lines.push_back(prefix + line);
+		i += 2U + arguments;
+	}
+	return lines;
+}
+
+/* Dump of log_ring: buffer[LOG_WORDS], head, tail. Returns the undrained words in order */
+static std::vector<std::uint32_t> decode_ring(const std::vector<std::uint8_t>& dump)
+{
+	std::vector<std::uint32_t> words;
+	if (dump.size() != (LOG_WORDS + 2U) * sizeof(std::uint32_t))
+	{
+		return words;
+	}
+	const std::uint32_t head = static_cast<std::uint32_t>(decode_field(dump, LOG_WORDS * 4U, 4U));
+	const std::uint32_t tail = static_cast<std::uint32_t>(decode_field(dump, LOG_WORDS * 4U + 4U, 4U));
+	for (std::uint32_t index = tail; index != head && (index - tail) < LOG_WORDS; ++index)
+	{
+		words.push_back(static_cast<std::uint32_t>(decode_field(dump, (index & (LOG_WORDS - 1U)) * 4U, 4U)));
+	}
+	return words;
+}
+
+static std::vector<std::uint32_t> decode_words(const std::vector<std::uint8_t>& bytes)
+{
+	std::vector<std::uint32_t> words(bytes.size() / sizeof(std::uint32_t));
+	for (std::size_t i = 0U; i < words.size(); ++i)
+	{
+		words[i] = static_cast<std::uint32_t>(decode_field(bytes, i * 4U, 4U));
+	}
+	return words;
+}
+
+static std::vector<std::uint32_t> drained;
+
+static void decode_sink(const std::uint32_t* words, const std::uint32_t count)
+{
+	drained.insert(drained.end(), words, words + count);
+}
+
+/* Every expected line has to appear, in this order */
+static bool decode_check(const std::vector<std::string>& lines, const std::vector<const char*>& expected)
+{
+	std::size_t next = 0U;
+	for (const std::string& line : lines)
+	{
+		if (next < expected.size() && line.find(expected[next]) != std::string::npos)
+		{
+			++next;
+		}
+	}
+	if (next != expected.size())
+	{
+		std::printf("missing: %s\n", expected[next]);
+		return false;
+	}
+	return true;
+}
+
+static int decode_self()
+{
+	bool ok = true;
+	const std::vector<char> formats = decode_format_section(decode_read_file("/proc/self/exe"));
+	std::printf("log_fmt section %zu bytes\n", formats.size());
+
+	mmio_simulator_reset();
+	Sys_Clock sys_clock = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	ok = (sys_clock.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) && ok;
+	sys_clock /= Prescaler_APB2::PRESCALER_APB2_DIV4;
+	ok = (sys_clock.configure_clock(Clock_84MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) && ok;
+	ok = (sys_clock.sysclk_select_hsi() == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) && ok;
+	LOG("user: %d 0x%08x %.3f %c", -42, 0xC0FFEEU, 2.5f, 'k');
+
+	/* Undrained: through a dump of the ring */
+	std::vector<std::uint8_t> dump(sizeof(log_ring));
+	std::memcpy(dump.data(), &log_ring, dump.size());
+	const std::vector<std::uint32_t> ring_words = decode_ring(dump);
+	const std::vector<std::string> ring_lines = decode_stream(formats, ring_words.data(), ring_words.size());
+
+	/* A burst larger than the ring */
+	log_drain(decode_sink);
+	for (std::uint32_t i = 0U; i < LOG_WORDS; ++i)
+	{
+		LOG("burst %u", i);
+	}
+	const std::uint32_t dropped = log_dropped();
+	log_drain(decode_sink);
+	LOG("after burst");
+	log_drain(decode_sink);
+
+	const std::vector<std::string> lines = decode_stream(formats, drained.data(), drained.size());
+	for (const std::string& line : lines)
+	{
+		if (line.find("burst ") == std::string::npos || line.find("burst 0") != std::string::npos)
+		{
+			std::printf("%s\n", line.c_str());
+		}
+	}
+
+	const std::vector<const char*> expected =
+	{
+		"sys_clock: flash latency 0 -> 5 wait states, read back ok 1",
+		"sys_clock: source 0 -> 2 (0 HSI, 1 HSE, 2 PLL), SYSCLK 168000000 Hz",
+		"sys_clock: prescalers HPRE 0x0 PPRE1 0x5 PPRE2 0x4, HCLK 168000000 P1CLK 42000000 P2CLK 84000000 Hz",
+		"sys_clock: prescalers HPRE 0x0 PPRE1 0x5 PPRE2 0x5, HCLK 168000000 P1CLK 42000000 P2CLK 42000000 Hz",
+		"sys_clock: source 2 -> 0 (0 HSI, 1 HSE, 2 PLL), SYSCLK 16000000 Hz",     /* Parked while the PLL relocks */
+		"sys_clock: source 0 -> 2 (0 HSI, 1 HSE, 2 PLL), SYSCLK 84000000 Hz",
+		"sys_clock: flash latency 5 -> 2 wait states, read back ok 1",
+		"sys_clock: source 2 -> 0 (0 HSI, 1 HSE, 2 PLL), SYSCLK 16000000 Hz",
+		"user: -42 0x00c0ffee 2.500 k",
+		"burst 0",
+		"records dropped",
+		"after burst",
+	};
+	const bool ring_ok = decode_check(ring_lines, std::vector<const char*>(expected.begin(), expected.begin() + 9));
+	const bool stream_ok = decode_check(lines, expected);
+	std::printf("ring dump %zu lines: %s\n", ring_lines.size(), ring_ok ? "ok" : "FAIL");
+	std::printf("stream %zu lines, %u records dropped: %s\n", lines.size(), dropped, stream_ok ? "ok" : "FAIL");
+
+	/* What the target stored and sent compared with formatting on the target */
+	std::size_t text = 0U;
+	for (const std::string& line : ring_lines)
+	{
+		text += line.size() - 23U + 1U;
+	}
+	std::printf("%zu records: %zu bytes binary, %zu bytes as text\n", ring_lines.size(), ring_words.size() * sizeof(std::uint32_t), text);
+
+	ok = ok && ring_ok && stream_ok && (dropped != 0U) && (formats.size() != 0U);
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 1)
+	{
+		return decode_self();
+	}
+	const bool ring = (argc == 4) && (std::strcmp(argv[2], "--ring") == 0);
+	if (argc != 3 && !ring)
+	{
+		std::printf("usage: %s <elf> [--ring] <file>\n", argv[0]);
+		return 1;
+	}
+
+	const std::vector<char> formats = decode_format_section(decode_read_file(argv[1]));
+	if (formats.empty())
+	{
+		std::printf("%s: no log_fmt section\n", argv[1]);
+		return 1;
+	}
+	const std::vector<std::uint8_t> bytes = decode_read_file(argv[ring ? 3 : 2]);
+	const std::vector<std::uint32_t> words = ring ? decode_ring(bytes) : decode_words(bytes);
+	if (ring && bytes.size() != (LOG_WORDS + 2U) * sizeof(std::uint32_t))
+	{
+		std::printf("%s: %zu bytes, not a log_ring dump\n", argv[3], bytes.size());
+		return 1;
+	}
+	for (const std::string& line : decode_stream(formats, words.data(), words.size()))
+	{
+		std::printf("%s\n", line.c_str());
+	}
+	return 0;
+}
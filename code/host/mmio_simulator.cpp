@@ -0,0 +1,529 @@
+/* Source: mmio_simulator.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Backs RCC and FLASH with plain memory on the host and models the parts of the
+ * RCC state machine that Sys_Clock waits on: HSERDY, PLLRDY, PLLI2SRDY and SWS.
+ * Ready bits are read-only, the simulator owns them and patches them into every read.
+ * RCC_CIR: HSERDYF/PLLRDYF are set when the oscillator becomes ready with its interrupt
+ * enable set, write 1 to HSERDYC/PLLRDYC clears them. While one is set and enabled the
+ * RCC interrupt is pending and mmio_simulator_advance() calls RCC_IRQHandler(), the
+ * cycles the handler spends are added on top of the application's own.
+ * HSE failure: CSSON set -> SW/SWS forced to HSI, the PLL on HSE stops, CSSF set, NMI_Handler() runs, then the RCC interrupt it pended.
+ * HSI calibration: one simulated cycle is one cycle of the actual HSI, 16MHz + hsi_offset +
+ * (HSITRIM - 16) * 80kHz, and the TIM5/TIM11 kernel clock is taken to be that HSI undivided.
+ * Input capture on TIM5 CH4 (LSE) and TIM11 CH1 (HSE_RTC) is worked out from the cycles since
+ * CEN on every SR/CCR read: CCxIF set per 8 reference edges, CCxOF when one was still pending.
+ * LSERDY follows LSEON at once, LSE startup is not modelled.
+ */
+
+#include "mmio_simulator.h"
+#include <hsi_trim.h>
+#include <dwt.h>
+
+extern "C" void RCC_IRQHandler();
+extern "C" void NMI_Handler();
+
+namespace bare_metal
+{
+	RCC_Register_Handle mmio_rcc;
+	Flash_Register_Handle mmio_flash;
+	Timer_Register_Handle mmio_tim5;
+	Timer_Register_Handle mmio_tim11;
+	Pwr_Register_Handle mmio_pwr;
+	Rtc_Register_Handle mmio_rtc;
+
+	/* One input capture channel, times in simulated cycles */
+	struct Mmio_Simulator_Capture
+	{
+		bool running;                         /* CEN with the channel enabled and a live reference */
+		std::uint64_t start;                  /* Cycle CEN was set, counter = 0 */
+		std::uint64_t frequency_hsi;          /* Actual HSI while running */
+		std::uint64_t frequency_reference;    /* Reference edges per second */
+		std::uint64_t captured;               /* Captures so far */
+		std::uint32_t flags;                  /* CCxIF | CCxOF */
+		std::uint32_t value;                  /* CCRx */
+	};
+
+	struct Mmio_Simulator_State
+	{
+		Mmio_Simulator_Config config;
+		Mmio_Simulator_Statistics statistics;
+		bool resetting;
+
+		bool hse_ready;
+		bool hse_pending;
+		std::uint64_t hse_ready_at;
+
+		bool pll_ready;
+		bool pll_pending;
+		std::uint64_t pll_ready_at;
+
+		bool plli2s_ready;
+		bool plli2s_pending;
+		std::uint64_t plli2s_ready_at;
+
+		bool pll_source_hse;                  /* Mirror of PLLSRC */
+		std::uint32_t sw;                     /* Mirror of SW */
+		std::uint32_t sws;
+		bool sws_pending;
+		std::uint64_t sws_ready_at;
+
+		std::uint32_t cir_flags;              /* RCC_CIR [7:0] */
+		std::uint32_t cir_enable;             /* Mirror of RCC_CIR [13:8] */
+		bool rcc_set_pending;                 /* NVIC ISPR bit of the RCC interrupt */
+		bool in_interrupt;
+
+		Mmio_Simulator_Capture capture_lse;   /* TIM5 CH4 */
+		Mmio_Simulator_Capture capture_hse;   /* TIM11 CH1 */
+	};
+
+	static Mmio_Simulator_State simulator;
+
+	/* RCC_CR read-only fields: HSIRDY, HSICAL, HSERDY, PLLRDY, PLLI2SRDY */
+	constexpr std::uint32_t RCC_CR_READ_ONLY   = (0x1U << 1U) | (0xFFU << 8U) | (0x1U << 17U) | (0x1U << 25U) | (0x1U << 27U);
+	/* RCC_CFGR read-only field: SWS */
+	constexpr std::uint32_t RCC_CFGR_READ_ONLY = (0x3U << 2U);
+
+	static bool mmio_simulator_source_ready(const std::uint32_t sw)
+	{
+		switch(sw)
+		{
+			case 0x0U:
+				return true;
+			case 0x1U:
+				return simulator.hse_ready;
+			case 0x2U:
+				return simulator.pll_ready;
+			default:
+				return false;
+		}
+	}
+
+	static std::uint32_t mmio_simulator_peek(const Register_Type& reg)
+	{
+		simulator.resetting = true;
+		const std::uint32_t value = static_cast<std::uint32_t>(reg);
+		simulator.resetting = false;
+		return value;
+	}
+
+	static std::uint64_t mmio_simulator_frequency_hsi()
+	{
+		const std::int64_t trim = static_cast<std::int64_t>((mmio_simulator_peek(mmio_rcc.rcc_cr) >> 3U) & 0x1FU);
+		return static_cast<std::uint64_t>(static_cast<std::int64_t>(FREQUENCY_HSI) + simulator.config.hsi_offset +
+		                                  (trim - static_cast<std::int64_t>(HSI_TRIM_DEFAULT)) * static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP));
+	}
+
+	/* CEN rising: the reference the channel sees, 0 when nothing toggles the input */
+	static std::uint64_t mmio_simulator_capture_reference(const Timer_Register_Handle& timer)
+	{
+		const std::uint32_t or_value = mmio_simulator_peek(timer.tim_or);
+		if (&timer == &mmio_tim5)
+		{
+			const bool enabled = (mmio_simulator_peek(timer.tim_ccer) & (0x1U << 12U)) != 0U;
+			const bool lse = (mmio_simulator_peek(mmio_rcc.rcc_bdcr) & 0x1U) != 0U;
+			return (enabled && lse && ((or_value >> 6U) & 0x3U) == 0x2U) ? FREQUENCY_LSE : 0U;
+		}
+		const bool enabled = (mmio_simulator_peek(timer.tim_ccer) & 0x1U) != 0U;
+		const std::uint32_t rtcpre = (mmio_simulator_peek(mmio_rcc.rcc_cfgr) >> 16U) & 0x1FU;
+		return (enabled && simulator.hse_ready && rtcpre >= 2U && (or_value & 0x3U) == 0x2U) ? (FREQUENCY_HSE / rtcpre) : 0U;
+	}
+
+	/* Catches the channel up with simulated time */
+	static void mmio_simulator_capture_step(Mmio_Simulator_Capture& capture, const std::uint32_t flag, const std::uint32_t overcapture, const std::uint32_t mask)
+	{
+		if (!capture.running)
+		{
+			return;
+		}
+		const std::uint64_t period = HSI_TRIM_CAPTURE_EDGES * capture.frequency_hsi;
+		const std::uint64_t due = ((simulator.statistics.cycles - capture.start) * capture.frequency_reference) / period;
+		if (due == capture.captured)
+		{
+			return;
+		}
+		if ((capture.flags & flag) || due > capture.captured + 1U)
+		{
+			capture.flags |= overcapture;
+		}
+		capture.flags |= flag;
+		capture.captured = due;
+		capture.value = static_cast<std::uint32_t>((due * period) / capture.frequency_reference) & mask;
+	}
+
+	static void mmio_simulator_step()
+	{
+		const std::uint64_t now = simulator.statistics.cycles;
+
+		if (simulator.hse_pending && simulator.config.hse_startup_cycles != MMIO_SIMULATOR_NEVER && now >= simulator.hse_ready_at)
+		{
+			simulator.hse_pending = false;
+			simulator.hse_ready = true;
+			simulator.cir_flags |= (simulator.cir_enable & (0x1U << 11U)) ? (0x1U << 3U) : 0U;
+		}
+
+		/* PLL only locks once its input is running */
+		if (simulator.pll_pending && now >= simulator.pll_ready_at)
+		{
+			if (!simulator.pll_source_hse || simulator.hse_ready)
+			{
+				simulator.pll_pending = false;
+				simulator.pll_ready = true;
+				simulator.cir_flags |= (simulator.cir_enable & (0x1U << 12U)) ? (0x1U << 4U) : 0U;
+			}
+		}
+
+		if (simulator.plli2s_pending && now >= simulator.plli2s_ready_at)
+		{
+			if (!simulator.pll_source_hse || simulator.hse_ready)
+			{
+				simulator.plli2s_pending = false;
+				simulator.plli2s_ready = true;
+			}
+		}
+
+		/* The switch happens only when the selected source is ready */
+		if (simulator.sws_pending && now >= simulator.sws_ready_at)
+		{
+			if (mmio_simulator_source_ready(simulator.sw))
+			{
+				simulator.sws_pending = false;
+				simulator.sws = simulator.sw;
+			}
+		}
+	}
+
+	static void mmio_simulator_tick()
+	{
+		const bool pending = simulator.hse_pending || simulator.pll_pending || simulator.plli2s_pending || simulator.sws_pending;
+		simulator.statistics.cycles += simulator.config.cycles_per_access;
+		if (pending)
+		{
+			simulator.statistics.wait_cycles += simulator.config.cycles_per_access;
+		}
+	}
+
+	std::uint32_t mmio_simulator_read(const Mmio_Register* reg, const std::uint32_t value)
+	{
+		if (simulator.resetting)
+		{
+			return value;
+		}
+
+		mmio_simulator_tick();
+		mmio_simulator_step();
+
+		if (reg == &mmio_rcc.rcc_cr)
+		{
+			std::uint32_t patched = value & ~((0x1U << 17U) | (0x1U << 25U) | (0x1U << 27U));
+			patched |= simulator.hse_ready ? (0x1U << 17U) : 0U;
+			patched |= simulator.pll_ready ? (0x1U << 25U) : 0U;
+			patched |= simulator.plli2s_ready ? (0x1U << 27U) : 0U;
+			return patched;
+		}
+		if (reg == &mmio_rcc.rcc_cfgr)
+		{
+			return (value & ~RCC_CFGR_READ_ONLY) | (simulator.sws << 2U);
+		}
+		if (reg == &mmio_rcc.rcc_cir)
+		{
+			return (value & ~0xFFU) | simulator.cir_flags;
+		}
+		if (reg == &mmio_rcc.rcc_bdcr)
+		{
+			/* LSERDY = LSEON */
+			return (value & ~(0x1U << 1U)) | ((value & 0x1U) << 1U);
+		}
+		if (reg == &mmio_tim5.tim_sr || reg == &mmio_tim5.tim_ccr4)
+		{
+			Mmio_Simulator_Capture& capture = simulator.capture_lse;
+			mmio_simulator_capture_step(capture, (0x1U << 4U), (0x1U << 12U), 0xFFFFFFFFU);
+			if (reg == &mmio_tim5.tim_sr)
+			{
+				return (value & ~((0x1U << 4U) | (0x1U << 12U))) | capture.flags;
+			}
+			capture.flags &= ~(0x1U << 4U);
+			return capture.value;
+		}
+		if (reg == &mmio_tim11.tim_sr || reg == &mmio_tim11.tim_ccr1)
+		{
+			Mmio_Simulator_Capture& capture = simulator.capture_hse;
+			mmio_simulator_capture_step(capture, (0x1U << 1U), (0x1U << 9U), 0xFFFFU);
+			if (reg == &mmio_tim11.tim_sr)
+			{
+				return (value & ~((0x1U << 1U) | (0x1U << 9U))) | capture.flags;
+			}
+			capture.flags &= ~(0x1U << 1U);
+			return capture.value;
+		}
+		return value;
+	}
+
+	std::uint32_t mmio_simulator_write(const Mmio_Register* reg, const std::uint32_t old_value, const std::uint32_t value)
+	{
+		if (simulator.resetting)
+		{
+			return value;
+		}
+
+		mmio_simulator_tick();
+		const std::uint64_t now = simulator.statistics.cycles;
+
+		if (reg == &mmio_rcc.rcc_cr)
+		{
+			const std::uint32_t stored = (value & ~RCC_CR_READ_ONLY) | (old_value & RCC_CR_READ_ONLY);
+			const std::uint32_t rising = ~old_value & value;
+			const std::uint32_t falling = old_value & ~value;
+
+			if (rising & (0x1U << 16U))
+			{
+				simulator.hse_pending = true;
+				simulator.hse_ready_at = now + simulator.config.hse_startup_cycles;
+			}
+			if (falling & (0x1U << 16U))
+			{
+				/* HSE still driving SYSCLK or the running PLL */
+				if (simulator.sws == 0x1U || (simulator.sws == 0x2U && simulator.pll_source_hse))
+				{
+					++simulator.statistics.invalid_writes;
+				}
+				simulator.hse_pending = false;
+				simulator.hse_ready = false;
+			}
+			if (rising & (0x1U << 24U))
+			{
+				simulator.pll_pending = true;
+				simulator.pll_ready_at = now + simulator.config.pll_lock_cycles;
+			}
+			if (falling & (0x1U << 24U))
+			{
+				if (simulator.sws == 0x2U)
+				{
+					++simulator.statistics.invalid_writes;
+				}
+				simulator.pll_pending = false;
+				simulator.pll_ready = false;
+			}
+			if (rising & (0x1U << 26U))
+			{
+				simulator.plli2s_pending = true;
+				simulator.plli2s_ready_at = now + simulator.config.pll_lock_cycles;
+			}
+			if (falling & (0x1U << 26U))
+			{
+				simulator.plli2s_pending = false;
+				simulator.plli2s_ready = false;
+			}
+			/* Turning off the oscillator SYSCLK runs from is ignored by hardware, count it */
+			if ((falling & (0x1U << 0U)) && simulator.sws == 0x0U)
+			{
+				++simulator.statistics.invalid_writes;
+			}
+			return stored;
+		}
+		if (reg == &mmio_rcc.rcc_pllcfgr)
+		{
+			/* PLLM and PLLSRC also feed PLLI2S, both have to be off */
+			if (simulator.pll_ready || simulator.pll_pending || simulator.plli2s_ready || simulator.plli2s_pending)
+			{
+				++simulator.statistics.invalid_writes;
+				return old_value;
+			}
+			simulator.pll_source_hse = (value & (0x1U << 22U)) != 0U;
+			return value;
+		}
+		if (reg == &mmio_rcc.rcc_plli2s)
+		{
+			if (simulator.plli2s_ready || simulator.plli2s_pending)
+			{
+				++simulator.statistics.invalid_writes;
+				return old_value;
+			}
+			return value;
+		}
+		if (reg == &mmio_rcc.rcc_cfgr)
+		{
+			simulator.sw = value & 0x3U;
+			if (((old_value ^ value) & 0x3U) != 0U)
+			{
+				simulator.sws_pending = true;
+				simulator.sws_ready_at = now + simulator.config.sws_switch_cycles;
+			}
+			return (value & ~RCC_CFGR_READ_ONLY) | (old_value & RCC_CFGR_READ_ONLY);
+		}
+		if (reg == &mmio_rcc.rcc_cir)
+		{
+			/* Clear bits [23:16] map onto flags [7:0] and read back as 0 */
+			simulator.cir_flags &= ~((value >> 16U) & 0xBFU);
+			simulator.cir_enable = value & (0x3FU << 8U);
+			return value & (0x3FU << 8U);
+		}
+		if (reg == &mmio_tim5.tim_cr1 || reg == &mmio_tim11.tim_cr1)
+		{
+			Mmio_Simulator_Capture& capture = (reg == &mmio_tim5.tim_cr1) ? simulator.capture_lse : simulator.capture_hse;
+			if ((~old_value & value) & 0x1U)
+			{
+				capture = Mmio_Simulator_Capture();
+				capture.frequency_reference = mmio_simulator_capture_reference((reg == &mmio_tim5.tim_cr1) ? mmio_tim5 : mmio_tim11);
+				capture.frequency_hsi = mmio_simulator_frequency_hsi();
+				capture.start = now;
+				capture.running = (capture.frequency_reference != 0U);
+			}
+			if ((old_value & ~value) & 0x1U)
+			{
+				capture.running = false;
+			}
+			return value;
+		}
+		if (reg == &mmio_tim5.tim_sr)
+		{
+			/* rc_w0: writing 0 clears, writing 1 keeps */
+			simulator.capture_lse.flags &= value;
+			return value;
+		}
+		if (reg == &mmio_tim11.tim_sr)
+		{
+			simulator.capture_hse.flags &= value;
+			return value;
+		}
+		return value;
+	}
+
+	void mmio_simulator_reset(const Mmio_Simulator_Config& config)
+	{
+		simulator = Mmio_Simulator_State();
+		simulator.config = config;
+		simulator.resetting = true;
+
+		/* Reset values from the reference manual */
+		mmio_rcc.rcc_cr = 0x00000083U;
+		mmio_rcc.rcc_pllcfgr = 0x24003010U;
+		mmio_rcc.rcc_cfgr = 0x00000000U;
+		mmio_rcc.rcc_cir = 0x00000000U;
+		mmio_rcc.rcc_plli2s = 0x20003000U;
+		mmio_rcc.rcc_bdcr = 0x00000000U;
+		mmio_flash.flash_acr = 0x00000000U;
+		mmio_tim5 = Timer_Register_Handle();
+		mmio_tim11 = Timer_Register_Handle();
+		mmio_pwr.pwr_cr = 0x00000000U;
+		mmio_pwr.pwr_csr = 0x00000000U;
+
+		simulator.resetting = false;
+		bus_access_counter_reset();
+	}
+
+	static bool mmio_simulator_rcc_interrupt_pending()
+	{
+		return simulator.rcc_set_pending || (simulator.cir_flags & (simulator.cir_enable >> 8U) & 0x3FU) != 0U;
+	}
+
+	/* Taken once no other handler runs, the NVIC clears the pending bit on entry */
+	static void mmio_simulator_rcc_interrupt()
+	{
+		if (!simulator.in_interrupt && mmio_simulator_rcc_interrupt_pending())
+		{
+			simulator.rcc_set_pending = false;
+			simulator.in_interrupt = true;
+			RCC_IRQHandler();
+			simulator.in_interrupt = false;
+		}
+	}
+
+	void mmio_simulator_pend_rcc_interrupt()
+	{
+		simulator.rcc_set_pending = true;
+	}
+
+	void mmio_simulator_advance(const std::uint64_t cycles)
+	{
+		std::uint64_t remaining = cycles;
+		while (true)
+		{
+			/* Stops at the next ready event so the interrupt arrives on time */
+			std::uint64_t step = remaining;
+			const std::uint64_t now = simulator.statistics.cycles;
+			if (simulator.hse_pending && simulator.hse_ready_at > now && simulator.hse_ready_at - now < step)
+			{
+				step = simulator.hse_ready_at - now;
+			}
+			if (simulator.pll_pending && simulator.pll_ready_at > now && simulator.pll_ready_at - now < step)
+			{
+				step = simulator.pll_ready_at - now;
+			}
+
+			const bool pending = simulator.hse_pending || simulator.pll_pending || simulator.plli2s_pending || simulator.sws_pending;
+			simulator.statistics.cycles += step;
+			if (pending)
+			{
+				simulator.statistics.wait_cycles += step;
+			}
+			remaining -= step;
+			mmio_simulator_step();
+			mmio_simulator_rcc_interrupt();
+			if (remaining == 0U)
+			{
+				break;
+			}
+		}
+	}
+
+	void mmio_simulator_fail_hse()
+	{
+		simulator.config.hse_startup_cycles = MMIO_SIMULATOR_NEVER;
+		simulator.hse_pending = false;
+		simulator.hse_ready = false;
+		if (simulator.pll_source_hse)
+		{
+			simulator.pll_pending = false;
+			simulator.pll_ready = false;
+			simulator.plli2s_pending = false;
+			simulator.plli2s_ready = false;
+		}
+
+		/* Hardware switches to HSI, clears HSEON and PLLON (if the PLL ran from HSE)
+		 * Without CSS the core would stall on a dead clock, the model keeps running */
+		simulator.resetting = true;
+		std::uint32_t cr = static_cast<std::uint32_t>(mmio_rcc.rcc_cr);
+		if (!(cr & (0x1U << 19U)))
+		{
+			simulator.resetting = false;
+			return;
+		}
+		cr = cr & ~((0x1U << 16U) | (0x1U << 17U));
+		if (simulator.pll_source_hse)
+		{
+			cr &= ~((0x1U << 24U) | (0x1U << 25U));
+		}
+		mmio_rcc.rcc_cr = cr;
+		if (simulator.sws == 0x1U || (simulator.sws == 0x2U && simulator.pll_source_hse))
+		{
+			mmio_rcc.rcc_cfgr = static_cast<std::uint32_t>(mmio_rcc.rcc_cfgr) & ~(0x3U << 0U);
+			simulator.sw = 0x0U;
+			simulator.sws = 0x0U;
+			simulator.sws_pending = false;
+		}
+		simulator.resetting = false;
+
+		simulator.cir_flags |= (0x1U << 7U);
+		const bool in_interrupt = simulator.in_interrupt;
+		simulator.in_interrupt = true;
+		NMI_Handler();
+		simulator.in_interrupt = in_interrupt;
+		/* The RCC interrupt the NMI pended tail-chains */
+		mmio_simulator_rcc_interrupt();
+	}
+
+	Mmio_Simulator_Statistics mmio_simulator_statistics()
+	{
+		return simulator.statistics;
+	}
+
+	std::uint32_t mmio_simulator_cycle_count()
+	{
+		/* CYCCNT is a bus read too, a loop polling it lets time pass */
+		mmio_simulator_tick();
+		mmio_simulator_step();
+		return static_cast<std::uint32_t>(simulator.statistics.cycles);
+	}
+}
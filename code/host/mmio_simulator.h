@@ -0,0 +1,62 @@
+#ifndef MMIO_SIMULATOR_H
+#define MMIO_SIMULATOR_H
+
+#include <cstdint>
+#include <sys_clock.h>
+
+/** Host side RCC/FLASH/TIM simulator (build with -DBARE_METAL_HOST)
+  * Time only moves when the driver touches a register, every access costs cycles_per_access.
+  * HSEON   -> HSERDY after hse_startup_cycles
+  * PLLON   -> PLLRDY after pll_lock_cycles (once the PLL source is ready)
+  * PLLI2SON -> PLLI2SRDY after pll_lock_cycles (same source, RCC_PLLCFGR is locked while it runs)
+  * SW      -> SWS    after sws_switch_cycles (once the selected source is ready)
+  * wait_cycles counts the cycles spent on accesses while one of those is still pending.
+  * HSERDYIE/PLLRDYIE in RCC_CIR raise the RCC interrupt, RCC_IRQHandler() runs from
+  * mmio_simulator_advance() (simulated application work), never in the middle of a driver access.
+  * A dead crystal is hse_startup_cycles = MMIO_SIMULATOR_NEVER, a crystal that stops later is
+  * mmio_simulator_fail_hse(), which runs NMI_Handler() when CSSON is set and then the RCC
+  * interrupt the NMI pended.
+  * TIM5 CH4 / TIM11 CH1 capture LSE / HSE_RTC against HSI with hsi_offset, see hsi_trim.h.
+  * dwt_cycle_count() reads the simulated cycle count (mmio_simulator_cycle_count()), one access like any register.
+  */
+
+namespace bare_metal
+{
+	struct Mmio_Simulator_Config
+	{
+		std::uint32_t cycles_per_access;      /* One poll loop iteration */
+		std::uint32_t hse_startup_cycles;     /* HSE startup, typ 2ms */
+		std::uint32_t pll_lock_cycles;        /* PLL lock, typ 100us */
+		std::uint32_t sws_switch_cycles;      /* SW -> SWS, a few source clock cycles */
+		std::int32_t hsi_offset;              /* HSI error at HSITRIM = 16 in Hz, factory parts are within +-1% */
+	};
+
+	/* Ready bit that never sets */
+	constexpr std::uint32_t MMIO_SIMULATOR_NEVER = (0xFFFFFFFFU);
+
+	/* Cycles counted at HSI 16MHz */
+	constexpr Mmio_Simulator_Config MMIO_SIMULATOR_DEFAULT = { 4U, 32000U, 1600U, 8U, 0 };
+
+	struct Mmio_Simulator_Statistics
+	{
+		std::uint64_t cycles;                 /* Simulated time since reset */
+		std::uint64_t wait_cycles;            /* Time spent while a ready bit was pending */
+		std::uint32_t invalid_writes;         /* PLLCFGR with PLLON/PLLI2SON = 1, PLLI2SCFGR with PLLI2SON = 1, turning off the running source */
+	};
+
+	/* Puts RCC and FLASH back to their reset values and clears the statistics */
+	void mmio_simulator_reset(const Mmio_Simulator_Config& config = MMIO_SIMULATOR_DEFAULT);
+
+	/* Lets simulated time pass without a register access, delivers the RCC interrupt */
+	void mmio_simulator_advance(const std::uint64_t cycles);
+
+	/* HSE stops: HSERDY drops, SYSCLK falls back to HSI like the Clock Security System does */
+	void mmio_simulator_fail_hse();
+
+	/* NVIC set-pending of the RCC interrupt (sys_clock.cpp), RCC_IRQHandler() runs with the next delivery */
+	void mmio_simulator_pend_rcc_interrupt();
+
+	Mmio_Simulator_Statistics mmio_simulator_statistics();
+}
+
+#endif /* MMIO_SIMULATOR_H */
@@ -0,0 +1,243 @@
+/* Source: spsc_ring_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Spsc_Ring with a producer and a consumer on two host threads, the target equivalent is an
+ * ISR filling and thread mode draining. Every run streams a counter through the ring and the
+ * consumer checks each element arrives once and in order, so a lost, doubled or torn
+ * element (index published before the data) fails the run.
+ * Stress: a 16 slot ring of 32 bit words, mixed single/batch/claim on both sides, the indices
+ * wrap the buffer every few elements and the sides keep catching up with each other.
+ * Throughput: a 4KiB byte ring, single push/pop, 64 byte batches and claim/commit spans,
+ * reported in bytes per second. A side that finds the ring full or empty yields, on a
+ * single core host the other thread would otherwise only run after a whole time slice.
+ * Exits non-zero on any mismatch.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <spsc_ring.h>
+
+using namespace bare_metal;
+
+constexpr std::uint32_t SPSC_BENCHMARK_STRESS       = (4000000);
+constexpr std::uint32_t SPSC_BENCHMARK_BYTES        = (64U * 1024U * 1024U);
+constexpr std::uint32_t SPSC_BENCHMARK_BYTES_SINGLE = (16U * 1024U * 1024U);
+constexpr std::uint32_t SPSC_BENCHMARK_BATCH        = (64);
+
+enum class Spsc_Benchmark_Mode
+{
+	SINGLE,
+	BATCH,
+	CLAIM,
+};
+
+static Spsc_Ring<std::uint32_t, 16> stress_ring;
+static Spsc_Ring<std::uint8_t, 4096> byte_ring;
+
+static double elapsed_ns(const std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Full or empty, let the other side run, the host may have fewer cores than threads */
+static std::uint32_t progress(const std::uint32_t count)
+{
+	if (count == 0U)
+	{
+		std::this_thread::yield();
+	}
+	return count;
+}
+
+static void print_result(const char* name, const double ns, const std::uint32_t bytes, const bool ok)
+{
+	std::printf("%-20s %12u %10.1f %12.1f %s\n", name, bytes, ns / 1000000.0, bytes * 1000.0 / ns, ok ? "ok" : "FAIL");
+}
+
+/* Producer cycles through single, batch and claim so every path meets every other on the consumer */
+static void stress_produce()
+{
+	std::uint32_t next = 0U;
+	std::uint32_t values[7];
+	while (next < SPSC_BENCHMARK_STRESS)
+	{
+		const std::uint32_t mode = next % 3U;
+		if (mode == 0U)
+		{
+			next += progress(stress_ring.push(next) ? 1U : 0U);
+		}
+		else if (mode == 1U)
+		{
+			const std::uint32_t count = ((SPSC_BENCHMARK_STRESS - next) < 7U) ? (SPSC_BENCHMARK_STRESS - next) : 7U;
+			for (std::uint32_t i = 0U; i < count; ++i)
+			{
+				values[i] = next + i;
+			}
+			next += progress(stress_ring.push(values, count));
+		}
+		else
+		{
+			const std::uint32_t count = ((SPSC_BENCHMARK_STRESS - next) < 5U) ? (SPSC_BENCHMARK_STRESS - next) : 5U;
+			const Spsc_Span_Type<std::uint32_t> span = stress_ring.claim_write(count);
+			for (std::uint32_t i = 0U; i < span.count; ++i)
+			{
+				span.data[i] = next + i;
+			}
+			stress_ring.commit_write(span.count);
+			next += progress(span.count);
+		}
+	}
+}
+
+static bool stress_consume()
+{
+	std::uint32_t expected = 0U;
+	std::uint32_t values[11];
+	std::uint32_t round = 0U;
+	bool ok = true;
+	while (expected < SPSC_BENCHMARK_STRESS)
+	{
+		const std::uint32_t mode = round++ % 3U;
+		if (mode == 0U)
+		{
+			std::uint32_t value;
+			if (progress(stress_ring.pop(value) ? 1U : 0U) != 0U)
+			{
+				ok = ok && (value == expected);
+				expected += 1U;
+			}
+		}
+		else if (mode == 1U)
+		{
+			const std::uint32_t count = stress_ring.pop(values, 11U);
+			for (std::uint32_t i = 0U; i < count; ++i)
+			{
+				ok = ok && (values[i] == expected + i);
+			}
+			expected += progress(count);
+		}
+		else
+		{
+			const Spsc_Span_Type<const std::uint32_t> span = stress_ring.claim_read(3U);
+			for (std::uint32_t i = 0U; i < span.count; ++i)
+			{
+				ok = ok && (span.data[i] == expected + i);
+			}
+			stress_ring.commit_read(span.count);
+			expected += progress(span.count);
+		}
+	}
+	return ok && stress_ring.empty();
+}
+
+static void byte_produce(const Spsc_Benchmark_Mode mode, const std::uint32_t bytes)
+{
+	std::uint32_t next = 0U;
+	std::uint8_t values[SPSC_BENCHMARK_BATCH];
+	while (next < bytes)
+	{
+		if (mode == Spsc_Benchmark_Mode::SINGLE)
+		{
+			next += progress(byte_ring.push(static_cast<std::uint8_t>(next)) ? 1U : 0U);
+		}
+		else if (mode == Spsc_Benchmark_Mode::BATCH)
+		{
+			const std::uint32_t count = ((bytes - next) < SPSC_BENCHMARK_BATCH) ? (bytes - next) : SPSC_BENCHMARK_BATCH;
+			for (std::uint32_t i = 0U; i < count; ++i)
+			{
+				values[i] = static_cast<std::uint8_t>(next + i);
+			}
+			std::uint32_t pushed = 0U;
+			while (pushed < count)
+			{
+				pushed += progress(byte_ring.push(values + pushed, count - pushed));
+			}
+			next += count;
+		}
+		else
+		{
+			/* Filled in place, no staging buffer */
+			const Spsc_Span_Type<std::uint8_t> span = byte_ring.claim_write(bytes - next);
+			for (std::uint32_t i = 0U; i < span.count; ++i)
+			{
+				span.data[i] = static_cast<std::uint8_t>(next + i);
+			}
+			byte_ring.commit_write(span.count);
+			next += progress(span.count);
+		}
+	}
+}
+
+static bool byte_consume(const Spsc_Benchmark_Mode mode, const std::uint32_t bytes)
+{
+	std::uint32_t expected = 0U;
+	std::uint8_t values[SPSC_BENCHMARK_BATCH];
+	std::uint32_t errors = 0U;
+	while (expected < bytes)
+	{
+		if (mode == Spsc_Benchmark_Mode::SINGLE)
+		{
+			std::uint8_t value;
+			if (progress(byte_ring.pop(value) ? 1U : 0U) != 0U)
+			{
+				errors += (value != static_cast<std::uint8_t>(expected)) ? 1U : 0U;
+				expected += 1U;
+			}
+		}
+		else if (mode == Spsc_Benchmark_Mode::BATCH)
+		{
+			const std::uint32_t count = byte_ring.pop(values, SPSC_BENCHMARK_BATCH);
+			for (std::uint32_t i = 0U; i < count; ++i)
+			{
+				errors += (values[i] != static_cast<std::uint8_t>(expected + i)) ? 1U : 0U;
+			}
+			expected += progress(count);
+		}
+		else
+		{
+			const Spsc_Span_Type<const std::uint8_t> span = byte_ring.claim_read(bytes - expected);
+			for (std::uint32_t i = 0U; i < span.count; ++i)
+			{
+				errors += (span.data[i] != static_cast<std::uint8_t>(expected + i)) ? 1U : 0U;
+			}
+			byte_ring.commit_read(span.count);
+			expected += progress(span.count);
+		}
+	}
+	return (errors == 0U) && byte_ring.empty();
+}
+
+static bool benchmark_bytes(const char* name, const Spsc_Benchmark_Mode mode, const std::uint32_t bytes)
+{
+	bool ok = false;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::thread consumer([&ok, mode, bytes]() { ok = byte_consume(mode, bytes); });
+	byte_produce(mode, bytes);
+	consumer.join();
+	print_result(name, elapsed_ns(start), bytes, ok);
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+
+	{
+		bool stress_ok = false;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::thread consumer([&stress_ok]() { stress_ok = stress_consume(); });
+		stress_produce();
+		consumer.join();
+		std::printf("stress %u words through 16 slots: %s (%.1f ms)\n", SPSC_BENCHMARK_STRESS, stress_ok ? "ok" : "FAIL", elapsed_ns(start) / 1000000.0);
+		ok = stress_ok && ok;
+	}
+
+	std::printf("%-20s %12s %10s %12s %s\n", "mode", "bytes", "ms", "MB/s", "status");
+	ok = benchmark_bytes("single", Spsc_Benchmark_Mode::SINGLE, SPSC_BENCHMARK_BYTES_SINGLE) && ok;
+	ok = benchmark_bytes("batch 64", Spsc_Benchmark_Mode::BATCH, SPSC_BENCHMARK_BYTES) && ok;
+	ok = benchmark_bytes("claim/commit", Spsc_Benchmark_Mode::CLAIM, SPSC_BENCHMARK_BYTES) && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/* Source: sys_clock_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Runs the Sys_Clock bring-up sequences from the README against the host simulator and
+ * reports bus accesses and simulated cycles for each one.
+ * Exits non-zero if a sequence leaves the simulated RCC in the wrong state.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <sys_clock.h>
+#include <clock_solver.h>
+#include <clock_governor.h>
+#include "mmio_simulator.h"
+
+using namespace bare_metal;
+
+struct Benchmark_Result_Type
+{
+	const char* name;
+	Bus_Access_Counter_Type bus;
+	Mmio_Simulator_Statistics simulator;
+	std::uint32_t frequency_sysclk;
+	bool ok;
+};
+
+static bool sysclk_status_is(const std::uint32_t sws)
+{
+	return ((static_cast<std::uint32_t>(RCC->rcc_cfgr) >> 2U) & 0x3U) == sws;
+}
+
+static Benchmark_Result_Type benchmark_finish(const char* name, const Sys_Clock& sys_clock, const bool ok)
+{
+	/* Sample the counters before the status check reads RCC again */
+	Benchmark_Result_Type result = { name, bus_access_counter_get(), mmio_simulator_statistics(), sys_clock.get_sysclk_frequency(), ok };
+	return result;
+}
+
+static Benchmark_Result_Type benchmark_hse()
+{
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	hse.sysclk_select_hse();
+	Benchmark_Result_Type result = benchmark_finish("hse select", hse, true);
+	result.ok = sysclk_status_is(0x1U);
+	return result;
+}
+
+static Benchmark_Result_Type benchmark_pll_manual()
+{
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	hse.configure_source_pll();
+	hse.configure_prescaler_pllm(Prescaler_PLLM::PRESCALER_PLLM_DIV4);
+	hse.configure_prescaler_plln(Prescaler_PLLN::PRESCALER_PLLN_MUL168);
+	hse.configure_prescaler_pllp(Prescaler_PLLP::PRESCALER_PLLP_DIV2);
+	bool ok = (hse.configure_flash_latency() == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	hse.sysclk_enable_pll();
+	hse.sysclk_select_pll();
+	hse.configure_prescaler_ahb(Prescaler_AHB::PRESCALER_AHB_DIV1);
+	hse.configure_prescaler_apb1(Prescaler_APB1::PRESCALER_APB1_DIV4);
+	hse.configure_prescaler_apb2(Prescaler_APB2::PRESCALER_APB2_DIV2);
+	Benchmark_Result_Type result = benchmark_finish("pll per-field", hse, ok);
+	result.ok = result.ok && sysclk_status_is(0x2U);
+	return result;
+}
+
+static Benchmark_Result_Type benchmark_pll_transaction()
+{
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSE);
+	hse.configure_source_pll();
+	hse.transaction_begin();
+	hse.transaction_stage(Prescaler_PLLM::PRESCALER_PLLM_DIV4);
+	hse.transaction_stage(Prescaler_PLLN::PRESCALER_PLLN_MUL168);
+	hse.transaction_stage(Prescaler_PLLP::PRESCALER_PLLP_DIV2);
+	hse.transaction_stage(Prescaler_AHB::PRESCALER_AHB_DIV1);
+	hse.transaction_stage(Prescaler_APB1::PRESCALER_APB1_DIV4);
+	hse.transaction_stage(Prescaler_APB2::PRESCALER_APB2_DIV2);
+	bool ok = (hse.transaction_commit() == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	ok = ok && (hse.configure_flash_latency() == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	hse.sysclk_enable_pll();
+	hse.sysclk_select_pll();
+	Benchmark_Result_Type result = benchmark_finish("pll transaction", hse, ok);
+	result.ok = result.ok && sysclk_status_is(0x2U);
+	return result;
+}
+
+static Benchmark_Result_Type benchmark_pll_solver()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	mmio_simulator_reset();
+	Sys_Clock hsi = Sys_Clock();
+	bool ok = (hsi.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	Benchmark_Result_Type result = benchmark_finish("pll solver", hsi, ok);
+	result.ok = result.ok && sysclk_status_is(0x2U);
+	return result;
+}
+
+/* A bootloader left 168MHz running, the application adopts it and asks for the same or nearly the same tree */
+static Benchmark_Result_Type benchmark_warm_start(const char* name, const Clock_Config_Type& config, const std::uint32_t frequency_p2clk)
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	mmio_simulator_reset();
+	Sys_Clock bootloader = Sys_Clock();
+	bool ok = (bootloader.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	bus_access_counter_reset();
+	const Mmio_Simulator_Statistics before = mmio_simulator_statistics();
+
+	Sys_Clock application = Sys_Clock::adopt();
+	ok = ok && (application.get_oscillator_type() == Sys_Oscillator_Type::OSC_TYPE_PLL);
+	ok = ok && (application.configure_clock(config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	Benchmark_Result_Type result = benchmark_finish(name, application, ok);
+	result.simulator.cycles -= before.cycles;
+	result.simulator.wait_cycles -= before.wait_cycles;
+	result.ok = result.ok && (application.get_p2clk_frequency() == frequency_p2clk) && sysclk_status_is(0x2U);
+	return result;
+}
+
+/* No HSE on the board: every wait gives up after its poll budget and SYSCLK stays on HSI */
+static Benchmark_Result_Type benchmark_dead_crystal()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	Mmio_Simulator_Config config = MMIO_SIMULATOR_DEFAULT;
+	config.hse_startup_cycles = MMIO_SIMULATOR_NEVER;
+	mmio_simulator_reset(config);
+	Sys_Clock hsi = Sys_Clock();
+	bool ok = (hsi.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_HSE);
+	Benchmark_Result_Type result = benchmark_finish("dead crystal", hsi, ok);
+	result.ok = result.ok && (result.frequency_sysclk == FREQUENCY_HSI) && sysclk_status_is(0x0U);
+	return result;
+}
+
+/* HSE stops at 168MHz, the CSS NMI pends RCC_IRQHandler, which rebuilds 168MHz from HSI */
+static Benchmark_Result_Type benchmark_css_fallback()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+
+	mmio_simulator_reset();
+	Sys_Clock hse = Sys_Clock();
+	bool ok = (hse.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	hse.enable_clock_security();
+	bus_access_counter_reset();
+	const Mmio_Simulator_Statistics before = mmio_simulator_statistics();
+	mmio_simulator_fail_hse();
+	ok = ok && hse.get_clock_security_failure();
+	Benchmark_Result_Type result = benchmark_finish("css fallback", hse, ok);
+	result.simulator.cycles -= before.cycles;
+	result.simulator.wait_cycles -= before.wait_cycles;
+	result.ok = result.ok && (result.frequency_sysclk == 168000000U) && sysclk_status_is(0x2U);
+	hse.disable_clock_security();
+	return result;
+}
+
+/* A stack instance starts on whatever the memory held, every member has to come from the constructor */
+static Benchmark_Result_Type benchmark_dirty_memory()
+{
+	using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSI, 168000000, 168000000, 42000000, 84000000>;
+
+	mmio_simulator_reset();
+	alignas(Sys_Clock) static std::uint8_t memory[sizeof(Sys_Clock)];
+	std::memset(memory, 0xFF, sizeof(memory));
+	Sys_Clock& hsi = *new (memory) Sys_Clock(Sys_Oscillator_Type::OSC_TYPE_HSI);
+	bool ok = (hsi.get_async_state() == Sys_Clock_Async_State::ASYNC_STATE_IDLE) && !hsi.get_clock_security_failure();
+	ok = ok && (hsi.configure_clock(Clock_168MHz::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	Benchmark_Result_Type result = benchmark_finish("dirty memory", hsi, ok);
+	result.ok = result.ok && (result.frequency_sysclk == 168000000U) && sysclk_status_is(0x2U);
+	return result;
+}
+
+/* Profile switches run back to back on one governor, counters are cleared before each step */
+static Sys_Clock governor_clock;
+static Clock_Governor governor(governor_clock);
+
+static Benchmark_Result_Type benchmark_profile(const char* name, const Clock_Profile profile, const std::uint32_t sws)
+{
+	bus_access_counter_reset();
+	const Mmio_Simulator_Statistics before = mmio_simulator_statistics();
+	const Frequency_Clock_Type frequency = governor.switch_profile(profile);
+	Benchmark_Result_Type result = benchmark_finish(name, governor_clock, governor.get_profile() == profile);
+	result.simulator.cycles -= before.cycles;
+	result.simulator.wait_cycles -= before.wait_cycles;
+	result.simulator.invalid_writes -= before.invalid_writes;
+	result.ok = result.ok && (frequency.frequency_sysclk == CLOCK_PROFILE_CONFIG[static_cast<std::uint8_t>(profile)].frequency.frequency_sysclk);
+	result.ok = result.ok && sysclk_status_is(sws);
+	return result;
+}
+
+static Benchmark_Result_Type benchmark_profile_reset()
+{
+	mmio_simulator_reset();
+	return benchmark_profile("idle (no change)", Clock_Profile::CLOCK_PROFILE_IDLE, 0x0U);
+}
+
+/* The tree went to burst behind the governor, which last applied idle: idle has to switch back */
+static Benchmark_Result_Type benchmark_profile_behind()
+{
+	const bool behind = (governor_clock.configure_clock(Clock_Profile_Burst::config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) &&
+	                    (governor.get_profile() == Clock_Profile::CLOCK_PROFILE_BURST);
+	Benchmark_Result_Type result = benchmark_profile("behind -> idle", Clock_Profile::CLOCK_PROFILE_IDLE, 0x0U);
+	result.ok = result.ok && behind;
+	return result;
+}
+
+int main()
+{
+	const Benchmark_Result_Type results[] =
+	{
+		benchmark_hse(),
+		benchmark_pll_manual(),
+		benchmark_pll_transaction(),
+		benchmark_pll_solver(),
+		benchmark_warm_start("warm start (same)", Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>::config, 84000000U),
+		benchmark_warm_start("warm start (APB2)", Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 42000000>::config, 42000000U),
+		benchmark_dead_crystal(),
+		benchmark_css_fallback(),
+		benchmark_dirty_memory(),
+		benchmark_profile_reset(),
+		benchmark_profile("idle -> burst", Clock_Profile::CLOCK_PROFILE_BURST, 0x2U),
+		benchmark_profile("burst -> balanced", Clock_Profile::CLOCK_PROFILE_BALANCED, 0x2U),
+		benchmark_profile("balanced -> idle", Clock_Profile::CLOCK_PROFILE_IDLE, 0x0U),
+		benchmark_profile_behind()
+	};
+
+	bool ok = true;
+	std::printf("%-18s %8s %8s %12s %12s %8s %12s %s\n", "sequence", "reads", "writes", "cycles", "wait", "invalid", "sysclk", "status");
+	for (const Benchmark_Result_Type& result : results)
+	{
+		std::printf("%-18s %8u %8u %12llu %12llu %8u %12u %s\n",
+		            result.name,
+		            result.bus.reads,
+		            result.bus.writes,
+		            static_cast<unsigned long long>(result.simulator.cycles),
+		            static_cast<unsigned long long>(result.simulator.wait_cycles),
+		            result.simulator.invalid_writes,
+		            result.frequency_sysclk,
+		            result.ok ? "ok" : "FAIL");
+		ok = ok && result.ok && (result.simulator.invalid_writes == 0U);
+	}
+	return ok ? 0 : 1;
+}
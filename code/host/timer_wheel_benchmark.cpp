@@ -0,0 +1,116 @@
+/* Source: timer_wheel_benchmark.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Start, cancel and expire throughput of Timer_Wheel with 10k timers.
+ * Timeouts are spread over all four levels, every other timer is cancelled and the
+ * wheel is advanced until the rest expired. A second run expires all timers on one tick.
+ * Exits non-zero if a timer fires on the wrong tick, twice, or after being cancelled.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <timer_wheel.h>
+
+using namespace bare_metal;
+
+constexpr std::uint32_t TIMER_BENCHMARK_COUNT     = (10000);
+constexpr std::uint32_t TIMER_BENCHMARK_TICKS_MAX = (300000);
+
+class Benchmark_Timer : public Software_Timer
+{
+	public:
+		void timer_expired() override
+		{
+			this->fired += 1U;
+			this->ok = this->ok && (this->wheel->get_tick() == this->due);
+		}
+
+		Timer_Wheel*  wheel = nullptr;
+		std::uint32_t due = 0U;
+		std::uint32_t fired = 0U;
+		bool ok = true;
+};
+
+static Timer_Wheel wheel;
+static Benchmark_Timer timers[TIMER_BENCHMARK_COUNT];
+
+static double elapsed_ns(const std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_result(const char* name, const double ns, const std::uint32_t operations)
+{
+	std::printf("%-20s %10u %12.1f %14.2f\n", name, operations, ns / operations, operations * 1000.0 / ns);
+}
+
+static bool timers_check(const bool cancelled_odd)
+{
+	for (std::uint32_t i = 0U; i < TIMER_BENCHMARK_COUNT; ++i)
+	{
+		const std::uint32_t expected = (cancelled_odd && (i & 0x1U)) ? 0U : 1U;
+		if (timers[i].fired != expected || !timers[i].ok || timers[i].is_active())
+		{
+			std::printf("timer %u fired %u times (expected %u)\n", i, timers[i].fired, expected);
+			return false;
+		}
+		timers[i].fired = 0U;
+	}
+	return true;
+}
+
+int main()
+{
+	std::printf("%-20s %10s %12s %14s\n", "operation", "count", "ns/op", "Mops/s");
+
+	/* Spread timeouts, LCG keeps the run reproducible */
+	std::uint32_t seed = 12345U;
+	std::uint32_t ticks_max = 0U;
+	std::uint32_t delays[TIMER_BENCHMARK_COUNT];
+	for (std::uint32_t i = 0U; i < TIMER_BENCHMARK_COUNT; ++i)
+	{
+		seed = seed * 1664525U + 1013904223U;
+		delays[i] = 1U + ((seed >> 8U) % TIMER_BENCHMARK_TICKS_MAX);
+		ticks_max = (delays[i] > ticks_max) ? delays[i] : ticks_max;
+		timers[i].wheel = &wheel;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::uint32_t i = 0U; i < TIMER_BENCHMARK_COUNT; ++i)
+	{
+		wheel.start(timers[i], delays[i]);
+	}
+	print_result("start", elapsed_ns(start), TIMER_BENCHMARK_COUNT);
+
+	start = std::chrono::steady_clock::now();
+	for (std::uint32_t i = 1U; i < TIMER_BENCHMARK_COUNT; i += 2U)
+	{
+		wheel.cancel(timers[i]);
+	}
+	print_result("cancel", elapsed_ns(start), TIMER_BENCHMARK_COUNT / 2U);
+
+	for (std::uint32_t i = 0U; i < TIMER_BENCHMARK_COUNT; ++i)
+	{
+		timers[i].due = wheel.get_tick() + delays[i];
+	}
+	start = std::chrono::steady_clock::now();
+	wheel.tick_elapsed(ticks_max);
+	const double spread_ns = elapsed_ns(start);
+	print_result("advance (spread)", spread_ns, ticks_max);
+	bool ok = timers_check(true);
+
+	/* All on one tick: one batch of 10k callbacks */
+	for (std::uint32_t i = 0U; i < TIMER_BENCHMARK_COUNT; ++i)
+	{
+		timers[i].due = wheel.get_tick() + 100U;
+		wheel.start(timers[i], 100U);
+	}
+	wheel.tick_elapsed(99U);
+	start = std::chrono::steady_clock::now();
+	wheel.advance();
+	print_result("expire (one tick)", elapsed_ns(start), TIMER_BENCHMARK_COUNT);
+	ok = ok && timers_check(false);
+
+	return ok ? 0 : 1;
+}
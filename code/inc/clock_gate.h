@@ -0,0 +1,178 @@
+#ifndef CLOCK_GATE_H
+#define CLOCK_GATE_H
+
+#include <cstdint>
+
+/** Peripheral clock gating over RCC_xxxENR and RCC_xxxLPENR
+  * Peripheral_Id (8 bit):
+  * 	[7:5] bus (AHB1, AHB2, AHB3, APB1, APB2)
+  * 	[4:0] bit in that bus' ENR/LPENR register
+  * Every peripheral has a reference count, the clock is on while it is above 0.
+  * Drivers sharing a peripheral (DMA, GPIO ports) enable and disable it independently,
+  * the last one out gates it. Counts change with interrupts masked, callable from ISRs.
+  *
+  * After a clock is enabled the peripheral needs 2 bus cycles before its registers
+  * respond (errata "delay after an RCC peripheral clock enabling"), every enable ends
+  * with a read back of the ENR register it wrote, which stalls until the write has
+  * reached RCC.
+  *
+  * LPENR decides which clocks stay on in Sleep mode (WFI/WFE), all on after reset.
+  */
+
+namespace bare_metal
+{
+	enum class Clock_Gate_Bus : std::uint8_t
+	{
+		CLOCK_GATE_BUS_AHB1              = (0x0),
+		CLOCK_GATE_BUS_AHB2              = (0x1),
+		CLOCK_GATE_BUS_AHB3              = (0x2),
+		CLOCK_GATE_BUS_APB1              = (0x3),
+		CLOCK_GATE_BUS_APB2              = (0x4)
+	};
+
+	constexpr std::uint32_t CLOCK_GATE_BUS_COUNT   = (5);
+	constexpr std::uint32_t CLOCK_GATE_BUS_SHIFT   = (5);
+	constexpr std::uint32_t CLOCK_GATE_BIT_MASK    = (0x1F);
+	constexpr std::uint32_t CLOCK_GATE_COUNT_MAX   = (0xFF);
+
+	constexpr std::uint8_t clock_gate_id(const Clock_Gate_Bus bus, const std::uint32_t bit)
+	{
+		return static_cast<std::uint8_t>((static_cast<std::uint32_t>(bus) << CLOCK_GATE_BUS_SHIFT) | bit);
+	}
+
+	enum class Peripheral_Id : std::uint8_t
+	{
+		/* RCC_AHB1ENR */
+		PERIPHERAL_GPIOA                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 0),
+		PERIPHERAL_GPIOB                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 1),
+		PERIPHERAL_GPIOC                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 2),
+		PERIPHERAL_GPIOD                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 3),
+		PERIPHERAL_GPIOE                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 4),
+		PERIPHERAL_GPIOF                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 5),
+		PERIPHERAL_GPIOG                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 6),
+		PERIPHERAL_GPIOH                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 7),
+		PERIPHERAL_GPIOI                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 8),
+		PERIPHERAL_CRC                   = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 12),
+		PERIPHERAL_BKPSRAM               = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 18),
+		PERIPHERAL_CCMDATARAM            = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 20),
+		PERIPHERAL_DMA1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 21),
+		PERIPHERAL_DMA2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 22),
+		PERIPHERAL_ETHMAC                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 25),
+		PERIPHERAL_ETHMACTX              = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 26),
+		PERIPHERAL_ETHMACRX              = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 27),
+		PERIPHERAL_ETHMACPTP             = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 28),
+		PERIPHERAL_OTGHS                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 29),
+		PERIPHERAL_OTGHSULPI             = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1, 30),
+
+		/* RCC_AHB2ENR */
+		PERIPHERAL_DCMI                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2, 0),
+		PERIPHERAL_CRYP                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2, 4),
+		PERIPHERAL_HASH                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2, 5),
+		PERIPHERAL_RNG                   = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2, 6),
+		PERIPHERAL_OTGFS                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2, 7),
+
+		/* RCC_AHB3ENR */
+		PERIPHERAL_FSMC                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB3, 0),
+
+		/* RCC_APB1ENR */
+		PERIPHERAL_TIM2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 0),
+		PERIPHERAL_TIM3                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 1),
+		PERIPHERAL_TIM4                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 2),
+		PERIPHERAL_TIM5                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 3),
+		PERIPHERAL_TIM6                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 4),
+		PERIPHERAL_TIM7                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 5),
+		PERIPHERAL_TIM12                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 6),
+		PERIPHERAL_TIM13                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 7),
+		PERIPHERAL_TIM14                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 8),
+		PERIPHERAL_WWDG                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 11),
+		PERIPHERAL_SPI2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 14),
+		PERIPHERAL_SPI3                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 15),
+		PERIPHERAL_USART2                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 17),
+		PERIPHERAL_USART3                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 18),
+		PERIPHERAL_UART4                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 19),
+		PERIPHERAL_UART5                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 20),
+		PERIPHERAL_I2C1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 21),
+		PERIPHERAL_I2C2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 22),
+		PERIPHERAL_I2C3                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 23),
+		PERIPHERAL_CAN1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 25),
+		PERIPHERAL_CAN2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 26),
+		PERIPHERAL_PWR                   = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 28),
+		PERIPHERAL_DAC                   = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB1, 29),
+
+		/* RCC_APB2ENR */
+		PERIPHERAL_TIM1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 0),
+		PERIPHERAL_TIM8                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 1),
+		PERIPHERAL_USART1                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 4),
+		PERIPHERAL_USART6                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 5),
+		PERIPHERAL_ADC1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 8),
+		PERIPHERAL_ADC2                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 9),
+		PERIPHERAL_ADC3                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 10),
+		PERIPHERAL_SDIO                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 11),
+		PERIPHERAL_SPI1                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 12),
+		PERIPHERAL_SYSCFG                = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 14),
+		PERIPHERAL_TIM9                  = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 16),
+		PERIPHERAL_TIM10                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 17),
+		PERIPHERAL_TIM11                 = clock_gate_id(Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, 18)
+	};
+
+	constexpr Clock_Gate_Bus clock_gate_bus(const Peripheral_Id id)
+	{
+		return static_cast<Clock_Gate_Bus>(static_cast<std::uint32_t>(id) >> CLOCK_GATE_BUS_SHIFT);
+	}
+
+	constexpr std::uint32_t clock_gate_mask(const Peripheral_Id id)
+	{
+		return 0x1U << (static_cast<std::uint32_t>(id) & CLOCK_GATE_BIT_MASK);
+	}
+
+	static_assert(clock_gate_bus(Peripheral_Id::PERIPHERAL_TIM11) == Clock_Gate_Bus::CLOCK_GATE_BUS_APB2, "Peripheral_Id bus field");
+	static_assert(clock_gate_mask(Peripheral_Id::PERIPHERAL_TIM11) == (0x1U << 18U), "Peripheral_Id bit field");
+
+	/* Use to take or drop a reference, ENR is written only on 0 -> 1 and 1 -> 0
+	 * At most CLOCK_GATE_COUNT_MAX references per peripheral. Returns false and changes
+	 * nothing on an enable past that limit or a disable without a reference, the caller
+	 * then holds no reference to drop later */
+	bool clock_gate_enable(const Peripheral_Id id);
+	bool clock_gate_disable(const Peripheral_Id id);
+
+	/* Use to keep (true) or gate (false) the clock in Sleep mode, one LPENR read-modify-write */
+	void clock_gate_sleep(const Peripheral_Id id, const bool run_in_sleep);
+
+	/* Use to gate every peripheral in Sleep mode that has no reference, LPENR = ENR on every bus */
+	void clock_gate_sleep_unused();
+
+	std::uint32_t clock_gate_get_count(const Peripheral_Id id);
+	bool clock_gate_is_enabled(const Peripheral_Id id);
+
+	/* Use to change several peripherals with one read-modify-write per bus
+	 * enable/disable/sleep only collect, commit() applies the reference counts and writes.
+	 * A peripheral counts once per batch however often it is staged */
+	class Clock_Gate_Batch
+	{
+		public:
+			constexpr Clock_Gate_Batch() :
+				enable_mask{ 0U, 0U, 0U, 0U, 0U },
+				disable_mask{ 0U, 0U, 0U, 0U, 0U },
+				sleep_set_mask{ 0U, 0U, 0U, 0U, 0U },
+				sleep_clear_mask{ 0U, 0U, 0U, 0U, 0U }
+			{
+			}
+
+			Clock_Gate_Batch& enable(const Peripheral_Id id);
+			Clock_Gate_Batch& disable(const Peripheral_Id id);
+			Clock_Gate_Batch& sleep(const Peripheral_Id id, const bool run_in_sleep);
+
+			/* Writes every ENR/LPENR with a staged change once, then clears the batch
+			 * Returns false and writes nothing when a staged enable would pass
+			 * CLOCK_GATE_COUNT_MAX or a staged disable has no reference, the batch stays staged */
+			bool commit();
+
+		private:
+			std::uint32_t enable_mask[CLOCK_GATE_BUS_COUNT];
+			std::uint32_t disable_mask[CLOCK_GATE_BUS_COUNT];
+			std::uint32_t sleep_set_mask[CLOCK_GATE_BUS_COUNT];
+			std::uint32_t sleep_clear_mask[CLOCK_GATE_BUS_COUNT];
+	};
+}
+
+#endif /* CLOCK_GATE_H */
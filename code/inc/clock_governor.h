@@ -0,0 +1,59 @@
+#ifndef CLOCK_GOVERNOR_H
+#define CLOCK_GOVERNOR_H
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+
+/** Clock Profiles:
+  * IDLE     = HSI 16MHz, PLL and HSE off
+  * BALANCED = PLL from HSI, 84MHz  (APB1 42MHz, APB2 84MHz)
+  * BURST    = PLL from HSI, 168MHz (APB1 42MHz, APB2 84MHz)
+  * The PLL profiles run from HSI so switching never waits on the crystal startup,
+  * only on a PLL relock.
+  */
+
+namespace bare_metal
+{
+	enum class Clock_Profile : std::uint8_t
+	{
+		CLOCK_PROFILE_IDLE               = (0x0),
+		CLOCK_PROFILE_BALANCED           = (0x1),
+		CLOCK_PROFILE_BURST              = (0x2)
+	};
+
+	using Clock_Profile_Idle = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSI, 16000000>;
+	using Clock_Profile_Balanced = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSI, 84000000, 84000000, 42000000, 84000000>;
+	using Clock_Profile_Burst = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSI, 168000000, 168000000, 42000000, 84000000>;
+
+	/* Indexed by Clock_Profile */
+	constexpr Clock_Config_Type CLOCK_PROFILE_CONFIG[] =
+	{
+		Clock_Profile_Idle::config,
+		Clock_Profile_Balanced::config,
+		Clock_Profile_Burst::config
+	};
+
+	class Clock_Governor
+	{
+		public:
+			constexpr Clock_Governor(Sys_Clock& sys_clock, const Clock_Profile profile = Clock_Profile::CLOCK_PROFILE_IDLE) : sys_clock(sys_clock), profile(profile)
+			{
+			}
+
+			/* Switches to the profile and returns the frequencies now in effect, always goes
+			 * through configure_clock() so a tree changed behind the governor is put back.
+			 * On failure the profile is left unchanged */
+			Frequency_Clock_Type switch_profile(const Clock_Profile profile);
+
+			/* The profile RCC and FLASH run now (read back), profile is only the answer when
+			 * the tree matches none of them */
+			Clock_Profile get_profile() const;
+
+		private:
+			Sys_Clock& sys_clock;
+			Clock_Profile profile;
+	};
+}
+
+#endif /* CLOCK_GOVERNOR_H */
@@ -0,0 +1,424 @@
+#ifndef CLOCK_SOLVER_H
+#define CLOCK_SOLVER_H
+
+#include <cstdint>
+#include <sys_clock.h>
+
+/** Compile-time clock solver
+  * Picks PLLM/PLLN/PLLP and the AHB/APB prescalers for a requested clock tree
+  * and emits the final RCC_PLLCFGR and RCC_CFGR words. Nothing is computed at runtime,
+  * an unreachable or out-of-spec request fails the build through static_assert.
+  *
+  * VCO Input  = PLLinput / PLLM              1 MHz <= VCO Input  <= 2 MHz
+  * VCO Output = VCO Input * PLLN           100 MHz <= VCO Output <= 432 MHz
+  * PLLCLK     = VCO Output / PLLP
+  * PLL48CLK   = VCO Output / PLLQ                     PLL48CLK   <= 48 MHz
+  *
+  * Usage:
+  * using Clock_168MHz = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSE, 168000000, 168000000, 42000000, 84000000>;
+  * sys_clock.configure_clock(Clock_168MHz::config);
+  *
+  * USB OTG FS needs PLL48CLK at exactly 48 MHz, Clock_Solver_Pll48 searches PLLM/PLLN/PLLP/PLLQ jointly
+  * for the highest SYSCLK that still gets it and runs the buses as fast as their limits allow:
+  * using Clock_Usb = Clock_Solver_Pll48<Sys_Oscillator_Type::OSC_TYPE_HSE>;
+  * sys_clock.configure_clock(Clock_Usb::config);
+  */
+
+namespace bare_metal
+{
+	/* Reference manual limits for the STM32F407 */
+	constexpr std::uint32_t FREQUENCY_SYSCLK_MAX     = (168000000);      /* 168MHz */
+	constexpr std::uint32_t FREQUENCY_HCLK_MAX       = (168000000);      /* 168MHz */
+	constexpr std::uint32_t FREQUENCY_P1CLK_MAX      = (42000000);       /* 42MHz */
+	constexpr std::uint32_t FREQUENCY_P2CLK_MAX      = (84000000);       /* 84MHz */
+	constexpr std::uint32_t FREQUENCY_VCO_INPUT_MIN  = (1000000);        /* 1MHz */
+	constexpr std::uint32_t FREQUENCY_VCO_INPUT_MAX  = (2000000);        /* 2MHz */
+	constexpr std::uint32_t FREQUENCY_VCO_OUTPUT_MIN = (100000000);      /* 100MHz */
+	constexpr std::uint32_t FREQUENCY_VCO_OUTPUT_MAX = (432000000);      /* 432MHz */
+	constexpr std::uint32_t FREQUENCY_PLL48_MAX      = (48000000);       /* 48MHz */
+	constexpr std::uint32_t FREQUENCY_FLASH_WS_STEP  = (30000000);       /* 30MHz per wait state at 2.7V - 3.6V */
+
+	/* Alternatives kept by clock_solve_pll48() */
+	constexpr std::uint32_t CLOCK_SOLVER_PARETO_MAX  = (8);
+
+	/* RCC_PLLCFGR value out of reset, used when the PLL is not part of the configuration */
+	constexpr std::uint32_t RCC_PLLCFGR_RESET        = (0x24003010);
+	/* PLLM, PLLN, PLLP, PLLSRC, PLLQ */
+	constexpr std::uint32_t RCC_PLLCFGR_FIELDS       = (0x0F437FFF);
+
+	enum class Clock_Solver_Status : std::uint8_t
+	{
+		STATUS_CLOCK_SOLVER_OK           = (0x0),
+		STATUS_CLOCK_SOLVER_NOK_INPUT    = (0x1),     /* PLL input must be HSI or HSE */
+		STATUS_CLOCK_SOLVER_NOK_PLL      = (0x2),     /* No PLLM/PLLN/PLLP reaches SYSCLK */
+		STATUS_CLOCK_SOLVER_NOK_AHB      = (0x3),     /* HCLK is not SYSCLK / Prescaler */
+		STATUS_CLOCK_SOLVER_NOK_APB1     = (0x4),     /* P1CLK is not HCLK / Prescaler */
+		STATUS_CLOCK_SOLVER_NOK_APB2     = (0x5),     /* P2CLK is not HCLK / Prescaler */
+		STATUS_CLOCK_SOLVER_NOK_I2S      = (0x6)      /* No PLLI2SN/PLLI2SR/I2SDIV for the sample rate */
+	};
+
+	/* Complete clock tree as it will be written to RCC */
+	struct Clock_Config_Type
+	{
+		Clock_Solver_Status status;
+		Sys_Oscillator_Type source_sysclk;    /* HSI, HSE or PLL drives SYSCLK */
+		Sys_Oscillator_Type source_pll;       /* HSI or HSE drives the PLL */
+		std::uint32_t pllm;                   /* Divider value 2 - 63 */
+		std::uint32_t plln;                   /* Multiplier value 50 - 432 */
+		std::uint32_t pllp;                   /* Divider value 2, 4, 6, 8 */
+		std::uint32_t pllq;                   /* Divider value 2 - 15 */
+		std::uint32_t register_pllcfgr;       /* Final RCC_PLLCFGR word */
+		std::uint32_t register_cfgr;          /* Final RCC_CFGR word (SW, HPRE, PPRE1, PPRE2) */
+		Flash_Latency flash_latency;
+		Frequency_Clock_Type frequency;
+	};
+
+	/* One PLL setting of the joint SYSCLK / PLL48CLK search */
+	struct Clock_Pll48_Candidate_Type
+	{
+		std::uint32_t pllm;
+		std::uint32_t plln;
+		std::uint32_t pllp;
+		std::uint32_t pllq;
+		std::uint32_t frequency_sysclk;
+		std::uint32_t frequency_pll48;        /* Never above 48 MHz, SDIO and RNG do not allow more */
+	};
+
+	/* Pareto front of SYSCLK against PLL48CLK error, closest to 48 MHz first
+	 * Every next entry trades a larger error for a strictly higher SYSCLK */
+	struct Clock_Pll48_Solution_Type
+	{
+		bool exact;                           /* pareto[0] runs PLL48CLK at exactly 48 MHz */
+		std::uint32_t count;
+		Clock_Pll48_Candidate_Type pareto[CLOCK_SOLVER_PARETO_MAX];
+	};
+
+	constexpr std::uint32_t clock_solver_input_frequency(const Sys_Oscillator_Type osc_type)
+	{
+		return (osc_type == Sys_Oscillator_Type::OSC_TYPE_HSE) ? FREQUENCY_HSE : FREQUENCY_HSI;
+	}
+
+	/* Wait states for a given HCLK, reference manual table 10 (2.7V - 3.6V) */
+	constexpr Flash_Latency clock_solver_flash_latency(const std::uint32_t frequency_hclk)
+	{
+		return static_cast<Flash_Latency>((frequency_hclk == 0U) ? 0U : ((frequency_hclk - 1U) / FREQUENCY_FLASH_WS_STEP));
+	}
+
+	/* Returns the HPRE field for SYSCLK / HCLK or 0xFF when the ratio is not a prescaler */
+	constexpr std::uint32_t clock_solver_prescaler_ahb(const std::uint32_t frequency_sysclk, const std::uint32_t frequency_hclk)
+	{
+		constexpr std::uint32_t divider[] = { 1U, 2U, 4U, 8U, 16U, 64U, 128U, 256U, 512U };
+		constexpr std::uint32_t field[] = { 0x0U, 0x8U, 0x9U, 0xAU, 0xBU, 0xCU, 0xDU, 0xEU, 0xFU };
+
+		for (std::uint32_t i = 0U; i < 9U; ++i)
+		{
+			if (frequency_hclk * divider[i] == frequency_sysclk)
+			{
+				return field[i];
+			}
+		}
+		return 0xFFU;
+	}
+
+	/* Returns the PPREx field for HCLK / PxCLK or 0xFF when the ratio is not a prescaler */
+	constexpr std::uint32_t clock_solver_prescaler_apb(const std::uint32_t frequency_hclk, const std::uint32_t frequency_pclk)
+	{
+		constexpr std::uint32_t divider[] = { 1U, 2U, 4U, 8U, 16U };
+		constexpr std::uint32_t field[] = { 0x0U, 0x4U, 0x5U, 0x6U, 0x7U };
+
+		for (std::uint32_t i = 0U; i < 5U; ++i)
+		{
+			if (frequency_pclk * divider[i] == frequency_hclk)
+			{
+				return field[i];
+			}
+		}
+		return 0xFFU;
+	}
+
+	/* Searches PLLM from the highest VCO input down (less jitter), then PLLP from the highest
+	 * VCO output down, and keeps the first exact PLLN. Fills pllm/plln/pllp/pllq on success. */
+	constexpr bool clock_solver_pll(Clock_Config_Type& config, const std::uint32_t frequency_input, const std::uint32_t frequency_sysclk)
+	{
+		for (std::uint32_t pllm = 2U; pllm <= 63U; ++pllm)
+		{
+			if ((frequency_input % pllm) != 0U)
+			{
+				continue;
+			}
+			const std::uint32_t frequency_vco_input = frequency_input / pllm;
+			if (frequency_vco_input < FREQUENCY_VCO_INPUT_MIN || frequency_vco_input > FREQUENCY_VCO_INPUT_MAX)
+			{
+				continue;
+			}
+			for (std::uint32_t pllp = 8U; pllp >= 2U; pllp -= 2U)
+			{
+				const std::uint64_t frequency_vco_output = static_cast<std::uint64_t>(frequency_sysclk) * pllp;
+				if ((frequency_vco_output % frequency_vco_input) != 0U)
+				{
+					continue;
+				}
+				const std::uint64_t plln = frequency_vco_output / frequency_vco_input;
+				if (plln < 50U || plln > 432U)
+				{
+					continue;
+				}
+				if (frequency_vco_output < FREQUENCY_VCO_OUTPUT_MIN || frequency_vco_output > FREQUENCY_VCO_OUTPUT_MAX)
+				{
+					continue;
+				}
+				/* Smallest PLLQ that keeps PLL48CLK in range */
+				std::uint32_t pllq = 2U;
+				while (pllq < 15U && (frequency_vco_output / pllq) > FREQUENCY_PLL48_MAX)
+				{
+					++pllq;
+				}
+				config.pllm = pllm;
+				config.plln = static_cast<std::uint32_t>(plln);
+				config.pllp = pllp;
+				config.pllq = pllq;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	constexpr std::uint32_t clock_solver_pllcfgr(const Clock_Config_Type& config)
+	{
+		return (config.pllm << 0U)
+		     | (config.plln << 6U)
+		     | (((config.pllp / 2U) - 1U) << 16U)
+		     | (((config.source_pll == Sys_Oscillator_Type::OSC_TYPE_HSE) ? 0x1U : 0x0U) << 22U)
+		     | (config.pllq << 24U);
+	}
+
+	/* Fastest HCLK / 1, 2, 4, 8, 16 that stays within frequency_max */
+	constexpr std::uint32_t clock_solver_pclk(const std::uint32_t frequency_hclk, const std::uint32_t frequency_max)
+	{
+		std::uint32_t divider = 1U;
+		while (divider < 16U && (frequency_hclk / divider) > frequency_max)
+		{
+			divider *= 2U;
+		}
+		return frequency_hclk / divider;
+	}
+
+	/* Best setting for one PLLM/PLLN pair: the smallest PLLP keeping SYSCLK within frequency_sysclk_max
+	 * and the smallest PLLQ keeping PLL48CLK within 48 MHz, any other PLLP/PLLQ is dominated by it.
+	 * False when the pair is outside the VCO limits or no PLLP/PLLQ fits */
+	constexpr bool clock_solver_pll48_candidate(Clock_Pll48_Candidate_Type& candidate,
+	                                            const std::uint32_t frequency_input,
+	                                            const std::uint32_t frequency_sysclk_max,
+	                                            const std::uint32_t pllm,
+	                                            const std::uint32_t plln)
+	{
+		/* VCO limits as fractions, PLLM does not have to divide the input */
+		if (frequency_input < FREQUENCY_VCO_INPUT_MIN * pllm || frequency_input > FREQUENCY_VCO_INPUT_MAX * pllm)
+		{
+			return false;
+		}
+		const std::uint64_t numerator = static_cast<std::uint64_t>(frequency_input) * plln;
+		if (numerator < static_cast<std::uint64_t>(FREQUENCY_VCO_OUTPUT_MIN) * pllm || numerator > static_cast<std::uint64_t>(FREQUENCY_VCO_OUTPUT_MAX) * pllm)
+		{
+			return false;
+		}
+		std::uint32_t pllp = 2U;
+		while (pllp <= 8U && (numerator / (pllm * pllp)) > frequency_sysclk_max)
+		{
+			pllp += 2U;
+		}
+		std::uint32_t pllq = 2U;
+		while (pllq <= 15U && (numerator / (pllm * pllq)) > FREQUENCY_PLL48_MAX)
+		{
+			++pllq;
+		}
+		if (pllp > 8U || pllq > 15U)
+		{
+			return false;
+		}
+		candidate = { pllm, plln, pllp, pllq, static_cast<std::uint32_t>(numerator / (pllm * pllp)), static_cast<std::uint32_t>(numerator / (pllm * pllq)) };
+		/* Exact 48 MHz only if nothing was rounded away */
+		if (candidate.frequency_pll48 == FREQUENCY_PLL48_MAX && (numerator % (pllm * pllq)) != 0U)
+		{
+			--candidate.frequency_pll48;
+		}
+		return true;
+	}
+
+	/* Joint PLLM/PLLN/PLLP/PLLQ search, each Pareto entry is one scan over every PLLM/PLLN pair:
+	 * the smallest PLL48CLK error among settings faster than the previous entry, ties go to the
+	 * higher SYSCLK, then to the smaller PLLM (higher VCO input, less jitter).
+	 * Fewer than CLOCK_SOLVER_PARETO_MAX entries means the front is complete */
+	constexpr Clock_Pll48_Solution_Type clock_solve_pll48(const std::uint32_t frequency_input, const std::uint32_t frequency_sysclk_max)
+	{
+		Clock_Pll48_Solution_Type solution{};
+		std::uint32_t frequency_floor = 0U;
+
+		while (solution.count < CLOCK_SOLVER_PARETO_MAX)
+		{
+			Clock_Pll48_Candidate_Type best{};
+			bool found = false;
+
+			for (std::uint32_t pllm = 2U; pllm <= 63U; ++pllm)
+			{
+				for (std::uint32_t plln = 50U; plln <= 432U; ++plln)
+				{
+					Clock_Pll48_Candidate_Type candidate{};
+					if (!clock_solver_pll48_candidate(candidate, frequency_input, frequency_sysclk_max, pllm, plln) ||
+					    candidate.frequency_sysclk <= frequency_floor)
+					{
+						continue;
+					}
+					if (!found ||
+					    candidate.frequency_pll48 > best.frequency_pll48 ||
+					    (candidate.frequency_pll48 == best.frequency_pll48 && candidate.frequency_sysclk > best.frequency_sysclk))
+					{
+						best = candidate;
+						found = true;
+					}
+				}
+			}
+			if (!found)
+			{
+				break;
+			}
+			solution.pareto[solution.count] = best;
+			++solution.count;
+			frequency_floor = best.frequency_sysclk;
+		}
+
+		solution.exact = (solution.count != 0U) && (solution.pareto[0].frequency_pll48 == FREQUENCY_PLL48_MAX);
+		return solution;
+	}
+
+	/* Clock tree around one candidate: HCLK = SYSCLK, APB1 and APB2 as fast as allowed */
+	constexpr Clock_Config_Type clock_solve_pll48_config(const Sys_Oscillator_Type osc_type, const Clock_Pll48_Candidate_Type& candidate)
+	{
+		Clock_Config_Type config{};
+		config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK;
+		config.source_sysclk = Sys_Oscillator_Type::OSC_TYPE_PLL;
+		config.source_pll = osc_type;
+		config.pllm = candidate.pllm;
+		config.plln = candidate.plln;
+		config.pllp = candidate.pllp;
+		config.pllq = candidate.pllq;
+		config.register_pllcfgr = clock_solver_pllcfgr(config);
+
+		const std::uint32_t frequency_hclk = candidate.frequency_sysclk;
+		const std::uint32_t ppre1 = clock_solver_prescaler_apb(frequency_hclk, clock_solver_pclk(frequency_hclk, FREQUENCY_P1CLK_MAX));
+		const std::uint32_t ppre2 = clock_solver_prescaler_apb(frequency_hclk, clock_solver_pclk(frequency_hclk, FREQUENCY_P2CLK_MAX));
+
+		config.register_cfgr = 0x2U | ((ppre1 & 0x7U) << 10U) | ((ppre2 & 0x7U) << 13U);
+		config.flash_latency = clock_solver_flash_latency(frequency_hclk);
+		config.frequency = sys_clock_decode(0x2U, config.register_cfgr, config.register_pllcfgr);
+		if (osc_type == Sys_Oscillator_Type::OSC_TYPE_PLL)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_INPUT;
+		}
+		else if (candidate.pllm == 0U)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_PLL;
+		}
+		return config;
+	}
+
+	constexpr Clock_Config_Type clock_solve(const Sys_Oscillator_Type osc_type,
+	                                        const std::uint32_t frequency_sysclk,
+	                                        const std::uint32_t frequency_hclk,
+	                                        const std::uint32_t frequency_p1clk,
+	                                        const std::uint32_t frequency_p2clk)
+	{
+		Clock_Config_Type config{};
+		config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK;
+		config.source_pll = osc_type;
+		config.register_pllcfgr = RCC_PLLCFGR_RESET;
+
+		if (osc_type == Sys_Oscillator_Type::OSC_TYPE_PLL)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_INPUT;
+			return config;
+		}
+
+		const std::uint32_t frequency_input = clock_solver_input_frequency(osc_type);
+		std::uint32_t sw = 0U;
+
+		if (frequency_sysclk == frequency_input)
+		{
+			/* Oscillator drives SYSCLK directly, PLL stays untouched */
+			config.source_sysclk = osc_type;
+			sw = (osc_type == Sys_Oscillator_Type::OSC_TYPE_HSE) ? 0x1U : 0x0U;
+		}
+		else if (clock_solver_pll(config, frequency_input, frequency_sysclk))
+		{
+			config.source_sysclk = Sys_Oscillator_Type::OSC_TYPE_PLL;
+			sw = 0x2U;
+			config.register_pllcfgr = clock_solver_pllcfgr(config);
+		}
+		else
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_PLL;
+			return config;
+		}
+
+		const std::uint32_t hpre = clock_solver_prescaler_ahb(frequency_sysclk, frequency_hclk);
+		const std::uint32_t ppre1 = clock_solver_prescaler_apb(frequency_hclk, frequency_p1clk);
+		const std::uint32_t ppre2 = clock_solver_prescaler_apb(frequency_hclk, frequency_p2clk);
+
+		if (hpre == 0xFFU)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_AHB;
+		}
+		else if (ppre1 == 0xFFU)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_APB1;
+		}
+		else if (ppre2 == 0xFFU)
+		{
+			config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_APB2;
+		}
+
+		config.register_cfgr = (sw << 0U) | ((hpre & 0xFU) << 4U) | ((ppre1 & 0x7U) << 10U) | ((ppre2 & 0x7U) << 13U);
+		config.flash_latency = clock_solver_flash_latency(frequency_hclk);
+		config.frequency = { frequency_sysclk, frequency_hclk, frequency_p1clk, frequency_p2clk };
+		return config;
+	}
+
+	/* Template front end, every limit is checked while compiling */
+	template <Sys_Oscillator_Type osc_type,
+	          std::uint32_t frequency_sysclk,
+	          std::uint32_t frequency_hclk = frequency_sysclk,
+	          std::uint32_t frequency_p1clk = frequency_hclk,
+	          std::uint32_t frequency_p2clk = frequency_hclk>
+	struct Clock_Solver
+	{
+		static_assert(frequency_sysclk <= FREQUENCY_SYSCLK_MAX, "SYSCLK exceeds 168 MHz");
+		static_assert(frequency_hclk <= FREQUENCY_HCLK_MAX, "HCLK exceeds 168 MHz");
+		static_assert(frequency_p2clk <= FREQUENCY_P2CLK_MAX, "P2CLK (APB2) exceeds 84 MHz");
+		static_assert(frequency_p1clk <= FREQUENCY_P1CLK_MAX, "P1CLK (APB1) exceeds 42 MHz");
+
+		static constexpr Clock_Config_Type config = clock_solve(osc_type, frequency_sysclk, frequency_hclk, frequency_p1clk, frequency_p2clk);
+
+		static_assert(config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_INPUT, "PLL input must be HSI or HSE");
+		static_assert(config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_PLL, "No PLLM/PLLN/PLLP keeps the VCO input in 1-2 MHz and output in 100-432 MHz for this SYSCLK");
+		static_assert(config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_AHB, "HCLK must be SYSCLK / 1, 2, 4, 8, 16, 64, 128, 256 or 512");
+		static_assert(config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_APB1, "P1CLK must be HCLK / 1, 2, 4, 8 or 16");
+		static_assert(config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_APB2, "P2CLK must be HCLK / 1, 2, 4, 8 or 16");
+	};
+
+	/* Highest SYSCLK up to frequency_sysclk_max with PLL48CLK at exactly 48 MHz
+	 * When the input cannot get there the build fails, clock_solve_pll48() lists what comes closest */
+	template <Sys_Oscillator_Type osc_type, std::uint32_t frequency_sysclk_max = FREQUENCY_SYSCLK_MAX>
+	struct Clock_Solver_Pll48
+	{
+		static_assert(osc_type != Sys_Oscillator_Type::OSC_TYPE_PLL, "PLL input must be HSI or HSE");
+		static_assert(frequency_sysclk_max <= FREQUENCY_SYSCLK_MAX, "SYSCLK exceeds 168 MHz");
+
+		static constexpr Clock_Pll48_Solution_Type solution = clock_solve_pll48(clock_solver_input_frequency(osc_type), frequency_sysclk_max);
+		static constexpr Clock_Config_Type config = clock_solve_pll48_config(osc_type, solution.pareto[0]);
+
+		static_assert(solution.count != 0U, "No PLLM/PLLN/PLLP/PLLQ keeps the VCO in range below this SYSCLK");
+		static_assert(solution.exact, "PLL48CLK cannot be exactly 48 MHz from this input, see clock_solve_pll48() for the closest settings");
+	};
+}
+
+#endif /* CLOCK_SOLVER_H */
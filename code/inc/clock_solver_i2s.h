@@ -0,0 +1,161 @@
+#ifndef CLOCK_SOLVER_I2S_H
+#define CLOCK_SOLVER_I2S_H
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+
+/** Compile-time I2S clock solver
+  * Picks PLLI2SN/PLLI2SR and the SPI_I2SPR prescaler (I2SDIV, ODD) for an audio sample rate with the
+  * lowest error. PLLI2S has no divider of its own, it runs from the main PLL input / PLLM, so the
+  * solution depends on the main clock tree it is paired with.
+  *
+  * VCO Input  = PLLinput / PLLM                         shared with the main PLL
+  * VCO Output = VCO Input * PLLI2SN           100 MHz <= VCO Output <= 432 MHz
+  * I2SCLK     = VCO Output / PLLI2SR                     I2SCLK     <= 192 MHz
+  * Fs         = I2SCLK / (256 * (2 * I2SDIV + ODD))      MCLK output on
+  * Fs         = I2SCLK / (2 * channel length * (2 * I2SDIV + ODD))
+  *
+  * Usage:
+  * using Clock_48kHz = Clock_Solver_I2s<Clock_168MHz, 48000, true>;
+  * sys_clock.configure_plli2s(Clock_48kHz::config);
+  * SPI_I2SPR = Clock_48kHz::config.register_i2spr (I2S driver)
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t FREQUENCY_I2SCLK_MAX     = (192000000);      /* 192MHz */
+	/* 2 * I2SDIV + ODD with I2SDIV 2 - 255 */
+	constexpr std::uint32_t CLOCK_SOLVER_I2S_DIV_MIN = (4);
+	constexpr std::uint32_t CLOCK_SOLVER_I2S_DIV_MAX = (511);
+	constexpr std::int64_t CLOCK_SOLVER_PPB          = (1000000000);
+
+	/* PLLI2S and SPI_I2SPR for one sample rate */
+	struct Clock_I2s_Config_Type
+	{
+		Clock_Solver_Status status;
+		std::uint32_t plli2sn;                /* Multiplier value 50 - 432 */
+		std::uint32_t plli2sr;                /* Divider value 2 - 7 */
+		std::uint32_t i2sdiv;                 /* Linear prescaler 2 - 255 */
+		std::uint32_t odd;                    /* Divider is 2 * I2SDIV + ODD */
+		bool mclk;                            /* MCKOE, MCLK = 256 * Fs on the MCK pin */
+		std::uint32_t register_plli2scfgr;    /* Final RCC_PLLI2SCFGR word */
+		std::uint32_t register_i2spr;         /* Final SPI_I2SPR word (I2SDIV, ODD, MCKOE) */
+		std::uint32_t frequency_i2sclk;
+		std::uint32_t frequency_sample;       /* Achieved Fs in mHz (1/1000 Hz) */
+		std::int32_t error_ppb;               /* Achieved / requested - 1 in parts per billion */
+	};
+
+	/* (numerator / denominator) / target - 1 in ppb, split in two so nothing overflows 64 bits */
+	constexpr std::int64_t clock_solver_i2s_error(const std::uint64_t numerator, const std::uint64_t denominator)
+	{
+		const std::int64_t difference = static_cast<std::int64_t>(numerator) - static_cast<std::int64_t>(denominator);
+		const std::int64_t scaled = difference * 1000000;
+		return (scaled / static_cast<std::int64_t>(denominator)) * 1000 +
+		       ((scaled % static_cast<std::int64_t>(denominator)) * 1000) / static_cast<std::int64_t>(denominator);
+	}
+
+	constexpr std::int64_t clock_solver_i2s_abs(const std::int64_t value)
+	{
+		return (value < 0) ? -value : value;
+	}
+
+	/* Tries every PLLI2SN/PLLI2SR pair with the two closest dividers, ties go to the lower VCO.
+	 * pllcfgr is the main RCC_PLLCFGR word, only PLLM and PLLSRC are used */
+	constexpr Clock_I2s_Config_Type clock_solve_i2s(const std::uint32_t pllcfgr,
+	                                                const std::uint32_t frequency_sample,
+	                                                const bool mclk,
+	                                                const std::uint32_t channel_bits)
+	{
+		Clock_I2s_Config_Type config{};
+		config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_NOK_I2S;
+		config.mclk = mclk;
+
+		const std::uint32_t pllm = pllcfgr & 0x3FU;
+		const std::uint32_t frequency_input = (pllcfgr & (0x1U << 22U)) ? FREQUENCY_HSE : FREQUENCY_HSI;
+		const std::uint32_t bit_clocks = mclk ? 256U : (2U * channel_bits);
+		if (pllm < 2U || frequency_input < FREQUENCY_VCO_INPUT_MIN * pllm || frequency_input > FREQUENCY_VCO_INPUT_MAX * pllm ||
+		    frequency_sample == 0U || (channel_bits != 16U && channel_bits != 32U))
+		{
+			return config;
+		}
+
+		std::int64_t error_best = 0;
+		for (std::uint32_t plli2sn = 50U; plli2sn <= 432U; ++plli2sn)
+		{
+			const std::uint64_t numerator = static_cast<std::uint64_t>(frequency_input) * plli2sn;
+			if (numerator < static_cast<std::uint64_t>(FREQUENCY_VCO_OUTPUT_MIN) * pllm || numerator > static_cast<std::uint64_t>(FREQUENCY_VCO_OUTPUT_MAX) * pllm)
+			{
+				continue;
+			}
+			for (std::uint32_t plli2sr = 2U; plli2sr <= 7U; ++plli2sr)
+			{
+				if (numerator > static_cast<std::uint64_t>(FREQUENCY_I2SCLK_MAX) * pllm * plli2sr)
+				{
+					continue;
+				}
+				/* Fs = numerator / (pllm * plli2sr * bit_clocks * div), div below and above the ideal one */
+				const std::uint64_t unit = static_cast<std::uint64_t>(pllm) * plli2sr * bit_clocks * frequency_sample;
+				const std::uint64_t div_floor = numerator / unit;
+				for (std::uint64_t div = div_floor; div <= div_floor + 1U; ++div)
+				{
+					if (div < CLOCK_SOLVER_I2S_DIV_MIN || div > CLOCK_SOLVER_I2S_DIV_MAX)
+					{
+						continue;
+					}
+					const std::int64_t error = clock_solver_i2s_error(numerator, unit * div);
+					if (config.status == Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK && clock_solver_i2s_abs(error) >= clock_solver_i2s_abs(error_best))
+					{
+						continue;
+					}
+					error_best = error;
+					config.status = Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK;
+					config.plli2sn = plli2sn;
+					config.plli2sr = plli2sr;
+					config.i2sdiv = static_cast<std::uint32_t>(div / 2U);
+					config.odd = static_cast<std::uint32_t>(div % 2U);
+					config.frequency_i2sclk = static_cast<std::uint32_t>(numerator / (static_cast<std::uint64_t>(pllm) * plli2sr));
+					config.frequency_sample = static_cast<std::uint32_t>((numerator * 1000U) / (unit / frequency_sample * div));
+				}
+			}
+		}
+
+		config.error_ppb = static_cast<std::int32_t>(error_best);
+		config.register_plli2scfgr = (config.plli2sn << 6U) | (config.plli2sr << 28U);
+		config.register_i2spr = config.i2sdiv | (config.odd << 8U) | ((mclk ? 0x1U : 0x0U) << 9U);
+		return config;
+	}
+
+	/* Template front end, pairs with the Clock_Solver that sets PLLM and the PLL source
+	 * error_ppm_max is the worst error the build accepts */
+	template <typename Pll_Solver,
+	          std::uint32_t frequency_sample,
+	          bool mclk,
+	          std::uint32_t channel_bits = 16,
+	          std::uint32_t error_ppm_max = 500>
+	struct Clock_Solver_I2s
+	{
+		static_assert(channel_bits == 16U || channel_bits == 32U, "I2S channel length is 16 or 32 bits");
+
+		static constexpr Clock_I2s_Config_Type config = clock_solve_i2s(Pll_Solver::config.register_pllcfgr, frequency_sample, mclk, channel_bits);
+
+		static_assert(config.status == Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK, "No PLLI2SN/PLLI2SR/I2SDIV reaches this sample rate with I2SCLK <= 192 MHz");
+		static_assert(clock_solver_i2s_abs(config.error_ppb) <= static_cast<std::int64_t>(error_ppm_max) * 1000, "Sample rate error above error_ppm_max");
+	};
+
+	/* HSE 8 MHz / 4 (VCO input 2 MHz) as Clock_Solver picks it for 168 MHz, and / 8 (1 MHz) for finer PLLI2SN steps */
+	constexpr std::uint32_t CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ = (0x1U << 22U) | 4U;
+	constexpr std::uint32_t CLOCK_SOLVER_I2S_PLLCFGR_HSE_1MHZ = (0x1U << 22U) | 8U;
+
+	/* MCLK: 2 MHz * 86 / 2 / (256 * 7) = 47991 Hz, -186 ppm, the I2SDIV step is the limit */
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ, 48000U, true, 16U).error_ppb == -186011, "48 kHz MCLK");
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_1MHZ, 44100U, true, 16U).error_ppb == 183059, "44.1 kHz MCLK");
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ, 96000U, true, 16U).error_ppb == -186011, "96 kHz MCLK");
+	/* No MCLK: 2 MHz * 96 / 5 / (32 * 25) = 48 kHz exactly */
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ, 48000U, false, 16U).error_ppb == 0, "48 kHz is exact");
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ, 48000U, false, 16U).register_i2spr == (12U | (0x1U << 8U)), "48 kHz I2SPR");
+	/* 2 * I2SDIV + ODD >= 4 keeps 192 kHz with MCLK out of reach below I2SCLK = 192 MHz */
+	static_assert(clock_solve_i2s(CLOCK_SOLVER_I2S_PLLCFGR_HSE_2MHZ, 192000U, true, 16U).error_ppb < -1000000, "192 kHz MCLK");
+}
+
+#endif /* CLOCK_SOLVER_I2S_H */
@@ -0,0 +1,106 @@
+#ifndef CLOCK_TRACE_H
+#define CLOCK_TRACE_H
+
+#include <cstdint>
+#include <dwt.h>
+
+/** Clock transition trace (build with -DBARE_METAL_CLOCK_TRACE)
+  * Every ready-bit wait in sys_clock.cpp (HSE ready, PLL lock, SWS switch ...), every FLASH_ACR
+  * latency write and every configure_clock() is timed with DWT CYCCNT into one record per boot.
+  * The last CLOCK_TRACE_BOOTS records sit in .noinit SRAM, they survive reset (not power loss)
+  * and are written before .data/.bss exist, Reset_Handler calls clock_trace_boot() first.
+  * Cycles are core clocks at whatever clock ran during the step, like startup_statistics.
+  *
+  * Reading it out:
+  * (gdb) dump binary value clock_trace.bin clock_trace_data
+  * $ code/host/clock_trace_decode clock_trace.bin          min/avg/max per step across boots
+  *
+  * Without the define the hooks are empty inlines and nothing is linked in.
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t CLOCK_TRACE_ENTRIES    = (24);             /* Steps per boot */
+	constexpr std::uint32_t CLOCK_TRACE_BOOTS      = (8);              /* Boots kept */
+	constexpr std::uint32_t CLOCK_TRACE_MAGIC      = (0xC10C9F01);     /* Changes with the layout */
+
+	enum class Clock_Trace_Event : std::uint8_t
+	{
+		CLOCK_TRACE_HSI_READY          = (0x0),      /* HSION -> HSIRDY */
+		CLOCK_TRACE_HSE_READY          = (0x1),      /* HSEON -> HSERDY, crystal startup */
+		CLOCK_TRACE_HSE_STOP           = (0x2),      /* HSEON = 0 -> HSERDY = 0 */
+		CLOCK_TRACE_PLL_LOCK           = (0x3),      /* PLLON -> PLLRDY */
+		CLOCK_TRACE_PLL_STOP           = (0x4),
+		CLOCK_TRACE_PLLI2S_LOCK        = (0x5),
+		CLOCK_TRACE_PLLI2S_STOP        = (0x6),
+		CLOCK_TRACE_SWS_SWITCH         = (0x7),      /* SW write -> SWS follows */
+		CLOCK_TRACE_FLASH_LATENCY      = (0x8),      /* FLASH_ACR LATENCY write and read back */
+		CLOCK_TRACE_CONFIGURE_CLOCK    = (0x9),      /* configure_clock() from entry to return */
+		CLOCK_TRACE_EVENT_COUNT        = (0xA)
+	};
+
+	struct Clock_Trace_Entry_Type
+	{
+		Clock_Trace_Event event;
+		std::uint8_t timeout;                 /* 1 when the wait gave up */
+		std::uint16_t reserved;
+		std::uint32_t start;                  /* CYCCNT when the step began, 0 = Reset_Handler */
+		std::uint32_t cycles;
+	};
+
+	struct Clock_Trace_Record_Type
+	{
+		std::uint32_t count;                  /* Entries used */
+		std::uint32_t dropped;                /* Steps past CLOCK_TRACE_ENTRIES */
+		Clock_Trace_Entry_Type entry[CLOCK_TRACE_ENTRIES];
+	};
+
+	/* Fixed width fields only, the host decoder reads a target dump with the same struct */
+	struct Clock_Trace_History_Type
+	{
+		std::uint32_t magic;
+		std::uint32_t boots;                  /* Boots since the history was cleared */
+		Clock_Trace_Record_Type record[CLOCK_TRACE_BOOTS];   /* record[(boots - 1) % BOOTS] is this boot */
+	};
+
+	static_assert(sizeof(Clock_Trace_Entry_Type) == 12U, "Clock_Trace_Entry_Type layout is shared with the host decoder");
+	static_assert(sizeof(Clock_Trace_History_Type) == 8U + CLOCK_TRACE_BOOTS * (8U + CLOCK_TRACE_ENTRIES * 12U), "Clock_Trace_History_Type layout");
+
+#if defined(BARE_METAL_CLOCK_TRACE)
+	extern Clock_Trace_History_Type clock_trace_data;
+
+	/* Starts this boot's record, clears the history if it is not valid (power-on). No .data/.bss needed */
+	void clock_trace_boot();
+
+	/* Drops every record */
+	void clock_trace_clear();
+
+	const Clock_Trace_History_Type& clock_trace_history();
+
+	/* Record of the running boot */
+	const Clock_Trace_Record_Type& clock_trace_current();
+
+	/* Hooks used by sys_clock.cpp */
+	inline std::uint32_t clock_trace_start()
+	{
+		return dwt_cycle_count();
+	}
+
+	void clock_trace_record(const Clock_Trace_Event event, const std::uint32_t start, const bool ok);
+#else
+	inline void clock_trace_boot()
+	{
+	}
+
+	inline std::uint32_t clock_trace_start()
+	{
+		return 0U;
+	}
+
+	inline void clock_trace_record(const Clock_Trace_Event, const std::uint32_t, const bool)
+	{
+	}
+#endif
+}
+
+#endif /* CLOCK_TRACE_H */
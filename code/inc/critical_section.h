@@ -0,0 +1,38 @@
+#ifndef CRITICAL_SECTION_H
+#define CRITICAL_SECTION_H
+
+#include <cstdint>
+
+/* Masks interrupts (PRIMASK) for the lifetime of the object and restores the previous
+ * state on destruction, so critical sections nest.
+ * On the host build there are no interrupts and this is a no-op. */
+
+namespace bare_metal
+{
+	class Critical_Section
+	{
+		public:
+			Critical_Section()
+			{
+#if !defined(BARE_METAL_HOST)
+				__asm volatile ("mrs %0, primask" : "=r" (this->primask));
+				__asm volatile ("cpsid i" ::: "memory");
+#endif
+			}
+
+			~Critical_Section()
+			{
+#if !defined(BARE_METAL_HOST)
+				__asm volatile ("msr primask, %0" :: "r" (this->primask) : "memory");
+#endif
+			}
+
+			Critical_Section(const Critical_Section&) = delete;
+			Critical_Section& operator =(const Critical_Section&) = delete;
+
+		private:
+			std::uint32_t primask = 0U;
+	};
+}
+
+#endif /* CRITICAL_SECTION_H */
@@ -0,0 +1,100 @@
+#ifndef DELAY_H
+#define DELAY_H
+
+#include <cstdint>
+#include <sys_clock.h>
+
+/** Busy-wait delays on DWT CYCCNT
+  * CYCCNT counts core clocks (HCLK), Reset_Handler turns it on. A delay in time becomes
+  * cycles = ceil(ns * HCLK / 10^9), so it is never shorter than asked, interrupts make it longer.
+  * delay_cycles() subtracts its own cost (call, first CYCCNT read, last compare), measured
+  * by delay_calibrate() because it depends on flash wait states and the ART accelerator.
+  *
+  * Where HCLK comes from:
+  * delay_ns(ns, frequency)           a Frequency_Clock_Type, e.g. sys_clock.get_frequency()
+  * delay_ns(ns)                      the Sys_Clock given to delay_attach(), follows every clock change,
+  *                                   also one that happens in the middle of the delay (ISR)
+  * delay_ns<Clock_168MHz, 250>()     cycles folded at compile time from a Clock_Solver tree
+  *
+  * Usage:
+  * delay_attach(startup_sys_clock);
+  * delay_us(10);                                     // 160 cycles at HSI, 1680 at 168MHz
+  * delay_ns<Clock_168MHz, 400>();                    // 68 cycles, no division at runtime
+  *
+  * At most 2^32 - 1 cycles per call, 25.5 s at 168MHz.
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint64_t DELAY_NS_PER_S           = (1000000000);
+	/* Cost of delay_cycles() until delay_calibrate() has measured it, Cortex-M4 at 0 wait states */
+	constexpr std::uint32_t DELAY_OVERHEAD_CYCLES    = (12);
+	/* Length of the calibration delay, long enough for several CYCCNT polls */
+	constexpr std::uint32_t DELAY_CALIBRATE_CYCLES   = (256);
+
+	/* Cycles at frequency_hclk that last at least ns, saturated to 32 bits */
+	constexpr std::uint32_t delay_cycles_ns(const std::uint64_t ns, const std::uint32_t frequency_hclk)
+	{
+		const std::uint64_t cycles = (ns * frequency_hclk + (DELAY_NS_PER_S - 1U)) / DELAY_NS_PER_S;
+		return (cycles > 0xFFFFFFFFU) ? 0xFFFFFFFFU : static_cast<std::uint32_t>(cycles);
+	}
+
+	constexpr std::uint32_t delay_cycles_us(const std::uint64_t us, const std::uint32_t frequency_hclk)
+	{
+		return delay_cycles_ns(us * 1000U, frequency_hclk);
+	}
+
+	static_assert(delay_cycles_ns(1000U, 168000000U) == 168U, "1us at 168MHz");
+	static_assert(delay_cycles_ns(400U, 168000000U) == 68U, "400ns at 168MHz rounds up from 67.2");
+	static_assert(delay_cycles_ns(1U, FREQUENCY_HSI) == 1U, "below one cycle is one cycle");
+	static_assert(delay_cycles_us(30000000U, 168000000U) == 0xFFFFFFFFU, "30s saturates");
+
+	/* Spins for cycles core clocks, call overhead included */
+	void delay_cycles(const std::uint32_t cycles);
+
+	/* Measures the overhead delay_cycles() subtracts, run again after changing flash wait states
+	 * or the ART accelerator. delay_attach() does it on every clock change */
+	void delay_calibrate();
+	std::uint32_t delay_overhead();
+
+	/* HCLK from a frequency snapshot, constant arguments fold, otherwise the conversion is
+	 * a 64 bit division on top of the delay. Prefer the attached or template form below 1us */
+	inline void delay_ns(const std::uint32_t ns, const Frequency_Clock_Type& frequency)
+	{
+		delay_cycles(delay_cycles_ns(ns, frequency.frequency_hclk));
+	}
+
+	inline void delay_us(const std::uint32_t us, const Frequency_Clock_Type& frequency)
+	{
+		delay_cycles(delay_cycles_us(us, frequency.frequency_hclk));
+	}
+
+	/* HCLK from the attached Sys_Clock (HSI 16MHz until delay_attach()), converted with a
+	 * fixed point factor kept per clock change: one 32 x 32 bit multiply, no division */
+	void delay_attach(Sys_Clock& sys_clock);
+	void delay_detach(Sys_Clock& sys_clock);
+	void delay_ns(const std::uint32_t ns);
+	void delay_us(const std::uint32_t us);
+
+	/* Compile time HCLK, Clock is a Clock_Solver (or anything with a constexpr config.frequency)
+	 * Only correct while that tree runs */
+	template <typename Clock, std::uint32_t ns>
+	inline void delay_ns()
+	{
+		constexpr std::uint64_t cycles = (static_cast<std::uint64_t>(ns) * Clock::config.frequency.frequency_hclk + (DELAY_NS_PER_S - 1U)) / DELAY_NS_PER_S;
+		static_assert(cycles <= 0xFFFFFFFFU, "Delay longer than 2^32 cycles");
+		if constexpr (cycles != 0U)
+		{
+			delay_cycles(static_cast<std::uint32_t>(cycles));
+		}
+	}
+
+	template <typename Clock, std::uint32_t us>
+	inline void delay_us()
+	{
+		static_assert(us <= 0xFFFFFFFFU / 1000U, "Use delay_ns range or split the delay");
+		delay_ns<Clock, us * 1000U>();
+	}
+}
+
+#endif /* DELAY_H */
@@ -0,0 +1,47 @@
+#ifndef DWT_H
+#define DWT_H
+
+#include <cstdint>
+
+/* Data Watchpoint and Trace (DWT) cycle counter
+ * CYCCNT counts every core clock (FCLK = HCLK) once TRCENA and CYCCNTENA are set
+ * 32 bit, wraps after 2^32 / 168000000 = 25.5 s at 168MHz */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t DWT_CTRL =                 (0xE0001000);
+	constexpr std::uint32_t DWT_CYCCNT =               (0xE0001004);
+	constexpr std::uint32_t SCB_DEMCR =                (0xE000EDFC);     /* Debug Exception and Monitor Control Register */
+
+#if defined(BARE_METAL_HOST)
+	/* Implemented by the host simulator, simulated cycles since mmio_simulator_reset() */
+	std::uint32_t mmio_simulator_cycle_count();
+
+	inline void dwt_enable_cycle_counter()
+	{
+	}
+
+	inline std::uint32_t dwt_cycle_count()
+	{
+		return mmio_simulator_cycle_count();
+	}
+#else
+	inline void dwt_enable_cycle_counter()
+	{
+		volatile std::uint32_t *scb_demcr = reinterpret_cast<volatile std::uint32_t *>(SCB_DEMCR);
+		volatile std::uint32_t *dwt_ctrl = reinterpret_cast<volatile std::uint32_t *>(DWT_CTRL);
+		volatile std::uint32_t *dwt_cyccnt = reinterpret_cast<volatile std::uint32_t *>(DWT_CYCCNT);
+
+		*scb_demcr |= (1U << 24U);   /* TRCENA, powers the DWT block */
+		*dwt_cyccnt = 0U;
+		*dwt_ctrl |= (1U << 0U);     /* CYCCNTENA */
+	}
+
+	inline std::uint32_t dwt_cycle_count()
+	{
+		return *reinterpret_cast<volatile std::uint32_t *>(DWT_CYCCNT);
+	}
+#endif
+}
+
+#endif /* DWT_H */
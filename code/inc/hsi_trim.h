@@ -0,0 +1,164 @@
+#ifndef HSI_TRIM_H
+#define HSI_TRIM_H
+
+#include <cstdint>
+#include <mmio.h>
+#include <sys_clock.h>
+
+/** HSI calibration against LSE or HSE
+  * The HSI RC oscillator is within +-1% out of the factory. Timer input capture counts HSI
+  * derived timer clocks over a known number of reference edges, HSITRIM (RCC_CR [7:3]) is
+  * moved to the value closest to 16MHz and the measured frequency goes into the Sys_Clock
+  * model, so baud rates and timeouts derived from HSI are right without waiting on the crystal.
+  *
+  * Reference   Timer input                                     Window
+  * LSE         TIM5 CH4, TI4_RMP = LSE, / 8 per capture        16 captures = 128 LSE periods = 3.9ms
+  * HSE         TIM11 CH1, TI1_RMP = HSE_RTC (HSE / RTCPRE)     512 captures at HSE / 8 / 8 = 4.1ms
+  *
+  * SYSCLK has to run from HSI or from a PLL fed by HSI so the timer clock scales with it.
+  * LSE has to be running already (2s startup), it usually is when the backup domain keeps the RTC.
+  * HSE is turned on for the measurement and off again if it was off, the HSE reference is NOK
+  * while a configure_clock_async() bring-up is pending, RCC_IRQHandler owns HSEON then.
+  *
+  * Usage:
+  * Sys_Clock hsi = Sys_Clock::adopt();
+  * if (!hsi_trim_restore(hsi))                        // trim from a previous boot, no wait
+  * {
+  *     const Hsi_Trim_Result_Type trim = hsi_trim_calibrate(hsi, Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE);
+  *     if (trim.status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) { hsi_trim_store(trim); }
+  * }
+  */
+
+namespace bare_metal
+{
+	typedef struct
+	{
+		Register_Type tim_cr1;                         /* TIMx + 0x00 */
+		Register_Type tim_cr2;                         /* TIMx + 0x04 */
+		Register_Type tim_smcr;                        /* TIMx + 0x08 */
+		Register_Type tim_dier;                        /* TIMx + 0x0C */
+		Register_Type tim_sr;                          /* TIMx + 0x10 */
+		Register_Type tim_egr;                         /* TIMx + 0x14 */
+		Register_Type tim_ccmr1;                       /* TIMx + 0x18 */
+		Register_Type tim_ccmr2;                       /* TIMx + 0x1C */
+		Register_Type tim_ccer;                        /* TIMx + 0x20 */
+		Register_Type tim_cnt;                         /* TIMx + 0x24 */
+		Register_Type tim_psc;                         /* TIMx + 0x28 */
+		Register_Type tim_arr;                         /* TIMx + 0x2C */
+		Register_Type tim_reserve_0;                   /* TIMx + 0x30 */
+		Register_Type tim_ccr1;                        /* TIMx + 0x34 */
+		Register_Type tim_ccr2;                        /* TIMx + 0x38 */
+		Register_Type tim_ccr3;                        /* TIMx + 0x3C */
+		Register_Type tim_ccr4;                        /* TIMx + 0x40 */
+		Register_Type tim_reserve_1;                   /* TIMx + 0x44 */
+		Register_Type tim_dcr;                         /* TIMx + 0x48 */
+		Register_Type tim_dmar;                        /* TIMx + 0x4C */
+		Register_Type tim_or;                          /* TIMx + 0x50 */
+	} Timer_Register_Handle;
+
+	typedef struct
+	{
+		Register_Type pwr_cr;                          /* 4000 7000 + 0x00 */
+		Register_Type pwr_csr;                         /* 4000 7000 + 0x04 */
+	} Pwr_Register_Handle;
+
+	typedef struct
+	{
+		Register_Type rtc_reserve[20];                 /* 4000 2800 + 0x00 - 0x4C */
+		Register_Type rtc_bkpr[20];                    /* 4000 2800 + 0x50 - 0x9C */
+	} Rtc_Register_Handle;
+
+	constexpr std::uint32_t TIM5_BASE_ADDRESS      = (0x40000C00);
+	constexpr std::uint32_t TIM11_BASE_ADDRESS     = (0x40014800);
+	constexpr std::uint32_t PWR_BASE_ADDRESS       = (0x40007000);
+	constexpr std::uint32_t RTC_BASE_ADDRESS       = (0x40002800);
+
+#if defined(BARE_METAL_HOST)
+	/* Simulated registers, see code/host/mmio_simulator.cpp */
+	extern Timer_Register_Handle mmio_tim5;
+	extern Timer_Register_Handle mmio_tim11;
+	extern Pwr_Register_Handle mmio_pwr;
+	extern Rtc_Register_Handle mmio_rtc;
+
+	#define TIM5              (&mmio_tim5)
+	#define TIM11             (&mmio_tim11)
+	#define PWR               (&mmio_pwr)
+	#define RTC               (&mmio_rtc)
+#else
+	#define TIM5              ((Timer_Register_Handle *)(TIM5_BASE_ADDRESS))
+	#define TIM11             ((Timer_Register_Handle *)(TIM11_BASE_ADDRESS))
+	#define PWR               ((Pwr_Register_Handle *)(PWR_BASE_ADDRESS))
+	#define RTC               ((Rtc_Register_Handle *)(RTC_BASE_ADDRESS))
+#endif
+
+	constexpr std::uint32_t FREQUENCY_LSE            = (32768);          /* 32.768kHz */
+	/* HSI change per HSITRIM step, reference manual: around 80kHz */
+	constexpr std::uint32_t FREQUENCY_HSI_TRIM_STEP  = (80000);
+	constexpr std::uint32_t HSI_TRIM_DEFAULT         = (16);
+	constexpr std::uint32_t HSI_TRIM_MAX             = (31);
+
+	/* Reference edges per capture (ICxPSC = 8) and captures per measurement */
+	constexpr std::uint32_t HSI_TRIM_CAPTURE_EDGES   = (8);
+	constexpr std::uint32_t HSI_TRIM_CAPTURES_LSE    = (16);
+	constexpr std::uint32_t HSI_TRIM_CAPTURES_HSE    = (512);
+	/* HSE_RTC = 8MHz / 8 = 1MHz, the RTC limit */
+	constexpr std::uint32_t HSI_TRIM_RTCPRE          = (8);
+	/* Register polls for one capture, the slowest (LSE / 8) is about 1000 polls */
+	constexpr std::uint32_t HSI_TRIM_TIMEOUT         = (16000);
+	/* Measurements after the first estimate, each one moves HSITRIM by one step */
+	constexpr std::uint32_t HSI_TRIM_STEPS_MAX       = (4);
+
+	/* RTC_BKP19R: [31:24] magic, [20:16] HSITRIM, RTC_BKP18R: measured HSI in Hz */
+	constexpr std::uint32_t HSI_TRIM_BACKUP_TRIM     = (19);
+	constexpr std::uint32_t HSI_TRIM_BACKUP_FREQUENCY = (18);
+	constexpr std::uint32_t HSI_TRIM_BACKUP_MAGIC    = (0xB5000000);
+
+	enum class Hsi_Trim_Reference : std::uint8_t
+	{
+		HSI_TRIM_REFERENCE_LSE           = (0x0),
+		HSI_TRIM_REFERENCE_HSE           = (0x1)
+	};
+
+	struct Hsi_Trim_Result_Type
+	{
+		Frequency_Sys_Clock_Status status;
+		std::uint32_t trim;                   /* HSITRIM written to RCC_CR */
+		std::uint32_t frequency_hsi;          /* Measured at that trim */
+		std::int32_t error_ppm;               /* Against 16MHz */
+	};
+
+	/* Error of a measured HSI against 16MHz in ppm */
+	constexpr std::int32_t hsi_trim_error_ppm(const std::uint32_t frequency_hsi)
+	{
+		return static_cast<std::int32_t>((static_cast<std::int64_t>(frequency_hsi) - FREQUENCY_HSI) * 1000000 / FREQUENCY_HSI);
+	}
+
+	/* HSITRIM that moves frequency_hsi (measured at trim) closest to 16MHz, by the nominal step */
+	constexpr std::uint32_t hsi_trim_estimate(const std::uint32_t trim, const std::uint32_t frequency_hsi)
+	{
+		const std::int64_t error = static_cast<std::int64_t>(FREQUENCY_HSI) - frequency_hsi;
+		const std::int64_t steps = (error + ((error < 0) ? -static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP / 2U) : static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP / 2U))) /
+		                           static_cast<std::int64_t>(FREQUENCY_HSI_TRIM_STEP);
+		const std::int64_t estimate = static_cast<std::int64_t>(trim) + steps;
+		return static_cast<std::uint32_t>((estimate < 0) ? 0 : ((estimate > HSI_TRIM_MAX) ? HSI_TRIM_MAX : estimate));
+	}
+
+	static_assert(hsi_trim_estimate(16U, 16000000U) == 16U, "already trimmed");
+	static_assert(hsi_trim_estimate(16U, 15850000U) == 18U, "-150kHz is two steps up");
+	static_assert(hsi_trim_estimate(1U, 16400000U) == 0U, "clamped at 0");
+	static_assert(hsi_trim_error_ppm(16160000U) == 10000, "+1%");
+
+	/* Measures HSI against reference at the current HSITRIM, 0 on failure. Nothing is changed */
+	std::uint32_t hsi_trim_measure(const Hsi_Trim_Reference reference, Frequency_Sys_Clock_Status& status);
+
+	/* Measures, moves HSITRIM to the best value and hands the measured frequency to sys_clock */
+	Hsi_Trim_Result_Type hsi_trim_calibrate(Sys_Clock& sys_clock, const Hsi_Trim_Reference reference);
+
+	/* Keeps a calibration in the RTC backup registers, survives reset as long as VBAT does */
+	void hsi_trim_store(const Hsi_Trim_Result_Type& result);
+
+	/* Applies a stored calibration (HSITRIM and frequency), false if there is none */
+	bool hsi_trim_restore(Sys_Clock& sys_clock);
+}
+
+#endif /* HSI_TRIM_H */
@@ -0,0 +1,142 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <cstdint>
+
+/** Fixed priority preemptive kernel
+  * Priority 0 is the highest, like the NVIC. The highest priority ready task always runs,
+  * tasks of the same priority share the CPU round robin, KERNEL_TIME_SLICE ticks each.
+  * An idle task below every priority runs time_base_idle() (tickless) when nothing is ready.
+  *
+  * Context switch: PendSV at the lowest exception priority, so it only runs once no ISR is
+  * active and a burst of wake-ups costs one switch. Hardware stacks r0-r3, r12, lr, pc, xPSR
+  * on the task stack (PSP), PendSV adds r4-r11 and EXC_RETURN. A task that used the FPU also
+  * gets s16-s31, s0-s15/FPSCR are stacked lazily by the hardware only if PendSV touches the FPU
+  * (it does not), tasks that never use the FPU pay nothing.
+  * Time: the kernel is a Tick_Observer of the SysTick time base (Nvic), ticks drive sleeping
+  * and time slices. kernel_start() puts PendSV at 0xF0, SysTick and the ISRs that call
+  * kernel_resume() may have any priority, the kernel lists are guarded by PRIMASK.
+  *
+  * Stacks are static, sized by the caller, painted at creation so kernel_stack_unused() tells
+  * how deep a task went. The main stack (MSP) stays the handler stack.
+  *
+  * Usage:
+  * static Kernel_Task control_task;
+  * static Kernel_Stack_Type<256> control_stack;
+  * static void control_loop(void*)
+  * {
+  * 	std::uint32_t wake = kernel_tick_count();
+  * 	for (;;) { kernel_sleep_until(wake += 1U); run_control(); }     // every tick, no drift
+  * }
+  * kernel_task_create(control_task, control_stack, control_loop, nullptr, 0);
+  * kernel_start();                                                  // does not return
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t KERNEL_PRIORITIES        = (8);              /* 0 (highest) to 7, idle below */
+	constexpr std::uint32_t KERNEL_TIME_SLICE        = (5);              /* Ticks before an equal priority task gets the CPU */
+	constexpr std::uint32_t KERNEL_STACK_WORDS_MIN   = (64);             /* Both frames with FPU (50 words) and a few calls */
+	constexpr std::uint32_t KERNEL_STACK_PAINT       = (0xDEADBEEF);
+
+	using Kernel_Entry = void (*)(void* argument);
+
+	enum class Kernel_Task_State : std::uint8_t
+	{
+		KERNEL_TASK_DORMANT          = (0x0),      /* Not created or returned from its entry */
+		KERNEL_TASK_READY            = (0x1),      /* Running or waiting for the CPU */
+		KERNEL_TASK_SLEEPING         = (0x2),      /* Until a tick, or kernel_resume() */
+		KERNEL_TASK_SUSPENDED        = (0x3)       /* Until kernel_resume() */
+	};
+
+	/* Task stack, 8 byte aligned as the AAPCS and the exception frame need */
+	template <std::uint32_t words>
+	struct Kernel_Stack_Type
+	{
+		static_assert(words >= KERNEL_STACK_WORDS_MIN, "Task stack below KERNEL_STACK_WORDS_MIN");
+		static_assert((words & 0x1U) == 0U, "Task stack has to be a multiple of 8 bytes");
+		alignas(8) std::uint32_t stack[words];
+	};
+
+	/* Task control block, caller owned (static) storage, nothing is allocated */
+	class Kernel_Task
+	{
+		public:
+			constexpr Kernel_Task()
+			{
+			}
+
+			Kernel_Task(const Kernel_Task&) = delete;
+			Kernel_Task& operator =(const Kernel_Task&) = delete;
+
+			Kernel_Task_State get_state() const { return this->state; }
+			std::uint32_t get_priority() const { return this->priority; }
+
+		private:
+			friend class Kernel_Scheduler;
+
+			std::uint32_t* stack_pointer = nullptr;       /* Saved PSP, offset 0: PendSV stores and loads it */
+			std::uint32_t* stack_base = nullptr;
+			std::uint32_t stack_words = 0U;
+			Kernel_Task* next = nullptr;                  /* Ready list of its priority or the sleep list */
+			std::uint32_t wake_tick = 0U;
+			std::uint8_t priority = 0U;
+			Kernel_Task_State state = Kernel_Task_State::KERNEL_TASK_DORMANT;
+			std::uint8_t slice = 0U;                      /* Ticks left in the time slice */
+	};
+
+	/* Makes task ready at priority (0 highest), before or after kernel_start(). A task that
+	 * returns from entry ends as if it called kernel_exit(). False if the task is still alive,
+	 * the priority out of range or the stack too small */
+	bool kernel_task_create(Kernel_Task& task, std::uint32_t* stack, const std::uint32_t stack_words,
+	                        Kernel_Entry entry, void* argument, const std::uint32_t priority);
+
+	template <std::uint32_t words>
+	inline bool kernel_task_create(Kernel_Task& task, Kernel_Stack_Type<words>& stack, Kernel_Entry entry, void* argument, const std::uint32_t priority)
+	{
+		return kernel_task_create(task, stack.stack, words, entry, argument, priority);
+	}
+
+	/* Runs the highest priority task, SysTick (Nvic) has to be running. Does not return on the target,
+	 * returns on the host once the simulator stops */
+	void kernel_start();
+
+	/* Calling task ---------------------------------------------------------------------------- */
+
+	/* Hands the CPU to the next task of the same priority, no-op if there is none */
+	void kernel_yield();
+
+	/* ticks = 0 is kernel_yield(). A kernel_resume() wakes the task early */
+	void kernel_sleep(const std::uint32_t ticks);
+
+	/* Until kernel_tick_count() reaches wake_tick, returns at once if it already passed.
+	 * Periodic tasks add their period to wake_tick, late wake-ups do not accumulate */
+	void kernel_sleep_until(const std::uint32_t wake_tick);
+
+	/* Until kernel_resume() from another task or an ISR */
+	void kernel_suspend();
+
+	/* Ends the calling task, its stack can be reused for a new kernel_task_create() */
+	void kernel_exit();
+
+	/* Any context, including ISRs ------------------------------------------------------------- */
+
+	/* Makes a sleeping or suspended task ready, a higher priority one preempts right away
+	 * (from an ISR: once no other ISR is active) */
+	void kernel_resume(Kernel_Task& task);
+
+	Kernel_Task* kernel_current();
+	std::uint32_t kernel_tick_count();
+
+	/* Context switches since kernel_start() */
+	std::uint32_t kernel_switch_count();
+
+	/* Words at the bottom of the stack never written, 0 means it probably overflowed */
+	std::uint32_t kernel_stack_unused(const Kernel_Task& task);
+
+	/* Advances the kernel by ticks, the time base calls it from SysTick_Handler (or after a
+	 * tickless sleep). Wakes sleepers, runs the time slice and requests the switch */
+	void kernel_tick(const std::uint32_t ticks);
+}
+
+#endif /* KERNEL_H */
@@ -0,0 +1,142 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <dwt.h>
+
+/** Deferred binary logging (build with -DBARE_METAL_LOG)
+  * LOG("pll lock after %u cycles", cycles) never formats on the target. The format string is
+  * a static array in the log_fmt section, which the linker script places at address 0 as
+  * (INFO): it is in the ELF but takes no flash, and its address is its offset, the string ID.
+  * The call only writes a record of raw words into a RAM ring:
+  * 	[31:28] argument count, [27:0] string ID
+  * 	DWT CYCCNT
+  * 	one word per argument: integers, enums, bool, pointers as is, float as its bits
+  * log_drain() hands the ring to a sink (UART, SWO, a RAM buffer the debugger reads) from
+  * thread mode, code/host/log_decode formats the words against the ELF on Linux:
+  * $ code/host/log_decode firmware.elf capture.bin
+  * (gdb) dump binary value log.bin log_ring            the ring itself, not yet drained
+  * $ code/host/log_decode firmware.elf --ring log.bin
+  *
+  * LOG() may be called from any context, producers are serialised by PRIMASK for the few
+  * stores of one record. A full ring drops the record and the next one that fits is preceded
+  * by a LOG_ID_DROPPED record with the count. 64 bit arguments and %s are not supported.
+  * Sys_Clock logs source switches, prescaler changes, flash latency writes and wait timeouts.
+  *
+  * Without the define LOG() compiles to nothing and log.cpp is empty.
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t LOG_WORDS                = (1024);           /* Ring size, 4KB */
+	constexpr std::uint32_t LOG_ARGUMENTS_MAX        = (8);
+	constexpr std::uint32_t LOG_RECORD_WORDS_MAX     = (2 + LOG_ARGUMENTS_MAX);
+	constexpr std::uint32_t LOG_ID_MASK              = (0x0FFFFFFF);
+	constexpr std::uint32_t LOG_ID_DROPPED           = (0x0FFFFFFF);     /* One argument, records lost before this one */
+
+#if defined(BARE_METAL_LOG)
+	constexpr bool LOG_ENABLED = true;
+#else
+	constexpr bool LOG_ENABLED = false;
+#endif
+
+	constexpr std::uint32_t log_header(const std::uint32_t id, const std::uint32_t arguments)
+	{
+		return (arguments << 28U) | (id & LOG_ID_MASK);
+	}
+
+	constexpr std::uint32_t log_header_arguments(const std::uint32_t header)
+	{
+		return header >> 28U;
+	}
+
+	static_assert(log_header_arguments(log_header(0x123U, LOG_ARGUMENTS_MAX)) == LOG_ARGUMENTS_MAX, "Argument count fits the header");
+
+	/* Receives the ring in up to two contiguous spans per log_drain() */
+	using Log_Sink = void (*)(const std::uint32_t* words, std::uint32_t count);
+
+	/* One word per argument, the decoder picks the type from the conversion in the format */
+	template <typename Argument>
+	inline std::uint32_t log_word(const Argument argument)
+	{
+		static_assert(sizeof(Argument) <= sizeof(std::uint32_t) || std::is_pointer<Argument>::value, "LOG arguments are at most 32 bits");
+		if constexpr (std::is_floating_point<Argument>::value)
+		{
+			std::uint32_t word;
+			std::memcpy(&word, &argument, sizeof(word));
+			return word;
+		}
+		else if constexpr (std::is_pointer<Argument>::value)
+		{
+			/* Host pointers are truncated, only the target's fit */
+			return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(argument));
+		}
+		else
+		{
+			return static_cast<std::uint32_t>(argument);
+		}
+	}
+
+	/* Appends one record, drops it when the ring is full. Safe from any context */
+	void log_push(const std::uint32_t* words, const std::uint32_t count);
+
+	template <typename... Arguments>
+	inline void log_write(const std::uint32_t id, const Arguments... arguments)
+	{
+		static_assert(sizeof...(Arguments) <= LOG_ARGUMENTS_MAX, "At most LOG_ARGUMENTS_MAX arguments per record");
+		const std::uint32_t words[] = { log_header(id, sizeof...(Arguments)), dwt_cycle_count(), log_word(arguments)... };
+		log_push(words, sizeof(words) / sizeof(words[0]));
+	}
+
+	/* Disabled LOG(), arguments are checked but not evaluated */
+	template <typename... Arguments>
+	inline void log_discard(const Arguments...)
+	{
+	}
+
+	/* Consumer side, one context only (thread mode). Returns the words handed to sink */
+	std::uint32_t log_drain(Log_Sink sink);
+
+	/* Records lost to a full ring since boot */
+	std::uint32_t log_dropped();
+
+	/* Empties the .noinit ring, Reset_Handler calls it before the first LOG() */
+#if defined(BARE_METAL_LOG)
+	void log_boot();
+#else
+	inline void log_boot()
+	{
+	}
+#endif
+}
+
+#if defined(BARE_METAL_HOST)
+/* The host has no linker script, GNU ld brackets a section named like an identifier */
+extern "C" const char __start_log_fmt[];
+#define LOG_ID(format) static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(format) - reinterpret_cast<std::uintptr_t>(__start_log_fmt))
+#else
+/* log_fmt is linked at address 0 */
+#define LOG_ID(format) static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(format))
+#endif
+
+#if defined(BARE_METAL_LOG)
+#define LOG(format, ...)                                                                                  \
+	do                                                                                                    \
+	{                                                                                                     \
+		__attribute__((section("log_fmt"), used)) static const char log_format[] = format;                \
+		::bare_metal::log_write(LOG_ID(log_format), ##__VA_ARGS__);                                       \
+	} while (0)
+#else
+#define LOG(format, ...)                                                                                  \
+	do                                                                                                    \
+	{                                                                                                     \
+		if (false)                                                                                        \
+		{                                                                                                 \
+			::bare_metal::log_discard(format, ##__VA_ARGS__);                                             \
+		}                                                                                                 \
+	} while (0)
+#endif
+
+#endif /* LOG_H */
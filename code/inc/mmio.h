@@ -0,0 +1,93 @@
+#ifndef MMIO_H
+#define MMIO_H
+
+#include <cstdint>
+
+/** Memory mapped register type used by the register handles
+  * Default:
+  * 	Register_Type = volatile std::uint32_t, every access is one bus transaction
+  * BARE_METAL_BUS_COUNTER:
+  * 	Register_Type wraps the same 32 bit storage and counts every read and write,
+  * 	used to measure how many bus round-trips a clock sequence costs
+  * 	x |= mask = 1 read + 1 write
+  * 	x = value = 1 write
+  * 	(x & mask) = 1 read
+  * BARE_METAL_HOST:
+  * 	Register_Type is backed by the host simulator (code/host/mmio_simulator.cpp),
+  * 	every access goes through mmio_simulator_read()/mmio_simulator_write() and is always counted
+  */
+
+#if defined(BARE_METAL_HOST) && !defined(BARE_METAL_BUS_COUNTER)
+	#define BARE_METAL_BUS_COUNTER
+#endif
+
+namespace bare_metal
+{
+	struct Bus_Access_Counter_Type
+	{
+		std::uint32_t reads;
+		std::uint32_t writes;
+	};
+
+#if defined(BARE_METAL_BUS_COUNTER)
+	extern Bus_Access_Counter_Type bus_access_counter;
+
+	class Mmio_Register;
+
+#if defined(BARE_METAL_HOST)
+	/* Implemented by the host simulator, return the value the register reads as or stores */
+	std::uint32_t mmio_simulator_read(const Mmio_Register* reg, const std::uint32_t value);
+	std::uint32_t mmio_simulator_write(const Mmio_Register* reg, const std::uint32_t old_value, const std::uint32_t value);
+#endif
+
+	class Mmio_Register
+	{
+		public:
+			operator std::uint32_t() const
+			{
+				++bus_access_counter.reads;
+#if defined(BARE_METAL_HOST)
+				this->value = mmio_simulator_read(this, this->value);
+#endif
+				return this->value;
+			}
+
+			Mmio_Register& operator =(const std::uint32_t value)
+			{
+				++bus_access_counter.writes;
+#if defined(BARE_METAL_HOST)
+				this->value = mmio_simulator_write(this, this->value, value);
+#else
+				this->value = value;
+#endif
+				return *this;
+			}
+
+			Mmio_Register& operator =(const Mmio_Register& other)
+			{
+				return *this = static_cast<std::uint32_t>(other);
+			}
+
+			Mmio_Register& operator |=(const std::uint32_t mask) { return *this = (static_cast<std::uint32_t>(*this) | mask); }
+			Mmio_Register& operator &=(const std::uint32_t mask) { return *this = (static_cast<std::uint32_t>(*this) & mask); }
+			Mmio_Register& operator ^=(const std::uint32_t mask) { return *this = (static_cast<std::uint32_t>(*this) ^ mask); }
+
+		private:
+#if defined(BARE_METAL_HOST)
+			mutable volatile std::uint32_t value;
+#else
+			volatile std::uint32_t value;
+#endif
+	};
+
+	typedef Mmio_Register Register_Type;
+#else
+	typedef volatile std::uint32_t Register_Type;
+#endif
+
+	/* Always {0, 0} unless built with BARE_METAL_BUS_COUNTER */
+	Bus_Access_Counter_Type bus_access_counter_get();
+	void bus_access_counter_reset();
+}
+
+#endif /* MMIO_H */
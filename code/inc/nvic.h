@@ -6,6 +6,7 @@
 
 /* 16000000 Hz = 6.25 x 10^-8 s
  * 1000 Hz = 1 x 10^-3 s delay 
+ * SysTick period from a Hz value, busy-wait delays below one tick are in delay.h
  */
 
 namespace bare_metal
@@ -14,36 +15,274 @@ namespace bare_metal
 	constexpr std::uint32_t SYST_RVR =                 (0xE000E014);
 	constexpr std::uint32_t SYST_CVR =                 (0xE000E018);
 	constexpr std::uint32_t SYST_CLALIB =              (0xE000E01C);
+	constexpr std::uint32_t NVIC_ISER =                (0xE000E100);     /* Interrupt Set-Enable Registers, 1 bit per IRQ, write 1 */
+	constexpr std::uint32_t NVIC_ICER =                (0xE000E180);     /* Interrupt Clear-Enable Registers */
+	constexpr std::uint32_t NVIC_ISPR =                (0xE000E200);     /* Interrupt Set-Pending Registers */
+	constexpr std::uint32_t NVIC_ICPR =                (0xE000E280);     /* Interrupt Clear-Pending Registers */
+	constexpr std::uint32_t NVIC_IABR =                (0xE000E300);     /* Interrupt Active Bit Registers */
+	constexpr std::uint32_t NVIC_IPR =                 (0xE000E400);     /* Interrupt Priority Registers, 1 byte per IRQ */
+	constexpr std::uint32_t NVIC_STIR =                (0xE000EF00);     /* Software Trigger Interrupt Register */
+	constexpr std::uint32_t SCB_ICSR =                 (0xE000ED04);     /* System Control Block (SCB) Interrupt Control and State Register */
+	constexpr std::uint32_t SCB_AIRCR =                (0xE000ED0C);     /* Application Interrupt and Reset Control Register */
+	constexpr std::uint32_t SCB_SHPR =                 (0xE000ED18);     /* System Handler Priority Registers, 1 byte per exception 4 - 15 */
 	constexpr std::uint32_t SCB_SHCRS =                (0xE000ED24);     /* System Control Block (SCB) System Handler Control and State Register  */
 
+	constexpr std::uint32_t SCB_AIRCR_VECTKEY =        (0x05FA0000);     /* Writes to AIRCR are ignored without it */
+	constexpr std::uint32_t NVIC_PRIORITY_BITS =       (4);              /* STM32F4 implements the upper 4 bits of every priority byte */
+	constexpr std::uint32_t NVIC_IRQ_COUNT =           (82);
+	constexpr std::uint32_t SYST_RELOAD_MAX =          (0x00FFFFFF);     /* SYST_RVR is 24 bits wide */
+
+	enum class Nvic_Status : std::uint8_t
+	{
+		STATUS_NVIC_OK                       = (0x0),
+		STATUS_NVIC_NOK_SYSTICK              = (0x1)       /* HCLK / rate - 1 does not fit SYST_RVR, or rate is 0 */
+	};
+
+	/* Cortex-M4 exception numbers */
 	enum class System_Exception_Number : std::uint8_t
 	{
-		EXCEPTION_MEMFAULT                   = (0x0)
-		EXCEPTION_BUSFAULT                   = (0x1)
-		EXCEPTION_USAGEFAULT                 = (0x3)
-		EXCEPTION_HARDFAULT                  = 
-		EXCEPTION_SVC
-		EXCPETION_SYSTICK
-		EXCEPTION_DEBUGMONITOR
+		EXCEPTION_NMI                        = (0x2),
+		EXCEPTION_HARDFAULT                  = (0x3),
+		EXCEPTION_MEMFAULT                   = (0x4),
+		EXCEPTION_BUSFAULT                   = (0x5),
+		EXCEPTION_USAGEFAULT                 = (0x6),
+		EXCEPTION_SVC                        = (0xB),
+		EXCEPTION_DEBUGMONITOR               = (0xC),
+		EXCEPTION_PENDSV                     = (0xE),
+		EXCEPTION_SYSTICK                    = (0xF)
 	};
 
+	/* STM32F407 interrupt numbers (position in the vector table - 16), RM0090 Table 61 */
+	enum class Irq_Number : std::uint8_t
+	{
+		IRQ_WWDG                             = (0),
+		IRQ_PVD                              = (1),
+		IRQ_TAMP_STAMP                       = (2),
+		IRQ_RTC_WKUP                         = (3),
+		IRQ_FLASH                            = (4),
+		IRQ_RCC                              = (5),
+		IRQ_EXTI0                            = (6),
+		IRQ_EXTI1                            = (7),
+		IRQ_EXTI2                            = (8),
+		IRQ_EXTI3                            = (9),
+		IRQ_EXTI4                            = (10),
+		IRQ_DMA1_STREAM0                     = (11),
+		IRQ_DMA1_STREAM1                     = (12),
+		IRQ_DMA1_STREAM2                     = (13),
+		IRQ_DMA1_STREAM3                     = (14),
+		IRQ_DMA1_STREAM4                     = (15),
+		IRQ_DMA1_STREAM5                     = (16),
+		IRQ_DMA1_STREAM6                     = (17),
+		IRQ_ADC                              = (18),
+		IRQ_CAN1_TX                          = (19),
+		IRQ_CAN1_RX0                         = (20),
+		IRQ_CAN1_RX1                         = (21),
+		IRQ_CAN1_SCE                         = (22),
+		IRQ_EXTI9_5                          = (23),
+		IRQ_TIM1_BRK_TIM9                    = (24),
+		IRQ_TIM1_UP_TIM10                    = (25),
+		IRQ_TIM1_TRG_COM_TIM11               = (26),
+		IRQ_TIM1_CC                          = (27),
+		IRQ_TIM2                             = (28),
+		IRQ_TIM3                             = (29),
+		IRQ_TIM4                             = (30),
+		IRQ_I2C1_EV                          = (31),
+		IRQ_I2C1_ER                          = (32),
+		IRQ_I2C2_EV                          = (33),
+		IRQ_I2C2_ER                          = (34),
+		IRQ_SPI1                             = (35),
+		IRQ_SPI2                             = (36),
+		IRQ_USART1                           = (37),
+		IRQ_USART2                           = (38),
+		IRQ_USART3                           = (39),
+		IRQ_EXTI15_10                        = (40),
+		IRQ_RTC_ALARM                        = (41),
+		IRQ_OTG_FS_WKUP                      = (42),
+		IRQ_TIM8_BRK_TIM12                   = (43),
+		IRQ_TIM8_UP_TIM13                    = (44),
+		IRQ_TIM8_TRG_COM_TIM14               = (45),
+		IRQ_TIM8_CC                          = (46),
+		IRQ_DMA1_STREAM7                     = (47),
+		IRQ_FSMC                             = (48),
+		IRQ_SDIO                             = (49),
+		IRQ_TIM5                             = (50),
+		IRQ_SPI3                             = (51),
+		IRQ_UART4                            = (52),
+		IRQ_UART5                            = (53),
+		IRQ_TIM6_DAC                         = (54),
+		IRQ_TIM7                             = (55),
+		IRQ_DMA2_STREAM0                     = (56),
+		IRQ_DMA2_STREAM1                     = (57),
+		IRQ_DMA2_STREAM2                     = (58),
+		IRQ_DMA2_STREAM3                     = (59),
+		IRQ_DMA2_STREAM4                     = (60),
+		IRQ_ETH                              = (61),
+		IRQ_ETH_WKUP                         = (62),
+		IRQ_CAN2_TX                          = (63),
+		IRQ_CAN2_RX0                         = (64),
+		IRQ_CAN2_RX1                         = (65),
+		IRQ_CAN2_SCE                         = (66),
+		IRQ_OTG_FS                           = (67),
+		IRQ_DMA2_STREAM5                     = (68),
+		IRQ_DMA2_STREAM6                     = (69),
+		IRQ_DMA2_STREAM7                     = (70),
+		IRQ_USART6                           = (71),
+		IRQ_I2C3_EV                          = (72),
+		IRQ_I2C3_ER                          = (73),
+		IRQ_OTG_HS_EP1_OUT                   = (74),
+		IRQ_OTG_HS_EP1_IN                    = (75),
+		IRQ_OTG_HS_WKUP                      = (76),
+		IRQ_OTG_HS                           = (77),
+		IRQ_DCMI                             = (78),
+		IRQ_CRYP                             = (79),
+		IRQ_HASH_RNG                         = (80),
+		IRQ_FPU                              = (81)
+	};
+
+	/* AIRCR PRIGROUP, preemption bits _ sub-priority bits of the 4 implemented bits */
+	enum class Priority_Group : std::uint8_t
+	{
+		PRIORITY_GROUP_4_0                   = (0x3),      /* 16 preemption levels, no sub-priority, reset PRIGROUP 0 - 3 behave the same */
+		PRIORITY_GROUP_3_1                   = (0x4),
+		PRIORITY_GROUP_2_2                   = (0x5),
+		PRIORITY_GROUP_1_3                   = (0x6),
+		PRIORITY_GROUP_0_4                   = (0x7)       /* No preemption between IRQs */
+	};
+
+	/* Priority byte for IPR/SHPR, lower value = higher priority */
+	constexpr std::uint8_t nvic_encode_priority(const Priority_Group group, const std::uint32_t preempt, const std::uint32_t sub)
+	{
+		/* Number of sub-priority bits out of the 4 implemented */
+		const std::uint32_t sub_bits = static_cast<std::uint32_t>(group) - 3U;
+		return static_cast<std::uint8_t>((((preempt << sub_bits) | (sub & ((1U << sub_bits) - 1U))) << (8U - NVIC_PRIORITY_BITS)) & 0xFFU);
+	}
+
+	static_assert(nvic_encode_priority(Priority_Group::PRIORITY_GROUP_4_0, 15U, 0U) == 0xF0U, "4 preemption bits");
+	static_assert(nvic_encode_priority(Priority_Group::PRIORITY_GROUP_2_2, 1U, 3U) == 0x70U, "2 preemption + 2 sub-priority bits");
+
+	/** IRQ control
+	  * The IRQ is a compile-time constant in almost every call, address and bit mask fold
+	  * and each call is a single store. Set/clear registers are write-1, no read-modify-write.
+	  */
+	inline void nvic_enable_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		*reinterpret_cast<volatile std::uint32_t *>(NVIC_ISER + ((n >> 5U) << 2U)) = (1U << (n & 0x1FU));
+	}
+
+	inline void nvic_disable_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		*reinterpret_cast<volatile std::uint32_t *>(NVIC_ICER + ((n >> 5U) << 2U)) = (1U << (n & 0x1FU));
+		/* The IRQ may still fire once if the write is in flight */
+		__asm volatile ("dsb" ::: "memory");
+		__asm volatile ("isb" ::: "memory");
+	}
+
+	inline bool nvic_is_enabled_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		return (*reinterpret_cast<volatile std::uint32_t *>(NVIC_ISER + ((n >> 5U) << 2U)) & (1U << (n & 0x1FU))) != 0U;
+	}
+
+	inline void nvic_set_pending_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		*reinterpret_cast<volatile std::uint32_t *>(NVIC_ISPR + ((n >> 5U) << 2U)) = (1U << (n & 0x1FU));
+	}
+
+	inline void nvic_clear_pending_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		*reinterpret_cast<volatile std::uint32_t *>(NVIC_ICPR + ((n >> 5U) << 2U)) = (1U << (n & 0x1FU));
+	}
+
+	inline bool nvic_is_pending_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		return (*reinterpret_cast<volatile std::uint32_t *>(NVIC_ISPR + ((n >> 5U) << 2U)) & (1U << (n & 0x1FU))) != 0U;
+	}
+
+	inline bool nvic_is_active_irq(const Irq_Number irq)
+	{
+		const std::uint32_t n = static_cast<std::uint32_t>(irq);
+		return (*reinterpret_cast<volatile std::uint32_t *>(NVIC_IABR + ((n >> 5U) << 2U)) & (1U << (n & 0x1FU))) != 0U;
+	}
+
+	/* Same as nvic_set_pending_irq(), unprivileged code can use it once CCR.USERSETMPEND = 1 */
+	inline void nvic_trigger_irq(const Irq_Number irq)
+	{
+		*reinterpret_cast<volatile std::uint32_t *>(NVIC_STIR) = static_cast<std::uint32_t>(irq);
+	}
+
+	/* priority from nvic_encode_priority(), byte store */
+	inline void nvic_set_priority(const Irq_Number irq, const std::uint8_t priority)
+	{
+		*reinterpret_cast<volatile std::uint8_t *>(NVIC_IPR + static_cast<std::uint32_t>(irq)) = priority;
+	}
+
+	inline std::uint8_t nvic_get_priority(const Irq_Number irq)
+	{
+		return *reinterpret_cast<volatile std::uint8_t *>(NVIC_IPR + static_cast<std::uint32_t>(irq));
+	}
+
+	/* MemManage, BusFault, UsageFault, SVCall, DebugMonitor, PendSV and SysTick, byte store */
+	inline void nvic_set_system_priority(const System_Exception_Number exception, const std::uint8_t priority)
+	{
+		*reinterpret_cast<volatile std::uint8_t *>(SCB_SHPR + static_cast<std::uint32_t>(exception) - 4U) = priority;
+	}
+
+	/* Set once at startup, before any priority is assigned */
+	inline void nvic_set_priority_grouping(const Priority_Group group)
+	{
+		volatile std::uint32_t *scb_aircr = reinterpret_cast<volatile std::uint32_t *>(SCB_AIRCR);
+		*scb_aircr = SCB_AIRCR_VECTKEY | (*scb_aircr & 0x00008000) | (static_cast<std::uint32_t>(group) << 8U);
+	}
+
+	inline Priority_Group nvic_get_priority_grouping()
+	{
+		const std::uint32_t prigroup = (*reinterpret_cast<volatile std::uint32_t *>(SCB_AIRCR) >> 8U) & 0x7U;
+		return static_cast<Priority_Group>((prigroup < 3U) ? 3U : prigroup);
+	}
+
 	/* SysTick Timer SVR is copied into CVR 
 	 * When the SysTick is enabled it will start counting down
 	 * Once CVR reaches zero the SVR will get reloaded into a fresh register 
 	 * CVR Does the counting 
 	 * SVR(4) -> CVR -> Count down 4 3 2 1 0 reload(4) --> System Exception Triggers 
 	 * Note: That the clock cycle took 5 seconds if you want it to be at the value specified subtract the reload value by 1 */
-	class Nvic
+	class Nvic : public Clock_Observer
 	{
 		public:
-			Nvic();	
+			/* Attaches to sys_clock so the SysTick period follows every clock change, see get_status() */
+			Nvic(Sys_Clock& sys_clock, const std::uint32_t hz_clk_delay);
+
+			/* No register access, for globals: start() later does what the constructor above does */
+			constexpr explicit Nvic(const std::uint32_t hz_clk_delay) : hz_clk_delay(hz_clk_delay), status(Nvic_Status::STATUS_NVIC_OK)
+			{
+			}
+			/* NOK when the rate does not fit the 24 bit reload at this HCLK, SysTick is left stopped */
+			Nvic_Status start(Sys_Clock& sys_clock);
+
+			/* MemManage/BusFault/UsageFault (SHCSR) and SysTick (TICKINT), the others are always enabled */
+			void enable_system_exception(const System_Exception_Number exception);
+			void disable_system_exception(const System_Exception_Number exception);
 
-			void enable_system_exception();
-			void configure_systick(const Sys_Clock& sys_clock, const std::uint32_t counter);
+			/* counter = SysTick rate in Hz from HCLK, the counter stays stopped
+			 * NOK without touching SysTick when HCLK / counter - 1 does not fit SYST_RVR */
+			Nvic_Status configure_systick(const Sys_Clock& sys_clock, const std::uint32_t counter);
 			void enable_systick_counter();
 
+			/* Recomputes the SysTick reload for the new HCLK. A period that no longer fits runs
+			 * at SYST_RELOAD_MAX instead, ticks come slower and get_status() reports NOK */
+			void clock_post_change(const Frequency_Clock_Type& frequency_new) override;
+
+			/* Result of the last start(), configure_systick() or clock change */
+			Nvic_Status get_status() const;
+
 		private:
-			
+			std::uint32_t hz_clk_delay;
+			Nvic_Status status;
 	};
 }
 
@@ -0,0 +1,243 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#if defined(BARE_METAL_HOST)
+#include <atomic>
+#endif
+
+/** Single producer / single consumer ring, ISR -> thread (or thread -> ISR) without locks
+  * head and tail run free over 32 bits, slot = index & (capacity - 1), so all capacity
+  * slots are usable and size = head - tail holds across the wrap.
+  * Only the producer writes head, only the consumer writes tail. Ordering:
+  * 	producer: tail load -> DMB -> data stores       (acquire, the consumer is done with the slot)
+  * 	          data stores -> DMB -> head store      (release)
+  * 	consumer: head load -> DMB -> data loads        (acquire)
+  * 	          data loads -> DMB -> tail store       (release, the slot may be refilled)
+  * On one Cortex-M4 core the DMB is what keeps the compiler and the write buffer from
+  * publishing the index first, it also covers a DMA or a second core reading the ring.
+  * The M4 has no data cache, nothing is padded to a cache line.
+  *
+  * Usage:
+  * static Spsc_Ring<std::uint8_t, 256> uart_rx;
+  * extern "C" void USART2_IRQHandler() { uart_rx.push(static_cast<std::uint8_t>(USART2->dr)); }
+  * std::uint8_t line[64];
+  * const std::uint32_t count = uart_rx.pop(line, sizeof(line));    // batch, thread mode
+  *
+  * Zero copy, the span is contiguous and can be shorter than asked at the end of the buffer:
+  * Spsc_Span_Type<std::uint8_t> span = ring.claim_write(64);      // fill span.data[0 .. span.count)
+  * ring.commit_write(filled);
+  */
+
+namespace bare_metal
+{
+	template <typename Type>
+	struct Spsc_Span_Type
+	{
+		Type* data;
+		std::uint32_t count;
+	};
+
+#if defined(BARE_METAL_HOST)
+	/* Host stress tests run producer and consumer on two threads */
+	using Spsc_Index_Type = std::atomic<std::uint32_t>;
+
+	inline std::uint32_t spsc_load(const Spsc_Index_Type& index)
+	{
+		return index.load(std::memory_order_relaxed);
+	}
+
+	inline void spsc_store(Spsc_Index_Type& index, const std::uint32_t value)
+	{
+		index.store(value, std::memory_order_relaxed);
+	}
+
+	inline void spsc_acquire()
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	inline void spsc_release()
+	{
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+#else
+	using Spsc_Index_Type = volatile std::uint32_t;
+
+	inline std::uint32_t spsc_load(const Spsc_Index_Type& index)
+	{
+		return index;
+	}
+
+	inline void spsc_store(Spsc_Index_Type& index, const std::uint32_t value)
+	{
+		index = value;
+	}
+
+	inline void spsc_acquire()
+	{
+		__asm volatile ("dmb" ::: "memory");
+	}
+
+	inline void spsc_release()
+	{
+		__asm volatile ("dmb" ::: "memory");
+	}
+#endif
+
+	template <typename Type, std::uint32_t capacity>
+	class Spsc_Ring
+	{
+		static_assert(capacity >= 2U && (capacity & (capacity - 1U)) == 0U, "Spsc_Ring capacity must be a power of two");
+		static_assert(capacity <= 0x80000000U, "head - tail has to tell full from empty");
+		static_assert(std::is_trivially_copyable<Type>::value, "Spsc_Ring copies elements with memcpy");
+
+		public:
+			static constexpr std::uint32_t CAPACITY = capacity;
+			static constexpr std::uint32_t MASK = capacity - 1U;
+
+			constexpr Spsc_Ring() : buffer(), head(0U), tail(0U)
+			{
+			}
+
+			Spsc_Ring(const Spsc_Ring&) = delete;
+			Spsc_Ring& operator =(const Spsc_Ring&) = delete;
+
+			/* Empties the ring, neither side may run meanwhile (a .noinit ring cleared at boot) */
+			void reset()
+			{
+				spsc_store(this->head, 0U);
+				spsc_store(this->tail, 0U);
+			}
+
+			/* Either side, a snapshot that is only exact for the calling side */
+			std::uint32_t size() const
+			{
+				return spsc_load(this->head) - spsc_load(this->tail);
+			}
+
+			bool empty() const
+			{
+				return size() == 0U;
+			}
+
+			/* Producer side ---------------------------------------------------------------- */
+
+			/* Slots the producer can fill now, more may free up any time */
+			std::uint32_t space() const
+			{
+				return capacity - (spsc_load(this->head) - spsc_load(this->tail));
+			}
+
+			bool push(const Type& value)
+			{
+				const std::uint32_t head = spsc_load(this->head);
+				if (head - spsc_load(this->tail) == capacity)
+				{
+					return false;
+				}
+				spsc_acquire();
+				this->buffer[head & MASK] = value;
+				spsc_release();
+				spsc_store(this->head, head + 1U);
+				return true;
+			}
+
+			/* Copies as many of values as fit (up to count), one index update. Returns how many */
+			std::uint32_t push(const Type* values, const std::uint32_t count)
+			{
+				const std::uint32_t head = spsc_load(this->head);
+				const std::uint32_t tail = spsc_load(this->tail);
+				spsc_acquire();
+				const std::uint32_t free = capacity - (head - tail);
+				const std::uint32_t total = (count < free) ? count : free;
+				const std::uint32_t first = ((capacity - (head & MASK)) < total) ? (capacity - (head & MASK)) : total;
+
+				std::memcpy(&this->buffer[head & MASK], values, first * sizeof(Type));
+				std::memcpy(&this->buffer[0], values + first, (total - first) * sizeof(Type));
+				spsc_release();
+				spsc_store(this->head, head + total);
+				return total;
+			}
+
+			/* Contiguous free slots from head, at most count, 0 long when full. Fill, then commit_write() */
+			Spsc_Span_Type<Type> claim_write(const std::uint32_t count)
+			{
+				const std::uint32_t head = spsc_load(this->head);
+				const std::uint32_t tail = spsc_load(this->tail);
+				spsc_acquire();
+				const std::uint32_t free = capacity - (head - tail);
+				const std::uint32_t contiguous = capacity - (head & MASK);
+				std::uint32_t span = (free < contiguous) ? free : contiguous;
+				span = (count < span) ? count : span;
+				return Spsc_Span_Type<Type>{ &this->buffer[head & MASK], span };
+			}
+
+			/* Publishes count slots of the last claim_write() span */
+			void commit_write(const std::uint32_t count)
+			{
+				spsc_release();
+				spsc_store(this->head, spsc_load(this->head) + count);
+			}
+
+			/* Consumer side ---------------------------------------------------------------- */
+
+			bool pop(Type& value)
+			{
+				const std::uint32_t tail = spsc_load(this->tail);
+				if (spsc_load(this->head) == tail)
+				{
+					return false;
+				}
+				spsc_acquire();
+				value = this->buffer[tail & MASK];
+				spsc_release();
+				spsc_store(this->tail, tail + 1U);
+				return true;
+			}
+
+			/* Copies up to count elements out, one index update. Returns how many */
+			std::uint32_t pop(Type* values, const std::uint32_t count)
+			{
+				const std::uint32_t tail = spsc_load(this->tail);
+				const std::uint32_t used = spsc_load(this->head) - tail;
+				const std::uint32_t total = (count < used) ? count : used;
+				const std::uint32_t first = ((capacity - (tail & MASK)) < total) ? (capacity - (tail & MASK)) : total;
+
+				spsc_acquire();
+				std::memcpy(values, &this->buffer[tail & MASK], first * sizeof(Type));
+				std::memcpy(values + first, &this->buffer[0], (total - first) * sizeof(Type));
+				spsc_release();
+				spsc_store(this->tail, tail + total);
+				return total;
+			}
+
+			/* Contiguous filled slots from tail, at most count, 0 long when empty. Read, then commit_read() */
+			Spsc_Span_Type<const Type> claim_read(const std::uint32_t count)
+			{
+				const std::uint32_t tail = spsc_load(this->tail);
+				const std::uint32_t used = spsc_load(this->head) - tail;
+				const std::uint32_t contiguous = capacity - (tail & MASK);
+				std::uint32_t span = (used < contiguous) ? used : contiguous;
+				span = (count < span) ? count : span;
+				spsc_acquire();
+				return Spsc_Span_Type<const Type>{ &this->buffer[tail & MASK], span };
+			}
+
+			/* Hands count slots of the last claim_read() span back to the producer */
+			void commit_read(const std::uint32_t count)
+			{
+				spsc_release();
+				spsc_store(this->tail, spsc_load(this->tail) + count);
+			}
+
+		private:
+			Type buffer[capacity];
+			Spsc_Index_Type head;                 /* Next slot to write, producer only */
+			Spsc_Index_Type tail;                 /* Next slot to read, consumer only */
+	};
+}
+
+#endif /* SPSC_RING_H */
@@ -0,0 +1,37 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <cstdint>
+#include <sys_clock.h>
+#include <clock_solver.h>
+
+/** Reset path (startup.cpp)
+  * 1. DWT cycle counter on, then the clock tree from startup_clock_config() (if any)
+  * 2. .data copy and .bss zero with 16 byte LDM/STM bursts at the new clock
+  * 3. static constructors, vector table to SRAM, main()
+  * Drivers have constexpr constructors, their globals are plain .data with no
+  * constructor code in step 3.
+  */
+
+namespace bare_metal
+{
+	/* Cycle counts from Reset_Handler entry (CYCCNT, mixed 16MHz / new HCLK cycles) */
+	struct Startup_Statistics_Type
+	{
+		std::uint32_t cycles_clock;      /* Clock tree up */
+		std::uint32_t cycles_memory;     /* + .data copy and .bss zero */
+		std::uint32_t cycles_main;       /* + constructors and vector table, entry of main() */
+	};
+
+	extern Startup_Statistics_Type startup_statistics;
+
+	/* Clock state Reset_Handler left behind, use it instead of a new Sys_Clock in main() */
+	extern Sys_Clock startup_sys_clock;
+
+	/* Weak, returns nullptr (stay on HSI 16MHz). Define it to bring the clock up before
+	 * the copy, it runs before .data/.bss exist so only return a constant:
+	 * const Clock_Config_Type* startup_clock_config() { return &Clock_168MHz::config; } */
+	const Clock_Config_Type* startup_clock_config();
+}
+
+#endif /* STARTUP_H */
@@ -2,6 +2,7 @@
 #define SYS_CLOCK_H
 
 #include <cstdint>
+#include <mmio.h>
 
 /** Max Frequency:
   * SYSClk            
@@ -25,8 +26,8 @@
   * |    |        |                           --------------------------- |                                           |        --*TIM--> TIMER          |
   * |    |        --HSI--> \\                 |                         | |                                           |                                 |
   * |    |                 | | ---> /PLLM --->| --> VCO --------> /PLLP |--                                           -----> /APB2 ---> PCLK            |
-  * |    -----------HSE--> //                 | /|\         |           |                                                      |                        |
-  * |                                         |  |         \|/          |                                                      --*TIM--> TIMER          |
+  * |    -----------HSE--> //                 | /|\         |   |       |                                                      |                        |
+  * |                                         |  |         \|/  --> /PLLQ ---> PLL48CLK (USB OTG FS, SDIO, RNG)                --*TIM--> TIMER          |
   * |                                         |  -- *PLLN ---           |                                                                               |
   * |                                         ---------------------------                                                                               |
   * -----------------------------------------------------------------------------------------------------------------------------------------------------
@@ -45,49 +46,49 @@ namespace bare_metal
 {
 	typedef struct 
 	{
-		volatile std::uint32_t rcc_cr;                 /* 4002 3800 + 0x00 */
-		volatile std::uint32_t rcc_pllcfgr;            /* 4002 3800 + 0x04 */
-		volatile std::uint32_t rcc_cfgr;               /* 4002 3800 + 0x08 */
-		volatile std::uint32_t rcc_cir;                /* 4002 3800 + 0x0C */
-		volatile std::uint32_t rcc_ahb1rstr;           /* 4002 3800 + 0x10 */
-		volatile std::uint32_t rcc_ahb2rstr;           /* 4002 3800 + 0x14 */
-		volatile std::uint32_t rcc_ahb3rstr;           /* 4002 3800 + 0x18 */
-		volatile std::uint32_t reserve_1;              /* 4002 3800 + 0x1C */
-		volatile std::uint32_t rcc_apb1rstr;           /* 4002 3800 + 0x20 */
-		volatile std::uint32_t rcc_apb2rstr;           /* 4002 3800 + 0x24 */
-		volatile std::uint32_t rcc_reserve_2[2];       /* 4002 3800 + 0x28 - 0x2C */
-		volatile std::uint32_t rcc_ahb1enr;            /* 4002 3800 + 0x30 */
-		volatile std::uint32_t rcc_ahb2enr;            /* 4002 3800 + 0x34 */
-		volatile std::uint32_t rcc_ahb3enr;            /* 4002 3800 + 0x38 */
-		volatile std::uint32_t rcc_reserve_3;          /* 4002 3800 + 0x3C */
-		volatile std::uint32_t rcc_apb1enr;            /* 4002 3800 + 0x40 */
-		volatile std::uint32_t rcc_apb2enr;            /* 4002 3800 + 0x44 */
-		volatile std::uint32_t rcc_reserve_4[2];       /* 4002 3800 + 0x48 - 0x4C */
-		volatile std::uint32_t rcc_ahb1lpenr;          /* 4002 3800 + 0x50 */
-		volatile std::uint32_t rcc_ahb2lpenr;          /* 4002 3800 + 0x54 */
-		volatile std::uint32_t rcc_ahb3lpenr;          /* 4002 3800 + 0x58 */
-		volatile std::uint32_t rcc_reserve_5;          /* 4002 3800 + 0x5C */
-		volatile std::uint32_t rcc_apb1lpenr;          /* 4002 3800 + 0x60 */
-		volatile std::uint32_t rcc_apb2lpenr;          /* 4002 3800 + 0x64 */
-		volatile std::uint32_t rcc_reserve_6[2];       /* 4002 3800 + 0x68 - 0x6C */
-		volatile std::uint32_t rcc_bdcr;               /* 4002 3800 + 0x70 */
-		volatile std::uint32_t rcc_csr;                /* 4002 3800 + 0x74 */
-		volatile std::uint32_t rcc_reserve_7[2];       /* 4002 3800 + 0x78 - 0x7C */
-		volatile std::uint32_t rcc_sscgr;              /* 4002 3800 + 0x80 */
-		volatile std::uint32_t rcc_plli2s;             /* 4002 3800 + 0x84 */
-		volatile std::uint32_t rcc_pllsaicfgr;         /* 4002 3800 + 0x88 */
-		volatile std::uint32_t rcc_dckcfgr;            /* 4002 3800 + 0x8C */
+		Register_Type rcc_cr;                          /* 4002 3800 + 0x00 */
+		Register_Type rcc_pllcfgr;                     /* 4002 3800 + 0x04 */
+		Register_Type rcc_cfgr;                        /* 4002 3800 + 0x08 */
+		Register_Type rcc_cir;                         /* 4002 3800 + 0x0C */
+		Register_Type rcc_ahb1rstr;                    /* 4002 3800 + 0x10 */
+		Register_Type rcc_ahb2rstr;                    /* 4002 3800 + 0x14 */
+		Register_Type rcc_ahb3rstr;                    /* 4002 3800 + 0x18 */
+		Register_Type reserve_1;                       /* 4002 3800 + 0x1C */
+		Register_Type rcc_apb1rstr;                    /* 4002 3800 + 0x20 */
+		Register_Type rcc_apb2rstr;                    /* 4002 3800 + 0x24 */
+		Register_Type rcc_reserve_2[2];                /* 4002 3800 + 0x28 - 0x2C */
+		Register_Type rcc_ahb1enr;                     /* 4002 3800 + 0x30 */
+		Register_Type rcc_ahb2enr;                     /* 4002 3800 + 0x34 */
+		Register_Type rcc_ahb3enr;                     /* 4002 3800 + 0x38 */
+		Register_Type rcc_reserve_3;                   /* 4002 3800 + 0x3C */
+		Register_Type rcc_apb1enr;                     /* 4002 3800 + 0x40 */
+		Register_Type rcc_apb2enr;                     /* 4002 3800 + 0x44 */
+		Register_Type rcc_reserve_4[2];                /* 4002 3800 + 0x48 - 0x4C */
+		Register_Type rcc_ahb1lpenr;                   /* 4002 3800 + 0x50 */
+		Register_Type rcc_ahb2lpenr;                   /* 4002 3800 + 0x54 */
+		Register_Type rcc_ahb3lpenr;                   /* 4002 3800 + 0x58 */
+		Register_Type rcc_reserve_5;                   /* 4002 3800 + 0x5C */
+		Register_Type rcc_apb1lpenr;                   /* 4002 3800 + 0x60 */
+		Register_Type rcc_apb2lpenr;                   /* 4002 3800 + 0x64 */
+		Register_Type rcc_reserve_6[2];                /* 4002 3800 + 0x68 - 0x6C */
+		Register_Type rcc_bdcr;                        /* 4002 3800 + 0x70 */
+		Register_Type rcc_csr;                         /* 4002 3800 + 0x74 */
+		Register_Type rcc_reserve_7[2];                /* 4002 3800 + 0x78 - 0x7C */
+		Register_Type rcc_sscgr;                       /* 4002 3800 + 0x80 */
+		Register_Type rcc_plli2s;                      /* 4002 3800 + 0x84 */
+		Register_Type rcc_pllsaicfgr;                  /* 4002 3800 + 0x88 */
+		Register_Type rcc_dckcfgr;                     /* 4002 3800 + 0x8C */
 	} RCC_Register_Handle;
 
 	typedef struct
 	{
-		volatile std::uint32_t flash_acr;              /* 0x4002 3C00 + 0x00 */
-		volatile std::uint32_t flash_keyr;             /* 0x4002 3C00 + 0x04 */
-		volatile std::uint32_t flash_optkeyr;          /* 0x4002 3C00 + 0x08 */
-		volatile std::uint32_t flash_sr;               /* 0x4002 3C00 + 0x0C */
-		volatile std::uint32_t flash_cr;               /* 0x4002 3C00 + 0x10 */
-		volatile std::uint32_t flash_optcr;            /* 0x4002 3C00 + 0x14 */
-		volatile std::uint32_t flash_reserve[2];       /* 0x4002 3C00 + 0x18 - 0xC */
+		Register_Type flash_acr;                       /* 0x4002 3C00 + 0x00 */
+		Register_Type flash_keyr;                      /* 0x4002 3C00 + 0x04 */
+		Register_Type flash_optkeyr;                   /* 0x4002 3C00 + 0x08 */
+		Register_Type flash_sr;                        /* 0x4002 3C00 + 0x0C */
+		Register_Type flash_cr;                        /* 0x4002 3C00 + 0x10 */
+		Register_Type flash_optcr;                     /* 0x4002 3C00 + 0x14 */
+		Register_Type flash_reserve[2];                /* 0x4002 3C00 + 0x18 - 0xC */
 	} Flash_Register_Handle;
 
 	/* Standard frequency for STM32F407 Discovery Board */
@@ -100,8 +101,17 @@ namespace bare_metal
 	/* Configuration for Flash Access Control Register */
 	constexpr std::uint32_t FLASH_BASE_ADDRESS     = (0x40023C00);                  /* Flash Access Control Register */
 
+#if defined(BARE_METAL_HOST)
+	/* Simulated registers, see code/host/mmio_simulator.cpp */
+	extern RCC_Register_Handle mmio_rcc;
+	extern Flash_Register_Handle mmio_flash;
+
+	#define RCC               (&mmio_rcc)
+	#define FLASH             (&mmio_flash)
+#else
 	#define RCC               ((RCC_Register_Handle *)(RCC_BASE_ADDRESS))
-	#define FLASH             ((Flash_Register_Handle *)(RCC_BASE_ADDRESS))
+	#define FLASH             ((Flash_Register_Handle *)(FLASH_BASE_ADDRESS))
+#endif
 
 	/* AHB Prescaler SysCLK / Prescaler = HCLK */
 	enum class Prescaler_AHB : std::uint32_t
@@ -617,6 +627,36 @@ namespace bare_metal
 		PRESCALER_PLLP_DIV8              = (0x3)
 	};
 
+	/* PLL48CLK (USB OTG FS, SDIO, RNG) = VCO / PLLQ, 0 and 1 are not allowed */
+	enum class Prescaler_PLLQ : std::uint32_t
+	{
+		PRESCALER_PLLQ_DIV2              = (0x2),
+		PRESCALER_PLLQ_DIV3              = (0x3),
+		PRESCALER_PLLQ_DIV4              = (0x4),
+		PRESCALER_PLLQ_DIV5              = (0x5),
+		PRESCALER_PLLQ_DIV6              = (0x6),
+		PRESCALER_PLLQ_DIV7              = (0x7),
+		PRESCALER_PLLQ_DIV8              = (0x8),
+		PRESCALER_PLLQ_DIV9              = (0x9),
+		PRESCALER_PLLQ_DIV10             = (0xA),
+		PRESCALER_PLLQ_DIV11             = (0xB),
+		PRESCALER_PLLQ_DIV12             = (0xC),
+		PRESCALER_PLLQ_DIV13             = (0xD),
+		PRESCALER_PLLQ_DIV14             = (0xE),
+		PRESCALER_PLLQ_DIV15             = (0xF)
+	};
+
+	/* I2SCLK = VCO (PLLI2SN) / PLLI2SR, PLLI2SN reuses Prescaler_PLLN */
+	enum class Prescaler_PLLI2SR : std::uint32_t
+	{
+		PRESCALER_PLLI2SR_DIV2           = (0x2),
+		PRESCALER_PLLI2SR_DIV3           = (0x3),
+		PRESCALER_PLLI2SR_DIV4           = (0x4),
+		PRESCALER_PLLI2SR_DIV5           = (0x5),
+		PRESCALER_PLLI2SR_DIV6           = (0x6),
+		PRESCALER_PLLI2SR_DIV7           = (0x7)
+	};
+
 	enum class Flash_Latency : std::uint32_t
 	{
 		FLASH_LATENCY_WS0                = (0x0),
@@ -629,37 +669,228 @@ namespace bare_metal
 		FLASH_LATENCY_WS7                = (0x7)
 	};
 
+	/* HPRE 0xxx = /1, 1000 = /2 ... 1011 = /16, 1100 = /64 ... 1111 = /512 (no /32) */
+	constexpr std::uint32_t sys_clock_divider_ahb(const std::uint32_t hpre)
+	{
+		return (hpre < 0x8U) ? 1U : (0x1U << ((hpre - 0x7U) + ((hpre >= 0xCU) ? 1U : 0U)));
+	}
+
+	/* PPREx 0xx = /1, 100 = /2 ... 111 = /16 */
+	constexpr std::uint32_t sys_clock_divider_apb(const std::uint32_t ppre)
+	{
+		return (ppre < 0x4U) ? 1U : (0x1U << (ppre - 0x3U));
+	}
+
+	/* Frequencies of a clock tree from its registers, sws = 0 HSI, 1 HSE, 2 PLL
+	 * Kept as a fraction input * PLLN / (PLLM * PLLP * dividers) and divided once per clock,
+	 * no intermediate rounding even when PLLM does not divide the input.
+	 * frequency_hsi is the nominal 16MHz unless HSI was measured, see hsi_trim.h */
+	constexpr Frequency_Clock_Type sys_clock_decode(const std::uint32_t sws, const std::uint32_t cfgr, const std::uint32_t pllcfgr,
+	                                                const std::uint32_t frequency_hsi = FREQUENCY_HSI)
+	{
+		std::uint64_t numerator = (sws == 0x1U) ? FREQUENCY_HSE : frequency_hsi;
+		std::uint32_t denominator = 1U;
+		if (sws == 0x2U)
+		{
+			const std::uint32_t pllm = (pllcfgr >> 0U) & 0x3FU;
+			const std::uint32_t plln = (pllcfgr >> 6U) & 0x1FFU;
+			const std::uint32_t pllp = (((pllcfgr >> 16U) & 0x3U) + 1U) * 2U;
+			numerator = static_cast<std::uint64_t>((pllcfgr & (0x1U << 22U)) ? FREQUENCY_HSE : frequency_hsi) * plln;
+			denominator = ((pllm == 0U) ? 1U : pllm) * pllp;
+		}
+		const std::uint32_t ahb = denominator * sys_clock_divider_ahb((cfgr >> 4U) & 0xFU);
+		return
+		{
+			static_cast<std::uint32_t>(numerator / denominator),
+			static_cast<std::uint32_t>(numerator / ahb),
+			static_cast<std::uint32_t>(numerator / (ahb * sys_clock_divider_apb((cfgr >> 10U) & 0x7U))),
+			static_cast<std::uint32_t>(numerator / (ahb * sys_clock_divider_apb((cfgr >> 13U) & 0x7U)))
+		};
+	}
+
+	/* PLL48CLK of an RCC_PLLCFGR word, same fraction as sys_clock_decode() */
+	constexpr std::uint32_t sys_clock_decode_pll48(const std::uint32_t pllcfgr, const std::uint32_t frequency_hsi = FREQUENCY_HSI)
+	{
+		const std::uint32_t pllm = (pllcfgr >> 0U) & 0x3FU;
+		const std::uint32_t plln = (pllcfgr >> 6U) & 0x1FFU;
+		const std::uint32_t pllq = (pllcfgr >> 24U) & 0xFU;
+		const std::uint64_t numerator = static_cast<std::uint64_t>((pllcfgr & (0x1U << 22U)) ? FREQUENCY_HSE : frequency_hsi) * plln;
+		return static_cast<std::uint32_t>(numerator / (((pllm == 0U) ? 1U : pllm) * ((pllq < 2U) ? 2U : pllq)));
+	}
+
+	/* I2SCLK of an RCC_PLLI2SCFGR word, PLLM and PLLSRC come from RCC_PLLCFGR */
+	constexpr std::uint32_t sys_clock_decode_plli2s(const std::uint32_t pllcfgr, const std::uint32_t plli2scfgr, const std::uint32_t frequency_hsi = FREQUENCY_HSI)
+	{
+		const std::uint32_t pllm = (pllcfgr >> 0U) & 0x3FU;
+		const std::uint32_t plli2sn = (plli2scfgr >> 6U) & 0x1FFU;
+		const std::uint32_t plli2sr = (plli2scfgr >> 28U) & 0x7U;
+		const std::uint64_t numerator = static_cast<std::uint64_t>((pllcfgr & (0x1U << 22U)) ? FREQUENCY_HSE : frequency_hsi) * plli2sn;
+		return static_cast<std::uint32_t>(numerator / (((pllm == 0U) ? 1U : pllm) * ((plli2sr < 2U) ? 2U : plli2sr)));
+	}
+
+	/* Reset: HSI, nothing divided */
+	static_assert(sys_clock_decode(0x0U, 0x00000000U, 0x24003010U).frequency_p1clk == FREQUENCY_HSI, "decode reset state");
+	/* HSE / 4 * 168 / 2, APB1 / 4, APB2 / 2 */
+	static_assert(sys_clock_decode(0x2U, (0x5U << 10U) | (0x4U << 13U), (0x1U << 22U) | (168U << 6U) | 4U).frequency_p1clk == 42000000U, "decode APB1");
+	static_assert(sys_clock_decode(0x2U, (0x5U << 10U) | (0x4U << 13U), (0x1U << 22U) | (168U << 6U) | 4U).frequency_p2clk == 84000000U, "decode APB2");
+	/* HSI / 12 * 252 / 2 = 168MHz exactly, dividing by PLLM first would give 167999958 */
+	static_assert(sys_clock_decode(0x2U, 0x0U, (252U << 6U) | 12U).frequency_sysclk == 168000000U, "decode is exact");
+	/* AHB / 512 */
+	static_assert(sys_clock_decode(0x0U, (0xFU << 4U), 0x0U).frequency_hclk == FREQUENCY_HSI / 512U, "decode HPRE");
+	/* Measured HSI 16.08MHz / 8 * 84 / 2 */
+	static_assert(sys_clock_decode(0x2U, 0x0U, (84U << 6U) | 8U, 16080000U).frequency_sysclk == 84420000U, "decode measured HSI");
+	/* HSE / 4 * 168 / 7 = 48MHz */
+	static_assert(sys_clock_decode_pll48((7U << 24U) | (0x1U << 22U) | (168U << 6U) | 4U) == 48000000U, "decode PLLQ");
+	/* PLLI2S reset: HSI / 16 * 192 / 2 = 96MHz */
+	static_assert(sys_clock_decode_plli2s(0x24003010U, 0x20003000U) == 96000000U, "decode PLLI2S");
+
+	/* Flash Mode:
+	 * LATENCY = Wait states only, ART accelerator off
+	 * PERFORMANCE = Wait states with prefetch, instruction cache and data cache (ART accelerator) */
+	enum class Flash_Mode : std::uint8_t
+	{
+		FLASH_MODE_LATENCY               = (0x0),
+		FLASH_MODE_PERFORMANCE           = (0x1)
+	};
+
 	enum class Frequency_Sys_Clock_Status : std::uint8_t
 	{
 		STATUS_SYS_CLOCK_OK              = (0x0),
-		STATUS_SYS_CLOCK_NOK             = (0x1)
+		STATUS_SYS_CLOCK_NOK             = (0x1),
+		STATUS_SYS_CLOCK_TIMEOUT_HSI     = (0x2),      /* HSIRDY never set */
+		STATUS_SYS_CLOCK_TIMEOUT_HSE     = (0x3),      /* HSERDY never set (dead crystal) or never cleared */
+		STATUS_SYS_CLOCK_TIMEOUT_PLL     = (0x4),      /* PLLRDY never set or never cleared */
+		STATUS_SYS_CLOCK_TIMEOUT_SWS     = (0x5),      /* SWS never followed SW */
+		STATUS_SYS_CLOCK_TIMEOUT_CAPTURE = (0x6)       /* No LSE/HSE edge on the HSI calibration timer */
+	};
+
+	/* Upper bound of every ready-bit wait, in register polls (>= 4 cycles each)
+	 * Sized for HCLK = 168MHz with 2x margin, longer in time on slower clocks */
+	constexpr std::uint32_t SYS_CLOCK_TIMEOUT_HSI  = (1000);           /* HSI startup 2us */
+	constexpr std::uint32_t SYS_CLOCK_TIMEOUT_HSE  = (168000);         /* HSE startup 2ms max */
+	constexpr std::uint32_t SYS_CLOCK_TIMEOUT_PLL  = (16800);          /* PLL lock 200us max */
+	constexpr std::uint32_t SYS_CLOCK_TIMEOUT_SWS  = (1000);           /* A few cycles of both clocks */
+
+	/* Asynchronous bring-up progress, see configure_clock_async()
+	 * WAIT_HSE / WAIT_PLL = armed in RCC_CIR, the RCC interrupt moves on */
+	enum class Sys_Clock_Async_State : std::uint8_t
+	{
+		ASYNC_STATE_IDLE                 = (0x0),
+		ASYNC_STATE_WAIT_HSE             = (0x1),
+		ASYNC_STATE_WAIT_PLL             = (0x2),
+		ASYNC_STATE_READY                = (0x3),
+		ASYNC_STATE_FAILED               = (0x4)
+	};
+
+	/* Shadow copies staged by a Sys_Clock transaction
+	 * staged_x holds the mask of fields that were staged */
+	struct Sys_Clock_Transaction_Type
+	{
+		bool active;
+		std::uint32_t shadow_pllcfgr;
+		std::uint32_t shadow_cfgr;
+		std::uint32_t staged_pllcfgr;
+		std::uint32_t staged_cfgr;
 	};
 
+	/* Clock change subscriber, intrusive so attaching never allocates
+	 * Callbacks run with interrupts masked, in the same critical section as the register writes:
+	 * clock_pre_change  = before the clock tree changes, frequency_new is what it is about to become
+	 * clock_post_change = after the clock tree changed, rescale dividers here
+	 * The observer has to stay alive until it is detached */
+	class Clock_Observer
+	{
+		public:
+			virtual void clock_pre_change(const Frequency_Clock_Type& frequency_old, const Frequency_Clock_Type& frequency_new)
+			{
+				static_cast<void>(frequency_old);
+				static_cast<void>(frequency_new);
+			}
+			virtual void clock_post_change(const Frequency_Clock_Type& frequency_new) = 0;
+
+		protected:
+			~Clock_Observer() = default;
+
+		private:
+			friend class Sys_Clock;
+			Clock_Observer* observer_next = nullptr;
+	};
+
+	/* Produced at compile time by Clock_Solver, see clock_solver.h */
+	struct Clock_Config_Type;
+
+	/* Produced at compile time by Clock_Solver_I2s, see clock_solver_i2s.h */
+	struct Clock_I2s_Config_Type;
+
 	class Sys_Clock
 	{
 		public:
-			Sys_Clock();
+			/* No register access so a global lands in .data, the first query reads RCC */
+			constexpr Sys_Clock() :
+				oscillator_type(Sys_Oscillator_Type::OSC_TYPE_HSI),
+				frequency_clock{ FREQUENCY_HSI, FREQUENCY_HSI, FREQUENCY_HSI, FREQUENCY_HSI },
+				frequency_stale(true),
+				frequency_hsi(FREQUENCY_HSI),
+				transaction(),
+				observers(nullptr),
+				async_config(nullptr),
+				async_state(Sys_Clock_Async_State::ASYNC_STATE_IDLE),
+				css_failure(false),
+				configuring(false)
+			{
+			}
 			Sys_Clock(Sys_Oscillator_Type osc_type);
 
+			/* Use after a bootloader jump: takes over whatever RCC runs now instead of assuming reset,
+			 * no register is written. configure_clock() afterwards only touches what differs */
+			static Sys_Clock adopt();
+
+			/* True if RCC and FLASH_ACR already run config (source, prescalers, PLL, wait states) */
+			bool is_configured(const Clock_Config_Type& config) const;
+
 			/* Gets type of Oscillator Type HSI, HSE, PLL */
 			Sys_Oscillator_Type get_oscillator_type() const;
 
-			/* To get the frequency of all or specific clock */
+			/* To get the frequency of all or specific clock
+			 * Decoded from RCC_CFGR/RCC_PLLCFGR after every change this driver makes, cached in between.
+			 * A query is a flag test and a load, callable from ISRs */
 			Frequency_Clock_Type get_frequency() const;
 			std::uint32_t get_sysclk_frequency() const;
 			std::uint32_t get_hclk_frequency() const;
 			std::uint32_t get_p1clk_frequency() const;
 			std::uint32_t get_p2clk_frequency() const;
 
-			/* Use to enable pll clock */
-			void sysclk_enable_pll();
+			/* Use after measuring HSI (hsi_trim.h): every HSI derived frequency is decoded from it
+			 * from then on, observers are notified like for any other clock change */
+			void set_hsi_frequency(const std::uint32_t frequency_hsi);
+			std::uint32_t get_hsi_frequency() const;
+
+			/* Timer kernel clocks: PxCLK when the APB prescaler is 1, 2 * PxCLK otherwise */
+			std::uint32_t get_p1timclk_frequency() const;
+			std::uint32_t get_p2timclk_frequency() const;
+
+			/* PLL48CLK for USB OTG FS, SDIO and RNG, 0 while the PLL is off. Read from RCC on every call */
+			std::uint32_t get_pll48clk_frequency() const;
 
-			/* Use to disable hsi system clk */
+			/* I2SCLK from PLLI2S, 0 while PLLI2S is off. Read from RCC on every call */
+			std::uint32_t get_plli2s_frequency() const;
+
+			/* Use to enable or disable pll clock */
+			Frequency_Sys_Clock_Status sysclk_enable_pll();
+			Frequency_Sys_Clock_Status sysclk_disable_pll();
+
+			/* Use to disable hsi or hse system clk */
 			void sysclk_disable_hsi();
+			Frequency_Sys_Clock_Status sysclk_disable_hse();
+
+			/* Use to select HSI, HSE or PLL for system clock */
+			Frequency_Sys_Clock_Status sysclk_select_hsi();
+			Frequency_Sys_Clock_Status sysclk_select_hse();
+			Frequency_Sys_Clock_Status sysclk_select_pll();
 
-			/* Use to select HSE for system clock */
-			void sysclk_select_hse();
-			void sysclk_select_pll();
+			/* Use to enable or disable the PLLI2S clock, it runs from the main PLL input / PLLM */
+			Frequency_Sys_Clock_Status sysclk_enable_plli2s();
+			Frequency_Sys_Clock_Status sysclk_disable_plli2s();
 
 			/* Use to choose which source clock input to use */
 			void configure_source_pll();
@@ -667,15 +898,80 @@ namespace bare_metal
 			/* Use to configure the flash latency according to reference manual specifications */
 			Frequency_Sys_Clock_Status configure_flash_latency();
 
+			/* Use to turn the ART accelerator (prefetch, I-cache, D-cache) on or off, caches are reset before enabling */
+			Frequency_Sys_Clock_Status configure_flash_mode(const Flash_Mode flash_mode);
+
+			/* Use to apply a complete clock tree solved at compile time, no runtime frequency math
+			 * Safe at runtime: parks on HSI while the PLL is reprogrammed, orders the flash wait states
+			 * and turns off the oscillators the new configuration does not use.
+			 * Registers that already match are not written, a tree that is already running costs 4 reads.
+			 * Interrupts stay enabled while HSE starts and the PLL locks, only the source switch and its
+			 * notifications are masked. A park on HSI is notified as a change of its own.
+			 * NOK when called from an interrupt in the middle of another configure_clock() */
+			Frequency_Sys_Clock_Status configure_clock(const Clock_Config_Type& config);
+
+			/* Use to run the I2S kernel clock from a PLLI2S setting solved at compile time
+			 * Call after configure_clock(), PLLI2S shares PLLM and PLLSRC with the main PLL and
+			 * both PLLs have to be off to change them. A PLLI2S that already runs config is left alone,
+			 * otherwise it is stopped, written and relocked. SPI_I2SPR is the I2S driver's to write */
+			Frequency_Sys_Clock_Status configure_plli2s(const Clock_I2s_Config_Type& config);
+
+			/* Use at boot to overlap oscillator startup with application init
+			 * Turns HSE/PLL on, arms HSERDYIE/PLLRDYIE in RCC_CIR and returns on the current clock,
+			 * RCC_IRQHandler finishes with configure_clock() once they are ready.
+			 * NOK if SYSCLK runs from a PLL that would have to be relocked, or a bring-up is pending.
+			 * config must outlive the bring-up (Clock_Solver configs are static) */
+			Frequency_Sys_Clock_Status configure_clock_async(const Clock_Config_Type& config);
+			Sys_Clock_Async_State get_async_state() const;
+
+			/* Called from RCC_IRQHandler */
+			void rcc_interrupt();
+
+			/* Use to turn on the Clock Security System (CSSON), needs HSE running
+			 * An HSE failure raises the NMI, NMI_Handler only clears CSSF, flags the failure and
+			 * pends the RCC interrupt. RCC_IRQHandler, set to the lowest priority here, rebuilds
+			 * SYSCLK from HSI at 168MHz once the code the NMI preempted is done, after a
+			 * configure_clock() in progress. One instance is watched at a time */
+			void enable_clock_security();
+			void disable_clock_security();
+			bool get_clock_security_failure() const;
+
+			/* Called from NMI_Handler */
+			void css_interrupt();
+
+			/* Called from RCC_IRQHandler */
+			void css_fallback();
+
 			/* Use to configure clock frequency for specific clock peripherals */
 			void configure_prescaler_ahb(const Prescaler_AHB prescaler_ahb);
 			void configure_prescaler_apb1(const Prescaler_APB1 prescaler_apb1);
 			void configure_prescaler_apb2(const Prescaler_APB2 prescaler_apb2);
 
+			/* Use to subscribe to clock changes, see Clock_Observer */
+			void attach_observer(Clock_Observer& observer);
+			void detach_observer(Clock_Observer& observer);
+
 			/* Use to configure prescalers for PLL Engine for the desired PLLCLK output */
 			void configure_prescaler_pllm(const Prescaler_PLLM prescaler_pllm);
 			void configure_prescaler_plln(const Prescaler_PLLN prescaler_plln);
 			void configure_prescaler_pllp(const Prescaler_PLLP prescaler_pllp);
+			void configure_prescaler_pllq(const Prescaler_PLLQ prescaler_pllq);
+
+			/* Use to configure prescalers for the PLLI2S Engine, PLLI2S has to be off */
+			void configure_prescaler_plli2sn(const Prescaler_PLLN prescaler_plli2sn);
+			void configure_prescaler_plli2sr(const Prescaler_PLLI2SR prescaler_plli2sr);
+
+			/* Use to stage prescalers in a shadow copy, commit writes RCC_PLLCFGR then RCC_CFGR once each
+			 * begin -> stage ... stage -> commit */
+			void transaction_begin();
+			void transaction_stage(const Prescaler_AHB prescaler_ahb);
+			void transaction_stage(const Prescaler_APB1 prescaler_apb1);
+			void transaction_stage(const Prescaler_APB2 prescaler_apb2);
+			void transaction_stage(const Prescaler_PLLM prescaler_pllm);
+			void transaction_stage(const Prescaler_PLLN prescaler_plln);
+			void transaction_stage(const Prescaler_PLLP prescaler_pllp);
+			void transaction_stage(const Prescaler_PLLQ prescaler_pllq);
+			Frequency_Sys_Clock_Status transaction_commit();
 
 			/* Alternate way to configure prescalers using operator overload */
 			Sys_Clock& operator /=(const Prescaler_AHB prescaler_ahb);
@@ -685,25 +981,43 @@ namespace bare_metal
 			/* Alternate way to configure prescaleres usiong opearator overload */
 			Sys_Clock& operator /= (const Prescaler_PLLM prescaler_pllp);
 			Sys_Clock& operator /= (const Prescaler_PLLP prescaler_pllp);
+			Sys_Clock& operator /= (const Prescaler_PLLQ prescaler_pllq);
 			Sys_Clock& operator *= (const Prescaler_PLLN prescaler_plln);
 
 		private:
-			void frequency_default_hsi();
-			void frequency_default_hse();
-			void frequency_default_pll();
+			/* Reads RCC_CFGR and RCC_PLLCFGR once each and decodes them into frequency_clock */
+			void frequency_refresh() const;
+
+			/* Switches to HSI with undivided buses, no model update or notification */
+			Frequency_Sys_Clock_Status sysclk_park_hsi();
 
-			void frequency_update_hclk(const Prescaler_AHB prescaler_ahb);
-			void frequency_update_p1clk(const Prescaler_APB1 prescaler_apb1);
-			void frequency_update_p2clk(const Prescaler_APB2 prescaler_apb2);
+			/* configure_clock() once it holds the configuring flag */
+			Frequency_Sys_Clock_Status configure_clock_tree(const Clock_Config_Type& config);
 
+			/* Notify every attached observer, post re-reads the frequencies from RCC first */
+			void clock_change_pre(const Frequency_Clock_Type& frequency_old, const Frequency_Clock_Type& frequency_new);
+			void clock_change_post();
 
-			void frequency_update_pllclk(const Prescaler_PLLM prescaler_pllm);
-			void frequency_update_pllclk(const Prescaler_PLLP prescaler_pllp);
-			void frequency_update_pllclk(const Prescaler_PLLN prescaler_plln);
+			/* Clears and writes LATENCY, then reads it back */
+			Frequency_Sys_Clock_Status flash_write_latency(const Flash_Latency flash_latency);
 
 			Sys_Oscillator_Type oscillator_type;
-			Frequency_Clock_Type frequency_clock;
+			mutable Frequency_Clock_Type frequency_clock;
+			mutable volatile bool frequency_stale;
+			std::uint32_t frequency_hsi;
+			Sys_Clock_Transaction_Type transaction;
+			Clock_Observer* observers;
+			const Clock_Config_Type* async_config;
+			volatile Sys_Clock_Async_State async_state;
+			volatile bool css_failure;
+			volatile bool configuring;
 	};
+
+	/* true while a configure_clock_async() bring-up owns HSEON/PLLON, any Sys_Clock instance */
+	bool sys_clock_async_pending();
+
+	/* Clears the driver's .noinit state, Reset_Handler calls it before the first Sys_Clock use */
+	void sys_clock_boot();
 }
 
 #endif /* SYS_CLOCK_H */
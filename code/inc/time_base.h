@@ -0,0 +1,82 @@
+#ifndef TIME_BASE_H
+#define TIME_BASE_H
+
+#include <cstdint>
+
+/** Monotonic time base on SysTick
+  * Time stamp (64 bit):
+  * 	[63:24] SysTick ticks since time_base_start()
+  * 	[23:0]  cycles elapsed inside the current tick (reload - SYST_CVR)
+  * SYST_RVR is 24 bit so the cycle field never overflows into the tick field,
+  * stamps compare and subtract as plain integers even across clock changes.
+  * 40 bit of ticks at 1000 Hz = 34 years.
+  *
+  * time_base_now() is lock-free and never masks interrupts, it can be called from
+  * thread and ISR context. SysTick must have a priority at least as high as any ISR
+  * that calls it, otherwise a reader preempting SysTick_Handler sees one tick less.
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t TIME_BASE_CYCLE_BITS   = (24);
+	constexpr std::uint32_t TIME_BASE_CYCLE_MASK   = (0x00FFFFFF);
+	constexpr std::uint32_t TIME_BASE_NO_DEADLINE  = (0xFFFFFFFF);
+
+	class Tick_Observer;
+
+	/* Runs on every SysTick from SysTick_Handler, in attach order reversed */
+	void time_base_attach_observer(Tick_Observer& observer);
+	void time_base_detach_observer(Tick_Observer& observer);
+
+	/* Intrusive list node, attaching never allocates */
+	class Tick_Observer
+	{
+		public:
+			/* ticks is 1 for a regular SysTick, more after a tickless sleep */
+			virtual void tick_elapsed(const std::uint32_t ticks) = 0;
+
+			/* Ticks until this observer has work again, time_base_idle() sleeps at most that long
+			 * Called with interrupts masked. 1 = every tick, TIME_BASE_NO_DEADLINE = nothing pending */
+			virtual std::uint32_t tick_next_deadline() const
+			{
+				return 1U;
+			}
+
+		protected:
+			~Tick_Observer() = default;
+
+		private:
+			friend void time_base_attach_observer(Tick_Observer& observer);
+			friend void time_base_detach_observer(Tick_Observer& observer);
+			friend void time_base_tick();
+			friend void time_base_idle();
+			Tick_Observer* tick_next = nullptr;
+	};
+
+	/* Called by Nvic once SysTick runs with reload_value */
+	void time_base_start(const std::uint32_t reload_value);
+
+	/* Called from SysTick_Handler only, single writer */
+	void time_base_tick();
+
+	/* Tickless idle, call from the idle loop in thread mode
+	 * Stops the periodic tick, sleeps (WFI) until the earliest observer deadline or any
+	 * interrupt, then adds the slept ticks and restarts SysTick in phase. SysTick runs from
+	 * HCLK/8 while asleep when the tick period allows it: 2^24 x 8 cycles, ~800 ms at 168 MHz */
+	void time_base_idle();
+
+	std::uint64_t time_base_now();
+	std::uint64_t time_base_tick_count();
+
+	constexpr std::uint64_t time_base_ticks(const std::uint64_t time_stamp)
+	{
+		return time_stamp >> TIME_BASE_CYCLE_BITS;
+	}
+
+	constexpr std::uint32_t time_base_cycles(const std::uint64_t time_stamp)
+	{
+		return static_cast<std::uint32_t>(time_stamp & TIME_BASE_CYCLE_MASK);
+	}
+}
+
+#endif /* TIME_BASE_H */
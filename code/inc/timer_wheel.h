@@ -0,0 +1,79 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <time_base.h>
+
+/** Hierarchical timing wheel
+  * 4 levels x 64 slots, level n holds timers expiring in [64^n, 64^(n+1)) ticks.
+  * start() / cancel() are O(1): the slot comes from the expiry tick, the node unlinks
+  * through its back pointer. Every 64^n ticks one level n slot is cascaded down.
+  * Timers further out than 2^24 ticks park in the top level and get re-filed until they fit.
+  *
+  * Timers are intrusive nodes owned by the caller (static storage, nothing is allocated).
+  * All timers due on a tick are taken off the wheel in one step and their callbacks run
+  * back to back from SysTick_Handler once the wheel is attached to the time base.
+  * A callback may start or cancel any timer, including itself.
+  */
+
+namespace bare_metal
+{
+	constexpr std::uint32_t TIMER_WHEEL_LEVELS     = (4);
+	constexpr std::uint32_t TIMER_WHEEL_SLOT_BITS  = (6);
+	constexpr std::uint32_t TIMER_WHEEL_SLOTS      = (1U << TIMER_WHEEL_SLOT_BITS);
+	constexpr std::uint32_t TIMER_WHEEL_SLOT_MASK  = (TIMER_WHEEL_SLOTS - 1U);
+	constexpr std::uint32_t TIMER_WHEEL_RANGE      = (1U << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS));
+	/* Longer timeouts wrap the 32 bit tick compare */
+	constexpr std::uint32_t TIMER_WHEEL_TICKS_MAX  = (0x7FFFFFFF);
+
+	class Software_Timer
+	{
+		public:
+			/* Runs from SysTick_Handler, keep it short */
+			virtual void timer_expired() = 0;
+
+			bool is_active() const { return this->timer_link != nullptr; }
+
+		protected:
+			~Software_Timer() = default;
+
+		private:
+			friend class Timer_Wheel;
+			Software_Timer*  timer_next = nullptr;
+			Software_Timer** timer_link = nullptr;     /* Pointer that points at this node, null when idle */
+			std::uint32_t    timer_expiry = 0U;
+	};
+
+	class Timer_Wheel : public Tick_Observer
+	{
+		public:
+			constexpr Timer_Wheel() : slots(), expired(nullptr), tick(0U)
+			{
+			}
+
+			/* (Re)starts the timer to expire after ticks (0 is treated as 1, the next tick) */
+			void start(Software_Timer& timer, const std::uint32_t ticks);
+			void cancel(Software_Timer& timer);
+
+			/* Moves the wheel by one tick and runs the expired callbacks */
+			void advance();
+			void tick_elapsed(const std::uint32_t ticks) override;
+
+			/* Ticks until the earliest slot that needs work (an expiry or a cascade),
+			 * TIME_BASE_NO_DEADLINE when the wheel is empty. Scans at most 4 x 64 slots */
+			std::uint32_t tick_next_deadline() const override;
+
+			std::uint32_t get_tick() const { return this->tick; }
+
+		private:
+			void timer_link(Software_Timer& timer);
+			void timer_unlink(Software_Timer& timer);
+			void cascade(const std::uint32_t level);
+
+			Software_Timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+			Software_Timer* expired;
+			volatile std::uint32_t tick;
+	};
+}
+
+#endif /* TIMER_WHEEL_H */
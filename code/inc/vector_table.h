@@ -0,0 +1,55 @@
+#ifndef VECTOR_TABLE_H
+#define VECTOR_TABLE_H
+
+#include <cstdint>
+#include <nvic.h>
+
+/** Vector table in SRAM
+  * The flash table is copied to SRAM during startup and VTOR points at the copy,
+  * handlers can then be swapped at runtime without touching flash.
+  *
+  * BARE_METAL_RAMFUNC places a function in SRAM (.ramfunc, copied with .data): no flash
+  * wait states and no ART misses. CCM RAM (0x10000000) is data only on the F407, the
+  * I-bus cannot fetch from it, so code goes to SRAM and CCM takes stacks and buffers
+  * with BARE_METAL_CCMRAM (not initialised, not reachable by DMA).
+  * BARE_METAL_NOINIT keeps data out of .data/.bss: Reset_Handler neither copies nor zeroes it,
+  * so code that runs before step 2 can use it once its owner cleared it. Plain .bss on the host.
+  */
+
+/* long_call, SRAM is out of BL range from flash */
+#if defined(__arm__)
+#define BARE_METAL_RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call))
+#else
+#define BARE_METAL_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#endif
+#define BARE_METAL_CCMRAM  __attribute__((section(".ccmram")))
+#if defined(BARE_METAL_HOST)
+#define BARE_METAL_NOINIT
+#else
+#define BARE_METAL_NOINIT  __attribute__((section(".noinit")))
+#endif
+
+namespace bare_metal
+{
+	using Isr_Handler = void (*)();
+
+	constexpr std::uint32_t SCB_VTOR =                 (0xE000ED08);     /* Vector Table Offset Register */
+	constexpr std::uint32_t VECTOR_TABLE_IRQ_OFFSET =  (16);
+	constexpr std::uint32_t VECTOR_TABLE_SIZE =        (VECTOR_TABLE_IRQ_OFFSET + NVIC_IRQ_COUNT);
+	constexpr std::uint32_t VECTOR_TABLE_ALIGNMENT =   (512);
+
+	static_assert(VECTOR_TABLE_SIZE * sizeof(std::uint32_t) <= VECTOR_TABLE_ALIGNMENT, "VTOR alignment too small for the table");
+
+	extern const Isr_Handler vector_table_flash[VECTOR_TABLE_SIZE];
+	extern Isr_Handler vector_table_ram[VECTOR_TABLE_SIZE];
+
+	/* Copies the flash table to SRAM and sets VTOR, called from Reset_Handler */
+	void vector_table_relocate();
+
+	/* Swap a handler, disable the IRQ first if it can fire while being swapped */
+	void vector_table_set_handler(const Irq_Number irq, const Isr_Handler handler);
+	void vector_table_set_handler(const System_Exception_Number exception, const Isr_Handler handler);
+	Isr_Handler vector_table_get_handler(const Irq_Number irq);
+}
+
+#endif /* VECTOR_TABLE_H */
@@ -0,0 +1,244 @@
+/* Source: clock_gate.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * One 8 bit reference count per ENR bit, indexed [bus][bit]. Counts and the ENR
+ * read-modify-write change together inside one critical section, so an ISR enabling
+ * a peripheral in the middle of a thread disabling it always sees a consistent pair.
+ * Clock_Gate_Batch::commit():
+ * 1. walk the staged bits of every bus, 0 -> 1 goes into set, 1 -> 0 goes into clear
+ * 2. one ENR read-modify-write per bus with a change, then one LPENR per bus
+ * 3. one read back of the last ENR that gained a bit, RCC sits on a single AHB port so
+ *    every earlier write has completed by then
+ * Counts never saturate, a reference past CLOCK_GATE_COUNT_MAX or a disable at 0 is refused.
+ * A saturated count would gate the clock while a driver still holds a reference.
+ * commit() checks every staged bit before it changes any count, a batch applies fully or not at all.
+ * AHB1LPENR also gates FLITF, SRAM1 and SRAM2 in Sleep mode, clock_gate_sleep_unused()
+ * leaves those as they are.
+ */
+
+#include "clock_gate.h"
+#include "sys_clock.h"
+#include "critical_section.h"
+
+namespace bare_metal
+{
+	/* FLITFLPEN, SRAM1LPEN, SRAM2LPEN have no ENR counterpart */
+	constexpr std::uint32_t CLOCK_GATE_AHB1LPENR_MEMORY = (0x7U << 15U);
+
+	static std::uint8_t clock_gate_counts[CLOCK_GATE_BUS_COUNT][CLOCK_GATE_BIT_MASK + 1U];
+
+	static Register_Type& clock_gate_enr(const std::uint32_t bus)
+	{
+		switch (static_cast<Clock_Gate_Bus>(bus))
+		{
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1: return RCC->rcc_ahb1enr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2: return RCC->rcc_ahb2enr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB3: return RCC->rcc_ahb3enr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_APB1: return RCC->rcc_apb1enr;
+			default:                                  return RCC->rcc_apb2enr;
+		}
+	}
+
+	static Register_Type& clock_gate_lpenr(const std::uint32_t bus)
+	{
+		switch (static_cast<Clock_Gate_Bus>(bus))
+		{
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1: return RCC->rcc_ahb1lpenr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB2: return RCC->rcc_ahb2lpenr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_AHB3: return RCC->rcc_ahb3lpenr;
+			case Clock_Gate_Bus::CLOCK_GATE_BUS_APB1: return RCC->rcc_apb1lpenr;
+			default:                                  return RCC->rcc_apb2lpenr;
+		}
+	}
+
+	static std::uint8_t& clock_gate_count(const Peripheral_Id id)
+	{
+		return clock_gate_counts[static_cast<std::uint32_t>(clock_gate_bus(id))][static_cast<std::uint32_t>(id) & CLOCK_GATE_BIT_MASK];
+	}
+
+	/* Stalls until the ENR write reached RCC, the peripheral is clocked afterwards */
+	static void clock_gate_read_back(const Register_Type& enr)
+	{
+		const std::uint32_t read_back = enr;
+		static_cast<void>(read_back);
+	}
+
+	bool clock_gate_enable(const Peripheral_Id id)
+	{
+		Critical_Section critical_section;
+		std::uint8_t& count = clock_gate_count(id);
+
+		if (count >= CLOCK_GATE_COUNT_MAX)
+		{
+			return false;
+		}
+		if (count == 0U)
+		{
+			Register_Type& enr = clock_gate_enr(static_cast<std::uint32_t>(clock_gate_bus(id)));
+			enr |= clock_gate_mask(id);
+			clock_gate_read_back(enr);
+		}
+		++count;
+		return true;
+	}
+
+	bool clock_gate_disable(const Peripheral_Id id)
+	{
+		Critical_Section critical_section;
+		std::uint8_t& count = clock_gate_count(id);
+
+		if (count == 0U)
+		{
+			return false;
+		}
+		if (count == 1U)
+		{
+			clock_gate_enr(static_cast<std::uint32_t>(clock_gate_bus(id))) &= ~clock_gate_mask(id);
+		}
+		--count;
+		return true;
+	}
+
+	void clock_gate_sleep(const Peripheral_Id id, const bool run_in_sleep)
+	{
+		Critical_Section critical_section;
+		Register_Type& lpenr = clock_gate_lpenr(static_cast<std::uint32_t>(clock_gate_bus(id)));
+
+		if (run_in_sleep)
+		{
+			lpenr |= clock_gate_mask(id);
+		}
+		else
+		{
+			lpenr &= ~clock_gate_mask(id);
+		}
+	}
+
+	void clock_gate_sleep_unused()
+	{
+		Critical_Section critical_section;
+
+		for (std::uint32_t bus = 0U; bus < CLOCK_GATE_BUS_COUNT; ++bus)
+		{
+			const std::uint32_t enr = clock_gate_enr(bus);
+			Register_Type& lpenr = clock_gate_lpenr(bus);
+			if (bus == static_cast<std::uint32_t>(Clock_Gate_Bus::CLOCK_GATE_BUS_AHB1))
+			{
+				lpenr = (enr & ~CLOCK_GATE_AHB1LPENR_MEMORY) | (lpenr & CLOCK_GATE_AHB1LPENR_MEMORY);
+			}
+			else
+			{
+				lpenr = enr;
+			}
+		}
+	}
+
+	std::uint32_t clock_gate_get_count(const Peripheral_Id id)
+	{
+		return clock_gate_count(id);
+	}
+
+	bool clock_gate_is_enabled(const Peripheral_Id id)
+	{
+		return clock_gate_count(id) != 0U;
+	}
+
+	Clock_Gate_Batch& Clock_Gate_Batch::enable(const Peripheral_Id id)
+	{
+		this->enable_mask[static_cast<std::uint32_t>(clock_gate_bus(id))] |= clock_gate_mask(id);
+		return *this;
+	}
+
+	Clock_Gate_Batch& Clock_Gate_Batch::disable(const Peripheral_Id id)
+	{
+		this->disable_mask[static_cast<std::uint32_t>(clock_gate_bus(id))] |= clock_gate_mask(id);
+		return *this;
+	}
+
+	Clock_Gate_Batch& Clock_Gate_Batch::sleep(const Peripheral_Id id, const bool run_in_sleep)
+	{
+		const std::uint32_t bus = static_cast<std::uint32_t>(clock_gate_bus(id));
+		if (run_in_sleep)
+		{
+			this->sleep_set_mask[bus] |= clock_gate_mask(id);
+			this->sleep_clear_mask[bus] &= ~clock_gate_mask(id);
+		}
+		else
+		{
+			this->sleep_clear_mask[bus] |= clock_gate_mask(id);
+			this->sleep_set_mask[bus] &= ~clock_gate_mask(id);
+		}
+		return *this;
+	}
+
+	bool Clock_Gate_Batch::commit()
+	{
+		Critical_Section critical_section;
+		const Register_Type* enr_enabled = nullptr;
+
+		/* A bit staged both ways counts +1 then -1, it only needs room for the +1 */
+		for (std::uint32_t bus = 0U; bus < CLOCK_GATE_BUS_COUNT; ++bus)
+		{
+			for (std::uint32_t staged = this->enable_mask[bus] | this->disable_mask[bus]; staged != 0U; staged &= staged - 1U)
+			{
+				const std::uint32_t bit = static_cast<std::uint32_t>(__builtin_ctz(staged));
+				const std::uint32_t count = clock_gate_counts[bus][bit];
+				const bool enable = (this->enable_mask[bus] & (0x1U << bit)) != 0U;
+				if ((enable && count >= CLOCK_GATE_COUNT_MAX) || (!enable && count == 0U))
+				{
+					return false;
+				}
+			}
+		}
+
+		for (std::uint32_t bus = 0U; bus < CLOCK_GATE_BUS_COUNT; ++bus)
+		{
+			std::uint32_t set = 0U;
+			std::uint32_t clear = 0U;
+
+			for (std::uint32_t staged = this->enable_mask[bus]; staged != 0U; staged &= staged - 1U)
+			{
+				const std::uint32_t bit = static_cast<std::uint32_t>(__builtin_ctz(staged));
+				std::uint8_t& count = clock_gate_counts[bus][bit];
+				set |= (count == 0U) ? (0x1U << bit) : 0U;
+				++count;
+			}
+			for (std::uint32_t staged = this->disable_mask[bus]; staged != 0U; staged &= staged - 1U)
+			{
+				const std::uint32_t bit = static_cast<std::uint32_t>(__builtin_ctz(staged));
+				std::uint8_t& count = clock_gate_counts[bus][bit];
+				clear |= (count == 1U) ? (0x1U << bit) : 0U;
+				--count;
+			}
+
+			/* Enabled and disabled in the same batch nets out to no write */
+			const std::uint32_t both = set & clear;
+			set &= ~both;
+			clear &= ~both;
+
+			if ((set | clear) != 0U)
+			{
+				Register_Type& enr = clock_gate_enr(bus);
+				enr = (enr | set) & ~clear;
+				enr_enabled = (set != 0U) ? &enr : enr_enabled;
+			}
+			if ((this->sleep_set_mask[bus] | this->sleep_clear_mask[bus]) != 0U)
+			{
+				Register_Type& lpenr = clock_gate_lpenr(bus);
+				lpenr = (lpenr | this->sleep_set_mask[bus]) & ~this->sleep_clear_mask[bus];
+			}
+
+			this->enable_mask[bus] = 0U;
+			this->disable_mask[bus] = 0U;
+			this->sleep_set_mask[bus] = 0U;
+			this->sleep_clear_mask[bus] = 0U;
+		}
+
+		if (enr_enabled != nullptr)
+		{
+			clock_gate_read_back(*enr_enabled);
+		}
+		return true;
+	}
+}
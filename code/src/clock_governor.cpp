@@ -0,0 +1,30 @@
+#include "clock_governor.h"
+
+namespace bare_metal
+{
+	/* No shortcut on the cached profile, adopt(), a CSS fallback or a direct configure_clock()
+	 * can change the tree behind the governor. configure_clock() returns after 4 reads when
+	 * RCC and FLASH already run the profile */
+	Frequency_Clock_Type Clock_Governor::switch_profile(const Clock_Profile profile)
+	{
+		const Clock_Config_Type& config = CLOCK_PROFILE_CONFIG[static_cast<std::uint8_t>(profile)];
+		if (this->sys_clock.configure_clock(config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			this->profile = profile;
+		}
+		return this->sys_clock.get_frequency();
+	}
+
+	Clock_Profile Clock_Governor::get_profile() const
+	{
+		/* What RCC runs, the last profile applied when the tree matches none of them */
+		for (std::uint8_t index = 0U; index < sizeof(CLOCK_PROFILE_CONFIG) / sizeof(CLOCK_PROFILE_CONFIG[0]); ++index)
+		{
+			if (this->sys_clock.is_configured(CLOCK_PROFILE_CONFIG[index]))
+			{
+				return static_cast<Clock_Profile>(index);
+			}
+		}
+		return this->profile;
+	}
+}
@@ -0,0 +1,115 @@
+/* Source: clock_trace.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * clock_trace_data lives in .noinit: startup.cpp neither copies nor zeroes it, so the
+ * records of earlier boots are still there after a reset and the running boot can write
+ * its record while Reset_Handler brings the clock up, before .data/.bss exist.
+ * At power-on the SRAM holds noise, a wrong magic, a count above CLOCK_TRACE_ENTRIES or a
+ * record past boots that is not empty clears it all.
+ * A step is one store of three words, entries are written from thread mode and from
+ * RCC_IRQHandler (asynchronous bring-up), the slot is claimed inside a critical section.
+ */
+
+#include "clock_trace.h"
+#include "critical_section.h"
+
+#if defined(BARE_METAL_CLOCK_TRACE)
+
+namespace bare_metal
+{
+#if defined(BARE_METAL_HOST)
+	/* The host has no reset, the simulator leaves it alone like SRAM across a reset */
+	Clock_Trace_History_Type clock_trace_data;
+#else
+	__attribute__((section(".noinit"))) Clock_Trace_History_Type clock_trace_data;
+#endif
+
+	static Clock_Trace_Record_Type& clock_trace_slot()
+	{
+		return clock_trace_data.record[(clock_trace_data.boots - 1U) % CLOCK_TRACE_BOOTS];
+	}
+
+	void clock_trace_clear()
+	{
+		Critical_Section critical_section;
+		clock_trace_data = Clock_Trace_History_Type();
+		clock_trace_data.magic = CLOCK_TRACE_MAGIC;
+	}
+
+	/* Power-on noise can carry the magic by chance, a record must also fit its entries and
+	 * the records no boot reached yet still hold the zeros clock_trace_clear() left */
+	static bool clock_trace_valid()
+	{
+		if (clock_trace_data.magic != CLOCK_TRACE_MAGIC)
+		{
+			return false;
+		}
+		for (std::uint32_t i = 0U; i < CLOCK_TRACE_BOOTS; ++i)
+		{
+			const Clock_Trace_Record_Type& record = clock_trace_data.record[i];
+			if (record.count > CLOCK_TRACE_ENTRIES)
+			{
+				return false;
+			}
+			if (i >= clock_trace_data.boots && (record.count != 0U || record.dropped != 0U))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void clock_trace_boot()
+	{
+		if (!clock_trace_valid())
+		{
+			clock_trace_clear();
+		}
+		++clock_trace_data.boots;
+		/* boots wrapped to 0 would index record[-1] */
+		if (clock_trace_data.boots == 0U)
+		{
+			clock_trace_data.boots = CLOCK_TRACE_BOOTS;
+		}
+		Clock_Trace_Record_Type& record = clock_trace_slot();
+		record.count = 0U;
+		record.dropped = 0U;
+	}
+
+	const Clock_Trace_History_Type& clock_trace_history()
+	{
+		return clock_trace_data;
+	}
+
+	const Clock_Trace_Record_Type& clock_trace_current()
+	{
+		return clock_trace_slot();
+	}
+
+	void clock_trace_record(const Clock_Trace_Event event, const std::uint32_t start, const bool ok)
+	{
+		const std::uint32_t end = dwt_cycle_count();
+		/* No clock_trace_boot() yet, nothing to write into */
+		if (clock_trace_data.magic != CLOCK_TRACE_MAGIC || clock_trace_data.boots == 0U)
+		{
+			return;
+		}
+
+		Critical_Section critical_section;
+		Clock_Trace_Record_Type& record = clock_trace_slot();
+		if (record.count >= CLOCK_TRACE_ENTRIES)
+		{
+			++record.dropped;
+			return;
+		}
+		Clock_Trace_Entry_Type& entry = record.entry[record.count++];
+		entry.event = event;
+		entry.timeout = ok ? 0U : 1U;
+		entry.reserved = 0U;
+		entry.start = start;
+		entry.cycles = end - start;
+	}
+}
+
+#endif
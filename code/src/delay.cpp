@@ -0,0 +1,185 @@
+/* Source: delay.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Every delay stamps CYCCNT first and spins until CYCCNT - start >= cycles - overhead,
+ * unsigned subtraction so a CYCCNT wrap in the middle does not matter.
+ *
+ * Overhead (delay_calibrate), with interrupts masked:
+ * 1. overhead = 0, time a delay of n cycles from the caller: elapsed - n = fixed cost + overshoot
+ *    the overshoot is where the last poll landed, 0 up to one loop iteration
+ * 2. repeat for DELAY_CALIBRATE_RUNS lengths one cycle apart, the smallest is the fixed cost
+ *    with no overshoot, so a compensated delay is never shorter than asked
+ * delay_cycles() and delay_ns() have their own overhead, delay_ns() also converts.
+ *
+ * Attached HCLK: delay_factor = floor(HCLK * 2^32 / 10^9), cycles = ceil(ns * factor / 2^32)
+ * HCLK <= 168MHz keeps the factor below 2^32 and the product below 2^64. The truncated factor
+ * loses less than ns / 2^32 cycles, one cycle short only when the exact count lies that close
+ * above a whole cycle.
+ * A clock change bumps delay_generation. A delay_ns() that sees it counts what already
+ * passed at the old HCLK and converts only the rest at the new one.
+ */
+
+#include "delay.h"
+#include "clock_solver.h"
+#include "dwt.h"
+#include "critical_section.h"
+
+namespace bare_metal
+{
+	/* Lengths one cycle apart, covers the poll loop of delay_cycles() (CYCCNT load, subtract, compare, branch) */
+	constexpr std::uint32_t DELAY_CALIBRATE_RUNS = (4);
+
+	constexpr std::uint32_t delay_factor_q32(const std::uint32_t frequency_hclk)
+	{
+		return static_cast<std::uint32_t>((static_cast<std::uint64_t>(frequency_hclk) << 32U) / DELAY_NS_PER_S);
+	}
+
+	constexpr std::uint32_t delay_cycles_q32(const std::uint32_t ns, const std::uint32_t factor)
+	{
+		return static_cast<std::uint32_t>((static_cast<std::uint64_t>(ns) * factor + 0xFFFFFFFFU) >> 32U);
+	}
+
+	static_assert(delay_factor_q32(FREQUENCY_HCLK_MAX) < 0xFFFFFFFFU, "Factor fits 32 bits up to 168MHz");
+	static_assert(delay_cycles_q32(1000U, delay_factor_q32(168000000U)) == 168U, "1us at 168MHz");
+	static_assert(delay_cycles_q32(400U, delay_factor_q32(168000000U)) == delay_cycles_ns(400U, 168000000U), "Fixed point matches the exact conversion");
+	static_assert(delay_cycles_q32(62U, delay_factor_q32(FREQUENCY_HSI)) == 1U, "62ns at 16MHz is one cycle");
+
+	static volatile std::uint32_t delay_overhead_cycles = DELAY_OVERHEAD_CYCLES;
+	static volatile std::uint32_t delay_overhead_ns = DELAY_OVERHEAD_CYCLES;
+	static volatile std::uint32_t delay_frequency_hclk = FREQUENCY_HSI;
+	static volatile std::uint32_t delay_factor = delay_factor_q32(FREQUENCY_HSI);
+	static volatile std::uint32_t delay_generation = 0U;
+
+	class Delay_Observer : public Clock_Observer
+	{
+		public:
+			void clock_post_change(const Frequency_Clock_Type& frequency_new) override
+			{
+				delay_frequency_hclk = frequency_new.frequency_hclk;
+				delay_factor = delay_factor_q32(frequency_new.frequency_hclk);
+				delay_generation = delay_generation + 1U;
+				/* Wait states and the ART accelerator change with the clock */
+				delay_calibrate();
+			}
+	};
+
+	static Delay_Observer delay_observer;
+
+	void delay_cycles(const std::uint32_t cycles)
+	{
+		const std::uint32_t start = dwt_cycle_count();
+		const std::uint32_t overhead = delay_overhead_cycles;
+		const std::uint32_t target = (cycles > overhead) ? (cycles - overhead) : 0U;
+		while ((dwt_cycle_count() - start) < target)
+		{
+		}
+	}
+
+	void delay_ns(const std::uint32_t ns)
+	{
+		std::uint32_t start = dwt_cycle_count();
+		std::uint32_t generation;
+		std::uint32_t frequency;
+		std::uint32_t factor;
+		{
+			/* One consistent snapshot, the observer may run from an ISR */
+			Critical_Section critical_section;
+			generation = delay_generation;
+			frequency = delay_frequency_hclk;
+			factor = delay_factor;
+		}
+		const std::uint32_t cycles = delay_cycles_q32(ns, factor);
+		const std::uint32_t overhead = delay_overhead_ns;
+		std::uint32_t target = (cycles > overhead) ? (cycles - overhead) : 0U;
+		std::uint32_t remaining = ns;
+
+		while (true)
+		{
+			const std::uint32_t elapsed = dwt_cycle_count() - start;
+			if (elapsed >= target)
+			{
+				return;
+			}
+			if (delay_generation != generation)
+			{
+				/* What passed ran at the old HCLK, the rest is converted at the new one */
+				Critical_Section critical_section;
+				const std::uint64_t passed = (static_cast<std::uint64_t>(elapsed) * DELAY_NS_PER_S) / frequency;
+				remaining = (passed >= remaining) ? 0U : (remaining - static_cast<std::uint32_t>(passed));
+				start += elapsed;
+				generation = delay_generation;
+				frequency = delay_frequency_hclk;
+				factor = delay_factor;
+				target = delay_cycles_q32(remaining, factor);
+			}
+		}
+	}
+
+	void delay_us(std::uint32_t us)
+	{
+		/* us * 1000 fits 32 bits up to 4.29 s, longer delays go in whole seconds */
+		while (us > 1000000U)
+		{
+			delay_ns(static_cast<std::uint32_t>(DELAY_NS_PER_S));
+			us -= 1000000U;
+		}
+		delay_ns(us * 1000U);
+	}
+
+	void delay_calibrate()
+	{
+		Critical_Section critical_section;
+		std::uint32_t best_cycles = 0xFFFFFFFFU;
+		std::uint32_t best_ns = 0xFFFFFFFFU;
+		delay_overhead_cycles = 0U;
+		delay_overhead_ns = 0U;
+
+		/* Cost of the two stamps around each measurement */
+		const std::uint32_t empty_start = dwt_cycle_count();
+		const std::uint32_t empty = dwt_cycle_count() - empty_start;
+
+		for (std::uint32_t run = 0U; run < DELAY_CALIBRATE_RUNS; ++run)
+		{
+			const std::uint32_t cycles = DELAY_CALIBRATE_CYCLES + run;
+			std::uint32_t start = dwt_cycle_count();
+			delay_cycles(cycles);
+			std::uint32_t excess = (dwt_cycle_count() - start) - empty - cycles;
+			best_cycles = (excess < best_cycles) ? excess : best_cycles;
+
+			/* Same length through the nanosecond path */
+			const std::uint32_t ns = static_cast<std::uint32_t>((static_cast<std::uint64_t>(cycles) * DELAY_NS_PER_S) / delay_frequency_hclk);
+			const std::uint32_t cycles_ns = delay_cycles_q32(ns, delay_factor);
+			start = dwt_cycle_count();
+			delay_ns(ns);
+			excess = (dwt_cycle_count() - start) - empty - cycles_ns;
+			best_ns = (excess < best_ns) ? excess : best_ns;
+		}
+
+		/* A negative excess (wrapped) would mean the stamps cost more than measured, keep 0 */
+		delay_overhead_cycles = (best_cycles > DELAY_CALIBRATE_CYCLES) ? 0U : best_cycles;
+		delay_overhead_ns = (best_ns > DELAY_CALIBRATE_CYCLES) ? 0U : best_ns;
+	}
+
+	std::uint32_t delay_overhead()
+	{
+		return delay_overhead_cycles;
+	}
+
+	void delay_attach(Sys_Clock& sys_clock)
+	{
+		{
+			Critical_Section critical_section;
+			delay_frequency_hclk = sys_clock.get_hclk_frequency();
+			delay_factor = delay_factor_q32(delay_frequency_hclk);
+			delay_generation = delay_generation + 1U;
+		}
+		delay_calibrate();
+		sys_clock.attach_observer(delay_observer);
+	}
+
+	void delay_detach(Sys_Clock& sys_clock)
+	{
+		sys_clock.detach_observer(delay_observer);
+	}
+}
@@ -0,0 +1,315 @@
+/* Source: hsi_trim.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Measurement, the timer counts its kernel clock (HSI derived) between input captures:
+ * 1. LSE: TIM5 CH4 remapped to LSE, HSE: TIM11 CH1 remapped to HSE_RTC = HSE / RTCPRE
+ * 2. ICxPSC = 8, one capture every 8 reference edges, the first capture only sets the start
+ * 3. sum of (capture - previous) & counter mask over the window = timer clocks
+ * 4. timer clock = sum * reference / (captures * 8), HSI = timer clock * 16MHz / nominal timer clock
+ *    (the nominal timer clock is decoded from RCC at 16MHz, PLL and prescalers scale both alike)
+ * An overcapture (CCxOF) means an interrupt held the poll loop longer than one capture period,
+ * the window is thrown away and measured again.
+ *
+ * Calibration:
+ * 1. measure at the current HSITRIM
+ * 2. jump to the trim the nominal 80kHz step predicts, measure
+ * 3. walk one step towards 16MHz while the error keeps shrinking, never measure a trim twice
+ * 4. keep the trim with the smallest measured error, hand its frequency to Sys_Clock
+ */
+
+#include "hsi_trim.h"
+#include "clock_gate.h"
+#include "critical_section.h"
+
+namespace bare_metal
+{
+	/* Windows thrown away on overcapture before giving up */
+	constexpr std::uint32_t HSI_TRIM_RETRIES = (3);
+
+	struct Hsi_Trim_Timer_Type
+	{
+		Timer_Register_Handle* timer;
+		Peripheral_Id peripheral;
+		Register_Type* ccr;
+		std::uint32_t counter_mask;
+		std::uint32_t flag;                   /* CCxIF */
+		std::uint32_t overcapture;            /* CCxOF */
+		std::uint32_t captures;
+	};
+
+	static bool hsi_trim_wait(const Register_Type& reg, const std::uint32_t mask, const std::uint32_t value, std::uint32_t polls)
+	{
+		while ((reg & mask) != value)
+		{
+			if (--polls == 0U)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static std::uint32_t hsi_trim_get()
+	{
+		return (RCC->rcc_cr >> 3U) & 0x1FU;
+	}
+
+	static void hsi_trim_set(const std::uint32_t trim)
+	{
+		/* RCC_CR also holds the oscillator enables, an ISR may switch them */
+		Critical_Section critical_section;
+		RCC->rcc_cr = (RCC->rcc_cr & ~(0x1FU << 3U)) | (trim << 3U);
+	}
+
+	/* Timer kernel clock the registers give at HSI = 16MHz */
+	static std::uint32_t hsi_trim_timer_nominal(const bool apb2)
+	{
+		const std::uint32_t cfgr = RCC->rcc_cfgr;
+		const Frequency_Clock_Type frequency = sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr, RCC->rcc_pllcfgr);
+		const std::uint32_t frequency_pclk = apb2 ? frequency.frequency_p2clk : frequency.frequency_p1clk;
+		return (frequency_pclk == frequency.frequency_hclk) ? frequency_pclk : (frequency_pclk * 2U);
+	}
+
+	/* Timer clocks over one window, 0 when an edge never came */
+	static std::uint64_t hsi_trim_window(const Hsi_Trim_Timer_Type& capture, Frequency_Sys_Clock_Status& status)
+	{
+		for (std::uint32_t retry = 0U; retry <= HSI_TRIM_RETRIES; ++retry)
+		{
+			capture.timer->tim_sr = 0U;
+			if (!hsi_trim_wait(capture.timer->tim_sr, capture.flag, capture.flag, HSI_TRIM_TIMEOUT))
+			{
+				status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_CAPTURE;
+				return 0U;
+			}
+			std::uint32_t previous = *capture.ccr;
+			std::uint64_t sum = 0U;
+			bool overcapture = false;
+
+			for (std::uint32_t i = 0U; i < capture.captures && !overcapture; ++i)
+			{
+				if (!hsi_trim_wait(capture.timer->tim_sr, capture.flag, capture.flag, HSI_TRIM_TIMEOUT))
+				{
+					status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_CAPTURE;
+					return 0U;
+				}
+				/* Reading CCRx clears CCxIF */
+				const std::uint32_t value = *capture.ccr;
+				sum += (value - previous) & capture.counter_mask;
+				previous = value;
+				overcapture = (capture.timer->tim_sr & capture.overcapture) != 0U;
+			}
+			if (!overcapture)
+			{
+				status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+				return sum;
+			}
+		}
+		status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+		return 0U;
+	}
+
+	std::uint32_t hsi_trim_measure(const Hsi_Trim_Reference reference, Frequency_Sys_Clock_Status& status)
+	{
+		const std::uint32_t cfgr = RCC->rcc_cfgr;
+		const std::uint32_t sws = (cfgr >> 2U) & 0x3U;
+
+		/* The timer clock has to follow HSI */
+		if (sws == 0x1U || (sws == 0x2U && (RCC->rcc_pllcfgr & (0x1U << 22U))))
+		{
+			status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+			return 0U;
+		}
+
+		const bool lse = (reference == Hsi_Trim_Reference::HSI_TRIM_REFERENCE_LSE);
+		bool hse_started = false;
+		std::uint32_t rtcpre_old = (cfgr >> 16U) & 0x1FU;
+		std::uint64_t frequency_reference = FREQUENCY_LSE;
+		std::uint64_t reference_divider = 1U;
+
+		if (lse)
+		{
+			/* LSERDY */
+			if ((RCC->rcc_bdcr & (0x1U << 1U)) == 0U)
+			{
+				status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+				return 0U;
+			}
+		}
+		else
+		{
+			/* RCC_IRQHandler owns HSEON while an asynchronous bring-up runs, turning it off would strand it */
+			if (sys_clock_async_pending())
+			{
+				status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+				return 0U;
+			}
+			if ((RCC->rcc_cr & (0x1U << 17U)) == 0U)
+			{
+				{
+					/* RCC_CR is shared with Sys_Clock, which may write it from an interrupt */
+					Critical_Section critical_section;
+					RCC->rcc_cr |= (0x1U << 16U);
+				}
+				hse_started = true;
+				if (!hsi_trim_wait(RCC->rcc_cr, (0x1U << 17U), (0x1U << 17U), SYS_CLOCK_TIMEOUT_HSE))
+				{
+					Critical_Section critical_section;
+					RCC->rcc_cr &= ~(0x1U << 16U);
+					status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_HSE;
+					return 0U;
+				}
+			}
+			/* RTCPRE 0 and 1 give no HSE_RTC, an RTC running on HSE keeps its own divider */
+			if (rtcpre_old < 2U)
+			{
+				Critical_Section critical_section;
+				RCC->rcc_cfgr = (RCC->rcc_cfgr & ~(0x1FU << 16U)) | (HSI_TRIM_RTCPRE << 16U);
+			}
+			frequency_reference = FREQUENCY_HSE;
+			reference_divider = (rtcpre_old < 2U) ? HSI_TRIM_RTCPRE : rtcpre_old;
+		}
+
+		const Hsi_Trim_Timer_Type capture = lse ?
+			Hsi_Trim_Timer_Type{ TIM5, Peripheral_Id::PERIPHERAL_TIM5, &TIM5->tim_ccr4, 0xFFFFFFFFU, (0x1U << 4U), (0x1U << 12U), HSI_TRIM_CAPTURES_LSE } :
+			Hsi_Trim_Timer_Type{ TIM11, Peripheral_Id::PERIPHERAL_TIM11, &TIM11->tim_ccr1, 0xFFFFU, (0x1U << 1U), (0x1U << 9U), HSI_TRIM_CAPTURES_HSE };
+		Timer_Register_Handle* timer = capture.timer;
+
+		const bool gated = clock_gate_enable(capture.peripheral);
+		timer->tim_cr1 = 0U;
+		timer->tim_psc = 0U;
+		timer->tim_arr = capture.counter_mask;
+		if (lse)
+		{
+			/* TI4_RMP = LSE, CC4S = TI4, IC4PSC = 8, CC4E */
+			timer->tim_or = (0x2U << 6U);
+			timer->tim_ccmr2 = (0x1U << 8U) | (0x3U << 10U);
+			timer->tim_ccer = (0x1U << 12U);
+		}
+		else
+		{
+			/* TI1_RMP = HSE_RTC, CC1S = TI1, IC1PSC = 8, CC1E */
+			timer->tim_or = (0x2U << 0U);
+			timer->tim_ccmr1 = (0x1U << 0U) | (0x3U << 2U);
+			timer->tim_ccer = (0x1U << 0U);
+		}
+		/* UG loads PSC */
+		timer->tim_egr = 0x1U;
+		timer->tim_cr1 = 0x1U;
+
+		const std::uint64_t sum = hsi_trim_window(capture, status);
+
+		timer->tim_cr1 = 0U;
+		timer->tim_ccer = 0U;
+		timer->tim_or = 0U;
+		if (gated)
+		{
+			clock_gate_disable(capture.peripheral);
+		}
+		if (!lse && rtcpre_old < 2U)
+		{
+			Critical_Section critical_section;
+			RCC->rcc_cfgr = (RCC->rcc_cfgr & ~(0x1FU << 16U)) | (rtcpre_old << 16U);
+		}
+		if (hse_started)
+		{
+			Critical_Section critical_section;
+			RCC->rcc_cr &= ~(0x1U << 16U);
+		}
+		if (status != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			return 0U;
+		}
+
+		const std::uint64_t frequency_timer = (sum * frequency_reference) / (static_cast<std::uint64_t>(capture.captures) * HSI_TRIM_CAPTURE_EDGES * reference_divider);
+		return static_cast<std::uint32_t>((frequency_timer * FREQUENCY_HSI) / hsi_trim_timer_nominal(!lse));
+	}
+
+	Hsi_Trim_Result_Type hsi_trim_calibrate(Sys_Clock& sys_clock, const Hsi_Trim_Reference reference)
+	{
+		Hsi_Trim_Result_Type result = { Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK, hsi_trim_get(), 0U, 0 };
+		result.frequency_hsi = hsi_trim_measure(reference, result.status);
+		if (result.status != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			return result;
+		}
+
+		/* One bit per HSITRIM value already measured */
+		std::uint32_t measured = (0x1U << result.trim);
+		std::uint32_t trim = hsi_trim_estimate(result.trim, result.frequency_hsi);
+
+		for (std::uint32_t step = 0U; step <= HSI_TRIM_STEPS_MAX && (measured & (0x1U << trim)) == 0U; ++step)
+		{
+			hsi_trim_set(trim);
+			Frequency_Sys_Clock_Status status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+			const std::uint32_t frequency_hsi = hsi_trim_measure(reference, status);
+			if (status != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+			{
+				result.status = status;
+				break;
+			}
+			measured |= (0x1U << trim);
+
+			const std::int32_t error = hsi_trim_error_ppm(frequency_hsi);
+			const std::int32_t error_best = hsi_trim_error_ppm(result.frequency_hsi);
+			if (((error < 0) ? -error : error) >= ((error_best < 0) ? -error_best : error_best))
+			{
+				break;
+			}
+			result.trim = trim;
+			result.frequency_hsi = frequency_hsi;
+
+			/* Next neighbour towards 16MHz */
+			if (frequency_hsi < FREQUENCY_HSI && trim < HSI_TRIM_MAX)
+			{
+				++trim;
+			}
+			else if (frequency_hsi > FREQUENCY_HSI && trim > 0U)
+			{
+				--trim;
+			}
+		}
+
+		hsi_trim_set(result.trim);
+		result.error_ppm = hsi_trim_error_ppm(result.frequency_hsi);
+		if (result.frequency_hsi != 0U)
+		{
+			sys_clock.set_hsi_frequency(result.frequency_hsi);
+		}
+		return result;
+	}
+
+	void hsi_trim_store(const Hsi_Trim_Result_Type& result)
+	{
+		if (result.frequency_hsi == 0U)
+		{
+			return;
+		}
+		/* Backup domain write protection, DBP */
+		const bool gated = clock_gate_enable(Peripheral_Id::PERIPHERAL_PWR);
+		PWR->pwr_cr |= (0x1U << 8U);
+		RTC->rtc_bkpr[HSI_TRIM_BACKUP_FREQUENCY] = result.frequency_hsi;
+		RTC->rtc_bkpr[HSI_TRIM_BACKUP_TRIM] = HSI_TRIM_BACKUP_MAGIC | (result.trim << 16U);
+		PWR->pwr_cr &= ~(0x1U << 8U);
+		if (gated)
+		{
+			clock_gate_disable(Peripheral_Id::PERIPHERAL_PWR);
+		}
+	}
+
+	bool hsi_trim_restore(Sys_Clock& sys_clock)
+	{
+		const std::uint32_t word = RTC->rtc_bkpr[HSI_TRIM_BACKUP_TRIM];
+		const std::uint32_t frequency_hsi = RTC->rtc_bkpr[HSI_TRIM_BACKUP_FREQUENCY];
+
+		/* Anything further off than the trim range can reach is not a calibration */
+		if ((word & 0xFF000000U) != HSI_TRIM_BACKUP_MAGIC ||
+		    frequency_hsi < (FREQUENCY_HSI - FREQUENCY_HSI / 32U) || frequency_hsi > (FREQUENCY_HSI + FREQUENCY_HSI / 32U))
+		{
+			return false;
+		}
+		hsi_trim_set((word >> 16U) & 0x1FU);
+		sys_clock.set_hsi_frequency(frequency_hsi);
+		return true;
+	}
+}
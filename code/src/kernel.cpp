@@ -0,0 +1,521 @@
+/* Source: kernel.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Ready tasks sit in one list per priority, the running task stays at the head of its list.
+ * kernel_ready_mask has bit p set while list p is not empty, the next task is the head of
+ * the lowest set bit (RBIT + CLZ on the Cortex-M4). The idle task is the only one at
+ * KERNEL_PRIORITIES and never blocks, so the mask is never empty once the kernel runs.
+ * Time slice: the running task's slice counts down per tick while another task of its
+ * priority is ready, at 0 it moves to the tail of its list. A preempted task stays at the
+ * head and keeps what was left of its slice.
+ * Sleeping tasks are in one list sorted by wake tick (signed distance, survives the wrap).
+ *
+ * Every change to the lists happens with PRIMASK set and ends in kernel_reschedule(), which
+ * pends PendSV when the head of the highest ready list is not the running task. PendSV runs
+ * once no other exception is active:
+ * 1. save: PSP, s16-s31 if EXC_RETURN says the task used the FPU (this VSTM also makes the
+ *    hardware store the lazily reserved s0-s15/FPSCR), r4-r11 and EXC_RETURN, store PSP
+ * 2. kernel_switch(): next task, with PRIMASK set for the few loads
+ * 3. load the same in reverse from the next task's stack, return with its EXC_RETURN
+ * Cycles at 168 MHz, 0 wait state SRAM stacks, no FPU context (Cortex-M4 TRM timings):
+ * 	exception entry 12, save 16, kernel_switch ~30, restore 15, exception return 12 = ~85
+ * 	with FPU context on both sides +17 (VSTM) +17 (lazy s0-s15) +17 (VLDM) +17 (return) = ~155
+ * bench/context_switch_benchmark.cpp measures it with CYCCNT on the board.
+ *
+ * The host build has no PendSV: kernel_simulator.cpp runs every task on a ucontext and does
+ * the switch where the core would take PendSV.
+ */
+
+#include "kernel.h"
+#include "time_base.h"
+#include "critical_section.h"
+#if !defined(BARE_METAL_HOST)
+#include "nvic.h"
+#endif
+
+extern "C"
+{
+	/* PendSV saves the outgoing PSP through it and kernel_switch() moves it on */
+	bare_metal::Kernel_Task* kernel_current_task = nullptr;
+	std::uint32_t* kernel_switch();
+}
+
+namespace bare_metal
+{
+#if defined(BARE_METAL_HOST)
+	/* Implemented by the host simulator (code/host/kernel_simulator.cpp) */
+	void kernel_simulator_task_init(Kernel_Task& task, Kernel_Entry entry, void* argument);
+	void kernel_simulator_pend_switch();
+	void kernel_simulator_start();
+	void kernel_simulator_idle();
+#else
+	constexpr std::uint32_t SCB_FPCCR                 = (0xE000EF34);     /* FP Context Control Register */
+	constexpr std::uint32_t KERNEL_EXC_RETURN         = (0xFFFFFFFD);     /* Thread mode, PSP, basic frame */
+	constexpr std::uint32_t KERNEL_XPSR               = (0x01000000);     /* Thumb bit */
+	constexpr std::uint8_t  KERNEL_PENDSV_PRIORITY    = (0xF0);           /* Lowest of the 4 implemented bits */
+#endif
+
+	constexpr std::uint32_t KERNEL_IDLE_PRIORITY = KERNEL_PRIORITIES;
+	constexpr std::uint32_t KERNEL_IDLE_STACK_WORDS = (2U * KERNEL_STACK_WORDS_MIN);
+
+	static Kernel_Task* kernel_ready_head[KERNEL_PRIORITIES + 1U];
+	static Kernel_Task* kernel_ready_tail[KERNEL_PRIORITIES + 1U];
+	static std::uint32_t kernel_ready_mask = 0U;
+	static Kernel_Task* kernel_sleeping = nullptr;
+	static volatile std::uint32_t kernel_ticks = 0U;
+	static volatile std::uint32_t kernel_switches = 0U;
+	static bool kernel_running = false;
+
+	static Kernel_Task kernel_idle_task;
+	static Kernel_Stack_Type<KERNEL_IDLE_STACK_WORDS> kernel_idle_stack;
+
+	/* Everything that touches Kernel_Task internals, the caller holds PRIMASK */
+	class Kernel_Scheduler : public Tick_Observer
+	{
+		public:
+			void tick_elapsed(const std::uint32_t ticks) override
+			{
+				kernel_tick(ticks);
+			}
+
+			/* Called with interrupts masked from time_base_idle(), so only the idle task is ready
+			 * unless a wake-up is already pending */
+			std::uint32_t tick_next_deadline() const override
+			{
+				if ((kernel_ready_mask & ~(1U << KERNEL_IDLE_PRIORITY)) != 0U)
+				{
+					return 1U;
+				}
+				if (kernel_sleeping == nullptr)
+				{
+					return TIME_BASE_NO_DEADLINE;
+				}
+				const std::int32_t ticks = static_cast<std::int32_t>(kernel_sleeping->wake_tick - kernel_ticks);
+				return (ticks < 1) ? 1U : static_cast<std::uint32_t>(ticks);
+			}
+
+			static Kernel_Task* highest()
+			{
+				return kernel_ready_head[__builtin_ctz(kernel_ready_mask)];
+			}
+
+			static void ready_insert(Kernel_Task& task)
+			{
+				const std::uint32_t priority = task.priority;
+				task.state = Kernel_Task_State::KERNEL_TASK_READY;
+				task.slice = KERNEL_TIME_SLICE;
+				task.next = nullptr;
+				if (kernel_ready_head[priority] == nullptr)
+				{
+					kernel_ready_head[priority] = &task;
+				}
+				else
+				{
+					kernel_ready_tail[priority]->next = &task;
+				}
+				kernel_ready_tail[priority] = &task;
+				kernel_ready_mask |= (1U << priority);
+			}
+
+			static void ready_remove(Kernel_Task& task)
+			{
+				const std::uint32_t priority = task.priority;
+				Kernel_Task* previous = nullptr;
+				for (Kernel_Task* node = kernel_ready_head[priority]; node != nullptr; node = node->next)
+				{
+					if (node == &task)
+					{
+						if (previous == nullptr)
+						{
+							kernel_ready_head[priority] = task.next;
+						}
+						else
+						{
+							previous->next = task.next;
+						}
+						if (kernel_ready_tail[priority] == &task)
+						{
+							kernel_ready_tail[priority] = previous;
+						}
+						break;
+					}
+					previous = node;
+				}
+				task.next = nullptr;
+				if (kernel_ready_head[priority] == nullptr)
+				{
+					kernel_ready_mask &= ~(1U << priority);
+				}
+			}
+
+			/* Head of the list to the tail, the next task of the same priority runs */
+			static void ready_rotate(const std::uint32_t priority)
+			{
+				Kernel_Task* head = kernel_ready_head[priority];
+				if (head == nullptr || head->next == nullptr)
+				{
+					return;
+				}
+				kernel_ready_head[priority] = head->next;
+				head->next = nullptr;
+				head->slice = KERNEL_TIME_SLICE;
+				kernel_ready_tail[priority]->next = head;
+				kernel_ready_tail[priority] = head;
+			}
+
+			static void sleep_insert(Kernel_Task& task)
+			{
+				const std::uint32_t now = kernel_ticks;
+				Kernel_Task** link = &kernel_sleeping;
+				while (*link != nullptr && static_cast<std::int32_t>((*link)->wake_tick - now) <= static_cast<std::int32_t>(task.wake_tick - now))
+				{
+					link = &(*link)->next;
+				}
+				task.next = *link;
+				*link = &task;
+			}
+
+			static void sleep_remove(Kernel_Task& task)
+			{
+				for (Kernel_Task** link = &kernel_sleeping; *link != nullptr; link = &(*link)->next)
+				{
+					if (*link == &task)
+					{
+						*link = task.next;
+						task.next = nullptr;
+						return;
+					}
+				}
+			}
+
+			/* Takes the running task off the ready list, PendSV switches once PRIMASK is restored */
+			static void block(const Kernel_Task_State state, const std::uint32_t wake_tick)
+			{
+				Kernel_Task& task = *kernel_current_task;
+				ready_remove(task);
+				task.state = state;
+				if (state == Kernel_Task_State::KERNEL_TASK_SLEEPING)
+				{
+					task.wake_tick = wake_tick;
+					sleep_insert(task);
+				}
+				reschedule();
+			}
+
+			static void wake(Kernel_Task& task)
+			{
+				if (task.state == Kernel_Task_State::KERNEL_TASK_SLEEPING)
+				{
+					sleep_remove(task);
+				}
+				if (task.state == Kernel_Task_State::KERNEL_TASK_SLEEPING || task.state == Kernel_Task_State::KERNEL_TASK_SUSPENDED)
+				{
+					ready_insert(task);
+					reschedule();
+				}
+			}
+
+			static void tick(const std::uint32_t ticks)
+			{
+				kernel_ticks = kernel_ticks + ticks;
+				const std::uint32_t now = kernel_ticks;
+				while (kernel_sleeping != nullptr && static_cast<std::int32_t>(now - kernel_sleeping->wake_tick) >= 0)
+				{
+					Kernel_Task& task = *kernel_sleeping;
+					kernel_sleeping = task.next;
+					ready_insert(task);
+				}
+
+				/* Only the head of a list with more than one task has a slice running */
+				Kernel_Task* current = kernel_current_task;
+				if (current != nullptr && current->state == Kernel_Task_State::KERNEL_TASK_READY &&
+				    kernel_ready_head[current->priority] == current && current->next != nullptr)
+				{
+					if (current->slice > ticks)
+					{
+						current->slice = static_cast<std::uint8_t>(current->slice - ticks);
+					}
+					else
+					{
+						ready_rotate(current->priority);
+					}
+				}
+				reschedule();
+			}
+
+			static void yield()
+			{
+				Kernel_Task* current = kernel_current_task;
+				if (kernel_ready_head[current->priority] == current)
+				{
+					ready_rotate(current->priority);
+					reschedule();
+				}
+			}
+
+			static bool create(Kernel_Task& task, std::uint32_t* stack, const std::uint32_t stack_words,
+			                   Kernel_Entry entry, void* argument, const std::uint32_t priority);
+
+			static void reschedule();
+
+			static std::uint32_t stack_unused(const Kernel_Task& task)
+			{
+				std::uint32_t unused = 0U;
+				while (unused < task.stack_words && task.stack_base[unused] == KERNEL_STACK_PAINT)
+				{
+					++unused;
+				}
+				return unused;
+			}
+
+			static std::uint32_t* switch_next()
+			{
+				Kernel_Task* next = highest();
+				if (next != kernel_current_task)
+				{
+					kernel_switches = kernel_switches + 1U;
+				}
+				kernel_current_task = next;
+				return next->stack_pointer;
+			}
+
+			static void port_task_init(Kernel_Task& task, Kernel_Entry entry, void* argument);
+	};
+
+	static void kernel_idle(void*)
+	{
+		for (;;)
+		{
+#if defined(BARE_METAL_HOST)
+			kernel_simulator_idle();
+#else
+			time_base_idle();
+#endif
+		}
+	}
+
+#if defined(BARE_METAL_HOST)
+	void Kernel_Scheduler::port_task_init(Kernel_Task& task, Kernel_Entry entry, void* argument)
+	{
+		/* The simulator runs the task on its own host stack, the static stack stays painted */
+		task.stack_pointer = task.stack_base + task.stack_words;
+		kernel_simulator_task_init(task, entry, argument);
+	}
+
+	void Kernel_Scheduler::reschedule()
+	{
+		if (kernel_running && highest() != kernel_current_task)
+		{
+			kernel_simulator_pend_switch();
+		}
+	}
+#else
+	static Kernel_Scheduler kernel_scheduler;
+
+	/* A task returning from its entry lands here (lr of the first frame) */
+	static void kernel_task_return()
+	{
+		kernel_exit();
+	}
+
+	void Kernel_Scheduler::port_task_init(Kernel_Task& task, Kernel_Entry entry, void* argument)
+	{
+		std::uint32_t* top = task.stack_base + task.stack_words;
+
+		/* Hardware frame as exception entry leaves it: r0-r3, r12, lr, pc, xPSR */
+		*--top = KERNEL_XPSR;
+		*--top = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(entry)) & ~0x1U;
+		*--top = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(&kernel_task_return));
+		for (std::uint32_t i = 0U; i < 4U; ++i)
+		{
+			*--top = 0U;                                                                     /* r12, r3 - r1 */
+		}
+		*--top = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(argument));  /* r0 */
+
+		/* PendSV frame: r4-r11 then EXC_RETURN (STMDB stores the highest register highest) */
+		*--top = KERNEL_EXC_RETURN;
+		for (std::uint32_t i = 0U; i < 8U; ++i)
+		{
+			*--top = 0U;
+		}
+		task.stack_pointer = top;
+	}
+
+	void Kernel_Scheduler::reschedule()
+	{
+		if (kernel_running && highest() != kernel_current_task)
+		{
+			/* ICSR PENDSVSET */
+			*reinterpret_cast<volatile std::uint32_t *>(SCB_ICSR) = (1U << 28U);
+		}
+	}
+#endif
+
+	bool Kernel_Scheduler::create(Kernel_Task& task, std::uint32_t* stack, const std::uint32_t stack_words,
+	                              Kernel_Entry entry, void* argument, const std::uint32_t priority)
+	{
+		if (task.state != Kernel_Task_State::KERNEL_TASK_DORMANT || priority > KERNEL_IDLE_PRIORITY ||
+		    stack_words < KERNEL_STACK_WORDS_MIN || (priority == KERNEL_IDLE_PRIORITY && &task != &kernel_idle_task))
+		{
+			return false;
+		}
+		for (std::uint32_t i = 0U; i < stack_words; ++i)
+		{
+			stack[i] = KERNEL_STACK_PAINT;
+		}
+		task.stack_base = stack;
+		task.stack_words = stack_words;
+		task.priority = static_cast<std::uint8_t>(priority);
+		port_task_init(task, entry, argument);
+		ready_insert(task);
+		reschedule();
+		return true;
+	}
+
+	bool kernel_task_create(Kernel_Task& task, std::uint32_t* stack, const std::uint32_t stack_words,
+	                        Kernel_Entry entry, void* argument, const std::uint32_t priority)
+	{
+		Critical_Section critical_section;
+		return Kernel_Scheduler::create(task, stack, stack_words, entry, argument, priority);
+	}
+
+	void kernel_start()
+	{
+		{
+			Critical_Section critical_section;
+			Kernel_Scheduler::create(kernel_idle_task, kernel_idle_stack.stack, KERNEL_IDLE_STACK_WORDS, kernel_idle, nullptr, KERNEL_IDLE_PRIORITY);
+			kernel_current_task = nullptr;
+			kernel_running = true;
+		}
+#if defined(BARE_METAL_HOST)
+		kernel_simulator_start();
+#else
+		time_base_attach_observer(kernel_scheduler);
+		nvic_set_system_priority(System_Exception_Number::EXCEPTION_PENDSV, KERNEL_PENDSV_PRIORITY);
+#if defined(__ARM_FP)
+		/* ASPEN, LSPEN: FP context stacked on exception entry, lazily (reset default, made explicit) */
+		*reinterpret_cast<volatile std::uint32_t *>(SCB_FPCCR) |= (1U << 31U) | (1U << 30U);
+#endif
+		/* First PendSV sees no current task and saves nothing, main()'s stack becomes the handler stack */
+		*reinterpret_cast<volatile std::uint32_t *>(SCB_ICSR) = (1U << 28U);
+		__asm volatile ("cpsie i" ::: "memory");
+		__asm volatile ("isb" ::: "memory");
+		for (;;)
+		{
+		}
+#endif
+	}
+
+	void kernel_yield()
+	{
+		Critical_Section critical_section;
+		Kernel_Scheduler::yield();
+	}
+
+	void kernel_sleep(const std::uint32_t ticks)
+	{
+		if (ticks == 0U)
+		{
+			kernel_yield();
+			return;
+		}
+		Critical_Section critical_section;
+		Kernel_Scheduler::block(Kernel_Task_State::KERNEL_TASK_SLEEPING, kernel_ticks + ticks);
+	}
+
+	void kernel_sleep_until(const std::uint32_t wake_tick)
+	{
+		Critical_Section critical_section;
+		if (static_cast<std::int32_t>(wake_tick - kernel_ticks) > 0)
+		{
+			Kernel_Scheduler::block(Kernel_Task_State::KERNEL_TASK_SLEEPING, wake_tick);
+		}
+	}
+
+	void kernel_suspend()
+	{
+		Critical_Section critical_section;
+		Kernel_Scheduler::block(Kernel_Task_State::KERNEL_TASK_SUSPENDED, 0U);
+	}
+
+	void kernel_exit()
+	{
+		{
+			Critical_Section critical_section;
+			Kernel_Scheduler::block(Kernel_Task_State::KERNEL_TASK_DORMANT, 0U);
+		}
+		/* Never scheduled again */
+		for (;;)
+		{
+		}
+	}
+
+	void kernel_resume(Kernel_Task& task)
+	{
+		Critical_Section critical_section;
+		Kernel_Scheduler::wake(task);
+	}
+
+	void kernel_tick(const std::uint32_t ticks)
+	{
+		Critical_Section critical_section;
+		Kernel_Scheduler::tick(ticks);
+	}
+
+	Kernel_Task* kernel_current()
+	{
+		return kernel_current_task;
+	}
+
+	std::uint32_t kernel_tick_count()
+	{
+		return kernel_ticks;
+	}
+
+	std::uint32_t kernel_switch_count()
+	{
+		return kernel_switches;
+	}
+
+	std::uint32_t kernel_stack_unused(const Kernel_Task& task)
+	{
+		return Kernel_Scheduler::stack_unused(task);
+	}
+}
+
+/* Called from PendSV_Handler (and the host simulator) with the outgoing context saved */
+extern "C" std::uint32_t* kernel_switch()
+{
+	bare_metal::Critical_Section critical_section;
+	return bare_metal::Kernel_Scheduler::switch_next();
+}
+
+#if !defined(BARE_METAL_HOST)
+extern "C" __attribute__((naked)) void PendSV_Handler()
+{
+	__asm volatile (
+		"    mrs      r0, psp                               \n"
+		"    movw     r3, #:lower16:kernel_current_task     \n"
+		"    movt     r3, #:upper16:kernel_current_task     \n"
+		"    ldr      r2, [r3]                              \n"
+		"    cbz      r2, 1f                                \n"     /* First switch, nothing to save */
+#if defined(__ARM_FP)
+		"    tst      lr, #0x10                             \n"     /* EXC_RETURN[4] = 0: extended frame */
+		"    it       eq                                    \n"
+		"    vstmdbeq r0!, {s16-s31}                        \n"
+#endif
+		"    stmdb    r0!, {r4-r11, lr}                     \n"
+		"    str      r0, [r2]                              \n"     /* Kernel_Task::stack_pointer */
+		"1:  bl       kernel_switch                         \n"
+		"    ldmia    r0!, {r4-r11, lr}                     \n"
+#if defined(__ARM_FP)
+		"    tst      lr, #0x10                             \n"
+		"    it       eq                                    \n"
+		"    vldmiaeq r0!, {s16-s31}                        \n"
+#endif
+		"    msr      psp, r0                               \n"
+		"    bx       lr                                    \n"
+	);
+}
+#endif
@@ -0,0 +1,88 @@
+/* Source: log.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * log_ring is an Spsc_Ring of words. The single producer the ring expects is "whoever holds
+ * PRIMASK": every LOG() from thread mode or an ISR checks for room and pushes its whole record
+ * inside one critical section, so records never interleave. The consumer is log_drain() in
+ * one thread, it takes no lock and ISRs keep logging while the sink runs.
+ * A record is pushed whole or not at all, the decoder never sees half a record. Lost records
+ * are counted and reported by one LOG_ID_DROPPED record as soon as there is room again.
+ * Sys_Clock logs from Reset_Handler before .data/.bss exist, so the ring and its counters sit
+ * in .noinit (startup.cpp neither copies nor zeroes them) and log_boot() empties them first.
+ * The boot records then survive the .bss zeroing and reach the first log_drain().
+ */
+
+#include "log.h"
+#include "spsc_ring.h"
+#include "critical_section.h"
+#include "vector_table.h"
+
+#if defined(BARE_METAL_LOG)
+
+namespace bare_metal
+{
+	/* Buffer, head, tail: log_decode --ring reads a dump of it with this layout */
+	BARE_METAL_NOINIT Spsc_Ring<std::uint32_t, LOG_WORDS> log_ring;
+
+	static_assert(sizeof(log_ring) == (LOG_WORDS + 2U) * sizeof(std::uint32_t), "log_decode expects buffer, head, tail");
+
+	static BARE_METAL_NOINIT std::uint32_t log_dropped_pending;
+	static BARE_METAL_NOINIT std::uint32_t log_dropped_total;
+
+	void log_boot()
+	{
+		log_ring.reset();
+		log_dropped_pending = 0U;
+		log_dropped_total = 0U;
+	}
+
+	void log_push(const std::uint32_t* words, const std::uint32_t count)
+	{
+		Critical_Section critical_section;
+		if (log_dropped_pending != 0U)
+		{
+			if (log_ring.space() < count + 3U)
+			{
+				log_dropped_pending += 1U;
+				log_dropped_total += 1U;
+				return;
+			}
+			const std::uint32_t dropped[] = { log_header(LOG_ID_DROPPED, 1U), words[1], log_dropped_pending };
+			log_ring.push(dropped, 3U);
+			log_dropped_pending = 0U;
+		}
+		if (log_ring.space() < count)
+		{
+			log_dropped_pending += 1U;
+			log_dropped_total += 1U;
+			return;
+		}
+		log_ring.push(words, count);
+	}
+
+	std::uint32_t log_drain(Log_Sink sink)
+	{
+		std::uint32_t total = 0U;
+		/* Second span after the wrap, records that arrive meanwhile wait for the next call */
+		for (std::uint32_t span_count = 0U; span_count < 2U; ++span_count)
+		{
+			const Spsc_Span_Type<const std::uint32_t> span = log_ring.claim_read(LOG_WORDS);
+			if (span.count == 0U)
+			{
+				break;
+			}
+			sink(span.data, span.count);
+			log_ring.commit_read(span.count);
+			total += span.count;
+		}
+		return total;
+	}
+
+	std::uint32_t log_dropped()
+	{
+		return log_dropped_total;
+	}
+}
+
+#endif
@@ -0,0 +1,27 @@
+#include "mmio.h"
+
+namespace bare_metal
+{
+#if defined(BARE_METAL_BUS_COUNTER)
+	Bus_Access_Counter_Type bus_access_counter = { 0U, 0U };
+
+	Bus_Access_Counter_Type bus_access_counter_get()
+	{
+		return bus_access_counter;
+	}
+
+	void bus_access_counter_reset()
+	{
+		bus_access_counter = { 0U, 0U };
+	}
+#else
+	Bus_Access_Counter_Type bus_access_counter_get()
+	{
+		return { 0U, 0U };
+	}
+
+	void bus_access_counter_reset()
+	{
+	}
+#endif
+}
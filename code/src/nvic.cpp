@@ -1,31 +1,129 @@
 #include "nvic.h"
+#include "time_base.h"
 
 namespace bare_metal
 {
+	/* HCLK cycles per SysTick - 1, false when the rate is 0, above HCLK or too slow for 24 bits */
+	static bool nvic_systick_reload(const std::uint32_t frequency_hclk, const std::uint32_t hz, std::uint32_t& reload)
+	{
+		if (hz == 0U || frequency_hclk / hz == 0U || (frequency_hclk / hz) - 1U > SYST_RELOAD_MAX)
+		{
+			return false;
+		}
+		reload = (frequency_hclk / hz) - 1U;
+		return true;
+	}
+
 	/* 1000 Hz = .001 ms in delay 
 	 * based on your requirements pass in the delay you want in Hertz */
-	Nvic::Nvic(const Sys_Clock& sys_clock, const std::uint32_t hz_clk_delay)
+	Nvic::Nvic(Sys_Clock& sys_clock, const std::uint32_t hz_clk_delay) : hz_clk_delay(hz_clk_delay), status(Nvic_Status::STATUS_NVIC_OK)
+	{
+		start(sys_clock);
+	}
+
+	Nvic_Status Nvic::start(Sys_Clock& sys_clock)
+	{
+		if (configure_systick(sys_clock, this->hz_clk_delay) != Nvic_Status::STATUS_NVIC_OK)
+		{
+			return this->status;
+		}
+		enable_systick_counter();
+
+		sys_clock.attach_observer(*this);
+		return this->status;
+	}
+
+	void Nvic::enable_system_exception(const System_Exception_Number exception)
+	{
+		volatile std::uint32_t *scb_shcsr = reinterpret_cast<volatile std::uint32_t *>(SCB_SHCRS);
+		volatile std::uint32_t *syst_csr = reinterpret_cast<volatile std::uint32_t *>(SYST_CSR);
+
+		switch (exception)
+		{
+			/* Disabled faults escalate to HardFault */
+			case System_Exception_Number::EXCEPTION_MEMFAULT:   *scb_shcsr |= (1U << 16U); break; /* MEMFAULTENA */
+			case System_Exception_Number::EXCEPTION_BUSFAULT:   *scb_shcsr |= (1U << 17U); break; /* BUSFAULTENA */
+			case System_Exception_Number::EXCEPTION_USAGEFAULT: *scb_shcsr |= (1U << 18U); break; /* USGFAULTENA */
+			case System_Exception_Number::EXCEPTION_SYSTICK:    *syst_csr |= (1U << 1U); break;   /* TICKINT */
+			default: break;
+		}
+	}
+
+	void Nvic::disable_system_exception(const System_Exception_Number exception)
+	{
+		volatile std::uint32_t *scb_shcsr = reinterpret_cast<volatile std::uint32_t *>(SCB_SHCRS);
+		volatile std::uint32_t *syst_csr = reinterpret_cast<volatile std::uint32_t *>(SYST_CSR);
+
+		switch (exception)
+		{
+			case System_Exception_Number::EXCEPTION_MEMFAULT:   *scb_shcsr &= ~(1U << 16U); break;
+			case System_Exception_Number::EXCEPTION_BUSFAULT:   *scb_shcsr &= ~(1U << 17U); break;
+			case System_Exception_Number::EXCEPTION_USAGEFAULT: *scb_shcsr &= ~(1U << 18U); break;
+			case System_Exception_Number::EXCEPTION_SYSTICK:    *syst_csr &= ~(1U << 1U); break;
+			default: break;
+		}
+	}
+
+	Nvic_Status Nvic::configure_systick(const Sys_Clock& sys_clock, const std::uint32_t counter)
 	{
 		/* SYST_RVR to configure the count down value */
 		volatile std::uint32_t *syst_rvr = reinterpret_cast<volatile std::uint32_t *>(SYST_RVR);
+		/* SYST_CVR any write clears it, the first period starts from the new reload */
+		volatile std::uint32_t *syst_cvr = reinterpret_cast<volatile std::uint32_t *>(SYST_CVR);
 		/* SYST_CSR to enable settings for the SYSTick */
 		volatile std::uint32_t *syst_csr = reinterpret_cast<volatile std::uint32_t *>(SYST_CSR);
 
 		/* The reload_value is to determine when to call SysTick exception 
 		 * Note: When counting down the - 1 is taken account for when it reloads
-		 * CSR */
-		std::uint32_t reload_value = (sys_clock.get_sysclk_frequency()/hz_clk_delay) - 1;
+		 * CSR, SysTick runs from the processor clock (HCLK), time_base counts HCLK cycles,
+		 * so a rate too slow for 24 bits is refused rather than moved to HCLK/8 */
+		std::uint32_t reload_value = 0U;
+		if (!nvic_systick_reload(sys_clock.get_frequency().frequency_hclk, counter, reload_value))
+		{
+			this->status = Nvic_Status::STATUS_NVIC_NOK_SYSTICK;
+			return this->status;
+		}
+		this->hz_clk_delay = counter;
+		this->status = Nvic_Status::STATUS_NVIC_OK;
+
+		/* Stop the counter while it is reconfigured */
+		*syst_csr &= ~(1U << 0U);
 
-		/* Clear the value of SVR before setting */
-		*syst_rvr &= ~(0x00FFFFFF);
 		/* Set the counter value */
-		*syst_rvr |= reload_value;
+		*syst_rvr = reload_value;
+		*syst_cvr = 0U;
 
 		/* Enable Systick Settings */
 		*syst_csr |= (1U << 1U); /* Enables SysTick exception(interrupt) */
 		*syst_csr |= (1U << 2U); /* Indicates the clock source, sysclk */
 
+		time_base_start(reload_value);
+		return this->status;
+	}
+
+	void Nvic::enable_systick_counter()
+	{
+		volatile std::uint32_t *syst_csr = reinterpret_cast<volatile std::uint32_t *>(SYST_CSR);
+
 		/* Enables the configured counter */
-		*syst_csr |= (1 << 0U);
+		*syst_csr |= (1U << 0U);
+	}
+
+	void Nvic::clock_post_change(const Frequency_Clock_Type& frequency_new)
+	{
+		volatile std::uint32_t *syst_rvr = reinterpret_cast<volatile std::uint32_t *>(SYST_RVR);
+
+		/* Same period at the new HCLK, runs with interrupts masked inside the clock switch
+		 * CVR is left alone, the new reload takes effect at the next wrap so the time base stays monotonic.
+		 * A period past 24 bits runs at the longest one, never a wrapped (shorter) reload */
+		std::uint32_t reload_value = SYST_RELOAD_MAX;
+		this->status = nvic_systick_reload(frequency_new.frequency_hclk, this->hz_clk_delay, reload_value) ?
+		               Nvic_Status::STATUS_NVIC_OK : Nvic_Status::STATUS_NVIC_NOK_SYSTICK;
+		*syst_rvr = reload_value;
+	}
+
+	Nvic_Status Nvic::get_status() const
+	{
+		return this->status;
 	}
 }
@@ -0,0 +1,159 @@
+/* Source: startup.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Reset_Handler runs from flash on the reset clock (HSI 16MHz, 0 wait states) or on what
+ * a bootloader left running:
+ * 0. FPU on (CPACR CP10/CP11 full access) when built for it (__ARM_FP), before any
+ *    code the compiler may give an FP instruction, it resets off and the first one faults
+ * 1. DWT CYCCNT on, clock tree up from startup_clock_config() with the ART accelerator
+ *    on, this runs before .data/.bss exist: Sys_Clock uses its own members and file
+ *    statics in .noinit that sys_clock_boot() clears first, the clock trace
+ *    (BARE_METAL_CLOCK_TRACE) its .noinit record and LOG() (BARE_METAL_LOG) its .noinit
+ *    ring, log_boot() empties it so the boot records survive step 3
+ * 2. copy .data (and .ramfunc, linked into it) from flash to SRAM
+ * 3. zero .bss
+ *    both move 16 bytes per LDM/STM pair (4 registers), sections are word aligned so
+ *    at most 3 words are left for the single word tail
+ * 4. run the C++ static constructors (.init_array), empty for the drivers
+ * 5. move the vector table to SRAM
+ * 6. main()
+ * Symbols come from stm32f407.ld.
+ */
+
+#include <cstdint>
+#include "startup.h"
+#include "vector_table.h"
+#include "dwt.h"
+#include "clock_trace.h"
+#include "log.h"
+
+extern "C"
+{
+	extern std::uint32_t _sidata;
+	extern std::uint32_t _sdata;
+	extern std::uint32_t _edata;
+	extern std::uint32_t _sbss;
+	extern std::uint32_t _ebss;
+
+	using Init_Function = void (*)();
+	extern Init_Function __init_array_start[];
+	extern Init_Function __init_array_end[];
+
+	int main();
+}
+
+namespace bare_metal
+{
+	constexpr std::uint32_t STARTUP_SCB_CPACR = (0xE000ED88);     /* Coprocessor Access Control Register */
+
+	Startup_Statistics_Type startup_statistics;
+	Sys_Clock startup_sys_clock;
+
+	__attribute__((weak)) const Clock_Config_Type* startup_clock_config()
+	{
+		return nullptr;
+	}
+
+	static inline void startup_copy(std::uint32_t* destination, const std::uint32_t* source, const std::uint32_t* end)
+	{
+#if defined(__arm__)
+		__asm volatile (
+			"1:  sub   r12, %[end], %[destination]  \n"
+			"    cmp   r12, #16                     \n"
+			"    blo   2f                           \n"
+			"    ldmia %[source]!, {r2-r5}          \n"
+			"    stmia %[destination]!, {r2-r5}     \n"
+			"    b     1b                           \n"
+			"2:  cmp   %[destination], %[end]       \n"
+			"    bhs   3f                           \n"
+			"    ldr   r2, [%[source]], #4          \n"
+			"    str   r2, [%[destination]], #4     \n"
+			"    b     2b                           \n"
+			"3:                                     \n"
+			: [destination] "+r" (destination), [source] "+r" (source)
+			: [end] "r" (end)
+			: "r2", "r3", "r4", "r5", "r12", "cc", "memory");
+#else
+		while (destination < end)
+		{
+			*destination++ = *source++;
+		}
+#endif
+	}
+
+	static inline void startup_zero(std::uint32_t* destination, const std::uint32_t* end)
+	{
+#if defined(__arm__)
+		__asm volatile (
+			"    movs  r2, #0                       \n"
+			"    movs  r3, #0                       \n"
+			"    movs  r4, #0                       \n"
+			"    movs  r5, #0                       \n"
+			"1:  sub   r12, %[end], %[destination]  \n"
+			"    cmp   r12, #16                     \n"
+			"    blo   2f                           \n"
+			"    stmia %[destination]!, {r2-r5}     \n"
+			"    b     1b                           \n"
+			"2:  cmp   %[destination], %[end]       \n"
+			"    bhs   3f                           \n"
+			"    str   r2, [%[destination]], #4     \n"
+			"    b     2b                           \n"
+			"3:                                     \n"
+			: [destination] "+r" (destination)
+			: [end] "r" (end)
+			: "r2", "r3", "r4", "r5", "r12", "cc", "memory");
+#else
+		while (destination < end)
+		{
+			*destination++ = 0U;
+		}
+#endif
+	}
+}
+
+extern "C" void Reset_Handler()
+{
+	using namespace bare_metal;
+
+#if defined(__ARM_FP)
+	*reinterpret_cast<volatile std::uint32_t *>(STARTUP_SCB_CPACR) |= (0xFU << 20U);
+	__asm volatile ("dsb" ::: "memory");
+	__asm volatile ("isb" ::: "memory");
+#endif
+
+	dwt_enable_cycle_counter();
+	clock_trace_boot();
+	log_boot();
+	sys_clock_boot();
+
+	/* Local until .data is in place, copied to startup_sys_clock afterwards
+	 * Adopted, after a bootloader jump the clock it left running is kept if it matches */
+	Sys_Clock sys_clock = Sys_Clock::adopt();
+	const Clock_Config_Type* config = startup_clock_config();
+	if (config != nullptr && sys_clock.configure_clock(*config) == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+	{
+		sys_clock.configure_flash_mode(Flash_Mode::FLASH_MODE_PERFORMANCE);
+	}
+	const std::uint32_t cycles_clock = dwt_cycle_count();
+
+	startup_copy(&_sdata, &_sidata, &_edata);
+	startup_zero(&_sbss, &_ebss);
+	const std::uint32_t cycles_memory = dwt_cycle_count();
+
+	startup_sys_clock = sys_clock;
+
+	for (Init_Function *function = __init_array_start; function < __init_array_end; ++function)
+	{
+		(*function)();
+	}
+
+	vector_table_relocate();
+
+	startup_statistics.cycles_clock = cycles_clock;
+	startup_statistics.cycles_memory = cycles_memory;
+	startup_statistics.cycles_main = dwt_cycle_count();
+
+	main();
+	while(true);
+}
@@ -36,9 +36,20 @@
  ---------------------------------------------------------------------------------------------
  * VCOCLK = PLLinput / (PLLM/PLLM)
  * PLLCLK = SYSCLK = VCOCLK / PLLP
+ * PLL48CLK = VCOCLK / PLLQ, USB OTG FS needs exactly 48 MHz, SDIO and RNG at most 48 MHz
+ * I2SCLK = PLLinput / PLLM * PLLI2SN / PLLI2SR, the PLLI2S shares PLLM and PLLSRC
  */
 
 #include "sys_clock.h"
+#include "clock_solver.h"
+#include "clock_solver_i2s.h"
+#include "critical_section.h"
+#include "clock_trace.h"
+#include "log.h"
+#include "vector_table.h"
+#if !defined(BARE_METAL_HOST)
+#include "nvic.h"
+#endif
 
 namespace bare_metal
 {
@@ -46,127 +57,72 @@ namespace bare_metal
 /* Beginning Sys_Clock Source Code
  */
 
-void Sys_Clock::frequency_default_hse()
-{
-	this->frequency_clock.frequency_sysclk = FREQUENCY_HSE;
-	this->frequency_clock.frequency_hclk = FREQUENCY_HSE;
-	this->frequency_clock.frequency_p1clk = FREQUENCY_HSE;
-	this->frequency_clock.frequency_p2clk = FREQUENCY_HSE;
-}
-
-void Sys_Clock::frequency_default_hsi()
-{
-	this->frequency_clock.frequency_sysclk = FREQUENCY_HSI;
-	this->frequency_clock.frequency_hclk = FREQUENCY_HSI;
-	this->frequency_clock.frequency_p1clk = FREQUENCY_HSI;
-	this->frequency_clock.frequency_p2clk = FREQUENCY_HSI;
-}
-
-void Sys_Clock::frequency_update_hclk(Prescaler_AHB prescaler_ahb)
+/* Polls until (reg & mask) == value, gives up after polls reads. The wait is traced as event */
+static bool sys_clock_wait(const Register_Type& reg, const std::uint32_t mask, const std::uint32_t value, std::uint32_t polls, const Clock_Trace_Event event)
 {
-	switch(prescaler_ahb)
+	const std::uint32_t trace_start = clock_trace_start();
+	while ((reg & mask) != value)
 	{
-		case Prescaler_AHB::PRESCALER_AHB_DIV1:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 1U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV2:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 2U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV4:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 4U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV8:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 8U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV16:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 16U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV64:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 64U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV128:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 128U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV256:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 256U;
-			break;
-		case Prescaler_AHB::PRESCALER_AHB_DIV512:
-			this->frequency_clock.frequency_hclk = (this->frequency_clock.frequency_sysclk) / 512U;
-			break;
+		if (--polls == 0U)
+		{
+			clock_trace_record(event, trace_start, false);
+			LOG("sys_clock: wait %u timed out, register 0x%08x mask 0x%08x", static_cast<std::uint32_t>(event), static_cast<std::uint32_t>(reg), mask);
+			return false;
+		}
 	}
-	this->frequency_clock.frequency_p1clk = this->frequency_clock.frequency_hclk;
-	this->frequency_clock.frequency_p2clk = this->frequency_clock.frequency_hclk;
+	clock_trace_record(event, trace_start, true);
+	return true;
 }
 
-void Sys_Clock::frequency_update_p1clk(Prescaler_APB1 prescaler_apb1)
+/* State before the change in flight, for the log record clock_change_post() writes
+ * .noinit like log_ring, a change Reset_Handler makes is logged before .bss is zeroed */
+static BARE_METAL_NOINIT std::uint32_t sys_clock_log_cfgr;
+static BARE_METAL_NOINIT std::uint32_t sys_clock_log_sysclk;
+
+/* SWS is the source that really runs, HPRE/PPRE1/PPRE2 the bus prescalers */
+static void sys_clock_log_change(const std::uint32_t cfgr_old, const std::uint32_t cfgr_new, const std::uint32_t sysclk_old, const Frequency_Clock_Type& frequency)
 {
-	switch(prescaler_apb1)
+	const std::uint32_t sws_old = (cfgr_old >> 2U) & 0x3U;
+	const std::uint32_t sws_new = (cfgr_new >> 2U) & 0x3U;
+	if (sws_old != sws_new)
 	{
-		case Prescaler_APB1::PRESCALER_APB1_DIV1:
-			this->frequency_clock.frequency_p1clk = (this->frequency_clock.frequency_hclk) / 1U;
-			break;
-		case Prescaler_APB1::PRESCALER_APB1_DIV2:
-			this->frequency_clock.frequency_p1clk = (this->frequency_clock.frequency_hclk) / 2U;
-			break;
-		case Prescaler_APB1::PRESCALER_APB1_DIV4:
-			this->frequency_clock.frequency_p1clk = (this->frequency_clock.frequency_hclk) / 4U;
-			break;
-		case Prescaler_APB1::PRESCALER_APB1_DIV8:
-			this->frequency_clock.frequency_p1clk = (this->frequency_clock.frequency_hclk) / 8U;
-			break;
-		case Prescaler_APB1::PRESCALER_APB1_DIV16:
-			this->frequency_clock.frequency_p1clk = (this->frequency_clock.frequency_hclk) / 16U;
-			break;
+		LOG("sys_clock: source %u -> %u (0 HSI, 1 HSE, 2 PLL), SYSCLK %u Hz", sws_old, sws_new, frequency.frequency_sysclk);
 	}
-}
-
-void Sys_Clock::frequency_update_p2clk(Prescaler_APB2 prescaler_apb2)
-{
-	switch(prescaler_apb2)
+	else if (sysclk_old != frequency.frequency_sysclk)
 	{
-		case Prescaler_APB2::PRESCALER_APB2_DIV1:
-			this->frequency_clock.frequency_p2clk = (this->frequency_clock.frequency_hclk) / 1U;
-			break;
-		case Prescaler_APB2::PRESCALER_APB2_DIV2:
-			this->frequency_clock.frequency_p2clk = (this->frequency_clock.frequency_hclk) / 2U;
-			break;
-		case Prescaler_APB2::PRESCALER_APB2_DIV4:
-			this->frequency_clock.frequency_p2clk = (this->frequency_clock.frequency_hclk) / 4U;
-			break;
-		case Prescaler_APB2::PRESCALER_APB2_DIV8:
-			this->frequency_clock.frequency_p2clk = (this->frequency_clock.frequency_hclk) / 8U;
-			break;
-		case Prescaler_APB2::PRESCALER_APB2_DIV16:
-			this->frequency_clock.frequency_p2clk = (this->frequency_clock.frequency_hclk) / 16U;
-			break;
+		/* Same source, the PLL was relocked with other factors */
+		LOG("sys_clock: SYSCLK %u -> %u Hz on source %u", sysclk_old, frequency.frequency_sysclk, sws_new);
+	}
+	if ((cfgr_old & 0xFCF0U) != (cfgr_new & 0xFCF0U))
+	{
+		LOG("sys_clock: prescalers HPRE 0x%x PPRE1 0x%x PPRE2 0x%x, HCLK %u P1CLK %u P2CLK %u Hz",
+		    (cfgr_new >> 4U) & 0xFU, (cfgr_new >> 10U) & 0x7U, (cfgr_new >> 13U) & 0x7U,
+		    frequency.frequency_hclk, frequency.frequency_p1clk, frequency.frequency_p2clk);
 	}
 }
 
-void Sys_Clock::frequency_default_pll()
-{
-	this->frequency_clock.frequency_hclk = this->frequency_clock.frequency_sysclk;
-	this->frequency_clock.frequency_p1clk = this->frequency_clock.frequency_sysclk;
-	this->frequency_clock.frequency_p2clk = this->frequency_clock.frequency_sysclk;
-}
-
-Sys_Clock::Sys_Clock() : oscillator_type(Sys_Oscillator_Type::OSC_TYPE_HSI)
+void Sys_Clock::frequency_refresh() const
 {
-	frequency_default_hsi();
+	/* Masked so a clock change from an ISR cannot land between the reads and the store */
+	Critical_Section critical_section;
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	this->frequency_clock = sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr, RCC->rcc_pllcfgr, this->frequency_hsi);
+	this->frequency_stale = false;
 }
 
-Sys_Clock::Sys_Clock(Sys_Oscillator_Type osc_type) : oscillator_type(osc_type)
+Sys_Clock::Sys_Clock(Sys_Oscillator_Type osc_type) : oscillator_type(osc_type), frequency_clock(), frequency_stale(true), frequency_hsi(FREQUENCY_HSI), transaction(), observers(nullptr), async_config(nullptr), async_state(Sys_Clock_Async_State::ASYNC_STATE_IDLE), css_failure(false), configuring(false)
 {
-	if (this->oscillator_type == Sys_Oscillator_Type::OSC_TYPE_HSI)
-	{
-		frequency_default_hsi();
-	}
-	else if (this->oscillator_type == Sys_Oscillator_Type::OSC_TYPE_HSE)
+	if (this->oscillator_type == Sys_Oscillator_Type::OSC_TYPE_HSE)
 	{
 		/* Enable HSE */
 		RCC->rcc_cr |= (0x1U << 16U);
 		/* Keeps looping if 0 if not HSERDY is in ready state */
-		while(!(RCC->rcc_cr & (0x1U << 17U)));
-		frequency_default_hse();
+		if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 17U), (0x1U << 17U), SYS_CLOCK_TIMEOUT_HSE, Clock_Trace_Event::CLOCK_TRACE_HSE_READY))
+		{
+			/* Dead crystal, stay on HSI: get_oscillator_type() reports it */
+			RCC->rcc_cr &= ~(0x1U << 16U);
+			this->oscillator_type = Sys_Oscillator_Type::OSC_TYPE_HSI;
+		}
 	}
 }
 
@@ -176,147 +132,378 @@ void Sys_Clock::sysclk_disable_hsi()
 	RCC->rcc_cr &= ~(0x1U << 0U);
 }
 
-void Sys_Clock::sysclk_select_hse()
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_select_hse()
 {
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t sws_old = (cfgr >> 2U) & 0x3U;
+	clock_change_pre(frequency_old, sys_clock_decode(0x1U, cfgr, 0U));
+
 	/* Select HSE as System Clock Source */
-	RCC->rcc_cfgr |= (0x1U << 0U);
+	RCC->rcc_cfgr = (cfgr & ~(0x3U << 0U)) | (0x1U << 0U);
 	/* Reads SW bit until it shows the System Clock Status is enabled 01 HSE */
-	while((RCC->rcc_cfgr & (0x3U << 2U)) != (0x1U << 2U));
+	if (!sys_clock_wait(RCC->rcc_cfgr, (0x3U << 2U), (0x1U << 2U), SYS_CLOCK_TIMEOUT_SWS, Clock_Trace_Event::CLOCK_TRACE_SWS_SWITCH))
+	{
+		/* Hardware stays on the old source, take the request back */
+		RCC->rcc_cfgr = (RCC->rcc_cfgr & ~(0x3U << 0U)) | sws_old;
+		clock_change_post();
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_SWS;
+	}
 	/* Disable HSI now since HSE is enabled */
 	sysclk_disable_hsi();
+
+	clock_change_post();
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
 }
 
-void Sys_Clock::sysclk_select_pll()
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_park_hsi()
 {
-	/* Clear the Selected Clock */
+	/* Make sure HSI runs before switching back to it */
+	RCC->rcc_cr |= (0x1U << 0U);
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 1U), (0x1U << 1U), SYS_CLOCK_TIMEOUT_HSI, Clock_Trace_Event::CLOCK_TRACE_HSI_READY))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_HSI;
+	}
+	/* Select HSI as System Clock, prescalers stay: they take effect at once, SW only once SWS follows,
+	 * dividing by 1 now would run APB1/APB2 from the old SYSCLK above 42/84MHz until then */
 	RCC->rcc_cfgr &= ~(0x3U << 0U);
-	/* Set the Clock to PLL as System Clock */
-	RCC->rcc_cfgr |= (0x2U << 0U);
+	/* Loops until System Clock Status is HSI 00 */
+	if (!sys_clock_wait(RCC->rcc_cfgr, (0x3U << 2U), (0x0U << 2U), SYS_CLOCK_TIMEOUT_SWS, Clock_Trace_Event::CLOCK_TRACE_SWS_SWITCH))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_SWS;
+	}
+	/* On HSI 16MHz, AHB, APB1 and APB2 undivided */
+	RCC->rcc_cfgr &= ~(0xFCF0U);
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_select_hsi()
+{
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	clock_change_pre(frequency_old, sys_clock_decode(0x0U, 0U, 0U, this->frequency_hsi));
+
+	const Frequency_Sys_Clock_Status status = sysclk_park_hsi();
+	if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+	{
+		this->oscillator_type = Sys_Oscillator_Type::OSC_TYPE_HSI;
+	}
+
+	clock_change_post();
+	return status;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_disable_pll()
+{
+	/* Clear PLLON and wait for PLLRDY to drop */
+	RCC->rcc_cr &= ~(0x1U << 24U);
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 25U), 0U, SYS_CLOCK_TIMEOUT_PLL, Clock_Trace_Event::CLOCK_TRACE_PLL_STOP))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_PLL;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_disable_hse()
+{
+	/* Clear HSEON and wait for HSERDY to drop */
+	RCC->rcc_cr &= ~(0x1U << 16U);
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 17U), 0U, SYS_CLOCK_TIMEOUT_HSE, Clock_Trace_Event::CLOCK_TRACE_HSE_STOP))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_HSE;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_select_pll()
+{
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t sws_old = (cfgr >> 2U) & 0x3U;
+	clock_change_pre(frequency_old, sys_clock_decode(0x2U, cfgr, RCC->rcc_pllcfgr, this->frequency_hsi));
+
+	/* Clear the Selected Clock and set PLL as System Clock, one write */
+	RCC->rcc_cfgr = (cfgr & ~(0x3U << 0U)) | (0x2U << 0U);
 	/* Loops until System Clock Status is enabled PLL 10 */
-	while((RCC->rcc_cfgr & (0x3U << 2U)) != (0x2U << 2U));
-	frequency_default_pll();
+	if (!sys_clock_wait(RCC->rcc_cfgr, (0x3U << 2U), (0x2U << 2U), SYS_CLOCK_TIMEOUT_SWS, Clock_Trace_Event::CLOCK_TRACE_SWS_SWITCH))
+	{
+		RCC->rcc_cfgr = (RCC->rcc_cfgr & ~(0x3U << 0U)) | sws_old;
+		clock_change_post();
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_SWS;
+	}
+
+	clock_change_post();
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
 }
 
 void Sys_Clock::configure_prescaler_ahb(const Prescaler_AHB prescaler_ahb)
 {
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t cfgr_new = (cfgr & ~(0xFU << 4U)) | (static_cast<std::uint32_t>(prescaler_ahb) << 4U);
+	clock_change_pre(frequency_old, sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr_new, RCC->rcc_pllcfgr, this->frequency_hsi));
+
 	/* Clear and Configure HCLK = SYS_CLK/PRESCALER_AHB */
-	RCC->rcc_cfgr &= ~(0xFU << 4U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_ahb) << 4U);
-	frequency_update_hclk(prescaler_ahb);
+	RCC->rcc_cfgr = cfgr_new;
+
+	clock_change_post();
 }
 
 void Sys_Clock::configure_prescaler_apb1(const Prescaler_APB1 prescaler_apb1)
 {
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t cfgr_new = (cfgr & ~(0x7U << 10U)) | (static_cast<std::uint32_t>(prescaler_apb1) << 10U);
+	clock_change_pre(frequency_old, sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr_new, RCC->rcc_pllcfgr, this->frequency_hsi));
+
 	/* Configure P1CLK = HCLK/PRESCALER_APB */
-	RCC->rcc_cfgr &= ~(0x7U << 10U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_apb1) << 10U);
-	frequency_update_p1clk(prescaler_apb1);
+	RCC->rcc_cfgr = cfgr_new;
+
+	clock_change_post();
 }
 
 void Sys_Clock::configure_prescaler_apb2(const Prescaler_APB2 prescaler_apb2)
 {
-	/* Configure P1CLK = HCLK/PRESCALER_APB */
-	RCC->rcc_cfgr &= ~(0x7U << 13U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_apb2) << 13U);
-	frequency_update_p2clk(prescaler_apb2);
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t cfgr_new = (cfgr & ~(0x7U << 13U)) | (static_cast<std::uint32_t>(prescaler_apb2) << 13U);
+	clock_change_pre(frequency_old, sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr_new, RCC->rcc_pllcfgr, this->frequency_hsi));
+
+	/* Configure P2CLK = HCLK/PRESCALER_APB */
+	RCC->rcc_cfgr = cfgr_new;
+
+	clock_change_post();
 }
 
 Sys_Clock& Sys_Clock::operator /=(const Prescaler_AHB prescaler_ahb)
 {
 	/* Configure HCLK = SYS_CLK/PRESCALER_AHB */
-	RCC->rcc_cfgr &= ~(0xFU << 4U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_ahb) << 4U);
-	frequency_update_hclk(prescaler_ahb);
+	configure_prescaler_ahb(prescaler_ahb);
 	return *this;
 }
 
 Sys_Clock& Sys_Clock::operator /=(const Prescaler_APB1 prescaler_apb1)
 {
 	/* Configure P1CLK = HCLK/PRESCALER_APB1 */
-	RCC->rcc_cfgr &= ~(0x7U << 10U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_apb1) << 10U);
-	frequency_update_p1clk(prescaler_apb1);
+	configure_prescaler_apb1(prescaler_apb1);
 	return *this;
 }
 
 Sys_Clock& Sys_Clock::operator /=(const Prescaler_APB2 prescaler_apb2)
 {
 	/* Configure P2CLK = HCLK/PRESCALER_APB2 */
-	RCC->rcc_cfgr &= ~(0x7U << 13U);
-	RCC->rcc_cfgr |= (static_cast<std::uint32_t>(prescaler_apb2) << 13U);
-	frequency_update_p2clk(prescaler_apb2);
+	configure_prescaler_apb2(prescaler_apb2);
 	return *this;
 }
 
+void Sys_Clock::attach_observer(Clock_Observer& observer)
+{
+	Critical_Section critical_section;
+	/* Already in the list, attaching twice would create a cycle */
+	for (Clock_Observer* node = this->observers; node != nullptr; node = node->observer_next)
+	{
+		if (node == &observer)
+		{
+			return;
+		}
+	}
+	observer.observer_next = this->observers;
+	this->observers = &observer;
+}
+
+void Sys_Clock::detach_observer(Clock_Observer& observer)
+{
+	Critical_Section critical_section;
+	for (Clock_Observer** node = &this->observers; *node != nullptr; node = &((*node)->observer_next))
+	{
+		if (*node == &observer)
+		{
+			*node = observer.observer_next;
+			observer.observer_next = nullptr;
+			return;
+		}
+	}
+}
+
+void Sys_Clock::clock_change_pre(const Frequency_Clock_Type& frequency_old, const Frequency_Clock_Type& frequency_new)
+{
+	if constexpr (LOG_ENABLED)
+	{
+		sys_clock_log_cfgr = RCC->rcc_cfgr;
+		sys_clock_log_sysclk = frequency_old.frequency_sysclk;
+	}
+	for (Clock_Observer* node = this->observers; node != nullptr; node = node->observer_next)
+	{
+		node->clock_pre_change(frequency_old, frequency_new);
+	}
+}
+
+void Sys_Clock::clock_change_post()
+{
+	/* What the hardware ended up with, also after a failed or rolled back switch */
+	frequency_refresh();
+	if constexpr (LOG_ENABLED)
+	{
+		sys_clock_log_change(sys_clock_log_cfgr, RCC->rcc_cfgr, sys_clock_log_sysclk, this->frequency_clock);
+	}
+	for (Clock_Observer* node = this->observers; node != nullptr; node = node->observer_next)
+	{
+		node->clock_post_change(this->frequency_clock);
+	}
+}
+
+Frequency_Clock_Type Sys_Clock::get_frequency() const
+{
+	if (this->frequency_stale)
+	{
+		frequency_refresh();
+	}
+	/* Four words, a clock change from an ISR must not tear the copy */
+	Critical_Section critical_section;
+	return this->frequency_clock;
+}
+
 std::uint32_t Sys_Clock::get_sysclk_frequency() const
 {
+	if (this->frequency_stale)
+	{
+		frequency_refresh();
+	}
 	return this->frequency_clock.frequency_sysclk;
 }
 
-Frequency_Clock_Type Sys_Clock::get_frequency() const 
+std::uint32_t Sys_Clock::get_hclk_frequency() const
 {
-	return this->frequency_clock;
+	if (this->frequency_stale)
+	{
+		frequency_refresh();
+	}
+	return this->frequency_clock.frequency_hclk;
 }
 
-Sys_Oscillator_Type Sys_Clock::get_oscillator_type() const
+std::uint32_t Sys_Clock::get_p1clk_frequency() const
 {
-	return this->oscillator_type;
+	if (this->frequency_stale)
+	{
+		frequency_refresh();
+	}
+	return this->frequency_clock.frequency_p1clk;
+}
+
+std::uint32_t Sys_Clock::get_p2clk_frequency() const
+{
+	if (this->frequency_stale)
+	{
+		frequency_refresh();
+	}
+	return this->frequency_clock.frequency_p2clk;
+}
+
+std::uint32_t Sys_Clock::get_p1timclk_frequency() const
+{
+	/* APB1 prescaler 1 is the only case where P1CLK equals HCLK */
+	const Frequency_Clock_Type frequency = get_frequency();
+	return (frequency.frequency_p1clk == frequency.frequency_hclk) ? frequency.frequency_p1clk : (frequency.frequency_p1clk * 2U);
+}
+
+std::uint32_t Sys_Clock::get_p2timclk_frequency() const
+{
+	const Frequency_Clock_Type frequency = get_frequency();
+	return (frequency.frequency_p2clk == frequency.frequency_hclk) ? frequency.frequency_p2clk : (frequency.frequency_p2clk * 2U);
 }
 
-void Sys_Clock::frequency_update_pllclk(const Prescaler_PLLM prescaler_pllm)
+std::uint32_t Sys_Clock::get_pll48clk_frequency() const
 {
-	this->frequency_clock.frequency_sysclk /= static_cast<uint32_t>(prescaler_pllm);
+	/* Not part of frequency_clock, only USB/SDIO/RNG setup asks for it */
+	if ((RCC->rcc_cr & (0x1U << 25U)) == 0U)
+	{
+		return 0U;
+	}
+	return sys_clock_decode_pll48(RCC->rcc_pllcfgr, this->frequency_hsi);
 }
 
-void Sys_Clock::frequency_update_pllclk(const Prescaler_PLLP prescaler_pllp)
+std::uint32_t Sys_Clock::get_plli2s_frequency() const
 {
-	switch(prescaler_pllp)
+	if ((RCC->rcc_cr & (0x1U << 27U)) == 0U)
 	{
-		case Prescaler_PLLP::PRESCALER_PLLP_DIV2:
-			this->frequency_clock.frequency_sysclk /= 2U;
-			break;
-		case Prescaler_PLLP::PRESCALER_PLLP_DIV4:
-			this->frequency_clock.frequency_sysclk /= 4U;
-			break;
-		case Prescaler_PLLP::PRESCALER_PLLP_DIV6:
-			this->frequency_clock.frequency_sysclk /= 6U;
-			break;
-		case Prescaler_PLLP::PRESCALER_PLLP_DIV8:
-			this->frequency_clock.frequency_sysclk /= 8U;
-			break;
+		return 0U;
 	}
+	return sys_clock_decode_plli2s(RCC->rcc_pllcfgr, RCC->rcc_plli2s, this->frequency_hsi);
+}
+
+void Sys_Clock::set_hsi_frequency(const std::uint32_t frequency_hsi)
+{
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	clock_change_pre(frequency_old, sys_clock_decode((cfgr >> 2U) & 0x3U, cfgr, RCC->rcc_pllcfgr, frequency_hsi));
+	this->frequency_hsi = frequency_hsi;
+	clock_change_post();
 }
 
-void Sys_Clock::frequency_update_pllclk(const Prescaler_PLLN prescaler_plln)
+std::uint32_t Sys_Clock::get_hsi_frequency() const
 {
-	this->frequency_clock.frequency_sysclk *= static_cast<uint32_t>(prescaler_plln);
+	return this->frequency_hsi;
+}
+
+Sys_Oscillator_Type Sys_Clock::get_oscillator_type() const
+{
+	return this->oscillator_type;
 }
 
 void Sys_Clock::configure_prescaler_pllm(const Prescaler_PLLM prescaler_pllm)
 {
 	RCC->rcc_pllcfgr &= ~(0x3FU << 0U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllm) << 0U);
-	frequency_update_pllclk(prescaler_pllm);
+	/* PLL output only, SYSCLK changes once it is selected */
+	this->frequency_stale = true;
 }
 
 void Sys_Clock::configure_prescaler_plln(const Prescaler_PLLN prescaler_plln)
 {
 	RCC->rcc_pllcfgr &= ~(511U << 6U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_plln) << 6U);
-	frequency_update_pllclk(prescaler_plln);
+	/* PLL output only, SYSCLK changes once it is selected */
+	this->frequency_stale = true;
 }
 
 void Sys_Clock::configure_prescaler_pllp(const Prescaler_PLLP prescaler_pllp)
 {
-	RCC->rcc_pllcfgr &= ~(0x3FU << 16U);
+	RCC->rcc_pllcfgr &= ~(0x3U << 16U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllp) << 16U);
-	frequency_update_pllclk(prescaler_pllp);
+	/* PLL output only, SYSCLK changes once it is selected */
+	this->frequency_stale = true;
+}
+
+void Sys_Clock::configure_prescaler_pllq(const Prescaler_PLLQ prescaler_pllq)
+{
+	RCC->rcc_pllcfgr &= ~(0xFU << 24U);
+	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllq) << 24U);
+	/* PLL48CLK only, SYSCLK and the buses keep running */
+}
+
+void Sys_Clock::configure_prescaler_plli2sn(const Prescaler_PLLN prescaler_plli2sn)
+{
+	RCC->rcc_plli2s &= ~(0x1FFU << 6U);
+	RCC->rcc_plli2s |= (static_cast<uint32_t>(prescaler_plli2sn) << 6U);
+}
+
+void Sys_Clock::configure_prescaler_plli2sr(const Prescaler_PLLI2SR prescaler_plli2sr)
+{
+	RCC->rcc_plli2s &= ~(0x7U << 28U);
+	RCC->rcc_plli2s |= (static_cast<uint32_t>(prescaler_plli2sr) << 28U);
 }
 
 Sys_Clock& Sys_Clock::operator *=(const Prescaler_PLLN prescaler_plln)
 {
 	RCC->rcc_pllcfgr &= ~(0x1FFU << 6U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_plln) << 6U);
+	this->frequency_stale = true;
 	return *this;
 }
 
@@ -324,21 +511,127 @@ Sys_Clock& Sys_Clock::operator /=(const Prescaler_PLLM prescaler_pllm)
 {
 	RCC->rcc_pllcfgr &= ~(0x3FU << 0U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllm) << 0U);
+	this->frequency_stale = true;
 	return *this;
 }
 
 Sys_Clock& Sys_Clock::operator /=(const Prescaler_PLLP prescaler_pllp)
 {
-	RCC->rcc_pllcfgr &= ~(0xFU << 16U);
+	RCC->rcc_pllcfgr &= ~(0x3U << 16U);
 	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllp) << 16U);
+	this->frequency_stale = true;
 	return *this;
 }
 
-void Sys_Clock::sysclk_enable_pll()
+Sys_Clock& Sys_Clock::operator /=(const Prescaler_PLLQ prescaler_pllq)
+{
+	RCC->rcc_pllcfgr &= ~(0xFU << 24U);
+	RCC->rcc_pllcfgr |= (static_cast<uint32_t>(prescaler_pllq) << 24U);
+	return *this;
+}
+
+void Sys_Clock::transaction_begin()
+{
+	/* One read of each register, every stage after this only touches the shadow copy */
+	this->transaction.active = true;
+	this->transaction.shadow_pllcfgr = RCC->rcc_pllcfgr;
+	this->transaction.shadow_cfgr = RCC->rcc_cfgr;
+	this->transaction.staged_pllcfgr = 0U;
+	this->transaction.staged_cfgr = 0U;
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_AHB prescaler_ahb)
+{
+	this->transaction.shadow_cfgr &= ~(0xFU << 4U);
+	this->transaction.shadow_cfgr |= (static_cast<std::uint32_t>(prescaler_ahb) << 4U);
+	this->transaction.staged_cfgr |= (0xFU << 4U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_APB1 prescaler_apb1)
+{
+	this->transaction.shadow_cfgr &= ~(0x7U << 10U);
+	this->transaction.shadow_cfgr |= (static_cast<std::uint32_t>(prescaler_apb1) << 10U);
+	this->transaction.staged_cfgr |= (0x7U << 10U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_APB2 prescaler_apb2)
+{
+	this->transaction.shadow_cfgr &= ~(0x7U << 13U);
+	this->transaction.shadow_cfgr |= (static_cast<std::uint32_t>(prescaler_apb2) << 13U);
+	this->transaction.staged_cfgr |= (0x7U << 13U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_PLLM prescaler_pllm)
+{
+	this->transaction.shadow_pllcfgr &= ~(0x3FU << 0U);
+	this->transaction.shadow_pllcfgr |= (static_cast<std::uint32_t>(prescaler_pllm) << 0U);
+	this->transaction.staged_pllcfgr |= (0x3FU << 0U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_PLLN prescaler_plln)
+{
+	this->transaction.shadow_pllcfgr &= ~(0x1FFU << 6U);
+	this->transaction.shadow_pllcfgr |= (static_cast<std::uint32_t>(prescaler_plln) << 6U);
+	this->transaction.staged_pllcfgr |= (0x1FFU << 6U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_PLLP prescaler_pllp)
+{
+	this->transaction.shadow_pllcfgr &= ~(0x3U << 16U);
+	this->transaction.shadow_pllcfgr |= (static_cast<std::uint32_t>(prescaler_pllp) << 16U);
+	this->transaction.staged_pllcfgr |= (0x3U << 16U);
+}
+
+void Sys_Clock::transaction_stage(const Prescaler_PLLQ prescaler_pllq)
+{
+	this->transaction.shadow_pllcfgr &= ~(0xFU << 24U);
+	this->transaction.shadow_pllcfgr |= (static_cast<std::uint32_t>(prescaler_pllq) << 24U);
+	this->transaction.staged_pllcfgr |= (0xFU << 24U);
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::transaction_commit()
+{
+	if (!this->transaction.active)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+	this->transaction.active = false;
+
+	/* Reference manual: PLL configuration can only be written while PLLON = 0 */
+	if (this->transaction.staged_pllcfgr != 0U && (RCC->rcc_cr & (0x1U << 24U)))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	Critical_Section critical_section;
+	const Frequency_Clock_Type frequency_old = get_frequency();
+	const std::uint32_t sws = (RCC->rcc_cfgr >> 2U) & 0x3U;
+	clock_change_pre(frequency_old, sys_clock_decode(sws, this->transaction.shadow_cfgr, this->transaction.shadow_pllcfgr, this->frequency_hsi));
+
+	if (this->transaction.staged_pllcfgr != 0U)
+	{
+		RCC->rcc_pllcfgr = this->transaction.shadow_pllcfgr;
+	}
+	if (this->transaction.staged_cfgr != 0U)
+	{
+		RCC->rcc_cfgr = this->transaction.shadow_cfgr;
+	}
+	clock_change_post();
+
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_enable_pll()
 {
 	RCC->rcc_cr |= (0x1U << 24U);
 	/* Waits until it is at a PLLRDY state */
-	while(!(RCC->rcc_cr & (0x1U << 25U)));
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 25U), (0x1U << 25U), SYS_CLOCK_TIMEOUT_PLL, Clock_Trace_Event::CLOCK_TRACE_PLL_LOCK))
+	{
+		/* No lock (missing input clock), leave it off */
+		RCC->rcc_cr &= ~(0x1U << 24U);
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_PLL;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
 }
 
 void Sys_Clock::configure_source_pll()
@@ -346,41 +639,586 @@ void Sys_Clock::configure_source_pll()
 	if (this->oscillator_type == Sys_Oscillator_Type::OSC_TYPE_HSE)
 	{
 		RCC->rcc_pllcfgr |= (0x1U << 22U);
+		this->frequency_stale = true;
 	}
 }
 
+Frequency_Sys_Clock_Status Sys_Clock::flash_write_latency(const Flash_Latency flash_latency)
+{
+	const std::uint32_t trace_start = clock_trace_start();
+	/* Clear the old LATENCY field, ORing alone can only ever add wait states */
+	std::uint32_t flash_acr = FLASH->flash_acr;
+	const std::uint32_t latency_old = flash_acr & (0x7U << 0U);
+	flash_acr &= ~(0x7U << 0U);
+	flash_acr |= (static_cast<std::uint32_t>(flash_latency) << 0U);
+	FLASH->flash_acr = flash_acr;
+
+	/* Reference manual: read back FLASH_ACR to check the new number of wait states is taken into account */
+	const bool ok = ((FLASH->flash_acr & (0x7U << 0U)) == (static_cast<std::uint32_t>(flash_latency) << 0U));
+	clock_trace_record(Clock_Trace_Event::CLOCK_TRACE_FLASH_LATENCY, trace_start, ok);
+	LOG("sys_clock: flash latency %u -> %u wait states, read back ok %u", latency_old, static_cast<std::uint32_t>(flash_latency), ok);
+	if (!ok)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
 Frequency_Sys_Clock_Status Sys_Clock::configure_flash_latency()
 {
-	if (this->frequency_clock.frequency_sysclk < 0U || this->frequency_clock.frequency_sysclk > 168000000U)
+	/* Also covers the configured PLL while SYSCLK is not on it yet, so this can run before sysclk_select_pll() */
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t frequency_pll = sys_clock_decode(0x2U, cfgr, RCC->rcc_pllcfgr, this->frequency_hsi).frequency_hclk;
+	std::uint32_t frequency_hclk = get_hclk_frequency();
+	if (((cfgr >> 2U) & 0x3U) != 0x2U && frequency_pll > frequency_hclk)
+	{
+		frequency_hclk = frequency_pll;
+	}
+
+	if (frequency_hclk > FREQUENCY_HCLK_MAX)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	/* 0 - 30MHz WS0, 30 - 60MHz WS1 ... 150 - 168MHz WS5 */
+	return flash_write_latency(clock_solver_flash_latency(frequency_hclk));
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::configure_flash_mode(const Flash_Mode flash_mode)
+{
+	const std::uint32_t expected = (flash_mode == Flash_Mode::FLASH_MODE_PERFORMANCE) ? ((0x1U << 8U) | (0x1U << 9U) | (0x1U << 10U)) : 0U;
+
+	/* Already in that mode (bootloader), flushing warm caches would only cost refills */
+	if ((FLASH->flash_acr & (0x7U << 8U)) == expected)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+	}
+
+	/* Turn off prefetch and both caches, caches can only be reset while disabled */
+	FLASH->flash_acr &= ~((0x1U << 8U) | (0x1U << 9U) | (0x1U << 10U));
+
+	if (flash_mode == Flash_Mode::FLASH_MODE_PERFORMANCE)
+	{
+		/* Pulse ICRST and DCRST so no stale lines survive a latency change */
+		FLASH->flash_acr |= (0x1U << 11U) | (0x1U << 12U);
+		FLASH->flash_acr &= ~((0x1U << 11U) | (0x1U << 12U));
+
+		/* PRFTEN, ICEN, DCEN */
+		FLASH->flash_acr |= expected;
+	}
+
+	if ((FLASH->flash_acr & (0x7U << 8U)) != expected)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+/* Live registers already hold config: source, prescalers, PLL fields, wait states, unused oscillators off */
+static bool sys_clock_matches(const Clock_Config_Type& config, const std::uint32_t cr, const std::uint32_t cfgr,
+                              const std::uint32_t pllcfgr, const std::uint32_t latency)
+{
+	const bool use_pll = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_PLL);
+	const bool use_hse = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_HSE) ||
+	                     (use_pll && config.source_pll == Sys_Oscillator_Type::OSC_TYPE_HSE);
+
+	if (((cfgr >> 2U) & 0x3U) != (config.register_cfgr & 0x3U) || (cfgr & 0xFCF3U) != config.register_cfgr)
+	{
+		return false;
+	}
+	if (latency != static_cast<std::uint32_t>(config.flash_latency))
+	{
+		return false;
+	}
+	if (use_pll && (pllcfgr & RCC_PLLCFGR_FIELDS) != (config.register_pllcfgr & RCC_PLLCFGR_FIELDS))
+	{
+		return false;
+	}
+	return (use_pll == ((cr & (0x1U << 24U)) != 0U)) && (use_hse == ((cr & (0x1U << 16U)) != 0U));
+}
+
+Sys_Clock Sys_Clock::adopt()
+{
+	Sys_Clock sys_clock;
+	/* SWS 00 HSI, 01 HSE, 10 PLL, same order as Sys_Oscillator_Type */
+	sys_clock.oscillator_type = static_cast<Sys_Oscillator_Type>((RCC->rcc_cfgr >> 2U) & 0x3U);
+	sys_clock.frequency_refresh();
+	return sys_clock;
+}
+
+bool Sys_Clock::is_configured(const Clock_Config_Type& config) const
+{
+	return (config.status == Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK) &&
+	       sys_clock_matches(config, RCC->rcc_cr, RCC->rcc_cfgr, RCC->rcc_pllcfgr, FLASH->flash_acr & (0x7U << 0U));
+}
+
+#if defined(BARE_METAL_HOST)
+/* Implemented by the host simulator (code/host/mmio_simulator.cpp) */
+void mmio_simulator_pend_rcc_interrupt();
+#endif
+
+/* HSE failed, the NMI left the fallback to RCC_IRQHandler
+ * The file statics below are read by configure_clock() and RCC_IRQHandler while Reset_Handler
+ * brings the clock up, before .bss is zeroed: .noinit, sys_clock_boot() clears them */
+static BARE_METAL_NOINIT volatile bool sys_clock_css_pending;
+
+/* ISPR only, no read-modify-write, safe from the NMI. RCC_IRQHandler runs once nothing of higher priority does */
+static void sys_clock_pend_rcc_interrupt()
+{
+#if defined(BARE_METAL_HOST)
+	mmio_simulator_pend_rcc_interrupt();
+#else
+	nvic_enable_irq(Irq_Number::IRQ_RCC);
+	nvic_set_pending_irq(Irq_Number::IRQ_RCC);
+#endif
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::configure_clock(const Clock_Config_Type& config)
+{
+	/* One tree change at a time, an interrupt handler calling in the middle of another gets NOK */
+	{
+		Critical_Section critical_section;
+		if (this->configuring)
+		{
+			return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+		}
+		this->configuring = true;
+	}
+	const Frequency_Sys_Clock_Status status = configure_clock_tree(config);
+	this->configuring = false;
+	/* A CSS fallback that landed meanwhile was left pending, it runs now */
+	if (sys_clock_css_pending)
+	{
+		sys_clock_pend_rcc_interrupt();
+	}
+	return status;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::configure_clock_tree(const Clock_Config_Type& config)
+{
+	if (config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK)
 	{
 		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
 	}
 
-	if (this->frequency_clock.frequency_sysclk >= 0U && this->frequency_clock.frequency_sysclk <= 30000000U)
+	const bool use_pll = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_PLL);
+	const bool use_hse = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_HSE) ||
+	                     (use_pll && config.source_pll == Sys_Oscillator_Type::OSC_TYPE_HSE);
+	/* Interrupts stay enabled through the oscillator and PLL waits (milliseconds for HSE), SysTick
+	 * keeps counting. PRIMASK is only held around a source switch and its notifications */
+	const std::uint32_t trace_start = clock_trace_start();
+	const std::uint32_t cr = RCC->rcc_cr;
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+	const std::uint32_t pllcfgr = RCC->rcc_pllcfgr;
+	const std::uint32_t latency_current = FLASH->flash_acr & (0x7U << 0U);
+	const std::uint32_t latency_target = static_cast<std::uint32_t>(config.flash_latency);
+	const std::uint32_t sws_current = (cfgr >> 2U) & 0x3U;
+
+	/* Warm start, a bootloader (or an earlier call) left exactly this tree running: no write, no notification */
+	if (sys_clock_matches(config, cr, cfgr, pllcfgr, latency_current))
+	{
+		this->oscillator_type = config.source_sysclk;
+		this->frequency_stale = true;
+		clock_trace_record(Clock_Trace_Event::CLOCK_TRACE_CONFIGURE_CLOCK, trace_start, true);
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+	}
+
+	/* A locked PLL with the same PLLM, PLLN, PLLP, PLLSRC and PLLQ is kept, no relock */
+	const bool pll_reuse = use_pll && (cr & (0x1U << 25U)) &&
+	                       ((pllcfgr & RCC_PLLCFGR_FIELDS) == (config.register_pllcfgr & RCC_PLLCFGR_FIELDS));
+
+	/* Park on HSI while the oscillator SYSCLK currently runs from gets reconfigured or turned off.
+	 * Observers get the park as a change of its own, SysTick follows HSI while the PLL relocks */
+	Frequency_Sys_Clock_Status status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+	if ((sws_current == 0x2U && !pll_reuse) || (sws_current == 0x1U && !use_hse))
+	{
+		status = sysclk_select_hsi();
+	}
+
+	/* HSE has to be ready if it drives SYSCLK directly or through the PLL */
+	if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK && use_hse && !(cr & (0x1U << 17U)))
+	{
+		RCC->rcc_cr |= (0x1U << 16U);
+		if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 17U), (0x1U << 17U), SYS_CLOCK_TIMEOUT_HSE, Clock_Trace_Event::CLOCK_TRACE_HSE_READY))
+		{
+			RCC->rcc_cr &= ~(0x1U << 16U);
+			status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_HSE;
+		}
+	}
+
+	/* Wait states are raised before HCLK goes up */
+	if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK && latency_target > latency_current)
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS0) << 0U);
+		status = flash_write_latency(config.flash_latency);
 	}
-	else if (this->frequency_clock.frequency_sysclk > 30000000U && this->frequency_clock.frequency_sysclk <= 60000000U)
+
+	if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK && use_pll && !pll_reuse)
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS1) << 0U);
+		/* PLLM, PLLN, PLLP, PLLSRC and PLLQ in one write, PLL has to be off */
+		status = sysclk_disable_pll();
+		if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			RCC->rcc_pllcfgr = config.register_pllcfgr;
+			status = sysclk_enable_pll();
+		}
 	}
-	else if (this->frequency_clock.frequency_sysclk > 60000000U && this->frequency_clock.frequency_sysclk <= 90000000U)
+
+	if (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS2) << 0U);
+		/* Observers see the switch as one change, inside the same critical section */
+		Critical_Section critical_section;
+		/* Parking rewrote CFGR, read it again */
+		const std::uint32_t cfgr_old = RCC->rcc_cfgr;
+		if ((cfgr_old & 0xFCF3U) != config.register_cfgr)
+		{
+			clock_change_pre(get_frequency(), config.frequency);
+			/* SW, HPRE, PPRE1 and PPRE2 in one write */
+			RCC->rcc_cfgr = (cfgr_old & ~(0xFCF3U)) | config.register_cfgr;
+			/* Loops until System Clock Status follows the selected clock */
+			if (!sys_clock_wait(RCC->rcc_cfgr, (0x3U << 2U), (config.register_cfgr & 0x3U) << 2U, SYS_CLOCK_TIMEOUT_SWS, Clock_Trace_Event::CLOCK_TRACE_SWS_SWITCH))
+			{
+				/* Source and prescalers go back to what is still running */
+				RCC->rcc_cfgr = cfgr_old;
+				status = Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_SWS;
+			}
+			else
+			{
+				this->oscillator_type = config.source_sysclk;
+			}
+			clock_change_post();
+		}
+		else
+		{
+			this->oscillator_type = config.source_sysclk;
+		}
 	}
-	else if (this->frequency_clock.frequency_sysclk > 90000000U && this->frequency_clock.frequency_sysclk <= 120000000U)
+
+	if (status != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS3) << 0U);
+		/* Still on the old clock, or parked on HSI, wait states are only ever left higher */
+		clock_trace_record(Clock_Trace_Event::CLOCK_TRACE_CONFIGURE_CLOCK, trace_start, false);
+		return status;
 	}
-	else if (this->frequency_clock.frequency_sysclk > 120000000U && this->frequency_clock.frequency_sysclk <= 150000000U)
+
+	/* Oscillators the new profile does not need are turned off to save power */
+	if (!use_pll && (cr & (0x1U << 24U)))
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS4) << 0U);
+		sysclk_disable_pll();
 	}
-	else if (this->frequency_clock.frequency_sysclk > 150000000U && this->frequency_clock.frequency_sysclk <= 168000000U)
+	if (!use_hse && (cr & (0x1U << 16U)))
 	{
-		FLASH->flash_acr |= (static_cast<std::uint32_t>(Flash_Latency::FLASH_LATENCY_WS5) << 0U);
+		sysclk_disable_hse();
+	}
+
+	/* Wait states are lowered only after HCLK went down */
+	if (latency_target < latency_current)
+	{
+		status = flash_write_latency(config.flash_latency);
+	}
+	clock_trace_record(Clock_Trace_Event::CLOCK_TRACE_CONFIGURE_CLOCK, trace_start, status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK);
+	return status;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_enable_plli2s()
+{
+	RCC->rcc_cr |= (0x1U << 26U);
+	/* Locks like the main PLL, same bound */
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 27U), (0x1U << 27U), SYS_CLOCK_TIMEOUT_PLL, Clock_Trace_Event::CLOCK_TRACE_PLLI2S_LOCK))
+	{
+		RCC->rcc_cr &= ~(0x1U << 26U);
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_PLL;
+	}
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::sysclk_disable_plli2s()
+{
+	RCC->rcc_cr &= ~(0x1U << 26U);
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 27U), 0U, SYS_CLOCK_TIMEOUT_PLL, Clock_Trace_Event::CLOCK_TRACE_PLLI2S_STOP))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_PLL;
 	}
 	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
 }
 
+Frequency_Sys_Clock_Status Sys_Clock::configure_plli2s(const Clock_I2s_Config_Type& config)
+{
+	if (config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	/* PLLI2SN, PLLI2SR */
+	constexpr std::uint32_t plli2s_fields = (0x1FFU << 6U) | (0x7U << 28U);
+	const std::uint32_t cr = RCC->rcc_cr;
+	const std::uint32_t plli2scfgr = RCC->rcc_plli2s;
+	const std::uint32_t cfgr = RCC->rcc_cfgr;
+
+	/* I2SSRC = PLLI2S instead of the I2S_CKIN pin */
+	if (cfgr & (0x1U << 23U))
+	{
+		RCC->rcc_cfgr = cfgr & ~(0x1U << 23U);
+	}
+	if ((cr & (0x1U << 27U)) && ((plli2scfgr & plli2s_fields) == config.register_plli2scfgr))
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+	}
+	if (cr & (0x1U << 26U))
+	{
+		const Frequency_Sys_Clock_Status status = sysclk_disable_plli2s();
+		if (status != Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK)
+		{
+			return status;
+		}
+	}
+	/* PLLI2SN and PLLI2SR in one write, PLLI2S has to be off */
+	RCC->rcc_plli2s = (plli2scfgr & ~plli2s_fields) | config.register_plli2scfgr;
+	return sysclk_enable_plli2s();
+}
+
+/* Sys_Clock with a bring-up in flight, RCC_IRQHandler forwards to it */
+static BARE_METAL_NOINIT Sys_Clock* sys_clock_async;
+
+bool sys_clock_async_pending()
+{
+	return sys_clock_async != nullptr;
+}
+
+/* PLLON without waiting for PLLRDY, PLLRDYIE reports the lock */
+static bool sys_clock_async_start_pll(const Clock_Config_Type& config)
+{
+	RCC->rcc_cr &= ~(0x1U << 24U);
+	if (!sys_clock_wait(RCC->rcc_cr, (0x1U << 25U), 0U, SYS_CLOCK_TIMEOUT_PLL, Clock_Trace_Event::CLOCK_TRACE_PLL_STOP))
+	{
+		return false;
+	}
+	RCC->rcc_pllcfgr = config.register_pllcfgr;
+	RCC->rcc_cir = (RCC->rcc_cir & (0x3FU << 8U)) | (0x1U << 20U) | (0x1U << 12U);   /* PLLRDYC, PLLRDYIE */
+	RCC->rcc_cr |= (0x1U << 24U);
+	return true;
+}
+
+Frequency_Sys_Clock_Status Sys_Clock::configure_clock_async(const Clock_Config_Type& config)
+{
+	if (config.status != Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	const bool use_pll = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_PLL);
+	const bool use_hse = (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_HSE) ||
+	                     (use_pll && config.source_pll == Sys_Oscillator_Type::OSC_TYPE_HSE);
+
+	Critical_Section critical_section;
+	if (this->async_state == Sys_Clock_Async_State::ASYNC_STATE_WAIT_HSE ||
+	    this->async_state == Sys_Clock_Async_State::ASYNC_STATE_WAIT_PLL)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	const std::uint32_t sws_current = (RCC->rcc_cfgr >> 2U) & 0x3U;
+	const bool pll_reuse = use_pll && (RCC->rcc_cr & (0x1U << 25U)) &&
+	                       ((RCC->rcc_pllcfgr & RCC_PLLCFGR_FIELDS) == (config.register_pllcfgr & RCC_PLLCFGR_FIELDS));
+	/* Relocking the PLL SYSCLK runs from needs the synchronous path */
+	if (sws_current == 0x2U && use_pll && !pll_reuse)
+	{
+		return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_NOK;
+	}
+
+	this->async_config = &config;
+	sys_clock_async = this;
+
+	if (use_hse && !(RCC->rcc_cr & (0x1U << 17U)))
+	{
+		this->async_state = Sys_Clock_Async_State::ASYNC_STATE_WAIT_HSE;
+		RCC->rcc_cir = (RCC->rcc_cir & (0x3FU << 8U)) | (0x1U << 19U) | (0x1U << 11U);   /* HSERDYC, HSERDYIE */
+		RCC->rcc_cr |= (0x1U << 16U);
+	}
+	else if (use_pll && !pll_reuse)
+	{
+		if (!sys_clock_async_start_pll(config))
+		{
+			sys_clock_async = nullptr;
+			this->async_state = Sys_Clock_Async_State::ASYNC_STATE_FAILED;
+			return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_TIMEOUT_PLL;
+		}
+		this->async_state = Sys_Clock_Async_State::ASYNC_STATE_WAIT_PLL;
+	}
+	else
+	{
+		/* Everything needed already runs, only the switch is left */
+		sys_clock_async = nullptr;
+		this->async_state = Sys_Clock_Async_State::ASYNC_STATE_IDLE;
+		return configure_clock(config);
+	}
+
+#if !defined(BARE_METAL_HOST)
+	nvic_enable_irq(Irq_Number::IRQ_RCC);
+#endif
+	return Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK;
+}
+
+Sys_Clock_Async_State Sys_Clock::get_async_state() const
+{
+	return this->async_state;
+}
+
+void Sys_Clock::rcc_interrupt()
+{
+	const std::uint32_t flags = RCC->rcc_cir & 0xFFU;
+	const Clock_Config_Type& config = *this->async_config;
+	bool finish = false;
+
+	/* HSERDYF, HSE up: lock the PLL on it or switch */
+	if ((flags & (0x1U << 3U)) && this->async_state == Sys_Clock_Async_State::ASYNC_STATE_WAIT_HSE)
+	{
+		RCC->rcc_cir = (RCC->rcc_cir & ~(0x1U << 11U) & (0x3FU << 8U)) | (0x1U << 19U);
+		if (config.source_sysclk == Sys_Oscillator_Type::OSC_TYPE_PLL)
+		{
+			this->async_state = Sys_Clock_Async_State::ASYNC_STATE_WAIT_PLL;
+			if (!sys_clock_async_start_pll(config))
+			{
+				this->async_state = Sys_Clock_Async_State::ASYNC_STATE_FAILED;
+				sys_clock_async = nullptr;
+#if !defined(BARE_METAL_HOST)
+				if (!sys_clock_css_pending)
+				{
+					nvic_disable_irq(Irq_Number::IRQ_RCC);
+				}
+#endif
+			}
+		}
+		else
+		{
+			finish = true;
+		}
+	}
+
+	/* PLLRDYF, PLL locked: switch */
+	if ((flags & (0x1U << 4U)) && this->async_state == Sys_Clock_Async_State::ASYNC_STATE_WAIT_PLL)
+	{
+		RCC->rcc_cir = (RCC->rcc_cir & ~(0x1U << 12U) & (0x3FU << 8U)) | (0x1U << 20U);
+		finish = true;
+	}
+
+	if (finish)
+	{
+		/* HSE ready and the PLL locked with the same PLLCFGR, no waits left but SWS */
+		const Frequency_Sys_Clock_Status status = configure_clock(config);
+		this->async_state = (status == Frequency_Sys_Clock_Status::STATUS_SYS_CLOCK_OK) ?
+		                    Sys_Clock_Async_State::ASYNC_STATE_READY : Sys_Clock_Async_State::ASYNC_STATE_FAILED;
+		sys_clock_async = nullptr;
+#if !defined(BARE_METAL_HOST)
+		/* Stays enabled for a CSS fallback the NMI pended meanwhile */
+		if (!sys_clock_css_pending)
+		{
+			nvic_disable_irq(Irq_Number::IRQ_RCC);
+		}
+#endif
+	}
+}
+
+/* Sys_Clock watched by the Clock Security System, NMI_Handler and RCC_IRQHandler forward to it */
+static BARE_METAL_NOINIT Sys_Clock* sys_clock_css;
+
+/* Highest SYSCLK reachable without HSE: HSI / 16 * 336 / 2 */
+using Sys_Clock_Css_Fallback = Clock_Solver<Sys_Oscillator_Type::OSC_TYPE_HSI, 168000000, 168000000, 42000000, 84000000>;
+static_assert(Sys_Clock_Css_Fallback::config.status == Clock_Solver_Status::STATUS_CLOCK_SOLVER_OK, "CSS fallback has to be solvable");
+
+#if !defined(BARE_METAL_HOST)
+/* The fallback runs below every other interrupt */
+constexpr std::uint8_t SYS_CLOCK_CSS_PRIORITY = (0xF0);
+#endif
+
+void Sys_Clock::enable_clock_security()
+{
+	sys_clock_css = this;
+	this->css_failure = false;
+	sys_clock_css_pending = false;
+#if !defined(BARE_METAL_HOST)
+	nvic_set_priority(Irq_Number::IRQ_RCC, SYS_CLOCK_CSS_PRIORITY);
+#endif
+	RCC->rcc_cr |= (0x1U << 19U);
+}
+
+void Sys_Clock::disable_clock_security()
+{
+	RCC->rcc_cr &= ~(0x1U << 19U);
+	sys_clock_css = nullptr;
+}
+
+bool Sys_Clock::get_clock_security_failure() const
+{
+	return this->css_failure;
+}
+
+void Sys_Clock::css_interrupt()
+{
+	/* Hardware already switched SYSCLK to HSI and stopped HSE (and the PLL it drove).
+	 * The NMI can land inside configure_clock(), an observer or any critical section, so it
+	 * only flags the failure and leaves the rebuild to RCC_IRQHandler */
+	this->css_failure = true;
+	this->frequency_stale = true;
+	sys_clock_css_pending = true;
+	sys_clock_pend_rcc_interrupt();
+}
+
+void sys_clock_boot()
+{
+	sys_clock_css_pending = false;
+	sys_clock_async = nullptr;
+	sys_clock_css = nullptr;
+	sys_clock_log_cfgr = 0U;
+	sys_clock_log_sysclk = 0U;
+}
+
+void Sys_Clock::css_fallback()
+{
+	/* A configure_clock() in progress pends the interrupt again once it is done */
+	if (this->configuring)
+	{
+		return;
+	}
+	sys_clock_css_pending = false;
+	/* HSE is left alone, configure_clock() turns it off since the fallback does not use it */
+	this->oscillator_type = Sys_Oscillator_Type::OSC_TYPE_HSI;
+	this->frequency_stale = true;
+	configure_clock(Sys_Clock_Css_Fallback::config);
+}
+
+}
+
+extern "C" void RCC_IRQHandler()
+{
+	using namespace bare_metal;
+
+	if (sys_clock_css_pending && sys_clock_css != nullptr)
+	{
+		sys_clock_css->css_fallback();
+	}
+	if (sys_clock_async != nullptr)
+	{
+		sys_clock_async->rcc_interrupt();
+	}
+	else
+	{
+		/* Stray flag, clear every ready flag so the line drops */
+		RCC->rcc_cir = (RCC->rcc_cir & (0x3FU << 8U)) | (0x3FU << 16U);
+	}
+}
+
+extern "C" void NMI_Handler()
+{
+	using namespace bare_metal;
+
+	/* CSSF, the only NMI source the driver owns */
+	if (RCC->rcc_cir & (0x1U << 7U))
+	{
+		/* CSSC, the NMI stays pending until CSSF is cleared */
+		RCC->rcc_cir = (RCC->rcc_cir & (0x3FU << 8U)) | (0x1U << 23U);
+		if (sys_clock_css != nullptr)
+		{
+			sys_clock_css->css_interrupt();
+		}
+	}
 }
@@ -0,0 +1,249 @@
+/* Source: time_base.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * SysTick_Handler counts ticks, time_base_now() adds the position inside the running
+ * tick read from SYST_CVR. No critical section, the reader retries instead:
+ * 1. tick_count changed while reading        -> SysTick_Handler ran, retry
+ *                                               (also catches a torn 64 bit read)
+ * 2. SYST_CVR went up between two reads      -> counter reloaded in between, retry
+ * 3. SysTick pending (ICSR PENDSTSET)        -> counter reloaded but the handler has not
+ *                                               run yet (interrupts masked or a higher
+ *                                               priority ISR), count the missing tick
+ * Tick observers run after the tick is counted, so time_base_now() inside a callback
+ * already reads the new tick.
+ * period_reload is the reload the running tick started with, SYST_RVR changes only
+ * take effect at the next reload so a clock change mid tick never moves time backwards.
+ *
+ * Tickless idle (time_base_idle), all with interrupts masked, WFI still wakes on a pending one:
+ * 1. ticks = earliest observer deadline, capped by what the 24 bit counter can hold
+ * 2. stop SysTick, sleep = rest of the current tick + (ticks - 1) full ticks
+ * 3. reload = sleep (HCLK/8 when the tick period is a multiple of 8), WFI
+ * 4. on wake stop SysTick, slept = programmed - CVR (+ a full reload if it wrapped)
+ * 5. count the whole ticks slept, run the rest of the partial tick with
+ *    SYST_RVR = remainder, wait until the counter has loaded it, then put the period back,
+ *    it is loaded at the next wrap. Writing SYST_RVR before that first load would start
+ *    a full period instead and shift the tick phase. A remainder too short to see loaded
+ *    (TIME_BASE_IDLE_REMAINDER_MIN) is counted as a tick right away and a full period runs
+ * The few cycles the counter is stopped are lost, time runs slightly slow while idle.
+ */
+
+#include "time_base.h"
+#include "nvic.h"
+#include "critical_section.h"
+
+namespace bare_metal
+{
+	/* Shortest partial tick run on its own, the wait for its load polls SYST_CVR well within it */
+	constexpr std::uint32_t TIME_BASE_IDLE_REMAINDER_MIN = (0x100);
+
+	static volatile std::uint64_t tick_count = 0U;
+	static volatile std::uint32_t period_reload = 0U;
+	static Tick_Observer* tick_observers = nullptr;
+
+	void time_base_attach_observer(Tick_Observer& observer)
+	{
+		Critical_Section critical_section;
+		for (Tick_Observer* node = tick_observers; node != nullptr; node = node->tick_next)
+		{
+			if (node == &observer)
+			{
+				return;
+			}
+		}
+		observer.tick_next = tick_observers;
+		tick_observers = &observer;
+	}
+
+	void time_base_detach_observer(Tick_Observer& observer)
+	{
+		Critical_Section critical_section;
+		for (Tick_Observer** node = &tick_observers; *node != nullptr; node = &(*node)->tick_next)
+		{
+			if (*node == &observer)
+			{
+				*node = observer.tick_next;
+				observer.tick_next = nullptr;
+				return;
+			}
+		}
+	}
+
+	void time_base_start(const std::uint32_t reload_value)
+	{
+		tick_count = 0U;
+		period_reload = reload_value & TIME_BASE_CYCLE_MASK;
+	}
+
+	void time_base_tick()
+	{
+		volatile std::uint32_t *syst_rvr = reinterpret_cast<volatile std::uint32_t *>(SYST_RVR);
+
+		/* The period that just started was loaded from the current SYST_RVR */
+		period_reload = *syst_rvr & TIME_BASE_CYCLE_MASK;
+		tick_count = tick_count + 1U;
+
+		/* next is read first, an observer may detach itself from its callback */
+		Tick_Observer* node = tick_observers;
+		while (node != nullptr)
+		{
+			Tick_Observer* next = node->tick_next;
+			node->tick_elapsed(1U);
+			node = next;
+		}
+	}
+
+	void time_base_idle()
+	{
+		volatile std::uint32_t *syst_csr = reinterpret_cast<volatile std::uint32_t *>(SYST_CSR);
+		volatile std::uint32_t *syst_rvr = reinterpret_cast<volatile std::uint32_t *>(SYST_RVR);
+		volatile std::uint32_t *syst_cvr = reinterpret_cast<volatile std::uint32_t *>(SYST_CVR);
+		volatile std::uint32_t *scb_icsr = reinterpret_cast<volatile std::uint32_t *>(SCB_ICSR);
+
+		std::uint32_t elapsed = 0U;
+		{
+			Critical_Section critical_section;
+
+			std::uint32_t ticks = TIME_BASE_NO_DEADLINE;
+			for (Tick_Observer* node = tick_observers; node != nullptr; node = node->tick_next)
+			{
+				const std::uint32_t deadline = node->tick_next_deadline();
+				ticks = (deadline < ticks) ? deadline : ticks;
+			}
+
+			const std::uint32_t period = (*syst_rvr & TIME_BASE_CYCLE_MASK) + 1U;
+			/* HCLK/8 (CLKSOURCE = 0) only when a tick is a whole number of HCLK/8 cycles */
+			const std::uint32_t divider = ((period & 0x7U) == 0U) ? 8U : 1U;
+			const std::uint32_t ticks_max = ((TIME_BASE_CYCLE_MASK + 1U) / (period / divider));
+			ticks = (ticks > ticks_max) ? ticks_max : ticks;
+
+			if (ticks <= 1U)
+			{
+				/* Next tick is due anyway, plain sleep */
+				__asm volatile ("wfi" ::: "memory");
+				return;
+			}
+
+			/* 1. Stop the tick, a reload that already happened is serviced normally */
+			*syst_csr &= ~(1U << 0U);
+			if (*scb_icsr & (1U << 26U))
+			{
+				*syst_csr |= (1U << 0U);
+				return;
+			}
+			const std::uint32_t remaining = (*syst_cvr & TIME_BASE_CYCLE_MASK);
+
+			/* 2. Sleep for the rest of this tick plus ticks - 1 full ticks */
+			const std::uint32_t sleep = (remaining + (ticks - 1U) * period) / divider;
+			*syst_rvr = sleep - 1U;
+			*syst_cvr = 0U;
+			*syst_csr = (divider == 1U) ? 0x7U : 0x3U;      /* TICKINT | ENABLE, CLKSOURCE */
+
+			__asm volatile ("dsb" ::: "memory");
+			__asm volatile ("wfi" ::: "memory");
+
+			/* 3. Stop and measure, a wrap means the full sleep elapsed */
+			*syst_csr &= ~(1U << 0U);
+			const bool wrapped = (*scb_icsr & (1U << 26U)) != 0U;
+			std::uint32_t slept = (sleep - 1U) - (*syst_cvr & TIME_BASE_CYCLE_MASK);
+			if (wrapped)
+			{
+				slept = sleep;
+				*scb_icsr = (1U << 25U);    /* PENDSTCLR, the ticks are counted here */
+			}
+			slept *= divider;
+
+			/* 4. Whole ticks slept and what is left of the tick the core woke up in */
+			std::uint32_t remainder = remaining - ((slept < remaining) ? slept : remaining);
+			if (slept >= remaining)
+			{
+				elapsed = 1U + (slept - remaining) / period;
+				remainder = period - ((slept - remaining) % period);
+			}
+			remainder = (remainder == 0U) ? period : remainder;
+			if (remainder < TIME_BASE_IDLE_REMAINDER_MIN)
+			{
+				elapsed = elapsed + 1U;
+				remainder = period;
+			}
+
+			/* 5. Finish the partial tick, then back to the periodic reload
+			 * CVR = 0 reloads on the first count, SYST_RVR only changes once that load is seen */
+			*syst_rvr = remainder - 1U;
+			*syst_cvr = 0U;
+			*syst_csr = 0x7U;
+			if (remainder != period)
+			{
+				while ((*syst_cvr & TIME_BASE_CYCLE_MASK) == 0U && (*scb_icsr & (1U << 26U)) == 0U)
+				{
+				}
+				*syst_rvr = period - 1U;
+			}
+
+			if (elapsed != 0U)
+			{
+				period_reload = period - 1U;
+				tick_count = tick_count + elapsed;
+			}
+		}
+
+		/* Observers run with interrupts enabled again, like from SysTick_Handler */
+		if (elapsed != 0U)
+		{
+			Tick_Observer* node = tick_observers;
+			while (node != nullptr)
+			{
+				Tick_Observer* next = node->tick_next;
+				node->tick_elapsed(elapsed);
+				node = next;
+			}
+		}
+	}
+
+	std::uint64_t time_base_tick_count()
+	{
+		std::uint64_t ticks;
+		do
+		{
+			ticks = tick_count;
+		} while (ticks != tick_count);
+		return ticks;
+	}
+
+	std::uint64_t time_base_now()
+	{
+		volatile std::uint32_t *syst_rvr = reinterpret_cast<volatile std::uint32_t *>(SYST_RVR);
+		volatile std::uint32_t *syst_cvr = reinterpret_cast<volatile std::uint32_t *>(SYST_CVR);
+		volatile std::uint32_t *scb_icsr = reinterpret_cast<volatile std::uint32_t *>(SCB_ICSR);
+
+		for (;;)
+		{
+			const std::uint64_t ticks_before = tick_count;
+			const std::uint32_t reload = period_reload;
+			const std::uint32_t cvr_before = *syst_cvr & TIME_BASE_CYCLE_MASK;
+			const bool pending = (*scb_icsr & (1U << 26U)) != 0U;     /* PENDSTSET */
+			const std::uint32_t cvr_after = *syst_cvr & TIME_BASE_CYCLE_MASK;
+			const std::uint64_t ticks_after = tick_count;
+
+			if (ticks_before != ticks_after || cvr_after > cvr_before)
+			{
+				continue;
+			}
+
+			if (pending)
+			{
+				/* CVR already belongs to the next tick, which started from SYST_RVR */
+				const std::uint32_t reload_next = *syst_rvr & TIME_BASE_CYCLE_MASK;
+				return ((ticks_before + 1U) << TIME_BASE_CYCLE_BITS) | (reload_next - cvr_before);
+			}
+			/* Counter can still hold a value from before a reload change */
+			const std::uint32_t elapsed = (cvr_before > reload) ? 0U : (reload - cvr_before);
+			return (ticks_before << TIME_BASE_CYCLE_BITS) | elapsed;
+		}
+	}
+}
+
+extern "C" void SysTick_Handler()
+{
+	bare_metal::time_base_tick();
+}
@@ -0,0 +1,172 @@
+/* Source: timer_wheel.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * Slot lists are singly linked with a back pointer (timer_link) to whatever points at the
+ * node: a slot head, the expired head or the previous node. Unlinking never walks a list.
+ * advance():
+ * 1. tick + 1, when the level 0 index wraps to 0 cascade level 1, and so on upwards
+ *    (a cascaded timer always lands in a lower level, or in the current level 0 slot)
+ * 2. the current level 0 slot is moved to the expired list as a whole
+ * 3. callbacks run one node at a time, so a callback cancelling a timer that expires
+ *    on the same tick still removes it from the batch
+ * tick_next_deadline() looks at the next non-empty slot of every level, a higher level
+ * slot is due when it cascades, which is never later than the timers it holds.
+ * List updates run in short critical sections, start()/cancel() can be called from
+ * thread mode or any ISR.
+ */
+
+#include "timer_wheel.h"
+#include "critical_section.h"
+
+namespace bare_metal
+{
+	void Timer_Wheel::timer_link(Software_Timer& timer)
+	{
+		const std::uint32_t delta = timer.timer_expiry - this->tick;
+		std::uint32_t level = 0U;
+		std::uint32_t expiry = timer.timer_expiry;
+
+		if (delta >= TIMER_WHEEL_RANGE)
+		{
+			/* Parks in the slot of the furthest reachable tick, re-filed when cascaded */
+			level = TIMER_WHEEL_LEVELS - 1U;
+			expiry = this->tick + (TIMER_WHEEL_RANGE - 1U);
+		}
+		else
+		{
+			while (delta >= (1U << (TIMER_WHEEL_SLOT_BITS * (level + 1U))))
+			{
+				++level;
+			}
+		}
+
+		Software_Timer** head = &this->slots[level][(expiry >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK];
+		timer.timer_next = *head;
+		if (timer.timer_next != nullptr)
+		{
+			timer.timer_next->timer_link = &timer.timer_next;
+		}
+		timer.timer_link = head;
+		*head = &timer;
+	}
+
+	void Timer_Wheel::timer_unlink(Software_Timer& timer)
+	{
+		*timer.timer_link = timer.timer_next;
+		if (timer.timer_next != nullptr)
+		{
+			timer.timer_next->timer_link = timer.timer_link;
+		}
+		timer.timer_next = nullptr;
+		timer.timer_link = nullptr;
+	}
+
+	void Timer_Wheel::start(Software_Timer& timer, const std::uint32_t ticks)
+	{
+		Critical_Section critical_section;
+		if (timer.is_active())
+		{
+			timer_unlink(timer);
+		}
+		const std::uint32_t delay = (ticks == 0U) ? 1U : ((ticks > TIMER_WHEEL_TICKS_MAX) ? TIMER_WHEEL_TICKS_MAX : ticks);
+		timer.timer_expiry = this->tick + delay;
+		timer_link(timer);
+	}
+
+	void Timer_Wheel::cancel(Software_Timer& timer)
+	{
+		Critical_Section critical_section;
+		if (timer.is_active())
+		{
+			timer_unlink(timer);
+		}
+	}
+
+	void Timer_Wheel::cascade(const std::uint32_t level)
+	{
+		Software_Timer** head = &this->slots[level][(this->tick >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK];
+		Software_Timer* node = *head;
+		*head = nullptr;
+		while (node != nullptr)
+		{
+			Software_Timer* next = node->timer_next;
+			timer_link(*node);
+			node = next;
+		}
+	}
+
+	void Timer_Wheel::advance()
+	{
+		{
+			Critical_Section critical_section;
+			this->tick = this->tick + 1U;
+
+			for (std::uint32_t level = 1U; level < TIMER_WHEEL_LEVELS; ++level)
+			{
+				/* Lower level index wrapped, its next 64 slots come from this level */
+				if (((this->tick >> (TIMER_WHEEL_SLOT_BITS * level)) << (TIMER_WHEEL_SLOT_BITS * level)) != this->tick)
+				{
+					break;
+				}
+				cascade(level);
+			}
+
+			/* Whole slot in one step, the batch keeps its back pointers valid */
+			Software_Timer** head = &this->slots[0][this->tick & TIMER_WHEEL_SLOT_MASK];
+			this->expired = *head;
+			*head = nullptr;
+			if (this->expired != nullptr)
+			{
+				this->expired->timer_link = &this->expired;
+			}
+		}
+
+		for (;;)
+		{
+			Software_Timer* timer;
+			{
+				Critical_Section critical_section;
+				timer = this->expired;
+				if (timer == nullptr)
+				{
+					break;
+				}
+				timer_unlink(*timer);
+			}
+			timer->timer_expired();
+		}
+	}
+
+	void Timer_Wheel::tick_elapsed(const std::uint32_t ticks)
+	{
+		for (std::uint32_t i = 0U; i < ticks; ++i)
+		{
+			advance();
+		}
+	}
+
+	std::uint32_t Timer_Wheel::tick_next_deadline() const
+	{
+		Critical_Section critical_section;
+		std::uint32_t deadline = TIME_BASE_NO_DEADLINE;
+
+		for (std::uint32_t level = 0U; level < TIMER_WHEEL_LEVELS; ++level)
+		{
+			const std::uint32_t shift = TIMER_WHEEL_SLOT_BITS * level;
+			const std::uint32_t index = this->tick >> shift;
+
+			/* Slot index + 64 is the current slot one revolution later */
+			for (std::uint32_t offset = 1U; offset <= TIMER_WHEEL_SLOTS; ++offset)
+			{
+				if (this->slots[level][(index + offset) & TIMER_WHEEL_SLOT_MASK] != nullptr)
+				{
+					const std::uint32_t due = ((index + offset) << shift) - this->tick;
+					deadline = (due < deadline) ? due : deadline;
+					break;
+				}
+			}
+		}
+		return deadline;
+	}
+}
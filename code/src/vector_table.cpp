@@ -0,0 +1,259 @@
+/* Source: vector_table.cpp
+ ---------------------------------------------------------------------------------------------
+ | Background
+ ---------------------------------------------------------------------------------------------
+ * vector_table_flash sits at 0x08000000 (.isr_vector) and is what the core boots from.
+ * vector_table_relocate() copies it to vector_table_ram (SRAM, .ram_vector) and points
+ * VTOR there, from then on handlers can be swapped with vector_table_set_handler().
+ * Every handler the application does not define is a weak alias of Default_Handler.
+ */
+
+#include "vector_table.h"
+#include "nvic.h"
+
+extern "C"
+{
+	extern std::uint32_t _estack;
+
+	void Reset_Handler();
+
+	/* Unexpected interrupt, stop here so the debugger shows which one (IPSR) */
+	void Default_Handler()
+	{
+		while(true);
+	}
+
+	void NMI_Handler()                   __attribute__((weak, alias("Default_Handler")));
+	void HardFault_Handler()             __attribute__((weak, alias("Default_Handler")));
+	void MemManage_Handler()             __attribute__((weak, alias("Default_Handler")));
+	void BusFault_Handler()              __attribute__((weak, alias("Default_Handler")));
+	void UsageFault_Handler()            __attribute__((weak, alias("Default_Handler")));
+	void SVC_Handler()                   __attribute__((weak, alias("Default_Handler")));
+	void DebugMon_Handler()              __attribute__((weak, alias("Default_Handler")));
+	void PendSV_Handler()                __attribute__((weak, alias("Default_Handler")));
+	void SysTick_Handler()               __attribute__((weak, alias("Default_Handler")));
+	void WWDG_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void PVD_IRQHandler()                __attribute__((weak, alias("Default_Handler")));
+	void TAMP_STAMP_IRQHandler()         __attribute__((weak, alias("Default_Handler")));
+	void RTC_WKUP_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void FLASH_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void RCC_IRQHandler()                __attribute__((weak, alias("Default_Handler")));
+	void EXTI0_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void EXTI1_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void EXTI2_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void EXTI3_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void EXTI4_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream0_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream1_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream2_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream3_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream4_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream5_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream6_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void ADC_IRQHandler()                __attribute__((weak, alias("Default_Handler")));
+	void CAN1_TX_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void CAN1_RX0_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void CAN1_RX1_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void CAN1_SCE_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void EXTI9_5_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void TIM1_BRK_TIM9_IRQHandler()      __attribute__((weak, alias("Default_Handler")));
+	void TIM1_UP_TIM10_IRQHandler()      __attribute__((weak, alias("Default_Handler")));
+	void TIM1_TRG_COM_TIM11_IRQHandler() __attribute__((weak, alias("Default_Handler")));
+	void TIM1_CC_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void TIM2_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void TIM3_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void TIM4_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void I2C1_EV_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void I2C1_ER_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void I2C2_EV_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void I2C2_ER_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void SPI1_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void SPI2_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void USART1_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void USART2_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void USART3_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void EXTI15_10_IRQHandler()          __attribute__((weak, alias("Default_Handler")));
+	void RTC_Alarm_IRQHandler()          __attribute__((weak, alias("Default_Handler")));
+	void OTG_FS_WKUP_IRQHandler()        __attribute__((weak, alias("Default_Handler")));
+	void TIM8_BRK_TIM12_IRQHandler()     __attribute__((weak, alias("Default_Handler")));
+	void TIM8_UP_TIM13_IRQHandler()      __attribute__((weak, alias("Default_Handler")));
+	void TIM8_TRG_COM_TIM14_IRQHandler() __attribute__((weak, alias("Default_Handler")));
+	void TIM8_CC_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void DMA1_Stream7_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void FSMC_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void SDIO_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void TIM5_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void SPI3_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void UART4_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void UART5_IRQHandler()              __attribute__((weak, alias("Default_Handler")));
+	void TIM6_DAC_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void TIM7_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream0_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream1_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream2_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream3_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream4_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void ETH_IRQHandler()                __attribute__((weak, alias("Default_Handler")));
+	void ETH_WKUP_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void CAN2_TX_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void CAN2_RX0_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void CAN2_RX1_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void CAN2_SCE_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void OTG_FS_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream5_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream6_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void DMA2_Stream7_IRQHandler()       __attribute__((weak, alias("Default_Handler")));
+	void USART6_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void I2C3_EV_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void I2C3_ER_IRQHandler()            __attribute__((weak, alias("Default_Handler")));
+	void OTG_HS_EP1_OUT_IRQHandler()     __attribute__((weak, alias("Default_Handler")));
+	void OTG_HS_EP1_IN_IRQHandler()      __attribute__((weak, alias("Default_Handler")));
+	void OTG_HS_WKUP_IRQHandler()        __attribute__((weak, alias("Default_Handler")));
+	void OTG_HS_IRQHandler()             __attribute__((weak, alias("Default_Handler")));
+	void DCMI_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void CRYP_IRQHandler()               __attribute__((weak, alias("Default_Handler")));
+	void HASH_RNG_IRQHandler()           __attribute__((weak, alias("Default_Handler")));
+	void FPU_IRQHandler()                __attribute__((weak, alias("Default_Handler")));
+}
+
+namespace bare_metal
+{
+	__attribute__((section(".isr_vector"), used))
+	const Isr_Handler vector_table_flash[VECTOR_TABLE_SIZE] =
+	{
+		reinterpret_cast<Isr_Handler>(&_estack),     /* 0  Initial main stack pointer */
+		Reset_Handler,                               /* 1  */
+		NMI_Handler,                                 /* 2  */
+		HardFault_Handler,                           /* 3  */
+		MemManage_Handler,                           /* 4  */
+		BusFault_Handler,                            /* 5  */
+		UsageFault_Handler,                          /* 6  */
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr,
+		SVC_Handler,                                 /* 11 */
+		DebugMon_Handler,                            /* 12 */
+		nullptr,
+		PendSV_Handler,                              /* 14 */
+		SysTick_Handler,                             /* 15 */
+		WWDG_IRQHandler,                             /* IRQ 0 */
+		PVD_IRQHandler,                              /* IRQ 1 */
+		TAMP_STAMP_IRQHandler,                       /* IRQ 2 */
+		RTC_WKUP_IRQHandler,                         /* IRQ 3 */
+		FLASH_IRQHandler,                            /* IRQ 4 */
+		RCC_IRQHandler,                              /* IRQ 5 */
+		EXTI0_IRQHandler,                            /* IRQ 6 */
+		EXTI1_IRQHandler,                            /* IRQ 7 */
+		EXTI2_IRQHandler,                            /* IRQ 8 */
+		EXTI3_IRQHandler,                            /* IRQ 9 */
+		EXTI4_IRQHandler,                            /* IRQ 10 */
+		DMA1_Stream0_IRQHandler,                     /* IRQ 11 */
+		DMA1_Stream1_IRQHandler,                     /* IRQ 12 */
+		DMA1_Stream2_IRQHandler,                     /* IRQ 13 */
+		DMA1_Stream3_IRQHandler,                     /* IRQ 14 */
+		DMA1_Stream4_IRQHandler,                     /* IRQ 15 */
+		DMA1_Stream5_IRQHandler,                     /* IRQ 16 */
+		DMA1_Stream6_IRQHandler,                     /* IRQ 17 */
+		ADC_IRQHandler,                              /* IRQ 18 */
+		CAN1_TX_IRQHandler,                          /* IRQ 19 */
+		CAN1_RX0_IRQHandler,                         /* IRQ 20 */
+		CAN1_RX1_IRQHandler,                         /* IRQ 21 */
+		CAN1_SCE_IRQHandler,                         /* IRQ 22 */
+		EXTI9_5_IRQHandler,                          /* IRQ 23 */
+		TIM1_BRK_TIM9_IRQHandler,                    /* IRQ 24 */
+		TIM1_UP_TIM10_IRQHandler,                    /* IRQ 25 */
+		TIM1_TRG_COM_TIM11_IRQHandler,               /* IRQ 26 */
+		TIM1_CC_IRQHandler,                          /* IRQ 27 */
+		TIM2_IRQHandler,                             /* IRQ 28 */
+		TIM3_IRQHandler,                             /* IRQ 29 */
+		TIM4_IRQHandler,                             /* IRQ 30 */
+		I2C1_EV_IRQHandler,                          /* IRQ 31 */
+		I2C1_ER_IRQHandler,                          /* IRQ 32 */
+		I2C2_EV_IRQHandler,                          /* IRQ 33 */
+		I2C2_ER_IRQHandler,                          /* IRQ 34 */
+		SPI1_IRQHandler,                             /* IRQ 35 */
+		SPI2_IRQHandler,                             /* IRQ 36 */
+		USART1_IRQHandler,                           /* IRQ 37 */
+		USART2_IRQHandler,                           /* IRQ 38 */
+		USART3_IRQHandler,                           /* IRQ 39 */
+		EXTI15_10_IRQHandler,                        /* IRQ 40 */
+		RTC_Alarm_IRQHandler,                        /* IRQ 41 */
+		OTG_FS_WKUP_IRQHandler,                      /* IRQ 42 */
+		TIM8_BRK_TIM12_IRQHandler,                   /* IRQ 43 */
+		TIM8_UP_TIM13_IRQHandler,                    /* IRQ 44 */
+		TIM8_TRG_COM_TIM14_IRQHandler,               /* IRQ 45 */
+		TIM8_CC_IRQHandler,                          /* IRQ 46 */
+		DMA1_Stream7_IRQHandler,                     /* IRQ 47 */
+		FSMC_IRQHandler,                             /* IRQ 48 */
+		SDIO_IRQHandler,                             /* IRQ 49 */
+		TIM5_IRQHandler,                             /* IRQ 50 */
+		SPI3_IRQHandler,                             /* IRQ 51 */
+		UART4_IRQHandler,                            /* IRQ 52 */
+		UART5_IRQHandler,                            /* IRQ 53 */
+		TIM6_DAC_IRQHandler,                         /* IRQ 54 */
+		TIM7_IRQHandler,                             /* IRQ 55 */
+		DMA2_Stream0_IRQHandler,                     /* IRQ 56 */
+		DMA2_Stream1_IRQHandler,                     /* IRQ 57 */
+		DMA2_Stream2_IRQHandler,                     /* IRQ 58 */
+		DMA2_Stream3_IRQHandler,                     /* IRQ 59 */
+		DMA2_Stream4_IRQHandler,                     /* IRQ 60 */
+		ETH_IRQHandler,                              /* IRQ 61 */
+		ETH_WKUP_IRQHandler,                         /* IRQ 62 */
+		CAN2_TX_IRQHandler,                          /* IRQ 63 */
+		CAN2_RX0_IRQHandler,                         /* IRQ 64 */
+		CAN2_RX1_IRQHandler,                         /* IRQ 65 */
+		CAN2_SCE_IRQHandler,                         /* IRQ 66 */
+		OTG_FS_IRQHandler,                           /* IRQ 67 */
+		DMA2_Stream5_IRQHandler,                     /* IRQ 68 */
+		DMA2_Stream6_IRQHandler,                     /* IRQ 69 */
+		DMA2_Stream7_IRQHandler,                     /* IRQ 70 */
+		USART6_IRQHandler,                           /* IRQ 71 */
+		I2C3_EV_IRQHandler,                          /* IRQ 72 */
+		I2C3_ER_IRQHandler,                          /* IRQ 73 */
+		OTG_HS_EP1_OUT_IRQHandler,                   /* IRQ 74 */
+		OTG_HS_EP1_IN_IRQHandler,                    /* IRQ 75 */
+		OTG_HS_WKUP_IRQHandler,                      /* IRQ 76 */
+		OTG_HS_IRQHandler,                           /* IRQ 77 */
+		DCMI_IRQHandler,                             /* IRQ 78 */
+		CRYP_IRQHandler,                             /* IRQ 79 */
+		HASH_RNG_IRQHandler,                         /* IRQ 80 */
+		FPU_IRQHandler                               /* IRQ 81 */
+	};
+
+	/* VTOR needs the table aligned to its size rounded up to a power of two: 98 words -> 512 bytes */
+	__attribute__((section(".ram_vector"), aligned(VECTOR_TABLE_ALIGNMENT)))
+	Isr_Handler vector_table_ram[VECTOR_TABLE_SIZE];
+
+	void vector_table_relocate()
+	{
+		volatile std::uint32_t *scb_vtor = reinterpret_cast<volatile std::uint32_t *>(SCB_VTOR);
+
+		for (std::uint32_t i = 0U; i < VECTOR_TABLE_SIZE; ++i)
+		{
+			vector_table_ram[i] = vector_table_flash[i];
+		}
+		__asm volatile ("dsb" ::: "memory");
+		*scb_vtor = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(vector_table_ram));
+		__asm volatile ("dsb" ::: "memory");
+		__asm volatile ("isb" ::: "memory");
+	}
+
+	void vector_table_set_handler(const Irq_Number irq, const Isr_Handler handler)
+	{
+		vector_table_ram[VECTOR_TABLE_IRQ_OFFSET + static_cast<std::uint32_t>(irq)] = handler;
+		/* Entry is visible before the next exception entry fetches it */
+		__asm volatile ("dsb" ::: "memory");
+	}
+
+	void vector_table_set_handler(const System_Exception_Number exception, const Isr_Handler handler)
+	{
+		vector_table_ram[static_cast<std::uint32_t>(exception)] = handler;
+		__asm volatile ("dsb" ::: "memory");
+	}
+
+	Isr_Handler vector_table_get_handler(const Irq_Number irq)
+	{
+		return vector_table_ram[VECTOR_TABLE_IRQ_OFFSET + static_cast<std::uint32_t>(irq)];
+	}
+}